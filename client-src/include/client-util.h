@@ -24,6 +24,16 @@
  */
 #define MAX_SEQ (uint8_t) 255
 
+/**
+ * Protocol versions. Version 1 is stop-and-wait with 8-bit sequence numbers; version 2 has 32-bit sequence numbers, a
+ * send window, and cumulative ACKs, which a receiver holding packets out of sequence may extend with a selective ACK
+ * (FLAG_SAK). The client offers version 2 in the payload of its SYN, which a version 1 server ignores; the server
+ * accepts by answering with an offer of its own in the payload of the SYN/ACK. The handshake is framed as in version 1
+ * either way, and every packet after it as in the negotiated version.
+ */
+#define PROTO_V1 (uint8_t) 1
+#define PROTO_V2 (uint8_t) 2
+
 /**
  * Bit masks for flags. Bitwise OR these to make combinations of flags (eg: FIN/ACK = FLAG_FIN | FLAG_ACK)
  * When checking if a packet has certain flags, combine flags and check equality
@@ -34,20 +44,108 @@
 #define FLAG_SYN (uint8_t) 4  // 0000 0100
 #define FLAG_FIN (uint8_t) 8  // 0000 1000
 #define FLAG_TRN (uint8_t) 16 // 0001 0000
+#define FLAG_SAK (uint8_t) 32 // 0010 0000
+#define FLAG_CID (uint8_t) 64 // 0100 0000
+#define FLAG_TKT (uint8_t) 128 // 1000 0000
 
 /**
  * The number of bytes of a packet before the payload is attached.
  */
 #define HLEN_BYTES 4
 
+/**
+ * The number of bytes of a version 2 packet before the payload is attached: flags, window, length, sequence number and
+ * ACK number.
+ */
+#define HLEN_V2_BYTES 12
+
+/**
+ * The number of bytes of the selective ACK a version 2 packet carries after its header when FLAG_SAK is set: a bitmap
+ * of the packets received beyond the ACK number.
+ */
+#define SACK_BYTES 4
+
+/**
+ * The number of bytes of the connection ID a version 2 packet from a client carries after its header, and after its
+ * selective ACK if any, when FLAG_CID is set. The first byte is the index of the server's shard which holds the
+ * connection; the rest are random, so that only the client, and the paths its packets take, know the ID.
+ */
+#define CID_BYTES 8
+
+/**
+ * The number of bytes of the offer in the payload of a SYN or SYN/ACK: the version, the window, and the sequence
+ * number of the first packet the offering side sends after the handshake.
+ */
+#define OFFER_BYTES 6
+
+/**
+ * The options a client may add in a byte after its offer, and their bits; a server which knows none ignores the byte.
+ * OPT_BUNDLE: the client takes datagrams which bundle several version 2 packets, one after another. Each header gives
+ * the size of its packet, so the packets need no other framing.
+ * OPT_COOKIE: the client returns a SYN cookie. The server answers its SYN without keeping any state, with a cookie
+ * after the options it took; the client echoes its SYN payload and the SYN/ACK payload in the ACK of the handshake,
+ * and the server connects it only if the cookie is one it made, for the address it came from, and recently.
+ * OPT_CID: the server gives the client a connection ID, after the options it took. The client sends it in every
+ * version 2 packet, so the server finds the connection, and follows it, when the client's address changes.
+ * OPT_TICKET: the server gives the client a resumption ticket once it is seated. A client whose connection is
+ * interrupted appends the ticket to the options of its next SYN, and is seated again where it sat.
+ */
+#define OPT_BYTES 1
+#define OPT_BUNDLE (uint8_t) 1
+#define OPT_DELTA (uint8_t) 2
+#define OPT_COOKIE (uint8_t) 4
+#define OPT_CID (uint8_t) 8
+#define OPT_TICKET (uint8_t) 16
+
+/**
+ * The number of bytes of a SYN cookie: the time it was made, in milliseconds, and the MAC of the handshake under the
+ * server's key.
+ */
+#define COOKIE_BYTES 12
+
+/**
+ * The number of bytes of a resumption ticket, which the server sends in the payload of a sequenced packet with
+ * FLAG_TKT. The client does not read it; the server makes it, and honours only the last ticket it gave the client.
+ */
+#define TICKET_BYTES 22
+
+/**
+ * The largest payload of a SYN/ACK: the offer, the options taken, a connection ID and a cookie.
+ */
+#define MAX_SYN_ACK_BYTES (OFFER_BYTES + OPT_BYTES + CID_BYTES + COOKIE_BYTES)
+
+/**
+ * The largest number of bytes the ACK of a handshake with OPT_COOKIE echoes: the payload of the SYN, and the payload
+ * of the SYN/ACK, cookie included.
+ */
+#define COOKIE_ECHO_BYTES (OFFER_BYTES + OPT_BYTES + MAX_SYN_ACK_BYTES)
+
+/**
+ * The game states a version 2 connection with OPT_DELTA sends are versioned. Each begins with its version and the
+ * version of the state it is based on, in STATE_HDR_BYTES. A keyframe is based on itself, and carries the whole state;
+ * any other state carries the bytes which changed since its base, each as an offset into the state and a value.
+ */
+#define STATE_HDR_BYTES 4
+
+/**
+ * The number of game states each side of a connection with OPT_DELTA keeps, each at its version modulo
+ * STATE_HISTORY. A state is based only on one less than STATE_HISTORY versions older, so the client still holds it.
+ */
+#define STATE_HISTORY 16
+
 /**
  * packet
  * <p>
  * Stores packet information.
  * <ul>
  * <li>flags: the flags set for the packet</li>
- * <li>seq_num: the sequence number of the packet</li>
- * <li>length: the number of bytes in the packet following these two bytes</li>
+ * <li>seq_num: the sequence number of the packet; only the low byte is sent in version 1</li>
+ * <li>length: the number of bytes in the payload</li>
+ * <li>ack_num: the sequence number of the next packet expected from the peer; version 2, if FLAG_ACK is set</li>
+ * <li>window: the number of packets the sender will accept beyond ack_num; version 2</li>
+ * <li>sack: the packets received beyond ack_num; bit i is set if ack_num + 1 + i has arrived; version 2, if FLAG_SAK
+ * is set</li>
+ * <li>cid: the connection ID, as sent; version 2, if FLAG_CID is set</li>
  * <li>payload: the byte data of the packet</li>
  * </ul>
  * </p>
@@ -55,12 +153,45 @@
 struct packet
 {
     uint8_t  flags;
-    uint8_t  seq_num;
+    uint32_t seq_num;
     uint16_t length;
+    uint32_t ack_num;
+    uint8_t  window;
+    uint32_t sack;
+    uint64_t cid;
     
     uint8_t *payload; // 'payload' is a cooler word than 'data'
 };
 
+/**
+ * seq_before
+ * <p>
+ * Compare two sequence numbers with serial number arithmetic (RFC 1982), so that the comparison holds across the
+ * wrap at 2^32 as long as the numbers are less than 2^31 apart.
+ * </p>
+ * @param a - a sequence number
+ * @param b - a sequence number
+ * @return true if a comes before b
+ */
+static inline bool seq_before(uint32_t a, uint32_t b)
+{
+    return (int32_t) (a - b) < 0;
+}
+
+/**
+ * seq_after
+ * <p>
+ * Compare two sequence numbers with serial number arithmetic.
+ * </p>
+ * @param a - a sequence number
+ * @param b - a sequence number
+ * @return true if a comes after b
+ */
+static inline bool seq_after(uint32_t a, uint32_t b)
+{
+    return seq_before(b, a);
+}
+
 /**
  * check_ip
  * <p>
@@ -109,22 +240,47 @@ in_port_t parse_port(const char *buffer, uint8_t base);
 /**
  * deserialize_packet
  * <p>
- * Load the bytes of a buffer into the received packet struct fields.
+ * Load the bytes of a buffer into the received packet struct fields, in the header layout of a protocol version.
  * </p>
  * @param packet - the packet to store the buffer info
  * @param buffer - the buffer to deserialize
+ * @param version - the protocol version the buffer is framed in
  */
-void deserialize_packet(struct packet *packet, const uint8_t *buffer);
+void deserialize_packet(struct packet *packet, const uint8_t *buffer, uint8_t version);
 
 /**
  * serialize_packet
  * <p>
- * Load the packet struct fields into the bytes of a buffer.
+ * Load the packet struct fields into the bytes of a buffer, in the header layout of a protocol version.
  * </p>
  * @param packet - the packet to serialize
+ * @param version - the protocol version to frame the packet in
  * @return the buffer storing the packet info
  */
-uint8_t *serialize_packet(struct packet *packet);
+uint8_t *serialize_packet(const struct packet *packet, uint8_t version);
+
+/**
+ * packet_size
+ * <p>
+ * Get the number of bytes a packet is serialized to.
+ * </p>
+ * @param packet - the packet
+ * @param version - the protocol version the packet is framed in
+ * @return the size of the packet, header included
+ */
+size_t packet_size(const struct packet *packet, uint8_t version);
+
+/**
+ * header_size
+ * <p>
+ * Get the number of bytes before the payload of a packet: the header of its protocol version, and the selective ACK
+ * and the connection ID if its flags say it carries them.
+ * </p>
+ * @param flags - the flags of the packet
+ * @param version - the protocol version the packet is framed in
+ * @return the size of the header
+ */
+size_t header_size(uint8_t flags, uint8_t version);
 
 /**
  * create_packet
@@ -137,7 +293,7 @@ uint8_t *serialize_packet(struct packet *packet);
  * @param len - the length of the payload
  * @param payload - the payload
  */
-void create_packet(struct packet *packet, uint8_t flags, uint8_t seq_num, uint16_t len, uint8_t *payload);
+void create_packet(struct packet *packet, uint8_t flags, uint32_t seq_num, uint16_t len, uint8_t *payload);
 
 /**
  * check_flags
@@ -163,6 +319,15 @@ const char *check_flags(uint8_t flags);
  */
 void fatal_errno(const char *file, const char *func, size_t line, int err_code);
 
+/**
+ * clock_ms
+ * <p>
+ * Read the monotonic clock.
+ * </p>
+ * @return the time, in milliseconds
+ */
+uint64_t clock_ms(void);
+
 /**
  * advise_usage.
  * <p>
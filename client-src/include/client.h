@@ -5,11 +5,76 @@
 #ifndef RELIABLE_UDP_CLIENT_H
 #define RELIABLE_UDP_CLIENT_H
 
+#include "Game.h"
+#include "client-util.h"
 #include "manager.h"
+#include "rtt.h"
 #include <stdbool.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 
+/**
+ * The number of bytes needed to be sent to the server to update the server-side game state.
+ */
+#define GAME_SEND_BYTES 2
+
+/**
+ * The window the client advertises on version 2: the number of packets the server may send beyond those ACKed. The
+ * client holds the packets which arrive ahead of a lost one, so it has a slot for each. A power of 2, so that a
+ * sequence number indexes the slots with a mask.
+ */
+#define CL_WINDOW 8
+
+/**
+ * The time the client may hold back the ACK of a game state on version 2, in milliseconds, so that one ACK covers the
+ * game states which arrive together. Well under RTT_MIN_RTO_MS, so the server does not time out first.
+ */
+#define CL_DELACK_MS 40
+
+/**
+ * The largest datagram the client receives on version 2: a bundle of packets as large as the MTU of Ethernet allows,
+ * less the IPv4 and UDP headers.
+ */
+#define CL_MAX_RECV_BYTES (1500 - 28)
+
+/**
+ * The largest payload of a game state on version 2: a keyframe, when the server took OPT_DELTA.
+ */
+#define CL_MAX_STATE_BYTES (STATE_HDR_BYTES + GAME_SEND_BYTES + GAME_STATE_BYTES)
+
+/**
+ * The largest payload of a sequenced packet from the server on version 2: a game state, or a ticket.
+ */
+#define CL_MAX_PUSH_BYTES ((CL_MAX_STATE_BYTES > TICKET_BYTES) ? CL_MAX_STATE_BYTES : TICKET_BYTES)
+
+/**
+ * held_packet
+ * <p>
+ * A packet from the server which arrived ahead of sequence on version 2, held until the packets before it arrive.
+ * </p>
+ */
+struct held_packet
+{
+    bool     held;
+    uint32_t seq_num;
+    uint8_t  flags;
+    uint16_t length;
+    uint8_t  payload[CL_MAX_PUSH_BYTES];
+};
+
+/**
+ * cl_state
+ * <p>
+ * A game state received on a connection with OPT_DELTA, kept as a base for the states after it.
+ * </p>
+ */
+struct cl_state
+{
+    bool     held;
+    uint16_t version;
+    uint8_t  state[GAME_SEND_BYTES + GAME_STATE_BYTES];
+};
+
 /**
  * client_settings
  * <p>
@@ -20,10 +85,33 @@
  * <li>server_fd: file descriptor of the socket connected to the server</li>
  * <li>turn: whether it is this client's turn</li>
  * <li>server_addr: the address of the server connection</li>
- * <li>timeout: timeval used to determine time client will sv_recvfrom a message before acting</li>
+ * <li>timeout: the time the client waits for a message before retransmitting; set from rtt before each wait</li>
  * <li>mm: a memory manager for the client</li>
- * <li>s_packet: the last-sent packet for this client</li>
+ * <li>rtt: the round-trip time estimator; gives the timeout</li>
+ * <li>s_packet: the last-sent packet for this client; on version 2, the packet outstanding, if any</li>
  * <li>r_packet: the last-received packet for this client</li>
+ * <li>s_payload: the payload of s_packet, kept until it is ACKed; version 2</li>
+ * <li>version: the protocol version of the connection</li>
+ * <li>snd_una: the oldest sequence number sent but not yet ACKed; version 2</li>
+ * <li>snd_nxt: the sequence number of the next packet to send; version 2</li>
+ * <li>rcv_nxt: the sequence number of the next packet expected from the server; version 2</li>
+ * <li>fin_received: whether the server's FIN/ACK has arrived in sequence; version 2</li>
+ * <li>held: the packets which arrived ahead of sequence, each at its sequence number modulo CL_WINDOW; version 2</li>
+ * <li>ack_pending: whether a packet has arrived in sequence and its ACK has not been sent; every packet sent carries
+ * the ACK. Version 2</li>
+ * <li>ack_due_ms: the time by which the ACK held back must be sent, in milliseconds; version 2</li>
+ * <li>delta: whether the server took OPT_DELTA, and sends game states as changes; version 2</li>
+ * <li>states: the last game states received, each at its version modulo STATE_HISTORY; OPT_DELTA</li>
+ * <li>shown_ver: the version of the game state shown, if state_shown is set; OPT_DELTA</li>
+ * <li>state_shown: whether a game state has been shown; OPT_DELTA</li>
+ * <li>echo: the payload of the SYN, then the payload of the SYN/ACK, which the ACK of the handshake echoes if the
+ * server sent a cookie</li>
+ * <li>echo_len: the number of bytes of echo sent; 0 until the SYN/ACK carries a cookie</li>
+ * <li>heard: whether a packet of the connection has arrived; until one has, the client returns the cookie, since the
+ * server keeps no state before it</li>
+ * <li>cid: the connection ID the server gave, as sent in every version 2 packet; 0 if it gave none</li>
+ * <li>ticket: the last ticket the server gave, if ticket_held is set; OPT_TICKET</li>
+ * <li>ticket_held: whether the client holds a ticket it has not spent; OPT_TICKET</li>
  * </ul>
  * </p>
  */
@@ -38,9 +126,34 @@ struct client_settings
     struct sockaddr_in    *server_addr;
     struct timeval        *timeout;
     struct memory_manager *mm;
+    struct rtt_estimator  rtt;
     
     struct packet *s_packet;
     struct packet *r_packet;
+    uint8_t       s_payload[GAME_SEND_BYTES];
+    
+    uint8_t  version;
+    uint32_t snd_una;
+    uint32_t snd_nxt;
+    uint32_t rcv_nxt;
+    bool     fin_received;
+    
+    struct held_packet held[CL_WINDOW];
+    bool               ack_pending;
+    uint64_t           ack_due_ms;
+    
+    bool            delta;
+    struct cl_state states[STATE_HISTORY];
+    uint16_t        shown_ver;
+    bool            state_shown;
+    
+    uint8_t  echo[COOKIE_ECHO_BYTES];
+    uint16_t echo_len;
+    bool     heard;
+    uint64_t cid;
+    
+    uint8_t ticket[TICKET_BYTES];
+    bool    ticket_held;
 };
 
 /**
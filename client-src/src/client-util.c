@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 char *check_ip(char *ip, uint8_t base)
 {
@@ -126,21 +127,55 @@ in_port_t parse_port(const char *buffer, uint8_t base)
     return port;
 }
 
-void deserialize_packet(struct packet *packet, const uint8_t *buffer)
+void deserialize_packet(struct packet *packet, const uint8_t *buffer, uint8_t version)
 {
-    size_t bytes_copied;
+    size_t   bytes_copied;
+    uint8_t  seq_num;
+    uint32_t n_num;
     
     bytes_copied = 0;
     memcpy(&packet->flags, buffer + bytes_copied, sizeof(packet->flags));
     bytes_copied += sizeof(packet->flags);
     
-    memcpy(&packet->seq_num, buffer + bytes_copied, sizeof(packet->seq_num));
-    bytes_copied += sizeof(packet->seq_num);
+    if (version == PROTO_V1)
+    {
+        memcpy(&seq_num, buffer + bytes_copied, sizeof(seq_num));
+        packet->seq_num = seq_num;
+        bytes_copied += sizeof(seq_num);
+    } else
+    {
+        memcpy(&packet->window, buffer + bytes_copied, sizeof(packet->window));
+        bytes_copied += sizeof(packet->window);
+    }
     
     memcpy(&packet->length, buffer + bytes_copied, sizeof(packet->length));
     packet->length = ntohs(packet->length);
     bytes_copied += sizeof(packet->length);
     
+    if (version != PROTO_V1)
+    {
+        memcpy(&n_num, buffer + bytes_copied, sizeof(n_num));
+        packet->seq_num = ntohl(n_num);
+        bytes_copied += sizeof(n_num);
+        
+        memcpy(&n_num, buffer + bytes_copied, sizeof(n_num));
+        packet->ack_num = ntohl(n_num);
+        bytes_copied += sizeof(n_num);
+        
+        if (packet->flags & FLAG_SAK)
+        {
+            memcpy(&n_num, buffer + bytes_copied, sizeof(n_num));
+            packet->sack = ntohl(n_num);
+            bytes_copied += sizeof(n_num);
+        }
+        
+        if (packet->flags & FLAG_CID) /* Opaque: kept as sent. */
+        {
+            memcpy(&packet->cid, buffer + bytes_copied, sizeof(packet->cid));
+            bytes_copied += sizeof(packet->cid);
+        }
+    }
+    
     if (packet->length > 0)
     {
         if ((packet->payload = (uint8_t *) s_malloc(packet->length + 1,
@@ -153,15 +188,15 @@ void deserialize_packet(struct packet *packet, const uint8_t *buffer)
     }
 }
 
-uint8_t *serialize_packet(struct packet *packet)
+uint8_t *serialize_packet(const struct packet *packet, uint8_t version)
 {
     uint8_t  *buffer;
-    size_t   packet_size;
     size_t   bytes_copied;
+    uint8_t  seq_num;
     uint16_t n_packet_length;
+    uint32_t n_num;
     
-    packet_size = HLEN_BYTES + packet->length;
-    if ((buffer = (uint8_t *) s_malloc(packet_size, __FILE__, __func__, __LINE__)) == NULL)
+    if ((buffer = (uint8_t *) s_malloc(packet_size(packet, version), __FILE__, __func__, __LINE__)) == NULL)
     {
         return NULL;
     }
@@ -170,13 +205,45 @@ uint8_t *serialize_packet(struct packet *packet)
     memcpy(buffer + bytes_copied, &packet->flags, sizeof(packet->flags));
     bytes_copied += sizeof(packet->flags);
     
-    memcpy(buffer + bytes_copied, &packet->seq_num, sizeof(packet->seq_num));
-    bytes_copied += sizeof(packet->seq_num);
+    if (version == PROTO_V1)
+    {
+        seq_num = (uint8_t) packet->seq_num;
+        memcpy(buffer + bytes_copied, &seq_num, sizeof(seq_num));
+        bytes_copied += sizeof(seq_num);
+    } else
+    {
+        memcpy(buffer + bytes_copied, &packet->window, sizeof(packet->window));
+        bytes_copied += sizeof(packet->window);
+    }
     
     n_packet_length = htons(packet->length);
     memcpy(buffer + bytes_copied, &n_packet_length, sizeof(n_packet_length));
     bytes_copied += sizeof(n_packet_length);
     
+    if (version != PROTO_V1)
+    {
+        n_num = htonl(packet->seq_num);
+        memcpy(buffer + bytes_copied, &n_num, sizeof(n_num));
+        bytes_copied += sizeof(n_num);
+        
+        n_num = htonl(packet->ack_num);
+        memcpy(buffer + bytes_copied, &n_num, sizeof(n_num));
+        bytes_copied += sizeof(n_num);
+        
+        if (packet->flags & FLAG_SAK)
+        {
+            n_num = htonl(packet->sack);
+            memcpy(buffer + bytes_copied, &n_num, sizeof(n_num));
+            bytes_copied += sizeof(n_num);
+        }
+        
+        if (packet->flags & FLAG_CID)
+        {
+            memcpy(buffer + bytes_copied, &packet->cid, sizeof(packet->cid));
+            bytes_copied += sizeof(packet->cid);
+        }
+    }
+    
     if (packet->length > 0)
     {
         memcpy(buffer + bytes_copied, packet->payload, packet->length);
@@ -185,7 +252,22 @@ uint8_t *serialize_packet(struct packet *packet)
     return buffer;
 }
 
-void create_packet(struct packet *packet, uint8_t flags, uint8_t seq_num, uint16_t len, uint8_t *payload)
+size_t packet_size(const struct packet *packet, uint8_t version)
+{
+    return header_size(packet->flags, version) + packet->length;
+}
+
+size_t header_size(uint8_t flags, uint8_t version)
+{
+    if (version == PROTO_V1)
+    {
+        return HLEN_BYTES;
+    }
+    
+    return HLEN_V2_BYTES + ((flags & FLAG_SAK) ? SACK_BYTES : 0) + ((flags & FLAG_CID) ? CID_BYTES : 0);
+}
+
+void create_packet(struct packet *packet, uint8_t flags, uint32_t seq_num, uint16_t len, uint8_t *payload)
 {
     memset(packet, 0, sizeof(struct packet));
     
@@ -227,6 +309,22 @@ const char *check_flags(uint8_t flags)
         {
             return "FIN/ACK";
         }
+        case (FLAG_PSH | FLAG_ACK):
+        {
+            return "PSH/ACK";
+        }
+        case (FLAG_PSH | FLAG_TRN | FLAG_ACK):
+        {
+            return "PSH/TRN/ACK";
+        }
+        case (FLAG_ACK | FLAG_SAK):
+        {
+            return "ACK/SAK";
+        }
+        case (FLAG_TKT | FLAG_ACK):
+        {
+            return "TKT/ACK";
+        }
         default:
         {
             return "INVALID";
@@ -243,6 +341,15 @@ void fatal_errno(const char *file, const char *func, const size_t line, int err_
     errno = ENOTRECOVERABLE;                                                                           // NOLINT(concurrency-mt-unsafe)
 }
 
+uint64_t clock_ms(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000; // NOLINT(readability-magic-numbers) : ms
+}
+
 void advise_usage(const char *usage_message)
 {
     fprintf(stderr, "Usage: %s\n", usage_message); // NOLINT(cert-err33-c) : val not needed
@@ -9,28 +9,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/random.h>
 #include <sys/time.h>
 #include <unistd.h>
 
 /**
- * The maximum number of timeouts to occur before the timeout duration is reduced.
+ * The number of timeouts in a row after which a connection is deemed failed. The timeout doubles after each one, up to
+ * RTT_MAX_RTO_MS.
  */
-#define MAX_NUM_TIMEOUTS 3
-
-/**
- * Timeout duration below which a connection is deemed failed.
- */
-#define MIN_TIMEOUT 1 /* seconds */
-
-/**
- * The base timeout duration before retransmission.
- */
-#define BASE_TIMEOUT 8 /* seconds */
-
-/**
- * The number of bytes needed to be sent to the server to update the server-side game state.
- */
-#define GAME_SEND_BYTES 2
+#define MAX_NUM_TIMEOUTS 10
 
 /**
  * While set to > 0, the program will continue running. Will be set to 0 by SIGINT or a catastrophic failure.
@@ -56,6 +43,39 @@ void open_client_socket(struct client_settings *set);
  */
 void cl_connect(struct client_settings *set);
 
+/**
+ * cl_resume
+ * <p>
+ * Connect to the server again after the connection was interrupted, from a new socket, with the ticket the server gave
+ * appended to the SYN. The server seats the client where it sat, and sends the game state with the SYN/ACK; a server
+ * which does not honour the ticket connects the client as a new one.
+ * </p>
+ * @param set - the settings for the client
+ * @return 0 if the client is connected again, -1 otherwise
+ */
+int cl_resume(struct client_settings *set);
+
+/**
+ * cl_choose_isn
+ * <p>
+ * Choose the sequence number of the first packet sent on a version 2 connection.
+ * </p>
+ * @return the initial sequence number
+ */
+uint32_t cl_choose_isn(void);
+
+/**
+ * cl_accept_offer
+ * <p>
+ * Read the offer in the payload of the SYN/ACK just received. If the server offers version 2, switch to it, and
+ * expect the server's first sequence number next; otherwise, the server speaks version 1. The options the server took
+ * follow its offer; a server which knows none sends none. A server which took OPT_CID sends the connection ID after
+ * them. A server which took OPT_COOKIE sends a cookie last, which is kept with the rest of the handshake to be echoed.
+ * </p>
+ * @param set - the settings for the client
+ */
+void cl_accept_offer(struct client_settings *set);
+
 /**
  * sv_recvfrom
  * <p>
@@ -95,12 +115,25 @@ void cl_disconnect(struct client_settings *set);
  */
 void cl_sendto(struct client_settings *set);
 
+/**
+ * cl_transmit
+ * <p>
+ * Serialize a packet in the header layout of a protocol version, and send it to the server. A version 2 packet carries
+ * the connection ID, if the server gave one, so that the server finds the connection from any address.
+ * </p>
+ * @param set - the settings for this client
+ * @param packet - the packet to send
+ * @param version - the protocol version to frame the packet in
+ */
+void cl_transmit(struct client_settings *set, const struct packet *packet, uint8_t version);
+
 /**
  * cl_recvfrom
  * <p>
  * Await a response from the server. If a response is not received within the timeout, retransmit the packet,
  * then wait again. If MAX_NUM_TIMEOUTS timeouts occur, set running to 0 and return. If the message received from the
- * server does not match the expected flags and sequence number, retransmit the last sent packet.
+ * server does not match the expected flags and sequence number, retransmit the last sent packet. The response ends
+ * the timing of the last sent packet.
  * </p>
  * @param set - the client settings
  * @param flag_set - the expected flags to be received
@@ -122,18 +155,28 @@ void cl_recvfrom(struct client_settings *set, const uint8_t *flag_set, uint8_t n
 int cl_recvfrom_err(struct client_settings *set, int *num_to);
 
 /**
- * hande_recv_timeout
+ * handle_timeout
  * <p>
- * If the number of timeouts occurring at the current timeout interval is equal to or exceeds MAX_NUM_TIMEOUTS,
- * reduce the current timeout interval by one half. If the timeout interval is then less than MIN_TIMEOUT, print a
- * relevant message, set running to 0, and return -1. Otherwise, return 0.
+ * If MAX_NUM_TIMEOUTS timeouts have occurred in a row, print a relevant message, set running to 0, and return -1.
+ * Otherwise, double the timeout, and return 0.
  * </p>
  * @param set - the client settings
- * @param num_to - the number of timeouts that have occurred at the current interval
- * @return -1 if the timeout interval has been reduced below the limit, 0 if it has not
+ * @param num_to - the number of timeouts that have occurred in a row
+ * @return -1 if the timeout limit has been reached, 0 if it has not
  */
 int handle_timeout(struct client_settings *set, int *num_to);
 
+/**
+ * cl_update_timeout
+ * <p>
+ * Set the timeout of the socket to the retransmission timeout of the connection, or to the time left to send the ACK
+ * held back, if that is sooner.
+ * </p>
+ * @param set - the client settings
+ * @return 0 on success, -1 on failure
+ */
+int cl_update_timeout(struct client_settings *set);
+
 /**
  * cl_process
  * <p>
@@ -144,6 +187,152 @@ int handle_timeout(struct client_settings *set, int *num_to);
  */
 void cl_process(struct client_settings *set, const uint8_t *packet_buffer);
 
+/**
+ * cl_show_state
+ * <p>
+ * Apply the game state in a packet: set the turn on a TRN, and display the board on a PSH. Stop running once the game
+ * is over.
+ * </p>
+ * @param set - the settings for the client
+ * @param packet - the packet
+ */
+void cl_show_state(struct client_settings *set, const struct packet *packet);
+
+/**
+ * cl_messaging_v2
+ * <p>
+ * Main messaging loop on version 2. Every packet from the server is handled as it arrives: game states are ACKed and
+ * displayed in sequence, and ACKs release the outstanding move. A move is sent when it is this client's turn and the
+ * last move has been ACKed. If a SIGINT occurs, or the game is over, the loop exits and the client disconnects.
+ * </p>
+ * @param set - the settings for the client
+ */
+void cl_messaging_v2(struct client_settings *set);
+
+/**
+ * cl_await
+ * <p>
+ * Wait for a datagram from the server on version 2, and process each packet bundled in it. Send the ACK held back if
+ * it is due then, or if nothing arrives before it is due; if nothing arrives within the timeout, retransmit: the
+ * outstanding packet, or an ACK if there is none.
+ * </p>
+ * @param set - the settings for the client
+ * @param num_to - the number of timeouts that have occurred in a row
+ * @return 0 if a packet was processed or the timeout limit has not been reached, -1 otherwise
+ */
+int cl_await(struct client_settings *set, int *num_to);
+
+/**
+ * cl_process_v2
+ * <p>
+ * React to a packet received on version 2. An ACK releases the outstanding packet if it covers it. A PSH or FIN in
+ * sequence is applied, with any held packets it brings into sequence; one ahead of sequence is held. A game state in
+ * sequence is ACKed after up to CL_DELACK_MS, unless a packet sent meanwhile carries the ACK; every other PSH or FIN
+ * is ACKed once its datagram is processed, so duplicates and packets after a lost one tell the server what to send
+ * again. A retransmitted SYN/ACK is answered with the ACK of the handshake.
+ * </p>
+ * @param set - the settings for the client
+ * @param packet_buffer - the received packet, followed by the rest of its datagram
+ * @param len - the number of bytes left in the datagram
+ * @return the size of the packet; 0 if the rest of the datagram is not a whole packet
+ */
+size_t cl_process_v2(struct client_settings *set, const uint8_t *packet_buffer, size_t len);
+
+/**
+ * cl_deliver
+ * <p>
+ * Apply a packet which is next in sequence on version 2: note a FIN/ACK, or show the game state in a PSH. A game state
+ * which cannot be applied is not taken, so it is not ACKed, and the server sends it again.
+ * </p>
+ * @param set - the settings for the client
+ * @param packet - the packet
+ */
+void cl_deliver(struct client_settings *set, const struct packet *packet);
+
+/**
+ * cl_apply_state
+ * <p>
+ * Keep the game state in a PSH on a connection with OPT_DELTA: a keyframe as it is, or the changes applied to the
+ * state they are based on. Show it if it is newer than the state shown: a packet the server sent again carries the
+ * newest state, so the packets after it may carry older ones. The server bases a state only on one the client still
+ * holds; a state based on any other is dropped, and the server sends a keyframe in its place.
+ * </p>
+ * @param set - the settings for the client
+ * @param packet - the packet
+ * @return false if the state is based on one which is not held
+ */
+bool cl_apply_state(struct client_settings *set, const struct packet *packet);
+
+/**
+ * cl_hold
+ * <p>
+ * Hold a packet which arrived ahead of sequence on version 2, until the packets before it arrive.
+ * </p>
+ * @param set - the settings for the client
+ * @param packet - the packet; within the window, and no larger than a game state
+ */
+void cl_hold(struct client_settings *set, const struct packet *packet);
+
+/**
+ * cl_deliver_held
+ * <p>
+ * Apply the held packets which have come into sequence, in order.
+ * </p>
+ * @param set - the settings for the client
+ */
+void cl_deliver_held(struct client_settings *set);
+
+/**
+ * cl_send_ack
+ * <p>
+ * Send a bare ACK on version 2, with a selective ACK of the packets held ahead of sequence. It takes no sequence
+ * number, and is not retransmitted.
+ * </p>
+ * @param set - the settings for the client
+ */
+void cl_send_ack(struct client_settings *set);
+
+/**
+ * cl_delay_ack
+ * <p>
+ * Hold back the ACK of a packet which arrived on version 2, for up to a delay. If an ACK is already held back, it is
+ * due now: every second packet is ACKed at once.
+ * </p>
+ * @param set - the settings for the client
+ * @param delay_ms - the delay, in milliseconds; 0 for an ACK due now
+ */
+void cl_delay_ack(struct client_settings *set, uint32_t delay_ms);
+
+/**
+ * cl_send_handshake_ack
+ * <p>
+ * Send the ACK which completes the handshake, framed as in version 1, with the handshake it echoes if the server sent a
+ * cookie.
+ * </p>
+ * @param set - the settings for the client
+ */
+void cl_send_handshake_ack(struct client_settings *set);
+
+/**
+ * cl_retransmit
+ * <p>
+ * Retransmit on version 2 after a timeout: the outstanding packet with the current ACK number, or an ACK if nothing
+ * is outstanding.
+ * </p>
+ * @param set - the settings for the client
+ */
+void cl_retransmit(struct client_settings *set);
+
+/**
+ * cl_disconnect_v2
+ * <p>
+ * Disconnect on version 2. Wait for the outstanding move to be ACKed, then send a FIN. Wait for it to be ACKed and
+ * for the server's FIN/ACK, which is ACKed on arrival. Wait to see if that ACK was received.
+ * </p>
+ * @param set - the settings for the client
+ */
+void cl_disconnect_v2(struct client_settings *set);
+
 /**
  * set_signal_handling
  * <p>
@@ -172,9 +361,10 @@ void run(int argc, char *argv[], struct client_settings *set)
     
     set_signal_handling(&sa);
     
+    running = 1;
     if (!errno)
     { open_client_socket(set); }
-    if (!errno)
+    if (!errno && running) /* The server may not have answered. */
     { cl_messaging(set); }
 }
 
@@ -204,27 +394,135 @@ void open_client_socket(struct client_settings *set)
 
 void cl_connect(struct client_settings *set)
 {
-    create_packet(set->s_packet, FLAG_SYN, MAX_SEQ, 0, NULL);
+    uint8_t  *offer;
+    uint32_t n_isn;
+    uint16_t len;
+    
+    /* Offer version 2 in the payload of the SYN, and take bundles, changes, cookies, a connection ID and tickets; a
+     * version 1 server ignores it. The offer is kept, to be echoed with a cookie. */
+    offer        = set->echo;
+    set->snd_una = cl_choose_isn();
+    set->snd_nxt = set->snd_una;
+    n_isn        = htonl(set->snd_nxt);
+    *offer       = PROTO_V2;
+    *(offer + 1) = CL_WINDOW;
+    memcpy(offer + 2, &n_isn, sizeof(n_isn));
+    *(offer + OFFER_BYTES) = OPT_BUNDLE | OPT_DELTA | OPT_COOKIE | OPT_CID | OPT_TICKET;
+    
+    /* A ticket follows the options; it is spent, whether the server honours it or not. */
+    len = OFFER_BYTES + OPT_BYTES;
+    if (set->ticket_held)
+    {
+        memcpy(offer + len, set->ticket, TICKET_BYTES);
+        len += TICKET_BYTES;
+        set->ticket_held = false;
+    }
+    
+    create_packet(set->s_packet, FLAG_SYN, MAX_SEQ, len, offer);
     cl_sendto(set);
+    rtt_start(&set->rtt, set->s_packet->seq_num, clock_ms());
     if (!errno)
     {
         uint8_t flag_set[] = {FLAG_SYN | FLAG_ACK};
         cl_recvfrom(set, flag_set, sizeof(flag_set), set->s_packet->seq_num);
     }
     
-    if (!errno)
+    if (!errno && running)
     {
         printf("\nConnected to server %s:%u\n",
                inet_ntoa(set->server_addr->sin_addr), // NOLINT(concurrency-mt-unsafe) : no threads here
                ntohs(set->server_addr->sin_port));
         
-        create_packet(set->s_packet, FLAG_ACK, MAX_SEQ, 0, NULL);
-        cl_sendto(set);
+        /* The handshake is framed as in version 1, whichever version was agreed. */
+        create_packet(set->s_packet, FLAG_ACK, MAX_SEQ, set->echo_len, set->echo);
+        cl_transmit(set, set->s_packet, PROTO_V1);
+    }
+}
+
+int cl_resume(struct client_settings *set)
+{
+    printf("\nResuming the game.\n");
+    close(set->server_fd);
+    if ((set->server_fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) // NOLINT(android-cloexec-socket) : SOCK_CLOEXEC dne
+    {
+        return -1;
+    }
+    
+    /* The connection starts over at the server's main port; only the ticket and the game carry over. */
+    set->server_addr->sin_port = htons(set->server_port);
+    set->version               = PROTO_V1;
+    set->turn                  = false;
+    set->fin_received          = false;
+    set->ack_pending           = false;
+    set->delta                 = false;
+    set->state_shown           = false;
+    set->echo_len              = 0;
+    set->heard                 = false;
+    set->cid                   = 0;
+    memset(set->held, 0, sizeof(set->held));
+    memset(set->states, 0, sizeof(set->states));
+    rtt_init(&set->rtt);
+    
+    running = 1;
+    cl_connect(set);
+    
+    return (!errno && running) ? 0 : -1;
+}
+
+uint32_t cl_choose_isn(void)
+{
+    uint32_t isn;
+    struct timeval now;
+    
+    if (getrandom(&isn, sizeof(isn), GRND_NONBLOCK) != (ssize_t) sizeof(isn))
+    {
+        gettimeofday(&now, NULL); /* The entropy pool is not ready: any number will do. */
+        isn   = (uint32_t) now.tv_usec;
+        errno = 0;
+    }
+    
+    return isn;
+}
+
+void cl_accept_offer(struct client_settings *set)
+{
+    uint32_t n_isn;
+    uint8_t  options;
+    uint16_t answer_len;
+    
+    if (set->r_packet->length < OFFER_BYTES || *set->r_packet->payload < PROTO_V2)
+    {
+        return; /* A version 1 server. */
+    }
+    
+    memcpy(&n_isn, set->r_packet->payload + 2, sizeof(n_isn));
+    set->rcv_nxt = ntohl(n_isn);
+    set->version = PROTO_V2;
+    options      = (set->r_packet->length >= OFFER_BYTES + OPT_BYTES) ? *(set->r_packet->payload + OFFER_BYTES) : 0;
+    set->delta   = options & OPT_DELTA;
+    
+    answer_len = OFFER_BYTES + OPT_BYTES;
+    if ((options & OPT_CID) && set->r_packet->length >= answer_len + CID_BYTES)
+    {
+        memcpy(&set->cid, set->r_packet->payload + answer_len, sizeof(set->cid));
+        answer_len += CID_BYTES;
+    }
+    
+    if (set->r_packet->length == answer_len + COOKIE_BYTES && (options & OPT_COOKIE))
+    {
+        memcpy(set->echo + OFFER_BYTES + OPT_BYTES, set->r_packet->payload, set->r_packet->length);
+        set->echo_len = OFFER_BYTES + OPT_BYTES + set->r_packet->length;
     }
 }
 
 void cl_messaging(struct client_settings *set) //
 {
+    if (set->version == PROTO_V2)
+    {
+        cl_messaging_v2(set);
+        return;
+    }
+    
     running = 1;
     while (running)
     {
@@ -257,15 +555,32 @@ void take_turn(struct client_settings *set)
     uint8_t          input_buffer[GAME_SEND_BYTES];
     // input buffer: 1 B cursor, 1 B btn press
     cursor = useController(set->game->cursor, &btn); // update the buffer, updating the button press
-
+    
     input_buffer[0] = cursor;
     input_buffer[1] = (uint8_t) btn;
     
+    if (set->version == PROTO_V2)
+    {
+        /* The move is kept until it is ACKed; the ACK is handled in the messaging loop. */
+        memcpy(set->s_payload, input_buffer, GAME_SEND_BYTES);
+        create_packet(set->s_packet, FLAG_PSH | FLAG_ACK, set->snd_nxt++, GAME_SEND_BYTES, set->s_payload);
+        set->s_packet->ack_num = set->rcv_nxt;
+        set->s_packet->window  = CL_WINDOW;
+        set->turn              = false;
+        set->ack_pending       = false;
+        cl_sendto(set);
+        rtt_start(&set->rtt, set->s_packet->seq_num, clock_ms());
+        return;
+    }
+    
     /* Send input to server. */
     create_packet(set->s_packet, FLAG_PSH, (uint8_t) (set->r_packet->seq_num + 1),
                   GAME_SEND_BYTES, input_buffer);
     if (!errno)
-    { cl_sendto(set); }
+    {
+        cl_sendto(set);
+        rtt_start(&set->rtt, set->s_packet->seq_num, clock_ms());
+    }
     
     if (!errno)
     {
@@ -276,11 +591,24 @@ void take_turn(struct client_settings *set)
 
 void cl_sendto(struct client_settings *set)
 {
-    socklen_t size_addr_in;
-    uint8_t   *buffer;
-    size_t    packet_size;
+    cl_transmit(set, set->s_packet, set->version);
+}
+
+void cl_transmit(struct client_settings *set, const struct packet *packet, uint8_t version)
+{
+    struct packet with_cid;
+    socklen_t     size_addr_in;
+    uint8_t       *buffer;
+    
+    if (version == PROTO_V2 && set->cid != 0)
+    {
+        with_cid       = *packet;
+        with_cid.flags |= FLAG_CID;
+        with_cid.cid   = set->cid;
+        packet         = &with_cid;
+    }
     
-    buffer = serialize_packet(set->s_packet); /* Serialize the packet to send. */
+    buffer = serialize_packet(packet, version); /* Serialize the packet to send. */
     if (errno == ENOTRECOVERABLE)
     {
         running = 0;
@@ -289,9 +617,9 @@ void cl_sendto(struct client_settings *set)
     set->mm->mm_add(set->mm, buffer);
     
     size_addr_in = sizeof(struct sockaddr_in);
-    packet_size  = HLEN_BYTES + set->s_packet->length;
     
-    if (sendto(set->server_fd, buffer, packet_size, 0, (struct sockaddr *) set->server_addr, size_addr_in) == -1)
+    if (sendto(set->server_fd, buffer, packet_size(packet, version), 0,
+               (struct sockaddr *) set->server_addr, size_addr_in) == -1)
     {
         /* errno will be set. */
         perror("Message transmission to server failed: ");
@@ -304,26 +632,20 @@ void cl_sendto(struct client_settings *set)
 void cl_recvfrom(struct client_settings *set, const uint8_t *flag_set, uint8_t num_flags, uint8_t seq_num)
 {
     socklen_t size_addr_in;
-    uint8_t   buffer[HLEN_BYTES + GAME_SEND_BYTES + GAME_STATE_BYTES];
+    uint8_t   buffer[CL_MAX_RECV_BYTES];
     bool      go_ahead;
     int num_to;
     
-    set->timeout->tv_sec = BASE_TIMEOUT;
-    
     size_addr_in = sizeof(struct sockaddr_in);
     go_ahead     = false;
     num_to = 0;
     do
     {
-        /* Update socket's timeout. */
-        if (setsockopt(set->server_fd, SOL_SOCKET, SO_RCVTIMEO,
-                       (const char *) set->timeout, sizeof(struct timeval)) == -1)
+        if (cl_update_timeout(set) == -1)
         {
-            fatal_errno(__FILE__, __func__, __LINE__, errno);
-            running = 0;
             return;
         }
-
+        
         memset(buffer, 0, sizeof(buffer));
         if (recvfrom(set->server_fd, buffer, sizeof(buffer), 0,
                      (struct sockaddr *) set->server_addr, &size_addr_in) == -1)
@@ -335,10 +657,8 @@ void cl_recvfrom(struct client_settings *set, const uint8_t *flag_set, uint8_t n
             cl_sendto(set); /* Timeout limit not exceeded, retransmit. */
         } else
         {
-            /* Packet received: reset the timeout. */
-            num_to = 0;
-            set->timeout->tv_usec = BASE_TIMEOUT;
-    
+            num_to = 0; /* Packet received: the timeouts are no longer in a row. */
+            
             /* Check the seq num and all flags in the set of accepted flags against
              * the seq num and flags in the buffer. If one is valid, we have right packet.
              * Otherwise, resend the last sent packet. */
@@ -352,11 +672,13 @@ void cl_recvfrom(struct client_settings *set, const uint8_t *flag_set, uint8_t n
             
             if (!go_ahead)
             {
+                rtt_stop(&set->rtt);
                 cl_sendto(set);
             }
         }
     } while (!go_ahead);
     
+    rtt_ack(&set->rtt, set->s_packet->seq_num, clock_ms());
     cl_process(set, buffer); /* Once we have the correct packet, we will process it */
 }
 
@@ -391,19 +713,14 @@ int cl_recvfrom_err(struct client_settings *set, int *num_to)
 
 int handle_timeout(struct client_settings *set, int *num_to)
 {
-    if (++(*num_to) >= MAX_NUM_TIMEOUTS) /* Every MAX_NUM_TIMEOUTS timeouts, reduce the timeout time. */
-    {
-        *num_to = 0;
-        set->timeout->tv_sec /= 2; /* Reduce the timeout duration by a factor of one half. */
-    }
-    
-    if (set->timeout->tv_sec < MIN_TIMEOUT)
+    if (++(*num_to) >= MAX_NUM_TIMEOUTS)
     {
         if (set->s_packet->flags == FLAG_SYN) /* Connection to server failed. */
         {
             printf("\nServer connection request timed out.\n");
-        } else if (set->s_packet->flags == (FLAG_FIN | FLAG_ACK)) /* Waiting to see if server missed FIN/ACK. */
+        } else if (set->s_packet->flags == (FLAG_FIN | FLAG_ACK) || set->fin_received)
         {
+            /* Waiting to see if server missed FIN/ACK. */
             printf("\nAssuming server disconnected.\n");
         } else
         {
@@ -412,8 +729,41 @@ int handle_timeout(struct client_settings *set, int *num_to)
         running = 0;
         return -1;
     }
+    
+    rtt_backoff(&set->rtt); /* Back off: the network is slower than estimated, or dropping packets. */
+    printf("\nTimeout occurred. Next timeout in %u milliseconds.\n", set->rtt.rto_ms);
+    return 0;
+}
 
-    printf("\nTimeout occurred. Next timeout in %ld seconds.\n", set->timeout->tv_sec);
+int cl_update_timeout(struct client_settings *set)
+{
+    uint32_t timeout_ms;
+    
+    timeout_ms = set->rtt.rto_ms;
+    if (set->ack_pending)
+    {
+        uint64_t now_ms;
+        
+        now_ms = clock_ms();
+        if (set->ack_due_ms <= now_ms)
+        {
+            timeout_ms = 1; /* A timeout of 0 would wait forever. */
+        } else if (set->ack_due_ms - now_ms < timeout_ms)
+        {
+            timeout_ms = (uint32_t) (set->ack_due_ms - now_ms);
+        }
+    }
+    
+    set->timeout->tv_sec  = (time_t) (timeout_ms / 1000);                // NOLINT(readability-magic-numbers)
+    set->timeout->tv_usec = (suseconds_t) (timeout_ms % 1000) * 1000; // NOLINT(readability-magic-numbers)
+    if (setsockopt(set->server_fd, SOL_SOCKET, SO_RCVTIMEO,
+                   (const char *) set->timeout, sizeof(struct timeval)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        running = 0;
+        return -1;
+    }
+    
     return 0;
 }
 
@@ -424,7 +774,7 @@ void cl_process(struct client_settings *set, const uint8_t *packet_buffer)
         return;
     }
     
-    deserialize_packet(set->r_packet, packet_buffer);
+    deserialize_packet(set->r_packet, packet_buffer, PROTO_V1);
     if (errno == ENOMEM)
     {
         running = 0;
@@ -432,15 +782,26 @@ void cl_process(struct client_settings *set, const uint8_t *packet_buffer)
     }
     set->mm->mm_add(set->mm, set->r_packet->payload);
     
-    if (set->r_packet->flags & FLAG_TRN) /* Indicates that it is this client's turn. */
+    if (set->r_packet->flags == (FLAG_SYN | FLAG_ACK))
+    {
+        cl_accept_offer(set);
+    }
+    cl_show_state(set, set->r_packet);
+    
+    set->mm->mm_free(set->mm, set->r_packet->payload);
+    set->r_packet->payload = NULL; /* A packet without a payload leaves it as it is. */
+}
+
+void cl_show_state(struct client_settings *set, const struct packet *packet)
+{
+    if (packet->flags & FLAG_TRN) /* Indicates that it is this client's turn. */
     {
         set->turn = true;
     }
     
-    if (set->r_packet->flags & FLAG_PSH) /* Indicates that the packet contains data which must be displayed. */
+    if (packet->flags & FLAG_PSH) /* Indicates that the packet contains data which must be displayed. */
     {
-        set->game->updateGameState(set->game, set->r_packet->payload, (char *) set->r_packet->payload + 1,
-                                   set->r_packet->payload + 2);
+        set->game->updateGameState(set->game, packet->payload, (char *) packet->payload + 1, packet->payload + 2);
         set->game->displayBoardWithCursor(set->game);
         if (set->game->isGameOver(set->game))
         {
@@ -448,8 +809,370 @@ void cl_process(struct client_settings *set, const uint8_t *packet_buffer)
             set->turn = false;
         }
     }
+}
+
+void cl_messaging_v2(struct client_settings *set)
+{
+    int num_to;
+    
+    running = 1;
+    num_to  = 0;
+    while (running)
+    {
+        if (cl_await(set, &num_to) == -1)
+        {
+            /* The server stopped answering: take the seat back, if the server gave a ticket for it. */
+            if (!errno && !set->fin_received && set->ticket_held && cl_resume(set) == 0)
+            {
+                num_to = 0;
+                continue;
+            }
+            break;
+        }
+        
+        /* One move in flight: the next is taken once the last has been ACKed. */
+        if (set->turn && set->snd_una == set->snd_nxt)
+        {
+            if (set->ack_pending) /* The controller waits for the player, for longer than the server may. */
+            {
+                cl_send_ack(set);
+            }
+            take_turn(set);
+        }
+    }
+    
+    if (!errno || errno == EINTR)
+    { cl_disconnect_v2(set); }
+}
+
+int cl_await(struct client_settings *set, int *num_to)
+{
+    socklen_t size_addr_in;
+    uint8_t   buffer[CL_MAX_RECV_BYTES];
+    ssize_t   len;
+    size_t    offset;
+    size_t    size;
+    
+    if (cl_update_timeout(set) == -1)
+    {
+        return -1;
+    }
+    
+    size_addr_in = sizeof(struct sockaddr_in);
+    if ((len = recvfrom(set->server_fd, buffer, sizeof(buffer), 0,
+                        (struct sockaddr *) set->server_addr, &size_addr_in)) == -1)
+    {
+        if (errno == EWOULDBLOCK && set->ack_pending) /* The wait ended early, for the ACK held back. */
+        {
+            errno = 0;
+            cl_send_ack(set);
+            return 0;
+        }
+        if (cl_recvfrom_err(set, num_to) == -1)
+        {
+            return -1;
+        }
+        cl_retransmit(set); /* Timeout limit not exceeded, retransmit. */
+        return 0;
+    }
+    
+    *num_to = 0; /* Packet received: the timeouts are no longer in a row. */
+    
+    /* The packets bundled in a datagram follow one another; all of them are ACKed together. */
+    offset = 0;
+    while (!errno && offset < (size_t) len && (size = cl_process_v2(set, buffer + offset, (size_t) len - offset)) > 0)
+    {
+        offset += size;
+    }
+    if (set->ack_pending && set->ack_due_ms <= clock_ms())
+    {
+        cl_send_ack(set);
+    }
+    
+    return 0;
+}
+
+size_t cl_process_v2(struct client_settings *set, const uint8_t *packet_buffer, size_t len)
+{
+    uint16_t length;
+    size_t   size;
+    
+    if (*packet_buffer == (FLAG_SYN | FLAG_ACK)) /* The server did not receive the ACK of the handshake. */
+    {
+        cl_send_handshake_ack(set);
+        return len; /* Framed as in version 1; never bundled. */
+    }
+    
+    /* The length follows the flags and the window. A truncated packet is dropped. */
+    if (len < HLEN_V2_BYTES)
+    {
+        return 0;
+    }
+    memcpy(&length, packet_buffer + 2, sizeof(length));
+    size = header_size(*packet_buffer, PROTO_V2) + ntohs(length);
+    if (len < size)
+    {
+        return 0;
+    }
+    set->heard = true; /* The server keeps the connection: the cookie need not be returned again. */
+    
+    deserialize_packet(set->r_packet, packet_buffer, PROTO_V2);
+    if (errno == ENOMEM)
+    {
+        running = 0;
+        return 0;
+    }
+    set->mm->mm_add(set->mm, set->r_packet->payload);
+    
+    /* The ACK is cumulative: every packet before the ACK number has arrived. */
+    if ((set->r_packet->flags & FLAG_ACK) && seq_after(set->r_packet->ack_num, set->snd_una) &&
+        !seq_after(set->r_packet->ack_num, set->snd_nxt))
+    {
+        set->snd_una = set->r_packet->ack_num;
+        rtt_ack(&set->rtt, set->snd_una - 1, clock_ms());
+    }
+    
+    if (set->r_packet->flags & (FLAG_PSH | FLAG_FIN | FLAG_TKT))
+    {
+        if (set->r_packet->seq_num == set->rcv_nxt)
+        {
+            uint32_t rcv_nxt;
+            
+            rcv_nxt = set->rcv_nxt;
+            cl_deliver(set, set->r_packet);
+            cl_deliver_held(set);
+            
+            /* A FIN/ACK, a packet which fills a hole, or one not taken, is ACKed at once. */
+            cl_delay_ack(set, (!set->fin_received && set->rcv_nxt == rcv_nxt + 1) ? CL_DELACK_MS : 0);
+        } else
+        {
+            if (seq_after(set->r_packet->seq_num, set->rcv_nxt) &&
+                set->r_packet->seq_num - set->rcv_nxt < CL_WINDOW &&
+                set->r_packet->length <= CL_MAX_PUSH_BYTES)
+            {
+                cl_hold(set, set->r_packet);
+            }
+            cl_delay_ack(set, 0);
+        }
+    }
     
     set->mm->mm_free(set->mm, set->r_packet->payload);
+    set->r_packet->payload = NULL;
+    
+    return size;
+}
+
+void cl_deliver(struct client_settings *set, const struct packet *packet)
+{
+    if (packet->flags & FLAG_FIN)
+    {
+        set->fin_received = true;
+    } else if (packet->flags & FLAG_TKT)
+    {
+        if (packet->length == TICKET_BYTES)
+        {
+            memcpy(set->ticket, packet->payload, TICKET_BYTES);
+            set->ticket_held = true;
+        }
+    } else if (set->delta && !cl_apply_state(set, packet))
+    {
+        return; /* The ACK stays behind it, so the server sends it again; as a keyframe. */
+    } else if (!set->delta && packet->length >= GAME_SEND_BYTES + GAME_STATE_BYTES)
+    {
+        set->turn = false; /* The latest game state decides the turn. */
+        cl_show_state(set, packet);
+    }
+    ++set->rcv_nxt;
+}
+
+bool cl_apply_state(struct client_settings *set, const struct packet *packet)
+{
+    uint8_t         state[GAME_SEND_BYTES + GAME_STATE_BYTES];
+    uint16_t        version;
+    uint16_t        base_ver;
+    struct cl_state *kept;
+    struct packet   shown;
+    
+    if (packet->length < STATE_HDR_BYTES)
+    {
+        return true;
+    }
+    memcpy(&version, packet->payload, sizeof(version));
+    memcpy(&base_ver, packet->payload + sizeof(version), sizeof(base_ver));
+    version  = ntohs(version);
+    base_ver = ntohs(base_ver);
+    
+    if (version == base_ver) /* A keyframe. */
+    {
+        if (packet->length != CL_MAX_STATE_BYTES)
+        {
+            return true;
+        }
+        memcpy(state, packet->payload + STATE_HDR_BYTES, sizeof(state));
+    } else
+    {
+        const struct cl_state *base;
+        
+        base = &set->states[base_ver & (STATE_HISTORY - 1)];
+        if (!base->held || base->version != base_ver || (packet->length - STATE_HDR_BYTES) % 2 != 0)
+        {
+            (void) fprintf(stderr, "\nGame state %u is based on state %u, which is not held; dropped\n", version,
+                           base_ver);
+            return false;
+        }
+        memcpy(state, base->state, sizeof(state));
+        for (uint16_t i = STATE_HDR_BYTES; i < packet->length; i += 2)
+        {
+            if (*(packet->payload + i) < sizeof(state))
+            {
+                state[*(packet->payload + i)] = *(packet->payload + i + 1);
+            }
+        }
+    }
+    
+    kept = &set->states[version & (STATE_HISTORY - 1)];
+    kept->held    = true;
+    kept->version = version;
+    memcpy(kept->state, state, sizeof(state));
+    
+    if (set->state_shown && (int16_t) (version - set->shown_ver) <= 0)
+    {
+        return true; /* Superseded. */
+    }
+    set->shown_ver   = version;
+    set->state_shown = true;
+    
+    set->turn = false; /* The latest game state decides the turn. */
+    create_packet(&shown, packet->flags, packet->seq_num, sizeof(kept->state), kept->state);
+    cl_show_state(set, &shown);
+    
+    return true;
+}
+
+void cl_hold(struct client_settings *set, const struct packet *packet)
+{
+    struct held_packet *held;
+    
+    held = &set->held[packet->seq_num & (CL_WINDOW - 1)];
+    held->held    = true;
+    held->seq_num = packet->seq_num;
+    held->flags   = packet->flags;
+    held->length  = packet->length;
+    if (packet->length > 0)
+    {
+        memcpy(held->payload, packet->payload, packet->length);
+    }
+}
+
+void cl_deliver_held(struct client_settings *set)
+{
+    struct held_packet *held;
+    struct packet      packet;
+    
+    held = &set->held[set->rcv_nxt & (CL_WINDOW - 1)];
+    while (held->held && held->seq_num == set->rcv_nxt)
+    {
+        held->held = false;
+        create_packet(&packet, held->flags, held->seq_num, held->length, held->payload);
+        cl_deliver(set, &packet);
+        held = &set->held[set->rcv_nxt & (CL_WINDOW - 1)];
+    }
+}
+
+void cl_send_ack(struct client_settings *set)
+{
+    struct packet packet;
+    
+    create_packet(&packet, FLAG_ACK, set->snd_nxt, 0, NULL);
+    packet.ack_num = set->rcv_nxt;
+    packet.window  = CL_WINDOW;
+    
+    /* Report what is held beyond the ACK number, so the server sends only the holes again. */
+    for (uint32_t i = 0; i < CL_WINDOW - 1; ++i)
+    {
+        const struct held_packet *held;
+        
+        held = &set->held[(set->rcv_nxt + 1 + i) & (CL_WINDOW - 1)];
+        if (held->held && held->seq_num == set->rcv_nxt + 1 + i)
+        {
+            packet.sack |= (uint32_t) 1 << i;
+        }
+    }
+    if (packet.sack != 0)
+    {
+        packet.flags |= FLAG_SAK;
+    }
+    
+    cl_transmit(set, &packet, PROTO_V2);
+    set->ack_pending = false;
+}
+
+void cl_delay_ack(struct client_settings *set, uint32_t delay_ms)
+{
+    set->ack_due_ms  = (set->ack_pending || delay_ms == 0) ? 0 : clock_ms() + delay_ms;
+    set->ack_pending = true;
+}
+
+void cl_send_handshake_ack(struct client_settings *set)
+{
+    struct packet packet;
+    
+    create_packet(&packet, FLAG_ACK, MAX_SEQ, set->echo_len, set->echo);
+    cl_transmit(set, &packet, PROTO_V1);
+}
+
+void cl_retransmit(struct client_settings *set)
+{
+    if (set->echo_len > 0 && !set->heard)
+    {
+        cl_send_handshake_ack(set); /* The ACK which returned the cookie may have been lost. */
+        return;
+    }
+    if (set->snd_una == set->snd_nxt)
+    {
+        cl_send_ack(set); /* Nothing is outstanding: tell the server what has arrived. */
+        return;
+    }
+    
+    set->s_packet->ack_num = set->rcv_nxt;
+    set->ack_pending       = false; /* The packet carries the ACK. */
+    cl_sendto(set);
+}
+
+void cl_disconnect_v2(struct client_settings *set)
+{
+    int num_to;
+    
+    errno  = 0;
+    num_to = 0;
+    
+    /* The FIN is sequenced after the move in flight, so the move must be received first. */
+    while (!errno && set->snd_una != set->snd_nxt)
+    {
+        if (cl_await(set, &num_to) == -1)
+        {
+            return;
+        }
+    }
+    
+    create_packet(set->s_packet, FLAG_FIN | FLAG_ACK, set->snd_nxt++, 0, NULL);
+    set->s_packet->ack_num = set->rcv_nxt;
+    set->s_packet->window  = CL_WINDOW;
+    set->ack_pending       = false;
+    cl_sendto(set);
+    rtt_start(&set->rtt, set->s_packet->seq_num, clock_ms());
+    
+    while (!errno && !(set->fin_received && set->snd_una == set->snd_nxt))
+    {
+        if (cl_await(set, &num_to) == -1)
+        {
+            return;
+        }
+    }
+    
+    /* The FIN/ACK was ACKed on arrival; if the ACK is lost, the FIN/ACK is sent again and ACKed again. */
+    while (!errno && cl_await(set, &num_to) == 0)
+    {}
 }
 
 void cl_disconnect(struct client_settings *set)
@@ -457,6 +1180,7 @@ void cl_disconnect(struct client_settings *set)
     errno = 0;
     create_packet(set->s_packet, FLAG_FIN, MAX_SEQ, 0, NULL);
     cl_sendto(set);
+    rtt_start(&set->rtt, set->s_packet->seq_num, clock_ms());
     if (!errno)
     {
         uint8_t flag_set[] = {FLAG_FIN | FLAG_ACK};
@@ -55,6 +55,8 @@ void set_client_defaults(struct client_settings *set)
     memset(set, 0, sizeof(struct client_settings));
     set->server_port = DEFAULT_PORT;
     set->turn        = false;
+    set->version     = PROTO_V1; /* Until the server accepts the offer of version 2. */
+    rtt_init(&set->rtt);
     
     if ((controllerSetup()) == -1)
     {
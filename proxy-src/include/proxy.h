@@ -6,6 +6,8 @@
 #define RELIABLE_UDP_PROXY_H
 
 #include "../../libs/include/manager.h"
+#include "uring.h"
+#include <stdbool.h>
 #include <sys/types.h>
 
 /**
@@ -20,6 +22,8 @@
  * <li>server_fd: file descriptor of the socket listening for connections</li>
  * <li>accept_fd: file descriptor of the socket created when a connection is made</li>
  * <li>output_fd: file descriptor for the output</li>
+ * <li>use_uring: whether to receive and forward messages through io_uring</li>
+ * <li>ring: the io_uring; NULL if it is not in use</li>
  * </ul>
  * </p>
  */
@@ -32,7 +36,9 @@ struct proxy_settings
     int       proxy_fd;
     uint8_t   drop_bound;
     uint8_t   hold_bound;
+    bool      use_uring;
     
+    struct uring          *ring;
     struct sockaddr_in    *from_addr;
     struct sockaddr_in    *output_addr;
     struct sockaddr_in    *input_addr;
@@ -0,0 +1,164 @@
+#ifndef RELIABLE_UDP_URING_H
+#define RELIABLE_UDP_URING_H
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/**
+ * The buffer group the provided buffers of a ring are registered as.
+ */
+#define UR_BUFFER_GROUP 0
+
+/**
+ * uring
+ * <p>
+ * An io_uring instance, driven through the raw system calls: the submission and completion queues shared with the
+ * kernel, and a ring of provided buffers from which the kernel picks a buffer for each message received by a
+ * buffer-selecting request.
+ * <ul>
+ * <li>fd: the io_uring file descriptor</li>
+ * <li>sq_khead, sq_ktail: the head and tail of the submission queue, shared with the kernel</li>
+ * <li>sq_mask, sq_entries: the index mask and the number of entries of the submission queue</li>
+ * <li>sqes: the submission queue entries</li>
+ * <li>sqe_tail, sqe_submitted: the number of entries prepared, and the number of those given to the kernel</li>
+ * <li>cq_khead, cq_ktail, cq_mask, cqes: the completion queue, shared with the kernel</li>
+ * <li>buf_ring: the ring the provided buffers are handed to the kernel through; NULL until buffers are provided</li>
+ * <li>bufs, buf_bytes, num_bufs: the provided buffers, each of buf_bytes</li>
+ * <li>buf_tail: the tail of the provided buffer ring</li>
+ * </ul>
+ * </p>
+ */
+struct uring
+{
+    int fd;
+    
+    _Atomic unsigned    *sq_khead;
+    _Atomic unsigned    *sq_ktail;
+    unsigned            sq_mask;
+    unsigned            sq_entries;
+    struct io_uring_sqe *sqes;
+    unsigned            sqe_tail;
+    unsigned            sqe_submitted;
+    
+    _Atomic unsigned    *cq_khead;
+    _Atomic unsigned    *cq_ktail;
+    unsigned            cq_mask;
+    struct io_uring_cqe *cqes;
+    
+    struct io_uring_buf_ring *buf_ring;
+    uint8_t                  *bufs;
+    size_t                   buf_bytes;
+    uint16_t                 num_bufs;
+    uint16_t                 buf_tail;
+    
+    void   *sq_ring;
+    size_t sq_ring_bytes;
+    void   *cq_ring;
+    size_t cq_ring_bytes;
+    size_t sqes_bytes;
+    size_t buf_ring_bytes;
+    
+    struct io_uring_sqe *(*ur_get_sqe)(struct uring *);
+    
+    int (*ur_submit)(struct uring *, unsigned, int);
+    
+    struct io_uring_cqe *(*ur_peek_cqe)(struct uring *);
+    
+    void (*ur_cqe_seen)(struct uring *);
+    
+    int (*ur_provide_buffers)(struct uring *, uint16_t, size_t);
+    
+    uint8_t *(*ur_buffer)(struct uring *, uint16_t);
+    
+    void (*ur_return_buffer)(struct uring *, uint16_t);
+};
+
+/**
+ * init_uring
+ * <p>
+ * Constructor. Set up an io_uring instance and map its queues. Fails if the kernel does not support io_uring, or
+ * lacks the features the ring is driven with; the caller is expected to fall back to another mechanism.
+ * </p>
+ * @param entries - the number of submission queue entries; rounded up to a power of two by the kernel
+ * @return a pointer to the new ring, NULL on failure with errno set
+ */
+struct uring *init_uring(unsigned entries);
+
+/**
+ * free_uring
+ * <p>
+ * Unmap the queues and the provided buffers of a ring, close it, and free it. Requests still in flight are cancelled
+ * by the kernel.
+ * </p>
+ * @param ring - the ring to free
+ * @return 0 on success, -1 if the ring is NULL
+ */
+int free_uring(struct uring *ring);
+
+/**
+ * ur_prep_recvmsg_multishot
+ * <p>
+ * Prepare a multishot recvmsg: a single request which stays posted and completes once for every message received on
+ * the socket, each into a buffer picked from the ring's provided buffers. The message header only describes the
+ * space reserved in each buffer for the source address; it must stay valid until the request is submitted.
+ * </p>
+ * @param sqe - the submission queue entry
+ * @param fd - the socket
+ * @param msg - the message header
+ * @param user_data - the data reported with each completion
+ */
+void ur_prep_recvmsg_multishot(struct io_uring_sqe *sqe, int fd, struct msghdr *msg, uint64_t user_data);
+
+/**
+ * ur_prep_sendmsg
+ * <p>
+ * Prepare a sendmsg. The message header, its address and its data must stay valid until the request completes.
+ * </p>
+ * @param sqe - the submission queue entry
+ * @param fd - the socket
+ * @param msg - the message header
+ * @param user_data - the data reported with the completion
+ */
+void ur_prep_sendmsg(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg, uint64_t user_data);
+
+/**
+ * ur_prep_poll_multishot
+ * <p>
+ * Prepare a multishot poll for read readiness: a single request which completes every time the descriptor becomes
+ * readable.
+ * </p>
+ * @param sqe - the submission queue entry
+ * @param fd - the descriptor
+ * @param user_data - the data reported with each completion
+ */
+void ur_prep_poll_multishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data);
+
+/**
+ * ur_prep_cancel
+ * <p>
+ * Prepare the cancellation of a request in flight.
+ * </p>
+ * @param sqe - the submission queue entry
+ * @param target - the user data of the request to cancel
+ * @param user_data - the data reported with the completion of the cancellation
+ */
+void ur_prep_cancel(struct io_uring_sqe *sqe, uint64_t target, uint64_t user_data);
+
+/**
+ * ur_recvmsg_payload
+ * <p>
+ * Find the source address and the payload of a message received into a provided buffer by a multishot recvmsg.
+ * </p>
+ * @param msg - the message header the request was prepared with
+ * @param buffer - the provided buffer
+ * @param len - the number of bytes of the buffer used, from the completion
+ * @param addr - set to the source address of the message
+ * @param payload_len - set to the number of bytes of the payload held in the buffer
+ * @return the payload, NULL if the buffer does not hold a valid message
+ */
+uint8_t *ur_recvmsg_payload(const struct msghdr *msg, uint8_t *buffer, size_t len, struct sockaddr **addr,
+                            size_t *payload_len);
+
+#endif //RELIABLE_UDP_URING_H
@@ -2,11 +2,14 @@
 // Created by Maxwell Babey on 10/27/22.
 //
 
+#define _GNU_SOURCE /* recvmmsg, sendmmsg */
+
 #include "../../libs/include/error.h"
 #include "../../libs/include/manager.h"
 #include "../../libs/include/util.h"
 #include "../include/proxy.h"
 #include "../include/setup.h"
+#include "../include/uring.h"
 #include <arpa/inet.h>
 #include <signal.h>
 #include <sys/socket.h>
@@ -19,6 +22,36 @@
  */
 #define HUNDRED_PERCENT 100
 
+/**
+ * The maximum number of messages received by one recvmmsg, and forwarded by one sendmmsg.
+ */
+#define PROXY_BATCH 64
+
+/**
+ * The number of entries of the submission queue of the io_uring, and of buffers messages are received into. A buffer
+ * is held while the message in it is forwarded.
+ */
+#define PROXY_URING_ENTRIES 256
+
+/**
+ * The user data of the multishot recvmsg posted on the proxy socket; a forward has the id of its buffer instead.
+ */
+#define PROXY_URING_RECV UINT64_MAX
+
+/**
+ * forward_batch
+ * <p>
+ * The messages of a received batch which are to be forwarded, sent together once the batch is handled.
+ * </p>
+ */
+struct forward_batch
+{
+    struct mmsghdr     msgs[PROXY_BATCH];
+    struct iovec       iovs[PROXY_BATCH];
+    struct sockaddr_in to_addrs[PROXY_BATCH];
+    unsigned int       count;
+};
+
 /**
  * @author D'Arcy Smith
  */
@@ -61,17 +94,37 @@ void get_output_address(struct proxy_settings *set);
 void await_connect(struct proxy_settings *set);
 
 /**
- * sv_recvfrom.
+ * await_message
  * <p>
- * Await a message from the connected client. If no message is received and a timeout occurs,
- * resend the last-sent packet. If a timeout occurs too many times, drop the connection.
+ * Await messages. Each recvmmsg blocks for the first message of a batch, then takes whatever else is waiting, up to
+ * PROXY_BATCH messages. The messages of a batch which are forwarded are sent with a single sendmmsg.
  * </p>
  * @param set - the proxy settings
- * @param send_packet - the packet struct to send
- * @param recv_packet - the packet struct to sv_recvfrom
  */
 void await_message(struct proxy_settings *set);
 
+/**
+ * await_message_uring
+ * <p>
+ * Await messages through the io_uring. A multishot recvmsg stays posted on the proxy socket, and the kernel receives
+ * each message into a buffer of its own. A forwarded message is sent straight from its buffer; the buffer is handed
+ * back to the kernel once the send completes. The sends queued while handling the completions are submitted with the
+ * next wait, in a single system call.
+ * </p>
+ * @param set - the proxy settings
+ */
+void await_message_uring(struct proxy_settings *set);
+
+/**
+ * init_proxy_uring
+ * <p>
+ * Set up the io_uring and the buffers messages are received into. If io_uring is not available, report it and leave
+ * the ring unset, so the proxy falls back to recvmmsg.
+ * </p>
+ * @param set - the proxy settings
+ */
+void init_proxy_uring(struct proxy_settings *set);
+
 /**
  * determine_action
  * <p>
@@ -79,12 +132,33 @@ void await_message(struct proxy_settings *set);
  * </p>
  * @param set - the proxy settings
  * @param buffer - the packet
+ * @return true if the packet is to be forwarded, false if it is dropped
  */
-void determine_action(struct proxy_settings *set, uint8_t *buffer);
+bool determine_action(const struct proxy_settings *set, const uint8_t *buffer);
 
-uint32_t get_packet_size(const uint8_t *buffer);
+/**
+ * forward_message
+ * <p>
+ * Address a packet to be forwarded: to the output address if it came from the input address, to the input address
+ * otherwise. The message header must already point at its own address and I/O vector; the packet must stay valid
+ * until the message is sent.
+ * </p>
+ * @param set - the proxy settings
+ * @param buffer - the packet
+ * @param len - the length of the packet
+ * @param msg - the message to send the packet with
+ */
+void forward_message(const struct proxy_settings *set, uint8_t *buffer, size_t len, struct msghdr *msg);
 
-void forward_message(const struct proxy_settings *set, const uint8_t *buffer);
+/**
+ * flush_forwards
+ * <p>
+ * Send every queued message of a batch with sendmmsg. A message which cannot be sent is reported and skipped.
+ * </p>
+ * @param set - the proxy settings
+ * @param batch - the batch of messages to forward
+ */
+void flush_forwards(const struct proxy_settings *set, struct forward_batch *batch);
 
 _Noreturn void close_proxy(struct proxy_settings *set, int exit_code);
 
@@ -167,20 +241,33 @@ void await_connect(struct proxy_settings *set)
     set_signal_handling(&sa);
     running = 1;
     
+    if (set->use_uring)
+    {
+        init_proxy_uring(set);
+    }
+    
     while (running)
     {
-        await_message(set);
+        if (set->ring != NULL)
+        {
+            await_message_uring(set);
+        } else
+        {
+            await_message(set);
+        }
     }
 }
 
 void await_message(struct proxy_settings *set)
 {
-    uint8_t   buffer[BUF_LEN];
-    ssize_t   bytes_recv;
-    socklen_t sockaddr_in_size;
+    struct mmsghdr       msgs[PROXY_BATCH];
+    struct iovec         iovs[PROXY_BATCH];
+    struct sockaddr_in   from_addrs[PROXY_BATCH];
+    struct forward_batch batch;
+    uint8_t              *buffers;
+    int                  num_recv;
     
     srandom(time(NULL));
-    sockaddr_in_size = sizeof(struct sockaddr_in);
     set->from_addr = (struct sockaddr_in *) s_calloc(1, sizeof(struct sockaddr_in), __FILE__, __func__, __LINE__);
     if (errno == ENOTRECOVERABLE)
     {
@@ -194,13 +281,37 @@ void await_message(struct proxy_settings *set)
         close_proxy(set, EXIT_FAILURE);
     }
     set->mem_manager->mm_add(set->mem_manager, set->input_addr);
+    
+    buffers = (uint8_t *) s_calloc(PROXY_BATCH, BUF_LEN, __FILE__, __func__, __LINE__);
+    if (errno == ENOTRECOVERABLE)
+    {
+        close_proxy(set, EXIT_FAILURE);
+    }
+    set->mem_manager->mm_add(set->mem_manager, buffers);
+    
+    memset(msgs, 0, sizeof(msgs));
+    memset(&batch, 0, sizeof(batch));
+    for (size_t i = 0; i < PROXY_BATCH; ++i)
+    {
+        iovs[i].iov_base           = buffers + i * BUF_LEN;
+        iovs[i].iov_len            = BUF_LEN;
+        msgs[i].msg_hdr.msg_iov    = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name   = &from_addrs[i];
+        
+        batch.msgs[i].msg_hdr.msg_iov  = &batch.iovs[i];
+        batch.msgs[i].msg_hdr.msg_name = &batch.to_addrs[i];
+    }
+    
     do
     {
         printf("Awaiting message\n");
         
-        memset(buffer, 0, BUF_LEN);
-        if ((bytes_recv = recvfrom(set->proxy_fd, buffer, BUF_LEN, 0,
-                                   (struct sockaddr *) set->from_addr, &sockaddr_in_size)) == -1)
+        for (size_t i = 0; i < PROXY_BATCH; ++i) /* The kernel overwrites the address lengths. */
+        {
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        }
+        if ((num_recv = recvmmsg(set->proxy_fd, msgs, PROXY_BATCH, MSG_WAITFORONE, NULL)) == -1)
         {
             switch(errno)
             {
@@ -216,18 +327,177 @@ void await_message(struct proxy_settings *set)
             }
         }
         
-        // Will get the first address as the client address.
-        if (set->input_addr->sin_addr.s_addr == 0)
+        for (int i = 0; i < num_recv; ++i)
         {
-            memcpy(set->input_addr, set->from_addr, sizeof(struct sockaddr_in));
+            *set->from_addr = from_addrs[i];
+            
+            // Will get the first address as the client address.
+            if (set->input_addr->sin_addr.s_addr == 0)
+            {
+                memcpy(set->input_addr, set->from_addr, sizeof(struct sockaddr_in));
+            }
+            
+            if (determine_action(set, iovs[i].iov_base))
+            {
+                forward_message(set, iovs[i].iov_base, msgs[i].msg_len, &batch.msgs[batch.count++].msg_hdr);
+            }
         }
         
-        determine_action(set, buffer);
+        flush_forwards(set, &batch);
+        
+    } while (num_recv > 0);
+}
+
+void init_proxy_uring(struct proxy_settings *set)
+{
+    if ((set->ring = init_uring(PROXY_URING_ENTRIES)) == NULL)
+    {
+        perror("io_uring is not available; falling back to recvmmsg");
+        errno = 0;
+        return;
+    }
+    
+    /* The buffers hold the recvmsg header and the source address ahead of the message. */
+    if (set->ring->ur_provide_buffers(set->ring, PROXY_URING_ENTRIES, sizeof(struct io_uring_recvmsg_out) +
+                                                                      sizeof(struct sockaddr_in) + BUF_LEN) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        close_proxy(set, EXIT_FAILURE);
+    }
+}
+
+void await_message_uring(struct proxy_settings *set)
+{
+    struct proxy_send
+    {
+        struct msghdr      msg;
+        struct iovec       iov;
+        struct sockaddr_in to_addr;
+    }                   *sends;
+    struct msghdr       recv_msg;
+    struct uring        *ring;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    
+    ring = set->ring;
+    srandom(time(NULL));
+    set->from_addr = (struct sockaddr_in *) s_calloc(1, sizeof(struct sockaddr_in), __FILE__, __func__, __LINE__);
+    if (errno == ENOTRECOVERABLE)
+    {
+        close_proxy(set, EXIT_FAILURE);
+    }
+    set->mem_manager->mm_add(set->mem_manager, set->from_addr);
+    
+    set->input_addr = (struct sockaddr_in *) s_calloc(1, sizeof(struct sockaddr_in), __FILE__, __func__, __LINE__);
+    if (errno == ENOTRECOVERABLE)
+    {
+        close_proxy(set, EXIT_FAILURE);
+    }
+    set->mem_manager->mm_add(set->mem_manager, set->input_addr);
+    
+    /* One send per buffer: a forward lives exactly as long as the buffer holding its message. */
+    sends = s_calloc(PROXY_URING_ENTRIES, sizeof(*sends), __FILE__, __func__, __LINE__);
+    if (errno == ENOTRECOVERABLE)
+    {
+        close_proxy(set, EXIT_FAILURE);
+    }
+    set->mem_manager->mm_add(set->mem_manager, sends);
+    for (size_t i = 0; i < PROXY_URING_ENTRIES; ++i)
+    {
+        sends[i].msg.msg_iov  = &sends[i].iov;
+        sends[i].msg.msg_name = &sends[i].to_addr;
+    }
+    
+    memset(&recv_msg, 0, sizeof(recv_msg));
+    recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+    if ((sqe = ring->ur_get_sqe(ring)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        close_proxy(set, EXIT_FAILURE);
+    }
+    ur_prep_recvmsg_multishot(sqe, set->proxy_fd, &recv_msg, PROXY_URING_RECV);
+    
+    while (running)
+    {
+        printf("Awaiting message\n");
+        
+        /* Submit the forwards queued since the last wait, and wait, unless completions are already waiting. */
+        if (ring->ur_submit(ring, (ring->ur_peek_cqe(ring) == NULL) ? 1 : 0, -1) == -1)
+        {
+            switch(errno)
+            {
+                case EINTR:
+                {
+                    close_proxy(set, EXIT_SUCCESS);
+                }
+                default:
+                {
+                    fatal_errno(__FILE__, __func__, __LINE__, errno);
+                    close_proxy(set, EXIT_FAILURE);
+                }
+            }
+        }
         
-    } while (bytes_recv > 0);
+        for (; (cqe = ring->ur_peek_cqe(ring)) != NULL; ring->ur_cqe_seen(ring))
+        {
+            struct sockaddr *from;
+            uint8_t         *buffer;
+            size_t          len;
+            uint16_t        bid;
+            
+            bid = (uint16_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe->user_data != PROXY_URING_RECV) /* A forward completed: its buffer is free again. */
+            {
+                if (cqe->res < 0)
+                {
+                    errno = -cqe->res;
+                    perror("Proxy failed to forward message");
+                    errno = 0;
+                }
+                ring->ur_return_buffer(ring, (uint16_t) cqe->user_data);
+                continue;
+            }
+            
+            if (!(cqe->flags & IORING_CQE_F_MORE)) /* The recvmsg ended, e.g. because every buffer is held. */
+            {
+                if ((sqe = ring->ur_get_sqe(ring)) == NULL)
+                {
+                    fatal_errno(__FILE__, __func__, __LINE__, errno);
+                    close_proxy(set, EXIT_FAILURE);
+                }
+                ur_prep_recvmsg_multishot(sqe, set->proxy_fd, &recv_msg, PROXY_URING_RECV);
+            }
+            if (cqe->res < 0 || !(cqe->flags & IORING_CQE_F_BUFFER))
+            {
+                continue;
+            }
+            
+            buffer = ur_recvmsg_payload(&recv_msg, ring->ur_buffer(ring, bid), (size_t) cqe->res, &from, &len);
+            if (buffer == NULL || len == 0)
+            {
+                ring->ur_return_buffer(ring, bid);
+                continue;
+            }
+            memcpy(set->from_addr, from, sizeof(struct sockaddr_in));
+            
+            // Will get the first address as the client address.
+            if (set->input_addr->sin_addr.s_addr == 0)
+            {
+                memcpy(set->input_addr, set->from_addr, sizeof(struct sockaddr_in));
+            }
+            
+            if (!determine_action(set, buffer) || (sqe = ring->ur_get_sqe(ring)) == NULL)
+            {
+                ring->ur_return_buffer(ring, bid); /* Dropped. */
+                continue;
+            }
+            forward_message(set, buffer, len, &sends[bid].msg);
+            ur_prep_sendmsg(sqe, set->proxy_fd, &sends[bid].msg, bid);
+        }
+    }
 }
 
-void determine_action(struct proxy_settings *set, uint8_t *buffer)
+bool determine_action(const struct proxy_settings *set, const uint8_t *buffer)
 {
     uint64_t directive;
     char *src = inet_ntoa(set->from_addr->sin_addr); // NOLINT(concurrency-mt-unsafe) : no threads here
@@ -237,55 +507,59 @@ void determine_action(struct proxy_settings *set, uint8_t *buffer)
     {
         // Do not send the packet.
         printf("Packet from %s with flags %s dropped.\n", src, check_flags(*buffer));
-        return;
+        return false;
     }
     if (set->drop_bound < directive && directive <= set->hold_bound)
     {
         // Pause a new thread.
     }
-    forward_message(set, buffer);
+    return true;
 }
 
-void forward_message(const struct proxy_settings *set, const uint8_t *buffer)
+void forward_message(const struct proxy_settings *set, uint8_t *buffer, size_t len, struct msghdr *msg)
 {
-    struct sockaddr_in to_addr;
+    struct sockaddr_in *to_addr;
     char *src = inet_ntoa(set->from_addr->sin_addr); // NOLINT(concurrency-mt-unsafe) : no threads here
     char *dest;
     
+    to_addr = (struct sockaddr_in *) msg->msg_name;
+    
     if (set->from_addr->sin_addr.s_addr == set->input_addr->sin_addr.s_addr)
     {
-        to_addr = *set->output_addr;
+        *to_addr = *set->output_addr;
         dest = set->output_ip;
     } else
     {
-        to_addr = *set->input_addr;
+        *to_addr = *set->input_addr;
         dest = inet_ntoa(set->input_addr->sin_addr); // NOLINT(concurrency-mt-unsafe) : no threads here
     }
     
     printf("Packet coming from %s and going to %s with flags %s\n", src, dest, check_flags(*buffer));
     
-    uint8_t packet_size = get_packet_size(buffer);
-    
-    if (sendto(set->proxy_fd, buffer, packet_size, 0,
-               (struct sockaddr *) &to_addr, sizeof(struct sockaddr_in)) == -1)
-    {
-        perror("Proxy failed to forward message");
-    }
+    /* Forward the datagram as received; the buffer stays valid until the message is sent. */
+    msg->msg_iov->iov_base = buffer;
+    msg->msg_iov->iov_len  = len;
+    msg->msg_iovlen        = 1;
+    msg->msg_namelen       = sizeof(struct sockaddr_in);
 }
 
-uint32_t get_packet_size(const uint8_t *buffer)
+void flush_forwards(const struct proxy_settings *set, struct forward_batch *batch)
 {
-    const uint8_t flag_size = 4;
-    uint16_t payload_len;
-    uint32_t ret_val;
+    unsigned int start;
     
-    memcpy(&payload_len, buffer + sizeof(uint16_t), sizeof(uint16_t));
-    
-    payload_len = ntohs(payload_len);
-    
-    ret_val = payload_len + flag_size;
+    for (start = 0; start < batch->count;)
+    {
+        int num_sent;
+        
+        if ((num_sent = sendmmsg(set->proxy_fd, &batch->msgs[start], batch->count - start, 0)) == -1)
+        {
+            perror("Proxy failed to forward message");
+            num_sent = 1; /* Skip the message at fault; forward the rest. */
+        }
+        start += (unsigned int) num_sent;
+    }
     
-    return ret_val;
+    batch->count = 0;
 }
 
 _Noreturn void close_proxy(struct proxy_settings *set, int exit_code)
@@ -294,6 +568,10 @@ _Noreturn void close_proxy(struct proxy_settings *set, int exit_code)
     {
         close(set->proxy_fd);
     }
+    if (set->ring != NULL)
+    {
+        free_uring(set->ring);
+    }
     free_memory_manager(set->mem_manager);
     exit(exit_code); // NOLINT(concurrency-mt-unsafe) : no threads here
 }
@@ -14,7 +14,7 @@
 /**
  * Usage message; printed when there is a user error upon running.
  */
-#define USAGE "proxy -i <host ip address> -o <server ip address> -p <input port number> -P <output port number> -d <drop chance %> -h <hold chance %>"
+#define USAGE "proxy -i <host ip address> -o <server ip address> -p <input port number> -P <output port number> -d <drop chance %> -h <hold chance %> [-u (io_uring)]"
 
 /**
  * 100%
@@ -78,7 +78,7 @@ void read_args(int argc, char *argv[], struct proxy_settings *set)
     
     drop_chance = 0;
     hold_chance = 0;
-    while ((c = getopt(argc, argv, ":i:o:p:P:d:h:")) != -1) // NOLINT(concurrency-mt-unsafe) : No threads here
+    while ((c = getopt(argc, argv, ":i:o:p:P:d:h:u")) != -1) // NOLINT(concurrency-mt-unsafe) : No threads here
     {
         switch (c)
         {
@@ -134,6 +134,11 @@ void read_args(int argc, char *argv[], struct proxy_settings *set)
                 hold_chance = get_percentage(optarg, base);
                 break;
             }
+            case 'u':
+            {
+                set->use_uring = true;
+                break;
+            }
             default:
             {
                 advise_usage(USAGE);
@@ -0,0 +1,457 @@
+#define _DEFAULT_SOURCE /* syscall */
+
+#include "../../libs/include/manager.h"
+#include "../include/uring.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * The number of completion queue entries per submission queue entry. Every multishot request may complete many
+ * times for a single submission.
+ */
+#define UR_CQ_FACTOR 4
+
+/**
+ * ur_get_sqe
+ * <p>
+ * Take the next free submission queue entry, and zero it. If the queue is full, the entries prepared so far are
+ * submitted first.
+ * </p>
+ * @param ring - the ring
+ * @return the entry, NULL if the queue is full and could not be submitted
+ */
+struct io_uring_sqe *ur_get_sqe(struct uring *ring);
+
+/**
+ * ur_submit
+ * <p>
+ * Give the prepared submission queue entries to the kernel and, if asked, wait for completions; one system call.
+ * A wait which times out is not a failure.
+ * </p>
+ * @param ring - the ring
+ * @param wait_nr - the number of completions to wait for; 0 to only submit
+ * @param timeout_ms - the maximum time to wait in milliseconds, -1 to wait indefinitely
+ * @return 0 on success, -1 on failure
+ */
+int ur_submit(struct uring *ring, unsigned wait_nr, int timeout_ms);
+
+/**
+ * ur_peek_cqe
+ * <p>
+ * Return the completion queue entry at the head of the queue, without consuming it.
+ * </p>
+ * @param ring - the ring
+ * @return the entry, NULL if the queue is empty
+ */
+struct io_uring_cqe *ur_peek_cqe(struct uring *ring);
+
+/**
+ * ur_cqe_seen
+ * <p>
+ * Consume the completion queue entry at the head of the queue, handing its slot back to the kernel.
+ * </p>
+ * @param ring - the ring
+ */
+void ur_cqe_seen(struct uring *ring);
+
+/**
+ * ur_provide_buffers
+ * <p>
+ * Allocate the ring's provided buffers and register them with the kernel as buffer group UR_BUFFER_GROUP.
+ * </p>
+ * @param ring - the ring
+ * @param num_bufs - the number of buffers; a power of two
+ * @param buf_bytes - the size of each buffer
+ * @return 0 on success, -1 on failure
+ */
+int ur_provide_buffers(struct uring *ring, uint16_t num_bufs, size_t buf_bytes);
+
+/**
+ * ur_buffer
+ * <p>
+ * Return the provided buffer with an id.
+ * </p>
+ * @param ring - the ring
+ * @param bid - the buffer id, from a completion
+ * @return the buffer
+ */
+uint8_t *ur_buffer(struct uring *ring, uint16_t bid);
+
+/**
+ * ur_return_buffer
+ * <p>
+ * Hand a provided buffer back to the kernel once its message has been handled.
+ * </p>
+ * @param ring - the ring
+ * @param bid - the buffer id
+ */
+void ur_return_buffer(struct uring *ring, uint16_t bid);
+
+/**
+ * map_queues
+ * <p>
+ * Map the submission queue, the completion queue, and the submission queue entries of a new ring.
+ * </p>
+ * @param ring - the ring
+ * @param params - the parameters filled in by io_uring_setup
+ * @return 0 on success, -1 on failure
+ */
+int map_queues(struct uring *ring, const struct io_uring_params *params);
+
+struct uring *init_uring(unsigned entries)
+{
+    struct uring           *ring;
+    struct io_uring_params params;
+    int                    fd;
+    
+    memset(&params, 0, sizeof(params));
+    params.flags      = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = entries * UR_CQ_FACTOR;
+    if ((fd = (int) syscall(__NR_io_uring_setup, entries, &params)) == -1 && errno == EINVAL)
+    {
+        /* Cooperative task running is an optimization only; kernels before 5.19 reject it. */
+        memset(&params, 0, sizeof(params));
+        params.flags      = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * UR_CQ_FACTOR;
+        fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if (fd == -1)
+    {
+        return NULL;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+    {
+        close(fd);
+        errno = ENOSYS;
+        return NULL;
+    }
+    
+    if ((ring = (struct uring *) s_calloc(1, sizeof(struct uring), __FILE__, __func__, __LINE__)) == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+    
+    if (map_queues(ring, &params) == -1)
+    {
+        free_uring(ring);
+        return NULL;
+    }
+    
+    ring->ur_get_sqe         = ur_get_sqe;
+    ring->ur_submit          = ur_submit;
+    ring->ur_peek_cqe        = ur_peek_cqe;
+    ring->ur_cqe_seen        = ur_cqe_seen;
+    ring->ur_provide_buffers = ur_provide_buffers;
+    ring->ur_buffer          = ur_buffer;
+    ring->ur_return_buffer   = ur_return_buffer;
+    
+    return ring;
+}
+
+int free_uring(struct uring *ring)
+{
+    if (ring == NULL)
+    {
+        errno = EFAULT;
+        return -1;
+    }
+    
+    if (ring->buf_ring != NULL)
+    {
+        munmap(ring->buf_ring, ring->buf_ring_bytes);
+    }
+    free(ring->bufs);
+    if (ring->sqes != NULL)
+    {
+        munmap(ring->sqes, ring->sqes_bytes);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_bytes);
+    }
+    if (ring->sq_ring != NULL)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_bytes);
+    }
+    close(ring->fd); /* The kernel cancels the requests still in flight. */
+    free(ring);
+    
+    return 0;
+}
+
+int map_queues(struct uring *ring, const struct io_uring_params *params)
+{
+    uint8_t  *sq_ring;
+    uint8_t  *cq_ring;
+    unsigned *sq_array;
+    
+    ring->sq_ring_bytes = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    ring->cq_ring_bytes = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (params->features & IORING_FEAT_SINGLE_MMAP) /* Both queues share one mapping. */
+    {
+        if (ring->cq_ring_bytes > ring->sq_ring_bytes)
+        {
+            ring->sq_ring_bytes = ring->cq_ring_bytes;
+        }
+        ring->cq_ring_bytes = ring->sq_ring_bytes;
+    }
+    
+    ring->sq_ring = mmap(NULL, ring->sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        ring->sq_ring = NULL;
+        return -1;
+    }
+    if (params->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cq_ring = ring->sq_ring;
+    } else
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                             IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+        {
+            ring->cq_ring = NULL;
+            return -1;
+        }
+    }
+    ring->sqes_bytes = params->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes       = (struct io_uring_sqe *) mmap(NULL, ring->sqes_bytes, PROT_READ | PROT_WRITE,
+                                                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        return -1;
+    }
+    
+    sq_ring = (uint8_t *) ring->sq_ring;
+    cq_ring = (uint8_t *) ring->cq_ring;
+    
+    /* The kernel aligns each field at the offset it gives. */
+    ring->sq_khead   = (_Atomic unsigned *) (void *) (sq_ring + params->sq_off.head);
+    ring->sq_ktail   = (_Atomic unsigned *) (void *) (sq_ring + params->sq_off.tail);
+    ring->sq_mask    = *(unsigned *) (void *) (sq_ring + params->sq_off.ring_mask);
+    ring->sq_entries = params->sq_entries;
+    sq_array         = (unsigned *) (void *) (sq_ring + params->sq_off.array);
+    
+    ring->cq_khead = (_Atomic unsigned *) (void *) (cq_ring + params->cq_off.head);
+    ring->cq_ktail = (_Atomic unsigned *) (void *) (cq_ring + params->cq_off.tail);
+    ring->cq_mask  = *(unsigned *) (void *) (cq_ring + params->cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe *) (void *) (cq_ring + params->cq_off.cqes);
+    
+    /* Entries are always prepared in queue order, so the indirection array maps every slot to itself. */
+    for (unsigned i = 0; i < ring->sq_entries; ++i)
+    {
+        sq_array[i] = i;
+    }
+    
+    return 0;
+}
+
+struct io_uring_sqe *ur_get_sqe(struct uring *ring)
+{
+    struct io_uring_sqe *sqe;
+    
+    if (ring->sqe_tail - atomic_load_explicit(ring->sq_khead, memory_order_acquire) >= ring->sq_entries)
+    {
+        if (ur_submit(ring, 0, 0) == -1 ||
+            ring->sqe_tail - atomic_load_explicit(ring->sq_khead, memory_order_acquire) >= ring->sq_entries)
+        {
+            return NULL;
+        }
+    }
+    
+    sqe = &ring->sqes[ring->sqe_tail++ & ring->sq_mask];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    
+    return sqe;
+}
+
+int ur_submit(struct uring *ring, unsigned wait_nr, int timeout_ms)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec      ts;
+    unsigned                      to_submit;
+    unsigned                      flags;
+    long                          ret;
+    
+    /* Publish the prepared entries; the kernel reads them once it sees the new tail. */
+    to_submit = ring->sqe_tail - ring->sqe_submitted;
+    atomic_store_explicit(ring->sq_ktail, ring->sqe_tail, memory_order_release);
+    
+    flags = 0;
+    memset(&arg, 0, sizeof(arg));
+    if (wait_nr > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeout_ms >= 0)
+        {
+            ts.tv_sec  = timeout_ms / 1000;                          // NOLINT(readability-magic-numbers) : ms per s
+            ts.tv_nsec = (long long) (timeout_ms % 1000) * 1000000; // NOLINT(readability-magic-numbers) : ns per ms
+            arg.ts     = (uint64_t) (uintptr_t) &ts;
+        }
+    }
+    if (to_submit == 0 && wait_nr == 0)
+    {
+        return 0;
+    }
+    
+    ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr, flags, (wait_nr > 0) ? &arg : NULL,
+                  (wait_nr > 0) ? sizeof(arg) : 0);
+    if (ret == -1)
+    {
+        if (errno == ETIME)
+        {
+            errno = 0;
+            ring->sqe_submitted = ring->sqe_tail;
+            return 0;
+        }
+        return -1;
+    }
+    ring->sqe_submitted += (unsigned) ret;
+    
+    return 0;
+}
+
+struct io_uring_cqe *ur_peek_cqe(struct uring *ring)
+{
+    unsigned head;
+    
+    head = atomic_load_explicit(ring->cq_khead, memory_order_relaxed);
+    if (head == atomic_load_explicit(ring->cq_ktail, memory_order_acquire))
+    {
+        return NULL;
+    }
+    
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void ur_cqe_seen(struct uring *ring)
+{
+    atomic_store_explicit(ring->cq_khead, atomic_load_explicit(ring->cq_khead, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+int ur_provide_buffers(struct uring *ring, uint16_t num_bufs, size_t buf_bytes)
+{
+    struct io_uring_buf_reg reg;
+    void                    *buf_ring;
+    
+    ring->buf_ring_bytes = num_bufs * sizeof(struct io_uring_buf);
+    buf_ring             = mmap(NULL, ring->buf_ring_bytes, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1,
+                                0);
+    if (buf_ring == MAP_FAILED)
+    {
+        return -1;
+    }
+    ring->buf_ring = (struct io_uring_buf_ring *) buf_ring;
+    
+    if ((ring->bufs = (uint8_t *) s_calloc(num_bufs, buf_bytes, __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return -1;
+    }
+    ring->buf_bytes = buf_bytes;
+    ring->num_bufs  = num_bufs;
+    
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t) (uintptr_t) buf_ring;
+    reg.ring_entries = num_bufs;
+    reg.bgid         = UR_BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    {
+        return -1;
+    }
+    
+    for (uint16_t bid = 0; bid < num_bufs; ++bid)
+    {
+        ur_return_buffer(ring, bid);
+    }
+    
+    return 0;
+}
+
+uint8_t *ur_buffer(struct uring *ring, uint16_t bid)
+{
+    return ring->bufs + (size_t) bid * ring->buf_bytes;
+}
+
+void ur_return_buffer(struct uring *ring, uint16_t bid)
+{
+    struct io_uring_buf *buf;
+    
+    buf       = &ring->buf_ring->bufs[ring->buf_tail & (ring->num_bufs - 1)];
+    buf->addr = (uint64_t) (uintptr_t) ur_buffer(ring, bid);
+    buf->len  = (uint32_t) ring->buf_bytes;
+    buf->bid  = bid;
+    
+    /* The kernel may take the buffer as soon as it sees the new tail. */
+    ++ring->buf_tail;
+    atomic_store_explicit((_Atomic uint16_t *) &ring->buf_ring->tail, ring->buf_tail, memory_order_release);
+}
+
+void ur_prep_recvmsg_multishot(struct io_uring_sqe *sqe, int fd, struct msghdr *msg, uint64_t user_data)
+{
+    sqe->opcode    = IORING_OP_RECVMSG;
+    sqe->fd        = fd;
+    sqe->addr      = (uint64_t) (uintptr_t) msg;
+    sqe->len       = 1;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = UR_BUFFER_GROUP;
+    sqe->user_data = user_data;
+}
+
+void ur_prep_sendmsg(struct io_uring_sqe *sqe, int fd, const struct msghdr *msg, uint64_t user_data)
+{
+    sqe->opcode    = IORING_OP_SENDMSG;
+    sqe->fd        = fd;
+    sqe->addr      = (uint64_t) (uintptr_t) msg;
+    sqe->len       = 1;
+    sqe->user_data = user_data;
+}
+
+void ur_prep_poll_multishot(struct io_uring_sqe *sqe, int fd, uint64_t user_data)
+{
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = fd;
+    sqe->len           = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data     = user_data;
+}
+
+void ur_prep_cancel(struct io_uring_sqe *sqe, uint64_t target, uint64_t user_data)
+{
+    sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+    sqe->fd        = -1;
+    sqe->addr      = target;
+    sqe->user_data = user_data;
+}
+
+uint8_t *ur_recvmsg_payload(const struct msghdr *msg, uint8_t *buffer, size_t len, struct sockaddr **addr,
+                            size_t *payload_len)
+{
+    struct io_uring_recvmsg_out out;
+    size_t                      offset;
+    
+    /* The buffer holds a header, the source address, the control data, then the payload. */
+    offset = sizeof(struct io_uring_recvmsg_out) + msg->msg_namelen + msg->msg_controllen;
+    if (len < offset)
+    {
+        return NULL;
+    }
+    memcpy(&out, buffer, sizeof(out));
+    
+    *addr        = (struct sockaddr *) (void *) (buffer + sizeof(struct io_uring_recvmsg_out)); /* Copied by callers. */
+    *payload_len = (out.payloadlen < len - offset) ? out.payloadlen : len - offset; /* Truncated if too long. */
+    
+    return buffer + offset;
+}
@@ -0,0 +1,109 @@
+#ifndef RELIABLE_UDP_BATCH_IO_H
+#define RELIABLE_UDP_BATCH_IO_H
+
+#include "event-loop.h"
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of datagrams received by one call to bio_recv, and queued before bio_send must flush.
+ */
+#define BIO_BATCH 64
+
+/**
+ * The most datagrams the kernel coalesces into one message received with UDP GRO.
+ */
+#define BIO_GRO_SEGMENTS 64
+
+/**
+ * bio_dgram
+ * <p>
+ * A datagram received or queued for sending.
+ * <ul>
+ * <li>fd: the socket the datagram was received on, or is to be sent from</li>
+ * <li>addr: the address the datagram was received from, or is to be sent to</li>
+ * <li>len: the number of bytes of the datagram in buffer</li>
+ * <li>buffer: the datagram; bytes past len are zero in received datagrams</li>
+ * <li>bundle: whether the queued datagram takes more messages bundled by bio_bundle</li>
+ * </ul>
+ * </p>
+ */
+struct bio_dgram
+{
+    int                fd;
+    struct sockaddr_in addr;
+    size_t             len;
+    uint8_t            *buffer;
+    bool               bundle;
+};
+
+/**
+ * batch_io
+ * <p>
+ * Moves datagrams in batches, so that the cost of a system call is shared by many datagrams. Received datagrams are
+ * read with one recvmmsg per batch; datagrams to send are queued and written with one sendmmsg per run of datagrams
+ * sent from the same socket. Messages bound for a peer which unpacks them may be bundled in one datagram instead.
+ * </p>
+ * <p>
+ * Where the kernel supports it, the cost of a datagram in the network stack is shared as well. With GSO, the queued
+ * datagrams of equal size bound for one address go to the kernel as a single message, split into datagrams as late
+ * as possible. With GRO, a burst of datagrams from one address arrives as a single message, split again into rx.
+ * <ul>
+ * <li>rx_bytes: the size of a receive buffer; longer datagrams are truncated</li>
+ * <li>tx_bytes: the size of a send buffer; longer datagrams are refused</li>
+ * <li>rx: the datagrams received by the last call to bio_recv; with GRO, up to BIO_GRO_SEGMENTS per message</li>
+ * <li>tx: the datagrams queued for sending</li>
+ * <li>num_tx: the number of queued datagrams</li>
+ * <li>loop: an event loop which sends datagrams itself; if set, queued datagrams are handed to it when flushed</li>
+ * <li>gso: whether queued datagrams are sent with UDP segmentation offload</li>
+ * <li>gro: whether datagrams are received with UDP receive offload</li>
+ * </ul>
+ * </p>
+ */
+struct batch_io
+{
+    size_t           rx_bytes;
+    size_t           tx_bytes;
+    struct bio_dgram rx[BIO_BATCH * BIO_GRO_SEGMENTS];
+    struct bio_dgram tx[BIO_BATCH];
+    size_t           num_tx;
+    struct event_loop *loop;
+    bool             gso;
+    bool             gro;
+    void             *impl;
+    
+    int (*bio_offload)(struct batch_io *, int);
+    
+    int (*bio_recv)(struct batch_io *, int);
+    
+    int (*bio_send)(struct batch_io *, int, const struct sockaddr_in *, const uint8_t *, size_t);
+    
+    int (*bio_bundle)(struct batch_io *, int, const struct sockaddr_in *, const uint8_t *, size_t);
+    
+    void (*bio_flush)(struct batch_io *);
+};
+
+/**
+ * init_batch_io
+ * <p>
+ * Constructor. Allocate memory for a batch I/O layer and its buffers, and initialize function pointers.
+ * </p>
+ * @param rx_bytes - the size of a receive buffer
+ * @param tx_bytes - the size of a send buffer
+ * @return a pointer to the new batch I/O layer, NULL on failure
+ */
+struct batch_io *init_batch_io(size_t rx_bytes, size_t tx_bytes);
+
+/**
+ * free_batch_io
+ * <p>
+ * Free the batch I/O layer and its buffers. Queued datagrams are not sent.
+ * </p>
+ * @param bio - the batch I/O layer to free
+ * @return 0 on success, -1 if the batch I/O layer is NULL
+ */
+int free_batch_io(struct batch_io *bio);
+
+#endif //RELIABLE_UDP_BATCH_IO_H
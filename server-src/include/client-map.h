@@ -0,0 +1,70 @@
+#ifndef RELIABLE_UDP_CLIENT_MAP_H
+#define RELIABLE_UDP_CLIENT_MAP_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * client_map
+ * <p>
+ * An open-addressing hash table, with linear probing, mapping client addresses (IPv4 address and port) to connected
+ * clients. Used to find the client that sent a message when all clients share the server socket. A map may be keyed
+ * by connection IDs instead, through the _id operations; the two kinds of key are not mixed in one map.
+ * <ul>
+ * <li>slots: the table; a slot with a NULL client is empty</li>
+ * <li>capacity: the number of slots; always a power of two</li>
+ * <li>count: the number of occupied slots</li>
+ * </ul>
+ * </p>
+ */
+struct client_map
+{
+    struct client_map_slot *slots;
+    size_t                 capacity;
+    size_t                 count;
+    
+    struct conn_client *(*cm_get)(const struct client_map *, const struct sockaddr_in *);
+    
+    int (*cm_put)(struct client_map *, const struct sockaddr_in *, struct conn_client *);
+    
+    int (*cm_remove)(struct client_map *, const struct sockaddr_in *);
+    
+    struct conn_client *(*cm_get_id)(const struct client_map *, uint64_t);
+    
+    int (*cm_put_id)(struct client_map *, uint64_t, struct conn_client *);
+    
+    int (*cm_remove_id)(struct client_map *, uint64_t);
+};
+
+/**
+ * init_client_map
+ * <p>
+ * Constructor. Allocate memory for an empty client map and initialize function pointers.
+ * </p>
+ * @return a pointer to the new client map, NULL on failure
+ */
+struct client_map *init_client_map(void);
+
+/**
+ * free_client_map
+ * <p>
+ * Free the client map and its table. The clients in the map are not freed.
+ * </p>
+ * @param map - the client map to free
+ * @return 0 on success, -1 if the client map is NULL
+ */
+int free_client_map(struct client_map *map);
+
+/**
+ * sockaddr_in_equal
+ * <p>
+ * Compare the IPv4 address and port of two socket addresses.
+ * </p>
+ * @param a - the first address
+ * @param b - the second address
+ * @return non-zero if the addresses are equal, 0 otherwise
+ */
+int sockaddr_in_equal(const struct sockaddr_in *a, const struct sockaddr_in *b);
+
+#endif //RELIABLE_UDP_CLIENT_MAP_H
@@ -0,0 +1,79 @@
+#ifndef RELIABLE_UDP_CONN_TABLE_H
+#define RELIABLE_UDP_CONN_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The number of slots in a chunk of a connection table. Slots are allocated a chunk at a time, and never move.
+ */
+#define CT_CHUNK_SLOTS 64
+
+/**
+ * conn_handle
+ * <p>
+ * Refers to a client by its slot in the connection table, and the generation of the slot when the client was given
+ * it. A slot's generation changes when its client is removed, so a handle kept past the client's removal resolves to
+ * nothing instead of to whichever client has the slot next. Generation 0 is never given out: a zeroed handle refers
+ * to no client.
+ * </p>
+ */
+struct conn_handle
+{
+    uint32_t index;
+    uint32_t generation;
+};
+
+/**
+ * conn_table
+ * <p>
+ * Holds the connected clients of a shard, each in a slot with its address and packets. Slots are allocated in
+ * chunks which never move, so a client stays at the same address while it is connected; the slots of removed clients
+ * are reused through a free list. The indices of the slots in use are kept densely packed, so the clients are iterated
+ * without looking at free slots. Inserting, removing and resolving a handle take constant time.
+ * <ul>
+ * <li>chunks, num_chunks: the chunks of CT_CHUNK_SLOTS slots</li>
+ * <li>first_free: the index of the first free slot; UINT32_MAX if there is none</li>
+ * <li>live: the indices of the slots in use, in no particular order</li>
+ * <li>count: the number of clients</li>
+ * </ul>
+ * </p>
+ */
+struct conn_table
+{
+    struct ct_slot **chunks;
+    size_t         num_chunks;
+    uint32_t       first_free;
+    uint32_t       *live;
+    size_t         count;
+    
+    struct conn_client *(*ct_insert)(struct conn_table *);
+    
+    void (*ct_remove)(struct conn_table *, struct conn_client *);
+    
+    struct conn_client *(*ct_get)(const struct conn_table *, struct conn_handle);
+    
+    struct conn_client *(*ct_at)(const struct conn_table *, size_t);
+};
+
+/**
+ * init_conn_table
+ * <p>
+ * Constructor. Allocate memory for an empty connection table and initialize function pointers.
+ * </p>
+ * @return a pointer to the new connection table, NULL on failure
+ */
+struct conn_table *init_conn_table(void);
+
+/**
+ * free_conn_table
+ * <p>
+ * Free every slot, and the connection table. The sockets of the clients are not closed.
+ * </p>
+ * @param table - the connection table to free
+ * @return 0 on success, -1 if the connection table is NULL
+ */
+int free_conn_table(struct conn_table *table);
+
+#endif //RELIABLE_UDP_CONN_TABLE_H
@@ -0,0 +1,120 @@
+#ifndef RELIABLE_UDP_EVENT_LOOP_H
+#define RELIABLE_UDP_EVENT_LOOP_H
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of ready events collected by a single call to el_wait.
+ */
+#define EL_MAX_EVENTS 64
+
+/**
+ * el_backend
+ * <p>
+ * The readiness notification mechanisms an event loop can be built on.
+ * <ul>
+ * <li>EL_BACKEND_SELECT: portable select(); limited to descriptors below FD_SETSIZE</li>
+ * <li>EL_BACKEND_EPOLL: edge-triggered epoll; Linux only</li>
+ * <li>EL_BACKEND_URING: io_uring; Linux only, and only if built with HAVE_IO_URING. Sockets registered with
+ * el_add_recv are read by the kernel ahead of time, and sends are submitted together with the next wait</li>
+ * </ul>
+ * </p>
+ */
+enum el_backend
+{
+    EL_BACKEND_SELECT,
+    EL_BACKEND_EPOLL,
+    EL_BACKEND_URING
+};
+
+/**
+ * el_event
+ * <p>
+ * A file descriptor reported ready for reading, and the data it was registered with. The data of an event is set to
+ * NULL if its descriptor is removed from the loop before the event is dispatched.
+ * </p>
+ * <p>
+ * If the backend received a message on the descriptor itself, the event carries the message instead: buffer holds
+ * the message, zero-padded up to the number of bytes given to el_add_recv, and addr its source. The buffer is valid
+ * until the next el_wait. Otherwise, buffer is NULL and the descriptor must be read until it would block.
+ * </p>
+ */
+struct el_event
+{
+    int  fd;
+    void *data;
+    
+    uint8_t            *buffer;
+    size_t             len;
+    struct sockaddr_in addr;
+};
+
+/**
+ * event_loop
+ * <p>
+ * Monitors a set of file descriptors for read readiness. Descriptors are registered once with el_add and stay
+ * registered until el_remove; el_wait reports only those descriptors which are ready. With the epoll and io_uring
+ * backends, readiness is edge-triggered: a ready descriptor must be read until it would block.
+ * </p>
+ * <p>
+ * el_add_recv registers a datagram socket whose messages the backend may receive itself; el_send is set only by
+ * backends which send, and queues a datagram to be sent with the next el_wait.
+ * </p>
+ */
+struct event_loop
+{
+    enum el_backend backend;
+    void            *impl;
+    
+    struct el_event ready[EL_MAX_EVENTS];
+    size_t          num_ready;
+    size_t          next_ready;
+    
+    int (*el_add)(struct event_loop *, int, void *);
+    
+    int (*el_add_recv)(struct event_loop *, int, void *, size_t);
+    
+    int (*el_remove)(struct event_loop *, int);
+    
+    int (*el_send)(struct event_loop *, int, const struct sockaddr_in *, const uint8_t *, size_t);
+    
+    int (*el_wait)(struct event_loop *, int);
+    
+    struct el_event *(*el_next)(struct event_loop *);
+};
+
+/**
+ * init_event_loop
+ * <p>
+ * Constructor. Allocate memory for an event loop and set up the requested backend. If io_uring is not available on
+ * this platform or kernel, fall back to the epoll backend; if epoll is not available, fall back to the select backend.
+ * </p>
+ * @param backend - the backend to use
+ * @return a pointer to the new event loop, NULL on failure
+ */
+struct event_loop *init_event_loop(enum el_backend backend);
+
+/**
+ * free_event_loop
+ * <p>
+ * Release the backend resources of an event loop, then free the event loop.
+ * </p>
+ * @param loop - the event loop to free
+ * @return 0 on success, -1 if the event loop is NULL
+ */
+int free_event_loop(struct event_loop *loop);
+
+/**
+ * parse_el_backend
+ * <p>
+ * Convert the name of an event loop backend into an el_backend. Sets errno to ENOTRECOVERABLE if the name is unknown.
+ * </p>
+ * @param name - the name of the backend: "select", "epoll" or "uring"
+ * @return the backend
+ */
+enum el_backend parse_el_backend(const char *name);
+
+#endif //RELIABLE_UDP_EVENT_LOOP_H
@@ -0,0 +1,165 @@
+#ifndef RELIABLE_UDP_GAME_POOL_H
+#define RELIABLE_UDP_GAME_POOL_H
+
+#include "Game.h"
+#include "mpsc-ring.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The largest number of game worker threads the server may be run with.
+ */
+#define GP_MAX_WORKERS 64
+
+/**
+ * The most moves one task carries. Moves received for a room while its task is with the game workers wait in the
+ * room for the next task.
+ */
+#define GP_MAX_MOVES 16
+
+/**
+ * The number of tasks each game worker's inbox holds.
+ */
+#define GP_INBOX_CAPACITY 256
+
+/**
+ * The most tasks an I/O thread may have out with the game workers at once; the returned tasks always fit in its queue.
+ */
+#define GP_RESULTS_CAPACITY 1024
+
+/**
+ * The most returned tasks an I/O thread collects at once.
+ */
+#define GP_COLLECT_BATCH 64
+
+/**
+ * gp_move
+ * <p>
+ * A move received from a player: where the cursor moved to, and whether the player placed a mark there.
+ * </p>
+ */
+struct gp_move
+{
+    uint8_t cursor;
+    bool    place;
+};
+
+/**
+ * gp_task
+ * <p>
+ * The moves of one room, handed by an I/O thread to the game workers, and handed back once played. The task carries a
+ * copy of the room's game; the I/O thread keeps the room and reads its game while the task is out, and takes the
+ * played game back when the task returns.
+ * <ul>
+ * <li>results: the queue of the I/O thread the task is returned to</li>
+ * <li>room_id, epoch: the room the moves were made in, and the epoch of its game the moves were made against</li>
+ * <li>game: a copy of the room's game; the moves are played on it</li>
+ * <li>moves, num_moves: the moves to play, in the order they were received</li>
+ * <li>game_over: whether the game is over once the moves have been played</li>
+ * </ul>
+ * </p>
+ */
+struct gp_task
+{
+    struct gp_results *results;
+    
+    uint32_t    room_id;
+    uint64_t    epoch;
+    struct Game game;
+    
+    struct gp_move moves[GP_MAX_MOVES];
+    size_t         num_moves;
+    bool           game_over;
+};
+
+/**
+ * gp_results
+ * <p>
+ * The tasks played by the game workers for one I/O thread: a ring the workers push to, and the I/O thread pops from
+ * in batches. The first worker to return a task since the I/O thread last collected writes to event_fd, which the I/O
+ * thread watches with its event loop.
+ * <ul>
+ * <li>ring: the returned tasks</li>
+ * <li>event_fd: an eventfd, readable while tasks have been returned and not collected</li>
+ * <li>signalled: whether event_fd has been written to since the I/O thread last collected</li>
+ * <li>num_out: the number of the I/O thread's tasks not yet collected; only used by the I/O thread</li>
+ * </ul>
+ * </p>
+ */
+struct gp_results
+{
+    struct mpsc_ring *ring;
+    int              event_fd;
+    atomic_bool      signalled;
+    size_t           num_out;
+    
+    size_t (*gp_collect)(struct gp_results *, struct gp_task *[GP_COLLECT_BATCH]);
+};
+
+/**
+ * game_pool
+ * <p>
+ * A pool of game worker threads which play the moves of rooms away from the I/O threads, so that a busy room does not
+ * hold up the sockets. The I/O threads submit tasks to the lock-free inboxes of the workers, so no I/O thread waits
+ * on another or on a worker. Each worker moves the tasks of its inbox to a deque of its own: it takes tasks from the
+ * bottom, and idle workers steal from the top. A room has at most one task out at a time, so its moves are played in
+ * order.
+ * <ul>
+ * <li>num_workers, workers: the game worker threads</li>
+ * <li>running: cleared to stop the workers</li>
+ * </ul>
+ * </p>
+ */
+struct game_pool
+{
+    size_t           num_workers;
+    struct gp_worker *workers;
+    atomic_bool      running;
+    
+    int (*gp_submit)(struct game_pool *, struct gp_task *);
+};
+
+/**
+ * init_game_pool
+ * <p>
+ * Constructor. Allocate memory for a game pool, initialize function pointers, and start its worker threads.
+ * </p>
+ * @param num_workers - the number of game worker threads
+ * @return a pointer to the new game pool, NULL on failure
+ */
+struct game_pool *init_game_pool(size_t num_workers);
+
+/**
+ * free_game_pool
+ * <p>
+ * Stop the worker threads and wait for them to finish, then free the tasks they had not played and the game pool.
+ * The queues the tasks were to be returned to are not touched.
+ * </p>
+ * @param pool - the game pool to free
+ * @return 0 on success, -1 if the game pool is NULL
+ */
+int free_game_pool(struct game_pool *pool);
+
+/**
+ * init_gp_results
+ * <p>
+ * Constructor. Allocate memory for an empty queue of played tasks and its eventfd, and initialize function pointers.
+ * </p>
+ * @return a pointer to the new queue, NULL on failure
+ */
+struct gp_results *init_gp_results(void);
+
+/**
+ * free_gp_results
+ * <p>
+ * Free the tasks returned and not collected, close the eventfd, and free the queue. No game worker may return a task
+ * to the queue afterwards.
+ * </p>
+ * @param results - the queue to free
+ * @return 0 on success, -1 if the queue is NULL
+ */
+int free_gp_results(struct gp_results *results);
+
+#endif //RELIABLE_UDP_GAME_POOL_H
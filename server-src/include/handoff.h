@@ -0,0 +1,115 @@
+#ifndef RELIABLE_UDP_HANDOFF_H
+#define RELIABLE_UDP_HANDOFF_H
+
+#include "server-util.h"
+
+/**
+ * A server is restarted without dropping its clients by handing its state off to the server which replaces it. Both
+ * are run with the same handoff path. The successor connects to the unix socket its predecessor listens on at that
+ * path, and the predecessor stops serving: it lets the game workers finish the moves in play, then sends the sockets
+ * of each shard and of its clients with SCM_RIGHTS, together with the rooms and the connections. The successor serves
+ * the clients on the same sockets, so their datagrams wait in the socket buffers during the handoff, and clients see
+ * no more than a delay. The successor then listens on the path for a successor of its own.
+ */
+
+/**
+ * ho_connect
+ * <p>
+ * Connect to a predecessor listening on the handoff path, and ask it to hand off. If one accepts, wait for it to stop,
+ * and take its configuration: the number of shards, and whether clients share the server socket. If no server
+ * listens on the path, do nothing; the server starts without clients.
+ * </p>
+ * @param set - the server settings
+ * @return 0 on success, or if there is no predecessor, -1 on failure
+ */
+int ho_connect(struct server_settings *set);
+
+/**
+ * ho_recv_shard
+ * <p>
+ * Take over the next shard of the predecessor: its server socket, its rooms, and its clients with their sockets. The
+ * shard must be initialized and empty. The sockets are not yet registered with the event loop, and the
+ * retransmission timers are not yet armed.
+ * </p>
+ * @param set - the server settings
+ * @param shard - the settings of the shard
+ * @return 0 on success, -1 on failure
+ */
+int ho_recv_shard(const struct server_settings *set, struct server_settings *shard);
+
+/**
+ * ho_finish
+ * <p>
+ * Check that the predecessor has sent every shard, and close the connection to it.
+ * </p>
+ * @param set - the server settings
+ * @return 0 on success, -1 on failure
+ */
+int ho_finish(struct server_settings *set);
+
+/**
+ * ho_listen
+ * <p>
+ * Listen on the handoff path for a successor, replacing whatever was left there, and register the socket with the
+ * event loop.
+ * </p>
+ * @param set - the server settings
+ * @return 0 on success, -1 on failure
+ */
+int ho_listen(struct server_settings *set);
+
+/**
+ * ho_accept
+ * <p>
+ * Accept the successors waiting on the handoff socket. The first whose request can be served is kept as the
+ * connection to hand off through; the others are refused.
+ * </p>
+ * @param set - the server settings
+ * @return true if a successor was accepted and the server must stop
+ */
+bool ho_accept(struct server_settings *set);
+
+/**
+ * ho_send_config
+ * <p>
+ * Send the configuration of the server to the successor: the number of shards, and whether clients share the server
+ * socket.
+ * </p>
+ * @param set - the server settings
+ * @return 0 on success, -1 on failure
+ */
+int ho_send_config(const struct server_settings *set);
+
+/**
+ * ho_send_shard
+ * <p>
+ * Send a shard to the successor: its server socket, its rooms, and its clients with their sockets. No task of the
+ * shard may be with the game workers.
+ * </p>
+ * @param set - the server settings
+ * @param shard - the settings of the shard
+ * @return 0 on success, -1 on failure
+ */
+int ho_send_shard(const struct server_settings *set, const struct server_settings *shard);
+
+/**
+ * ho_send_done
+ * <p>
+ * Tell the successor every shard has been sent.
+ * </p>
+ * @param set - the server settings
+ * @return 0 on success, -1 on failure
+ */
+int ho_send_done(const struct server_settings *set);
+
+/**
+ * close_handoff
+ * <p>
+ * Close the handoff sockets. The handoff path is removed, unless the server handed off: it then belongs to the
+ * successor.
+ * </p>
+ * @param set - the server settings
+ */
+void close_handoff(struct server_settings *set);
+
+#endif //RELIABLE_UDP_HANDOFF_H
@@ -0,0 +1,78 @@
+#ifndef RELIABLE_UDP_MPSC_RING_H
+#define RELIABLE_UDP_MPSC_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * The size of a cache line; the producers' and the consumer's ends of a ring are kept on separate lines.
+ */
+#define MR_CACHE_LINE 64
+
+/**
+ * mr_slot
+ * <p>
+ * A slot of a ring. Its sequence number says whose turn it is: equal to a position, the slot is free for the producer
+ * which claims that position; one past it, the slot holds the item at that position for the consumer.
+ * </p>
+ */
+struct mr_slot
+{
+    _Atomic size_t seq;
+    void           *item;
+};
+
+/**
+ * mpsc_ring
+ * <p>
+ * A bounded lock-free queue of pointers with many producers and a single consumer. Producers claim a position with
+ * a compare-and-swap on the tail and publish the item through the slot's sequence number; they never wait on each
+ * other or on the consumer. A full ring refuses the item, and leaves it to the producer to hold it back. The consumer
+ * takes items in batches without any atomic read-modify-write.
+ * <ul>
+ * <li>tail: the next position to be claimed by a producer</li>
+ * <li>head: the next position to be taken by the consumer; only used by the consumer</li>
+ * <li>capacity: the number of slots; a power of two</li>
+ * <li>slots: the slots, indexed by position modulo capacity</li>
+ * </ul>
+ * </p>
+ */
+struct mpsc_ring
+{
+    _Atomic size_t tail;
+    char           tail_pad[MR_CACHE_LINE - sizeof(size_t)];
+    size_t         head;
+    char           head_pad[MR_CACHE_LINE - sizeof(size_t)];
+    
+    size_t         capacity;
+    struct mr_slot *slots;
+    
+    int (*mr_push)(struct mpsc_ring *, void *);
+    
+    size_t (*mr_pop_batch)(struct mpsc_ring *, void **, size_t);
+    
+    bool (*mr_is_empty)(struct mpsc_ring *);
+};
+
+/**
+ * init_mpsc_ring
+ * <p>
+ * Constructor. Allocate memory for an empty ring, and initialize function pointers.
+ * </p>
+ * @param capacity - the number of items the ring holds; rounded up to a power of two
+ * @return a pointer to the new ring, NULL on failure
+ */
+struct mpsc_ring *init_mpsc_ring(size_t capacity);
+
+/**
+ * free_mpsc_ring
+ * <p>
+ * Free the ring. The items still in it are not freed.
+ * </p>
+ * @param ring - the ring to free
+ * @return 0 on success, -1 if the ring is NULL
+ */
+int free_mpsc_ring(struct mpsc_ring *ring);
+
+#endif //RELIABLE_UDP_MPSC_RING_H
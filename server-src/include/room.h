@@ -0,0 +1,128 @@
+#ifndef RELIABLE_UDP_ROOM_H
+#define RELIABLE_UDP_ROOM_H
+
+#include "conn-table.h"
+#include "game-pool.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The number of players in a full room; a match starts once its room is full.
+ */
+#define ROOM_CAPACITY 2
+
+/**
+ * room
+ * <p>
+ * A single match: the game, the clients seated in it, and whether the game state must be broadcast to them.
+ * <ul>
+ * <li>id: the room's index in the room table</li>
+ * <li>game: the game played in this room</li>
+ * <li>players: the handles of the clients in each seat; zeroed if the seat is open. The player in seat N moves when
+ * the game turn modulo ROOM_CAPACITY is N</li>
+ * <li>num_players: the number of occupied seats</li>
+ * <li>do_broadcast: whether the room is on the table's broadcast list</li>
+ * <li>next_broadcast: the next room on the broadcast list</li>
+ * <li>prev_open, next_open: neighbours on the table's list of rooms with open seats</li>
+ * <li>epoch: identifies the room's game until it is reset; a task played against an earlier epoch is discarded</li>
+ * <li>moves, num_moves: the moves received which have not yet been handed to the game workers</li>
+ * <li>in_play: whether a task for the room is with the game workers</li>
+ * <li>stalled: whether the room is on the table's stalled list: its moves were refused by the game workers</li>
+ * <li>next_stalled: the next room on the stalled list</li>
+ * </ul>
+ * </p>
+ */
+struct room
+{
+    uint32_t           id;
+    struct Game        *game;
+    struct conn_handle players[ROOM_CAPACITY];
+    uint8_t            num_players;
+    
+    bool        do_broadcast;
+    struct room *next_broadcast;
+    
+    struct room *prev_open;
+    struct room *next_open;
+    
+    uint64_t       epoch;
+    struct gp_move moves[GP_MAX_MOVES];
+    size_t         num_moves;
+    bool           in_play;
+    
+    bool        stalled;
+    struct room *next_stalled;
+};
+
+/**
+ * room_table
+ * <p>
+ * Holds every room on the server. Rooms are created when a client connects and no room has an open seat, and
+ * destroyed when their last player leaves. Room ids are recycled through a free list.
+ * <ul>
+ * <li>rooms: the rooms, indexed by id; NULL if the id is free</li>
+ * <li>capacity: the length of rooms</li>
+ * <li>count: the number of rooms in use</li>
+ * <li>free_ids: a stack of ids below capacity which are not in use</li>
+ * <li>num_free: the number of ids on the free_ids stack</li>
+ * <li>first_open: the head of the list of rooms with an open seat</li>
+ * <li>first_broadcast: the head of the list of rooms whose game state must be broadcast</li>
+ * <li>first_stalled: the head of the list of rooms whose moves must be submitted to the game workers again</li>
+ * <li>epochs: the last epoch given to a game</li>
+ * </ul>
+ * </p>
+ */
+struct room_table
+{
+    struct room **rooms;
+    size_t      capacity;
+    size_t      count;
+    uint32_t    *free_ids;
+    size_t      num_free;
+    
+    struct room *first_open;
+    struct room *first_broadcast;
+    struct room *first_stalled;
+    
+    uint64_t epochs;
+    
+    struct room *(*rt_join)(struct room_table *, struct conn_client *);
+    
+    void (*rt_leave)(struct room_table *, struct conn_client *);
+    
+    struct room *(*rt_open)(struct room_table *);
+    
+    void (*rt_seat)(struct room_table *, struct room *, struct conn_client *, uint8_t);
+    
+    void (*rt_replace)(struct room_table *, struct conn_client *, struct conn_client *);
+    
+    void (*rt_mark_broadcast)(struct room_table *, struct room *);
+    
+    struct room *(*rt_next_broadcast)(struct room_table *);
+    
+    void (*rt_mark_stalled)(struct room_table *, struct room *);
+    
+    struct room *(*rt_next_stalled)(struct room_table *);
+};
+
+/**
+ * init_room_table
+ * <p>
+ * Constructor. Allocate memory for an empty room table and initialize function pointers.
+ * </p>
+ * @return a pointer to the new room table, NULL on failure
+ */
+struct room_table *init_room_table(void);
+
+/**
+ * free_room_table
+ * <p>
+ * Free every room, its game, and the room table. The clients seated in the rooms are not freed.
+ * </p>
+ * @param table - the room table to free
+ * @return 0 on success, -1 if the room table is NULL
+ */
+int free_room_table(struct room_table *table);
+
+#endif //RELIABLE_UDP_ROOM_H
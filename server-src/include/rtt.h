@@ -0,0 +1,105 @@
+#ifndef RELIABLE_UDP_RTT_H
+#define RELIABLE_UDP_RTT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The retransmission timeout before the round-trip time has been measured, in milliseconds.
+ */
+#define RTT_INITIAL_RTO_MS 1000
+
+/**
+ * The bounds of the retransmission timeout, in milliseconds. The lower bound keeps a timeout from firing before a
+ * delayed ACK can arrive; the upper bound caps the backoff.
+ */
+#define RTT_MIN_RTO_MS 200
+#define RTT_MAX_RTO_MS 8000
+
+/**
+ * The granularity of the clock the timeouts are measured with, in milliseconds. The variance term of the timeout is
+ * never less than this.
+ */
+#define RTT_GRANULARITY_MS 10
+
+/**
+ * rtt_estimator
+ * <p>
+ * Estimates the round-trip time of a connection, and derives its retransmission timeout (Jacobson/Karels, as in
+ * RFC 6298). One packet at a time is timed from its first transmission to the ACK which covers it. Following Karn's
+ * rule, the timing is abandoned if the packet is retransmitted, since the ACK could answer either copy; the timeout
+ * doubles on each retransmission, and keeps its backed-off value until a packet sent once is ACKed.
+ * <ul>
+ * <li>srtt: the smoothed round-trip time, in eighths of a millisecond</li>
+ * <li>rttvar: the round-trip time variation, in quarters of a millisecond</li>
+ * <li>rto_ms: the retransmission timeout, in milliseconds</li>
+ * <li>measured: whether a round-trip time has been measured</li>
+ * <li>timing: whether a packet is being timed</li>
+ * <li>timed_seq: the sequence number of the packet being timed</li>
+ * <li>timed_ms: the time the packet being timed was sent, in milliseconds</li>
+ * </ul>
+ * </p>
+ */
+struct rtt_estimator
+{
+    uint32_t srtt;
+    uint32_t rttvar;
+    uint32_t rto_ms;
+    bool     measured;
+    
+    bool     timing;
+    uint32_t timed_seq;
+    uint64_t timed_ms;
+};
+
+/**
+ * rtt_init
+ * <p>
+ * Initialize an estimator which has not measured a round-trip time: its timeout is RTT_INITIAL_RTO_MS.
+ * </p>
+ * @param rtt - the estimator
+ */
+void rtt_init(struct rtt_estimator *rtt);
+
+/**
+ * rtt_start
+ * <p>
+ * Start timing a packet on its first transmission, unless another packet is being timed.
+ * </p>
+ * @param rtt - the estimator
+ * @param seq_num - the sequence number of the packet
+ * @param now_ms - the current time, in milliseconds
+ */
+void rtt_start(struct rtt_estimator *rtt, uint32_t seq_num, uint64_t now_ms);
+
+/**
+ * rtt_ack
+ * <p>
+ * Note that the packets up to and including a sequence number have been ACKed. If they include the packet being
+ * timed, its round-trip time is a sample: the estimates and the timeout are updated, and any backoff is dropped.
+ * </p>
+ * @param rtt - the estimator
+ * @param seq_num - the sequence number of the last packet ACKed
+ * @param now_ms - the current time, in milliseconds
+ */
+void rtt_ack(struct rtt_estimator *rtt, uint32_t seq_num, uint64_t now_ms);
+
+/**
+ * rtt_stop
+ * <p>
+ * Abandon the timing of a packet, because a packet was retransmitted.
+ * </p>
+ * @param rtt - the estimator
+ */
+void rtt_stop(struct rtt_estimator *rtt);
+
+/**
+ * rtt_backoff
+ * <p>
+ * Double the timeout after it expires, up to RTT_MAX_RTO_MS, and abandon the timing of a packet.
+ * </p>
+ * @param rtt - the estimator
+ */
+void rtt_backoff(struct rtt_estimator *rtt);
+
+#endif //RELIABLE_UDP_RTT_H
@@ -5,14 +5,20 @@
 #ifndef RELIABLE_UDP_SERVER_UTIL_HPP
 #define RELIABLE_UDP_SERVER_UTIL_HPP
 
-#include "../include/server-util.h"
+#include "../include/Game.h"
+#include "../include/batch-io.h"
+#include "../include/conn-table.h"
+#include "../include/event-loop.h"
+#include "../include/game-pool.h"
+#include "../include/rtt.h"
+#include "../include/siphash.h"
+#include "../include/timer-wheel.h"
 #include <errno.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 
@@ -26,11 +32,27 @@
  */
 #define GAME_RECV_BYTES 2
 
+/**
+ * The standard number of bytes in a payload; the size of the game data.
+ * The game data is a uint8_t cursor, a char turn indicator, and a 9 B game state array.
+ */
+#define STD_PAYLOAD_BYTES (sizeof(uint8_t) + sizeof(char) + GAME_STATE_BYTES)
+
 /**
  * The maximum sequence number.
  */
 #define MAX_SEQ (uint8_t) 255
 
+/**
+ * Protocol versions. Version 1 is stop-and-wait with 8-bit sequence numbers; version 2 has 32-bit sequence numbers, a
+ * send window, and cumulative ACKs, which a receiver holding packets out of sequence may extend with a selective ACK
+ * (FLAG_SAK). A client offers version 2 in the payload of its SYN, which a version 1 server ignores; the server accepts
+ * by answering with an offer of its own in the payload of the SYN/ACK. The handshake is framed as in version 1 either
+ * way, and every packet after it as in the negotiated version.
+ */
+#define PROTO_V1 (uint8_t) 1
+#define PROTO_V2 (uint8_t) 2
+
 /**
  * Bit masks for flags. Bitwise OR these to make combinations of flags (eg: FIN/ACK = FLAG_FIN | FLAG_ACK)
  * When checking if a packet has certain flags, combine flags and check equality
@@ -41,6 +63,9 @@
 #define FLAG_SYN (uint8_t) 4  // 0000 0100
 #define FLAG_FIN (uint8_t) 8  // 0000 1000
 #define FLAG_TRN (uint8_t) 16 // 0001 0000
+#define FLAG_SAK (uint8_t) 32 // 0010 0000
+#define FLAG_CID (uint8_t) 64 // 0100 0000
+#define FLAG_TKT (uint8_t) 128 // 1000 0000
 
 /**
  * The number of bytes of a packet before the payload is attached.
@@ -48,9 +73,199 @@
 #define HLEN_BYTES 4
 
 /**
- * The maximum number of clients that can communicate with the server at once.
+ * The number of bytes of a version 2 packet before the payload is attached: flags, window, length, sequence number and
+ * ACK number.
+ */
+#define HLEN_V2_BYTES 12
+
+/**
+ * The number of bytes of the selective ACK a version 2 packet carries after its header when FLAG_SAK is set: a bitmap
+ * of the packets received beyond the ACK number.
+ */
+#define SACK_BYTES 4
+
+/**
+ * The number of bytes of the connection ID a version 2 packet from a client carries after its header, and after its
+ * selective ACK if any, when FLAG_CID is set. The first byte is the index of the server's shard which holds the
+ * connection; the rest are random, so that only the client, and the paths its packets take, know the ID.
+ */
+#define CID_BYTES 8
+
+/**
+ * The number of bytes of the offer in the payload of a SYN or SYN/ACK: the version, the window, and the sequence
+ * number of the first packet the offering side sends after the handshake.
+ */
+#define OFFER_BYTES 6
+
+/**
+ * The options a client may add in a byte after its offer, and their bits; a server which knows none ignores the byte.
+ * OPT_BUNDLE: the client takes datagrams which bundle several version 2 packets, one after another. Each header gives
+ * the size of its packet, so the packets need no other framing.
+ * OPT_COOKIE: the client returns a SYN cookie. The server answers its SYN without keeping any state, with a cookie
+ * after the options it took; the client echoes its SYN payload and the SYN/ACK payload in the ACK of the handshake,
+ * and the server connects it only if the cookie is one it made, for the address it came from, and recently.
+ * OPT_CID: the server gives the client a connection ID, after the options it took. The client sends it in every
+ * version 2 packet, so the server finds the connection, and follows it, when the client's address changes.
+ * OPT_TICKET: the server gives the client a resumption ticket once it is seated. A client whose connection is
+ * interrupted appends the ticket to the options of its next SYN, and is seated again where it sat.
+ */
+#define OPT_BYTES 1
+#define OPT_BUNDLE (uint8_t) 1
+#define OPT_DELTA (uint8_t) 2
+#define OPT_COOKIE (uint8_t) 4
+#define OPT_CID (uint8_t) 8
+#define OPT_TICKET (uint8_t) 16
+
+/**
+ * The number of bytes of a SYN cookie: the time it was made, in milliseconds, and the MAC of the handshake under the
+ * server's key.
+ */
+#define COOKIE_BYTES 12
+
+/**
+ * The number of bytes of a resumption ticket: the index of the shard which seated the client, its seat, the id of its
+ * room and the ticket ID the server gave the connection, then the MAC of these under the server's key. It is sent in
+ * the payload of a sequenced packet with FLAG_TKT, and names the seat only while the connection it was given to holds
+ * it; the server gives a new one to each connection.
+ */
+#define TICKET_BYTES 22
+
+/**
+ * The largest payload of a SYN/ACK: the offer, the options taken, a connection ID and a cookie.
+ */
+#define MAX_SYN_ACK_BYTES (OFFER_BYTES + OPT_BYTES + CID_BYTES + COOKIE_BYTES)
+
+/**
+ * The largest number of bytes the ACK of a handshake with OPT_COOKIE echoes: the payload of the SYN, and the payload
+ * of the SYN/ACK, cookie included.
+ */
+#define COOKIE_ECHO_BYTES (OFFER_BYTES + OPT_BYTES + MAX_SYN_ACK_BYTES)
+
+/**
+ * The number of bytes of the payload a client keeps until it is ACKed: a game state, or the answer of a SYN/ACK.
+ */
+#define S_PAYLOAD_BYTES ((STD_PAYLOAD_BYTES > MAX_SYN_ACK_BYTES) ? STD_PAYLOAD_BYTES : MAX_SYN_ACK_BYTES)
+
+/**
+ * The game states a version 2 connection with OPT_DELTA sends are versioned. Each begins with its version and the
+ * version of the state it is based on, in STATE_HDR_BYTES. A keyframe is based on itself, and carries the whole state;
+ * any other state carries the bytes which changed since its base, each as an offset into the state and a value.
+ */
+#define STATE_HDR_BYTES 4
+
+/**
+ * The number of game states each side of a connection with OPT_DELTA keeps, each at its version modulo
+ * STATE_HISTORY. A state is based only on one less than STATE_HISTORY versions older, so the client still holds it.
+ */
+#define STATE_HISTORY 16
+
+/**
+ * The largest payload of a game state: a keyframe.
+ */
+#define MAX_STATE_BYTES (STATE_HDR_BYTES + STD_PAYLOAD_BYTES)
+
+/**
+ * The largest message the server receives: the ACK which returns a SYN cookie. A move in a version 2 packet is smaller.
+ */
+#define MAX_RECV_BYTES (HLEN_BYTES + COOKIE_ECHO_BYTES)
+
+/**
+ * The largest payload of a packet kept in the retransmission ring of a version 2 connection: a game state, or a
+ * ticket.
+ */
+#define MAX_PUSH_BYTES ((MAX_STATE_BYTES > TICKET_BYTES) ? MAX_STATE_BYTES : TICKET_BYTES)
+
+/**
+ * The largest message the server sends: a game state or a ticket in a version 2 packet.
+ */
+#define MAX_SEND_BYTES (HLEN_V2_BYTES + MAX_PUSH_BYTES)
+
+/**
+ * The number of packets the retransmission ring of a version 2 connection holds. A power of 2, so that a sequence
+ * number indexes the ring with a mask.
+ */
+#define SV_RTX_SLOTS 32
+
+/**
+ * The largest send window a version 2 connection may have, in packets. One slot of the ring is left over for the
+ * FIN/ACK, which is sent whether or not the window is full.
+ */
+#define SV_MAX_WINDOW (SV_RTX_SLOTS - 1)
+
+/**
+ * The send window of a version 2 connection when none is configured, in packets.
+ */
+#define SV_DEFAULT_WINDOW 8
+
+/**
+ * The number of duplicate ACKs after which a version 2 connection retransmits without waiting for its timeout, when
+ * none is configured. Lower than the 3 of TCP: a game keeps only a few packets in flight, so a loss is rarely followed
+ * by three more.
+ */
+#define SV_DEFAULT_DUP_THRESH 2
+
+/**
+ * The time a version 2 connection may hold back the ACK of a packet from its client, in milliseconds, so that the
+ * game state the packet leads to carries it. Well under RTT_MIN_RTO_MS, so the client does not time out first.
+ */
+#define SV_DELACK_MS 40
+
+/**
+ * The bounds of the path MTU the packets to a client are bundled up to, in bytes: the least MTU an IPv4 host must
+ * accept, and the MTU of Ethernet, which clients size their receive buffers for. The upper bound is the default.
+ */
+#define SV_MIN_MTU 576
+#define SV_MAX_MTU 1500
+
+/**
+ * The number of bytes of a datagram taken by its IPv4 and UDP headers.
+ */
+#define UDP_IP_HLEN_BYTES 28
+
+/**
+ * The largest number of worker threads the server may be run with.
+ */
+#define SV_MAX_WORKERS 64
+
+/**
+ * The time a SYN cookie is accepted for after it was made, in milliseconds: long enough for a client to retransmit the
+ * ACK which returns it a few times.
+ */
+#define SV_COOKIE_LIFETIME_MS 30000
+
+/**
+ * The time the seat of a client holding a ticket is kept after its connection times out, in milliseconds: long enough
+ * for the client to time out too, and resume.
+ */
+#define SV_SEAT_HOLD_MS 30000
+
+/**
+ * The largest number of half-open connections a shard holds for the clients which do not take OPT_COOKIE; their SYNs
+ * are dropped beyond it, so a flood of SYNs cannot exhaust the server's memory or sockets.
  */
-#define MAX_CLIENTS 2
+#define SV_MAX_HALF_OPEN 256
+
+/**
+ * conn_state
+ * <p>
+ * The state of a connection, as seen by the server. Each message from a client is handled according to the state of
+ * its connection, so no connection waits on another.
+ * <ul>
+ * <li>CONN_SYN_RCVD: a SYN was answered with a SYN/ACK; waiting for the ACK</li>
+ * <li>CONN_ESTABLISHED: the handshake is complete; the client is seated in a room</li>
+ * <li>CONN_LAST_ACK: a FIN was answered with a FIN/ACK and a FIN; waiting for the FIN/ACK</li>
+ * <li>CONN_HELD: the connection timed out, and its seat is kept for the client to resume with its ticket; its messages
+ * are dropped</li>
+ * </ul>
+ * </p>
+ */
+enum conn_state
+{
+    CONN_SYN_RCVD,
+    CONN_ESTABLISHED,
+    CONN_LAST_ACK,
+    CONN_HELD
+};
 
 /**
  * packet
@@ -58,8 +273,13 @@
  * Stores packet information.
  * <ul>
  * <li>flags: the flags set for the packet</li>
- * <li>seq_num: the sequence number of the packet</li>
- * <li>length: the number of bytes in the packet following these two bytes</li>
+ * <li>seq_num: the sequence number of the packet; only the low byte is sent in version 1</li>
+ * <li>length: the number of bytes in the payload</li>
+ * <li>ack_num: the sequence number of the next packet expected from the peer; version 2, if FLAG_ACK is set</li>
+ * <li>window: the number of packets the sender will accept beyond ack_num; version 2</li>
+ * <li>sack: the packets received beyond ack_num; bit i is set if ack_num + 1 + i has arrived; version 2, if FLAG_SAK
+ * is set</li>
+ * <li>cid: the connection ID, as sent; version 2, if FLAG_CID is set</li>
  * <li>payload: the byte data of the packet</li>
  * </ul>
  * </p>
@@ -67,8 +287,12 @@
 struct packet
 {
     uint8_t  flags;
-    uint8_t  seq_num;
+    uint32_t seq_num;
     uint16_t length;
+    uint32_t ack_num;
+    uint8_t  window;
+    uint32_t sack;
+    uint64_t cid;
     
     uint8_t *payload; // 'payload' is a cooler word than 'data'
 };
@@ -81,9 +305,38 @@ struct packet
  * <li>server_ip: the server's ip address</li>
  * <li>server_port: the server's port number</li>
  * <li>server_fd: file descriptor of the socket listening for connections</li>
- * <li>first_conn_client: Head of linked list holding communication information of connected clients</li>
+ * <li>conns: the connected clients</li>
  * <li>timeout: timeval used to determine time server will sv_recvfrom a message before acting</li>
  * <li>mm: a memory manager for the server</li>
+ * <li>rooms: the rooms in which matches are played</li>
+ * <li>timers: the retransmission timers of the connected clients</li>
+ * <li>bio: batches the datagrams received and sent on every socket</li>
+ * <li>el_backend: the readiness mechanism the event loop is built on</li>
+ * <li>loop: the event loop monitoring the server socket and the connected client sockets</li>
+ * <li>single_socket: whether all clients share the server socket instead of each having their own</li>
+ * <li>clients: clients by address; used to demultiplex the server socket. Holds every client when single_socket is
+ * set, otherwise only half-open connections and the clients which returned a SYN cookie</li>
+ * <li>num_half_open: the number of clients in clients awaiting the ACK of a stateful handshake, up to
+ * SV_MAX_HALF_OPEN</li>
+ * <li>cids: clients by connection ID; holds every client which took OPT_CID once it is connected</li>
+ * <li>shard_id: the index of the shard, and of its server socket among those bound to the server address; the first
+ * byte of the connection IDs it gives out</li>
+ * <li>num_workers: the number of threads serving clients, each with its own shard of the server</li>
+ * <li>workers: the shards run on the other threads; NULL in the settings of a worker</li>
+ * <li>wake_fds: a pipe written to when any thread stops, waking every other thread; -1 with a single thread</li>
+ * <li>num_game_workers: the number of threads playing the moves of rooms; 0 to play them on the I/O threads</li>
+ * <li>pool: the game workers, shared by every shard; NULL without game workers</li>
+ * <li>results: the tasks the game workers have played for this shard; NULL without game workers</li>
+ * <li>handoff_path: the path of the unix socket the server is handed off through on a restart; NULL if it is not</li>
+ * <li>handoff_listen_fd: the unix socket a successor connects to; -1 if not listening, and in the settings of a
+ * worker</li>
+ * <li>handoff_fd: the connection to the predecessor while taking over from it, or to the successor once handing off
+ * to it; -1 otherwise</li>
+ * <li>window: the send window of version 2 connections, in packets</li>
+ * <li>dup_thresh: the number of duplicate ACKs which trigger a fast retransmit on version 2 connections; 0 to wait
+ * for the timeout</li>
+ * <li>mtu: the path MTU the packets to a client which takes bundles are bundled up to, in bytes</li>
+ * <li>cookie_key: the key SYN cookies are made with; the same on every thread, and kept across a handoff</li>
  * </ul>
  * </p>
  */
@@ -92,32 +345,179 @@ struct server_settings
     int       server_fd;
     char      *server_ip;
     in_port_t server_port;
-    bool do_broadcast;
-    bool do_unicast;
     
-    uint8_t               num_conn_client;
-    struct conn_client    *first_conn_client;
+    struct conn_table     *conns;
     struct memory_manager *mm;
-    struct Game           *game;
+    struct room_table     *rooms;
+    struct timer_wheel    *timers;
+    struct batch_io       *bio;
+    
+    enum el_backend   el_backend;
+    struct event_loop *loop;
+    
+    bool              single_socket;
+    struct client_map *clients;
+    size_t            num_half_open;
+    struct client_map *cids;
+    uint8_t           shard_id;
+    
+    size_t           num_workers;
+    struct sv_worker *workers;
+    int              wake_fds[2];
+    
+    size_t            num_game_workers;
+    struct game_pool  *pool;
+    struct gp_results *results;
+    
+    char *handoff_path;
+    int  handoff_listen_fd;
+    int  handoff_fd;
+    
+    uint8_t  window;
+    uint8_t  dup_thresh;
+    uint16_t mtu;
+    uint8_t  cookie_key[SIPHASH_KEY_BYTES];
+};
+
+/**
+ * rtx_entry
+ * <p>
+ * A packet sent on a version 2 connection and kept until it is ACKed, in the retransmission ring of its client. The
+ * ACK number is not kept: it is filled in each time the packet is sent. A packet the client has reported in a
+ * selective ACK is marked, and is not sent again on a timeout. A game state is superseded by the states of the same
+ * game sent after it, which the epoch of the room's game when it was sent tells: when it is sent again, it carries the
+ * newest of them instead, and is marked superseded. The ACK of a superseded state does not tell which of the states
+ * it carried arrived.
+ * </p>
+ */
+struct rtx_entry
+{
+    uint32_t seq_num;
+    uint8_t  flags;
+    bool     sacked;
+    bool     superseded;
+    uint64_t epoch;
+    uint16_t length;
+    uint8_t  payload[MAX_PUSH_BYTES];
 };
 
 /**
  * conn_client
  * <p>
  * Represents an individual client connected to the server. The server uses this struct to keep track of the connected
- * client's socket file descriptor, address information, and their last sent and received packets.
+ * client's socket file descriptor, address information, their last sent and received packets, and the room and seat
+ * in which they play.
+ * <ul>
+ * <li>s_packet: the last packet sent to the client; while awaiting_ack is set, it is outstanding and is retransmitted
+ * on a bad ACK</li>
+ * <li>s_payload: the client's own copy of the payload of s_packet, so that s_packet stays valid until it is ACKed</li>
+ * <li>awaiting_ack: whether s_packet has been sent but not yet ACKed</li>
+ * <li>state_pending: whether a game state was held back from a broadcast while s_packet was outstanding</li>
+ * <li>rto: the retransmission timer; armed while s_packet is outstanding</li>
+ * <li>num_retrans: the number of times s_packet has been retransmitted on a timeout</li>
+ * <li>rtt: the round-trip time estimator; gives the delay rto is armed with</li>
+ * <li>state: the state of the connection</li>
+ * <li>handle: refers to the client in the connection table</li>
+ * <li>mapped: whether the client is in the client map of its shard</li>
+ * <li>cid: the connection ID given to the client, as sent; 0 if it did not take OPT_CID</li>
+ * <li>version: the protocol version of the connection</li>
+ * <li>snd_una: the oldest sequence number sent but not yet ACKed; version 2</li>
+ * <li>snd_nxt: the sequence number of the next packet to send; version 2</li>
+ * <li>rcv_nxt: the sequence number of the next packet expected from the client; version 2</li>
+ * <li>snd_wnd: the number of packets which may be outstanding; the lesser of the configured window and the client's
+ * advertised window. Version 2</li>
+ * <li>rtx: the retransmission ring; the packets from snd_una to snd_nxt, each at its sequence number modulo
+ * SV_RTX_SLOTS. Version 2</li>
+ * <li>dup_acks: the number of duplicate ACKs received since snd_una last advanced, up to the fast retransmit
+ * threshold. Version 2</li>
+ * <li>ack_pending: whether a packet from the client has arrived in sequence and its ACK has not been sent; every packet
+ * sent carries the ACK. Version 2</li>
+ * <li>delack: the delayed ACK timer; armed while ack_pending is set. Version 2</li>
+ * <li>bundle: whether the client offered OPT_BUNDLE; the packets queued for it in an iteration of the event loop are
+ * then sent in as few datagrams as the path MTU allows. Version 2</li>
+ * <li>delta: whether the client offered OPT_DELTA; its game states are then versioned, and sent as changes. Version
+ * 2</li>
+ * <li>state_ver: the version of the last game state sent; OPT_DELTA</li>
+ * <li>acked_ver: the version of the newest game state the client has ACKed, if state_acked is set; OPT_DELTA</li>
+ * <li>state_acked: whether the client has ACKed a game state; until it has, every state is a keyframe. OPT_DELTA</li>
+ * <li>states: the last STATE_HISTORY game states sent, each at its version modulo STATE_HISTORY; OPT_DELTA</li>
+ * <li>tickets: whether the client offered OPT_TICKET; it is then given a ticket once seated. Version 2</li>
+ * <li>ticket_id: the ID of the tickets given to the connection; OPT_TICKET</li>
+ * <li>ticket_pending: whether a ticket was held back while the send window was full; OPT_TICKET</li>
+ * </ul>
  * <p>
  */
 struct conn_client
 {
-    int                c_fd;
-    struct sockaddr_in *addr;
-    struct packet      *s_packet;
-    struct packet      *r_packet;
+    int                  c_fd;
+    struct sockaddr_in   *addr;
+    struct packet        *s_packet;
+    struct packet        *r_packet;
+    uint8_t              s_payload[S_PAYLOAD_BYTES];
+    bool                 awaiting_ack;
+    bool                 state_pending;
+    struct tw_timer      rto;
+    uint8_t              num_retrans;
+    struct rtt_estimator rtt;
+    enum conn_state      state;
+    struct room          *room;
+    uint8_t              seat;
     
-    struct conn_client *next;
+    struct conn_handle handle;
+    bool               mapped;
+    uint64_t           cid;
+    
+    uint8_t          version;
+    uint32_t         snd_una;
+    uint32_t         snd_nxt;
+    uint32_t         rcv_nxt;
+    uint8_t          snd_wnd;
+    struct rtx_entry rtx[SV_RTX_SLOTS];
+    uint8_t          dup_acks;
+    bool             ack_pending;
+    struct tw_timer  delack;
+    bool             bundle;
+    
+    bool     delta;
+    uint16_t state_ver;
+    uint16_t acked_ver;
+    bool     state_acked;
+    uint8_t  states[STATE_HISTORY][STD_PAYLOAD_BYTES];
+    
+    bool     tickets;
+    uint64_t ticket_id;
+    bool     ticket_pending;
 };
 
+/**
+ * seq_before
+ * <p>
+ * Compare two sequence numbers with serial number arithmetic (RFC 1982), so that the comparison holds across the
+ * wrap at 2^32 as long as the numbers are less than 2^31 apart.
+ * </p>
+ * @param a - a sequence number
+ * @param b - a sequence number
+ * @return true if a comes before b
+ */
+static inline bool seq_before(uint32_t a, uint32_t b)
+{
+    return (int32_t) (a - b) < 0;
+}
+
+/**
+ * seq_after
+ * <p>
+ * Compare two sequence numbers with serial number arithmetic.
+ * </p>
+ * @param a - a sequence number
+ * @param b - a sequence number
+ * @return true if a comes after b
+ */
+static inline bool seq_after(uint32_t a, uint32_t b)
+{
+    return seq_before(b, a);
+}
+
 
 /**
  * check_ip
@@ -163,6 +563,30 @@ void set_string(char **str, const char *new_str);
  */
 in_port_t parse_port(const char *buffer, uint8_t base);
 
+/**
+ * parse_num_workers
+ * <p>
+ * Check the user input number of worker threads to ensure it is within parameters. Namely, that it is between 1 and
+ * SV_MAX_WORKERS.
+ * </p>
+ * @param buffer - char *: string containing the number of worker threads
+ * @param base - int: base in which to interpret the number of worker threads
+ * @return the number of worker threads
+ */
+size_t parse_num_workers(const char *buffer, uint8_t base);
+
+/**
+ * parse_num_game_workers
+ * <p>
+ * Check the user input number of game worker threads to ensure it is within parameters. Namely, that it is between 0
+ * and GP_MAX_WORKERS.
+ * </p>
+ * @param buffer - char *: string containing the number of game worker threads
+ * @param base - int: base in which to interpret the number of game worker threads
+ * @return the number of game worker threads
+ */
+size_t parse_num_game_workers(const char *buffer, uint8_t base);
+
 /**
  * set_self_ip.
  * <p>
@@ -181,23 +605,12 @@ void set_self_ip(char **ip);
  */
 int open_server_socket(void);
 
-/**
- * set_readfds
- * <p>
- * Set the readfds set for use in the select function: clear the set, then add the server's file descriptor followed by
- * up to MAX_CLIENTS client file descriptors. Keep track of the file descriptor with the greatest value.
- * </p>
- * @param set - the server settings
- * @param readfds - the file descriptor set to be monitored for read activity
- * @return the file descriptor with the greatest value
- */
-int set_readfds(struct server_settings *set, fd_set *readfds);
-
 /**
  * connect_client
  * <p>
  * Connect a new client. Store the client's information and create a new socket with which to
- * exchange messages with that client. Increment the number of connected clients.
+ * exchange messages with that client, and register the socket with the event loop; if clients share the server
+ * socket, use the server socket instead. Map the client's address to the client.
  * </p>
  * @param set - the client settings
  * @param from_addr - the address from which the message was sent
@@ -208,8 +621,7 @@ struct conn_client *connect_client(struct server_settings *set, struct sockaddr_
 /**
  * create_conn_client
  * <p>
- * Allocate memory for and return a pointer to a new connected client node. Add the new client to the
- * server settings linked list of connected clients and add the memory to the memory manager.
+ * Give a new client a slot in the connection table, with its address and packets.
  * </p>
  * @return a pointer to the newly allocated connected client struct.
  */
@@ -218,7 +630,7 @@ struct conn_client *create_conn_client(struct server_settings *set);
 /**
  * remove_client
  * <p>
- * Remove a client from the connected client list. Delete the client.
+ * Remove a client from its room. Delete the client.
  * </p>
  * @param set - the server settings
  * @param client - the client to be removed
@@ -228,32 +640,93 @@ void remove_client(struct server_settings *set, struct conn_client *client);
 /**
  * delete_conn_client
  * <p>
- * Decrement the number of connected clients. Close the client socket. Free the memory associated with a client.
+ * Remove the client's address and connection ID mappings, if it has them. Remove the client socket from the event loop
+ * and close it, unless clients share the server socket. Free the client's slot in the connection table.
  * </p>
  * @param set - the server settings
  * @param client - the client to free
  */
 void delete_conn_client(struct server_settings *set, struct conn_client *client);
 
+/**
+ * parse_window
+ * <p>
+ * Check the user input send window to ensure it is within parameters. Namely, that it is between 1 and SV_MAX_WINDOW.
+ * </p>
+ * @param buffer - char *: string containing the send window
+ * @param base - int: base in which to interpret the send window
+ * @return the send window
+ */
+uint8_t parse_window(const char *buffer, uint8_t base);
+
+/**
+ * parse_dup_thresh
+ * <p>
+ * Check the user input fast retransmit threshold to ensure it is within parameters. Namely, that it is between 0 and
+ * SV_MAX_WINDOW.
+ * </p>
+ * @param buffer - char *: string containing the threshold
+ * @param base - int: base in which to interpret the threshold
+ * @return the threshold
+ */
+uint8_t parse_dup_thresh(const char *buffer, uint8_t base);
+
+/**
+ * parse_mtu
+ * <p>
+ * Check the user input path MTU to ensure it is within parameters. Namely, that it is between SV_MIN_MTU and
+ * SV_MAX_MTU.
+ * </p>
+ * @param buffer - char *: string containing the path MTU
+ * @param base - int: base in which to interpret the path MTU
+ * @return the path MTU
+ */
+uint16_t parse_mtu(const char *buffer, uint8_t base);
+
 /**
  * deserialize_packet
  * <p>
- * Load the bytes of a buffer into the received packet struct fields.
+ * Load the bytes of a buffer into the received packet struct fields, in the header layout of a protocol version.
  * </p>
  * @param packet - the packet to store the buffer info
  * @param buffer - the buffer to deserialize
+ * @param version - the protocol version the buffer is framed in
  */
-void deserialize_packet(struct packet *packet, const uint8_t *buffer);
+void deserialize_packet(struct packet *packet, const uint8_t *buffer, uint8_t version);
 
 /**
  * serialize_packet
  * <p>
- * Load the packet struct fields into the bytes of a buffer.
+ * Load the packet struct fields into the bytes of a buffer, in the header layout of a protocol version.
  * </p>
  * @param packet - the packet to serialize
+ * @param version - the protocol version to frame the packet in
  * @return the buffer storing the packet info
  */
-uint8_t *serialize_packet(struct packet *packet);
+uint8_t *serialize_packet(const struct packet *packet, uint8_t version);
+
+/**
+ * packet_size
+ * <p>
+ * Get the number of bytes a packet is serialized to.
+ * </p>
+ * @param packet - the packet
+ * @param version - the protocol version the packet is framed in
+ * @return the size of the packet, header included
+ */
+size_t packet_size(const struct packet *packet, uint8_t version);
+
+/**
+ * header_size
+ * <p>
+ * Get the number of bytes before the payload of a packet: the header of its protocol version, and the selective ACK
+ * and the connection ID if its flags say it carries them.
+ * </p>
+ * @param flags - the flags of the packet
+ * @param version - the protocol version the packet is framed in
+ * @return the size of the header
+ */
+size_t header_size(uint8_t flags, uint8_t version);
 
 /**
  * create_packet
@@ -266,7 +739,7 @@ uint8_t *serialize_packet(struct packet *packet);
  * @param len - the length of the payload
  * @param payload - the payload
  */
-void create_packet(struct packet *packet, uint8_t flags, uint8_t seq_num, uint16_t len, uint8_t *payload);
+void create_packet(struct packet *packet, uint8_t flags, uint32_t seq_num, uint16_t len, uint8_t *payload);
 
 /**
  * check_flags
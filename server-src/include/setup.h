@@ -10,7 +10,9 @@
 /**
  * init_def_state
  * <p>
- * Initialize the default values in the server settings. Parse command line arguments.
+ * Initialize the default values in the server settings. Parse command line arguments. If a server listens on the
+ * handoff path, ask it to hand off, and take its configuration. Create the state of the shard served by the main
+ * thread, the pipe which wakes the threads when one stops, and the game workers.
  * </p>
  * @param argc - the number of command line arguments
  * @param argv - the command line arguments
@@ -18,4 +20,15 @@
  */
 void init_def_state(int argc, char *argv[], struct server_settings *set);
 
+/**
+ * init_worker_state
+ * <p>
+ * Initialize the settings of a worker thread from those of the main thread. The worker is given its own memory
+ * manager and shard state; only the configuration, the wake pipe and the game workers are shared.
+ * </p>
+ * @param set - the settings of the main thread
+ * @param worker - the settings of the worker
+ */
+void init_worker_state(const struct server_settings *set, struct server_settings *worker);
+
 #endif //RELIABLE_UDP_SETUP_H
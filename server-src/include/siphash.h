@@ -0,0 +1,25 @@
+#ifndef RELIABLE_UDP_SIPHASH_H
+#define RELIABLE_UDP_SIPHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The number of bytes of a SipHash key.
+ */
+#define SIPHASH_KEY_BYTES 16
+
+/**
+ * siphash24
+ * <p>
+ * Compute SipHash-2-4 of a message under a key: a 64-bit MAC which cannot be forged without the key, and is cheap
+ * enough to compute for every datagram of a flood.
+ * </p>
+ * @param key - the key, SIPHASH_KEY_BYTES long
+ * @param in - the message
+ * @param len - the length of the message
+ * @return the MAC
+ */
+uint64_t siphash24(const uint8_t *key, const uint8_t *in, size_t len);
+
+#endif //RELIABLE_UDP_SIPHASH_H
@@ -0,0 +1,99 @@
+#ifndef RELIABLE_UDP_TIMER_WHEEL_H
+#define RELIABLE_UDP_TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The duration of one tick of a timer wheel, in milliseconds. Timers expire on tick boundaries.
+ */
+#define TW_TICK_MS 10
+
+/**
+ * The number of levels of a timer wheel, and the number of bits of a timer's expiry tick indexing each level.
+ * Each level has 2^TW_SLOT_BITS slots; a slot of level N spans 2^(N * TW_SLOT_BITS) ticks.
+ */
+#define TW_LEVELS 4
+#define TW_SLOT_BITS 6
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+
+/**
+ * tw_timer
+ * <p>
+ * A timer, embedded in the struct it times. A timer is armed while it is in a slot of a timer wheel.
+ * <ul>
+ * <li>next: the next timer in the same slot, or in the list of expired timers</li>
+ * <li>pprev: the link pointing to this timer; NULL if the timer is not armed</li>
+ * <li>expires: the tick on which the timer expires</li>
+ * <li>data: the struct the timer belongs to</li>
+ * </ul>
+ * </p>
+ */
+struct tw_timer
+{
+    struct tw_timer *next;
+    struct tw_timer **pprev;
+    uint64_t        expires;
+    void            *data;
+};
+
+/**
+ * timer_wheel
+ * <p>
+ * A hierarchical timing wheel. Timers due within TW_SLOTS ticks sit in the slot of level 0 for their tick; timers
+ * due later sit in a coarser slot of a higher level, and are moved down a level each time the level below completes
+ * a rotation. Arming and cancelling a timer are O(1), and the cost of advancing the wheel does not depend on the
+ * number of timers which have not expired.
+ * <ul>
+ * <li>slots: the head of the list of timers in each slot of each level</li>
+ * <li>origin_ms: the time of tick 0</li>
+ * <li>now: the current tick</li>
+ * <li>count: the number of armed timers</li>
+ * </ul>
+ * </p>
+ */
+struct timer_wheel
+{
+    struct tw_timer *slots[TW_LEVELS][TW_SLOTS];
+    uint64_t        origin_ms;
+    uint64_t        now;
+    size_t          count;
+    
+    void (*tw_arm)(struct timer_wheel *, struct tw_timer *, uint64_t, uint32_t);
+    
+    void (*tw_cancel)(struct timer_wheel *, struct tw_timer *);
+    
+    struct tw_timer *(*tw_expire)(struct timer_wheel *, uint64_t);
+    
+    int (*tw_timeout)(const struct timer_wheel *, uint64_t);
+};
+
+/**
+ * init_timer_wheel
+ * <p>
+ * Constructor. Allocate memory for an empty timer wheel whose tick 0 is now, and initialize function pointers.
+ * </p>
+ * @return a pointer to the new timer wheel, NULL on failure
+ */
+struct timer_wheel *init_timer_wheel(void);
+
+/**
+ * free_timer_wheel
+ * <p>
+ * Free the timer wheel. The timers in the wheel are not freed.
+ * </p>
+ * @param wheel - the timer wheel to free
+ * @return 0 on success, -1 if the timer wheel is NULL
+ */
+int free_timer_wheel(struct timer_wheel *wheel);
+
+/**
+ * tw_clock_ms
+ * <p>
+ * Read the monotonic clock.
+ * </p>
+ * @return the time, in milliseconds
+ */
+uint64_t tw_clock_ms(void);
+
+#endif //RELIABLE_UDP_TIMER_WHEEL_H
@@ -0,0 +1,544 @@
+#define _GNU_SOURCE /* recvmmsg, sendmmsg, SOL_UDP */
+
+#include "../include/batch-io.h"
+#include "../include/manager.h"
+#include <errno.h>
+#include <netinet/udp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+/**
+ * The largest message sent with GSO: the most a UDP datagram over IPv4 may carry.
+ */
+#define BIO_GSO_MAX_BYTES 65507
+
+/**
+ * bio_cmsg
+ * <p>
+ * Space for the control message carrying a GSO or GRO segment size, aligned for a cmsghdr.
+ * </p>
+ */
+union bio_cmsg
+{
+    char   buf[CMSG_SPACE(sizeof(int))];
+    size_t align; /* A cmsghdr is aligned as its length. */
+};
+
+/**
+ * bio_impl
+ * <p>
+ * The message headers handed to recvmmsg and sendmmsg. Without GRO, the receive headers point straight at the
+ * datagrams of a batch_io; with GRO, they point into gro_buffers, from which the segments are copied out. The send
+ * headers are assembled on each flush from the I/O vectors of tx_iovs, one per queued datagram.
+ * </p>
+ */
+struct bio_impl
+{
+    struct mmsghdr     rx_msgs[BIO_BATCH];
+    struct iovec       rx_iovs[BIO_BATCH];
+    union bio_cmsg     rx_cmsgs[BIO_BATCH];
+    struct mmsghdr     tx_msgs[BIO_BATCH];
+    struct iovec       tx_iovs[BIO_BATCH];
+    union bio_cmsg     tx_cmsgs[BIO_BATCH];
+    int                tx_fds[BIO_BATCH];
+    struct sockaddr_in gro_addrs[BIO_BATCH];
+    uint8_t            *rx_buffers;
+    uint8_t            *tx_buffers;
+    uint8_t            *gro_buffers;
+};
+
+/**
+ * bio_offload
+ * <p>
+ * Use the UDP offloads the kernel supports on a socket. GSO needs no socket option, only a kernel which knows it;
+ * GRO is enabled on the socket. An offload which is not supported is left off.
+ * </p>
+ * @param bio - the batch I/O layer
+ * @param fd - the socket
+ * @return 0 on success, -1 on failure
+ */
+int bio_offload(struct batch_io *bio, int fd);
+
+/**
+ * bio_recv
+ * <p>
+ * Receive, without blocking, up to BIO_BATCH messages waiting on a socket into rx. A message coalesced by GRO is
+ * split into the datagrams it was made of. If fewer than BIO_BATCH datagrams are received, the socket was drained.
+ * </p>
+ * @param bio - the batch I/O layer
+ * @param fd - the socket
+ * @return the number of datagrams received, 0 if the socket would block, -1 on failure
+ */
+int bio_recv(struct batch_io *bio, int fd);
+
+/**
+ * bio_split_gro
+ * <p>
+ * Copy the segments of a received message into rx, one datagram each, zero-padded to rx_bytes. A segment longer than
+ * rx_bytes is dropped: without GRO, recvmmsg would truncate it, and report only the bytes it kept.
+ * </p>
+ * @param bio - the batch I/O layer
+ * @param msg - the received message
+ * @param fd - the socket the message was received on
+ * @param num_dgrams - the number of datagrams in rx
+ * @return the number of datagrams in rx after the split
+ */
+size_t bio_split_gro(struct batch_io *bio, struct mmsghdr *msg, int fd, size_t num_dgrams);
+
+/**
+ * bio_send
+ * <p>
+ * Queue a datagram to be sent by the next flush. If the queue is full, flush it first.
+ * </p>
+ * @param bio - the batch I/O layer
+ * @param fd - the socket to send from
+ * @param addr - the address to send to
+ * @param data - the datagram
+ * @param len - the length of the datagram
+ * @return 0 on success, -1 if the datagram is longer than tx_bytes
+ */
+int bio_send(struct batch_io *bio, int fd, const struct sockaddr_in *addr, const uint8_t *data, size_t len);
+
+/**
+ * bio_bundle
+ * <p>
+ * Queue a message at the end of the last datagram queued for the same socket and address by bio_bundle, if it fits
+ * in tx_bytes; otherwise, queue it as a datagram of its own, which later messages may be bundled in. The receiver must
+ * be able to tell where each message ends.
+ * </p>
+ * @param bio - the batch I/O layer
+ * @param fd - the socket to send from
+ * @param addr - the address to send to
+ * @param data - the message
+ * @param len - the length of the message
+ * @return 0 on success, -1 if the message is longer than tx_bytes
+ */
+int bio_bundle(struct batch_io *bio, int fd, const struct sockaddr_in *addr, const uint8_t *data, size_t len);
+
+/**
+ * bio_flush
+ * <p>
+ * Send every queued datagram with one sendmmsg per run of messages sent from the same socket. With GSO, the datagrams
+ * bound for one address are gathered into a single message while they are of equal size; the last may be shorter.
+ * Datagrams to one address are sent in the order they were queued. A message which cannot be sent is reported and
+ * skipped.
+ * </p>
+ * @param bio - the batch I/O layer
+ */
+void bio_flush(struct batch_io *bio);
+
+/**
+ * bio_gather
+ * <p>
+ * Assemble the next message to send: the first queued datagram not yet taken and, with GSO, the datagrams after it
+ * which can be sent as its segments.
+ * </p>
+ * @param bio - the batch I/O layer
+ * @param first - the index of the first datagram not yet taken
+ * @param taken - which datagrams are already part of a message
+ * @param msg - the message header
+ * @param iov - the I/O vectors to point the message at; one per datagram taken
+ * @param cmsg - the space for the segment size control message
+ * @return the number of datagrams taken
+ */
+size_t bio_gather(struct batch_io *bio, size_t first, bool *taken, struct msghdr *msg, struct iovec *iov,
+                  union bio_cmsg *cmsg);
+
+struct batch_io *init_batch_io(size_t rx_bytes, size_t tx_bytes)
+{
+    struct batch_io *bio;
+    struct bio_impl *impl;
+    
+    if ((bio = (struct batch_io *) s_calloc(1, sizeof(struct batch_io), __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return NULL;
+    }
+    if ((impl = (struct bio_impl *) s_calloc(1, sizeof(struct bio_impl), __FILE__, __func__, __LINE__)) == NULL)
+    {
+        free(bio);
+        return NULL;
+    }
+    bio->impl = impl;
+    if ((impl->rx_buffers = (uint8_t *) s_calloc(BIO_BATCH * BIO_GRO_SEGMENTS, rx_bytes,
+                                                 __FILE__, __func__, __LINE__)) == NULL ||
+        (impl->tx_buffers = (uint8_t *) s_calloc(BIO_BATCH, tx_bytes, __FILE__, __func__, __LINE__)) == NULL)
+    {
+        free_batch_io(bio);
+        return NULL;
+    }
+    
+    bio->rx_bytes = rx_bytes;
+    bio->tx_bytes = tx_bytes;
+    
+    for (size_t i = 0; i < BIO_BATCH * BIO_GRO_SEGMENTS; ++i)
+    {
+        bio->rx[i].buffer = impl->rx_buffers + i * rx_bytes;
+    }
+    
+    /* The receive headers always point at the same buffers and addresses; only the lengths change between calls. */
+    for (size_t i = 0; i < BIO_BATCH; ++i)
+    {
+        bio->tx[i].buffer = impl->tx_buffers + i * tx_bytes;
+        
+        impl->rx_iovs[i].iov_base            = bio->rx[i].buffer;
+        impl->rx_iovs[i].iov_len             = rx_bytes;
+        impl->rx_msgs[i].msg_hdr.msg_iov     = &impl->rx_iovs[i];
+        impl->rx_msgs[i].msg_hdr.msg_iovlen  = 1;
+        impl->rx_msgs[i].msg_hdr.msg_name    = &bio->rx[i].addr;
+    }
+    
+    bio->bio_offload = bio_offload;
+    bio->bio_recv    = bio_recv;
+    bio->bio_send    = bio_send;
+    bio->bio_bundle  = bio_bundle;
+    bio->bio_flush   = bio_flush;
+    
+    return bio;
+}
+
+int free_batch_io(struct batch_io *bio)
+{
+    struct bio_impl *impl;
+    
+    if (bio == NULL)
+    {
+        errno = EFAULT;
+        return -1;
+    }
+    
+    impl = (struct bio_impl *) bio->impl;
+    free(impl->rx_buffers);
+    free(impl->tx_buffers);
+    free(impl->gro_buffers);
+    free(impl);
+    free(bio);
+    
+    return 0;
+}
+
+int bio_offload(struct batch_io *bio, int fd)
+{
+#if defined(UDP_SEGMENT) && defined(UDP_GRO)
+    struct bio_impl *impl;
+    const int       enable = 1;
+    int             segment_bytes;
+    socklen_t       opt_len;
+    
+    impl    = (struct bio_impl *) bio->impl;
+    opt_len = sizeof(segment_bytes);
+    if (!bio->gso && getsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment_bytes, &opt_len) == 0)
+    {
+        bio->gso = true;
+    }
+    
+    if (setsockopt(fd, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == -1)
+    {
+        errno = 0; /* Not supported: the socket delivers every datagram on its own. */
+        return 0;
+    }
+    if (!bio->gro) /* Receive into space for a full coalesced message, headed by its segment size. */
+    {
+        if ((impl->gro_buffers = (uint8_t *) s_calloc(BIO_BATCH, bio->rx_bytes * BIO_GRO_SEGMENTS,
+                                                      __FILE__, __func__, __LINE__)) == NULL)
+        {
+            return -1;
+        }
+        for (size_t i = 0; i < BIO_BATCH; ++i)
+        {
+            impl->rx_iovs[i].iov_base            = impl->gro_buffers + i * bio->rx_bytes * BIO_GRO_SEGMENTS;
+            impl->rx_iovs[i].iov_len             = bio->rx_bytes * BIO_GRO_SEGMENTS;
+            impl->rx_msgs[i].msg_hdr.msg_name    = &impl->gro_addrs[i];
+            impl->rx_msgs[i].msg_hdr.msg_control = impl->rx_cmsgs[i].buf;
+        }
+        bio->gro = true;
+    }
+#else
+    (void) bio;
+    (void) fd;
+#endif
+    
+    return 0;
+}
+
+int bio_recv(struct batch_io *bio, int fd)
+{
+    struct bio_impl *impl;
+    int             num_recv;
+    size_t          num_dgrams;
+    
+    impl = (struct bio_impl *) bio->impl;
+    
+    for (size_t i = 0; i < BIO_BATCH; ++i) /* The kernel overwrites the address and control lengths. */
+    {
+        impl->rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        if (bio->gro)
+        {
+            impl->rx_msgs[i].msg_hdr.msg_controllen = sizeof(impl->rx_cmsgs[i].buf);
+        }
+    }
+    
+    if ((num_recv = recvmmsg(fd, impl->rx_msgs, BIO_BATCH, MSG_DONTWAIT, NULL)) == -1)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            errno = 0;
+            return 0;
+        }
+        return -1;
+    }
+    
+    if (bio->gro)
+    {
+        num_dgrams = 0;
+        for (int i = 0; i < num_recv; ++i)
+        {
+            num_dgrams = bio_split_gro(bio, &impl->rx_msgs[i], fd, num_dgrams);
+        }
+        return (int) num_dgrams;
+    }
+    
+    for (int i = 0; i < num_recv; ++i)
+    {
+        bio->rx[i].fd  = fd;
+        bio->rx[i].len = impl->rx_msgs[i].msg_len;
+        if (bio->rx[i].len < bio->rx_bytes) /* Short datagrams read as if zero-padded. */
+        {
+            memset(bio->rx[i].buffer + bio->rx[i].len, 0, bio->rx_bytes - bio->rx[i].len);
+        }
+    }
+    
+    return num_recv;
+}
+
+size_t bio_split_gro(struct batch_io *bio, struct mmsghdr *msg, int fd, size_t num_dgrams)
+{
+    const uint8_t  *data;
+    size_t         segment_bytes;
+    struct cmsghdr *cmsg;
+    
+    data          = (const uint8_t *) msg->msg_hdr.msg_iov->iov_base;
+    segment_bytes = msg->msg_len; /* A message which was not coalesced is a single datagram. */
+    for (cmsg = CMSG_FIRSTHDR(&msg->msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg->msg_hdr, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+        {
+            int gro_bytes;
+            
+            memcpy(&gro_bytes, CMSG_DATA(cmsg), sizeof(gro_bytes));
+            segment_bytes = (size_t) gro_bytes;
+        }
+    }
+    
+    if (segment_bytes == 0)
+    {
+        segment_bytes = bio->rx_bytes;
+    }
+    
+    /* An empty datagram is still a datagram; the kernel never coalesces more than BIO_GRO_SEGMENTS. */
+    for (size_t offset = 0; (offset == 0 || offset < msg->msg_len) && num_dgrams < BIO_BATCH * BIO_GRO_SEGMENTS;
+         offset += segment_bytes)
+    {
+        struct bio_dgram *dgram;
+        size_t           len;
+        
+        len = (msg->msg_len - offset < segment_bytes) ? msg->msg_len - offset : segment_bytes;
+        if (len > bio->rx_bytes)
+        {
+            continue; /* Longer than any message taken; its length must not outrun the buffer. */
+        }
+        
+        dgram       = &bio->rx[num_dgrams++];
+        dgram->fd   = fd;
+        dgram->addr = *(const struct sockaddr_in *) msg->msg_hdr.msg_name;
+        dgram->len  = len;
+        memcpy(dgram->buffer, data + offset, len);
+        memset(dgram->buffer + len, 0, bio->rx_bytes - len);
+    }
+    
+    return num_dgrams;
+}
+
+int bio_send(struct batch_io *bio, int fd, const struct sockaddr_in *addr, const uint8_t *data, size_t len)
+{
+    struct bio_dgram *dgram;
+    
+    if (len > bio->tx_bytes)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (bio->num_tx == BIO_BATCH)
+    {
+        bio_flush(bio);
+    }
+    
+    dgram       = &bio->tx[bio->num_tx++];
+    dgram->fd   = fd;
+    dgram->addr = *addr;
+    dgram->len    = len;
+    dgram->bundle = false;
+    memcpy(dgram->buffer, data, len);
+    
+    return 0;
+}
+
+int bio_bundle(struct batch_io *bio, int fd, const struct sockaddr_in *addr, const uint8_t *data, size_t len)
+{
+    /* Only the last datagram to the address is looked at, so the messages to an address keep their order. */
+    for (size_t i = bio->num_tx; i > 0; --i)
+    {
+        struct bio_dgram *dgram;
+        
+        dgram = &bio->tx[i - 1];
+        if (dgram->fd == fd && dgram->addr.sin_port == addr->sin_port &&
+            dgram->addr.sin_addr.s_addr == addr->sin_addr.s_addr)
+        {
+            if (dgram->bundle && dgram->len + len <= bio->tx_bytes)
+            {
+                memcpy(dgram->buffer + dgram->len, data, len);
+                dgram->len += len;
+                return 0;
+            }
+            break;
+        }
+    }
+    
+    if (bio_send(bio, fd, addr, data, len) == -1)
+    {
+        return -1;
+    }
+    bio->tx[bio->num_tx - 1].bundle = true;
+    
+    return 0;
+}
+
+void bio_flush(struct batch_io *bio)
+{
+    struct bio_impl *impl;
+    bool            taken[BIO_BATCH];
+    int             saved_errno;
+    size_t          num_msgs;
+    size_t          num_iovs;
+    size_t          start;
+    
+    impl        = (struct bio_impl *) bio->impl;
+    saved_errno = errno;
+    
+    if (bio->loop != NULL && bio->loop->el_send != NULL) /* The loop submits the datagrams with its next wait. */
+    {
+        for (size_t i = 0; i < bio->num_tx; ++i)
+        {
+            if (bio->loop->el_send(bio->loop, bio->tx[i].fd, &bio->tx[i].addr, bio->tx[i].buffer,
+                                   bio->tx[i].len) == -1)
+            {
+                perror("\nMessage transmission failed: \n");
+            }
+        }
+        bio->num_tx = 0;
+        errno       = saved_errno;
+        return;
+    }
+    
+    memset(taken, 0, sizeof(taken));
+    num_msgs = 0;
+    num_iovs = 0;
+    for (size_t first = 0; first < bio->num_tx; ++first)
+    {
+        if (!taken[first])
+        {
+            impl->tx_fds[num_msgs] = bio->tx[first].fd;
+            num_iovs += bio_gather(bio, first, taken, &impl->tx_msgs[num_msgs].msg_hdr, &impl->tx_iovs[num_iovs],
+                                   &impl->tx_cmsgs[num_msgs]);
+            ++num_msgs;
+        }
+    }
+    
+    for (start = 0; start < num_msgs;)
+    {
+        size_t end;
+        int    num_sent;
+        
+        for (end = start + 1; end < num_msgs && impl->tx_fds[end] == impl->tx_fds[start]; ++end)
+        {}
+        
+        if ((num_sent = sendmmsg(impl->tx_fds[start], &impl->tx_msgs[start], (unsigned int) (end - start), 0)) == -1)
+        {
+            perror("\nMessage transmission failed: \n"); /* Skip the message at fault; send the rest. */
+            if (errno == EIO && impl->tx_msgs[start].msg_hdr.msg_iovlen > 1)
+            {
+                bio->gso = false; /* The device cannot segment: send datagrams on their own from now on. */
+            }
+            num_sent = 1;
+        }
+        start += (size_t) num_sent;
+    }
+    
+    bio->num_tx = 0;
+    errno       = saved_errno;
+}
+
+size_t bio_gather(struct batch_io *bio, size_t first, bool *taken, struct msghdr *msg, struct iovec *iov,
+                  union bio_cmsg *cmsg)
+{
+    struct bio_dgram *head;
+    size_t           num_segments;
+    size_t           total_bytes;
+    
+    head            = &bio->tx[first];
+    taken[first]    = true;
+    iov[0].iov_base = head->buffer;
+    iov[0].iov_len  = head->len;
+    num_segments    = 1;
+    total_bytes     = head->len;
+    
+    /* Segments must be of the head's size; a shorter one ends the message. A longer one is left for a later message,
+     * and so is every datagram to the address after it, to keep them in order; so is one the message cannot hold. */
+    for (size_t i = first + 1; bio->gso && i < bio->num_tx && iov[num_segments - 1].iov_len == head->len; ++i)
+    {
+        const struct bio_dgram *dgram;
+        
+        dgram = &bio->tx[i];
+        if (taken[i] || dgram->fd != head->fd || dgram->addr.sin_port != head->addr.sin_port ||
+            dgram->addr.sin_addr.s_addr != head->addr.sin_addr.s_addr)
+        {
+            continue;
+        }
+        if (dgram->len > head->len || dgram->len == 0 || total_bytes + dgram->len > BIO_GSO_MAX_BYTES)
+        {
+            break;
+        }
+        total_bytes                += dgram->len;
+        taken[i]                    = true;
+        iov[num_segments].iov_base  = dgram->buffer;
+        iov[num_segments++].iov_len = dgram->len;
+    }
+    
+    memset(msg, 0, sizeof(*msg));
+    msg->msg_name    = &head->addr;
+    msg->msg_namelen = sizeof(struct sockaddr_in);
+    msg->msg_iov     = iov;
+    msg->msg_iovlen  = num_segments;
+    
+#ifdef UDP_SEGMENT
+    if (num_segments > 1) /* The kernel splits the message into datagrams of the head's size. */
+    {
+        struct cmsghdr *hdr;
+        uint16_t       segment_bytes;
+        
+        msg->msg_control    = cmsg->buf;
+        msg->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+        hdr                 = CMSG_FIRSTHDR(msg);
+        hdr->cmsg_level     = SOL_UDP;
+        hdr->cmsg_type      = UDP_SEGMENT;
+        hdr->cmsg_len       = CMSG_LEN(sizeof(uint16_t));
+        segment_bytes       = (uint16_t) head->len;
+        memcpy(CMSG_DATA(hdr), &segment_bytes, sizeof(segment_bytes));
+    }
+#else
+    (void) cmsg;
+#endif
+    
+    return num_segments;
+}
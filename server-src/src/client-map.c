@@ -0,0 +1,325 @@
+#include "../include/client-map.h"
+#include "../include/manager.h"
+#include <errno.h>
+#include <stdlib.h>
+
+/**
+ * The number of slots in a new client map. Must be a power of two.
+ */
+#define CM_BASE_CAPACITY 64
+
+/**
+ * The table grows once count / capacity would exceed CM_MAX_LOAD_NUM / CM_MAX_LOAD_DEN.
+ */
+#define CM_MAX_LOAD_NUM 1
+#define CM_MAX_LOAD_DEN 2
+
+/**
+ * client_map_slot
+ * <p>
+ * A slot in the client map: the packed address key and the client it maps to.
+ * </p>
+ */
+struct client_map_slot
+{
+    uint64_t           key;
+    struct conn_client *client;
+};
+
+/**
+ * cm_get
+ * <p>
+ * Find the client connected from an address.
+ * </p>
+ * @param map - the client map
+ * @param addr - the client address
+ * @return the client, NULL if no client is connected from the address
+ */
+struct conn_client *cm_get(const struct client_map *map, const struct sockaddr_in *addr);
+
+/**
+ * cm_put
+ * <p>
+ * Map an address to a client, replacing any client already mapped from that address. Grow the table if it is too
+ * full.
+ * </p>
+ * @param map - the client map
+ * @param addr - the client address
+ * @param client - the client
+ * @return 0 on success, -1 on allocation failure
+ */
+int cm_put(struct client_map *map, const struct sockaddr_in *addr, struct conn_client *client);
+
+/**
+ * cm_remove
+ * <p>
+ * Remove the mapping for an address. Later entries in the probe run are shifted back, so no tombstones are left.
+ * </p>
+ * @param map - the client map
+ * @param addr - the client address
+ * @return 0 on success, -1 if the address is not mapped
+ */
+int cm_remove(struct client_map *map, const struct sockaddr_in *addr);
+
+/**
+ * cm_get_id
+ * <p>
+ * Find the client a key maps to.
+ * </p>
+ * @param map - the client map
+ * @param key - the key: a packed address, or a connection ID
+ * @return the client, NULL if the key is not mapped
+ */
+struct conn_client *cm_get_id(const struct client_map *map, uint64_t key);
+
+/**
+ * cm_put_id
+ * <p>
+ * Map a key to a client, replacing any client already mapped from that key. Grow the table if it is too full.
+ * </p>
+ * @param map - the client map
+ * @param key - the key: a packed address, or a connection ID
+ * @param client - the client
+ * @return 0 on success, -1 on allocation failure
+ */
+int cm_put_id(struct client_map *map, uint64_t key, struct conn_client *client);
+
+/**
+ * cm_remove_id
+ * <p>
+ * Remove the mapping for a key. Later entries in the probe run are shifted back, so no tombstones are left.
+ * </p>
+ * @param map - the client map
+ * @param key - the key: a packed address, or a connection ID
+ * @return 0 on success, -1 if the key is not mapped
+ */
+int cm_remove_id(struct client_map *map, uint64_t key);
+
+/**
+ * cm_grow
+ * <p>
+ * Double the capacity of the table and re-insert every entry.
+ * </p>
+ * @param map - the client map
+ * @return 0 on success, -1 on allocation failure
+ */
+int cm_grow(struct client_map *map);
+
+/**
+ * cm_key
+ * <p>
+ * Pack the IPv4 address and port of a socket address into a single key.
+ * </p>
+ * @param addr - the address
+ * @return the key
+ */
+uint64_t cm_key(const struct sockaddr_in *addr);
+
+/**
+ * cm_hash
+ * <p>
+ * Mix the bits of a key so that neighbouring addresses and ports spread over the table.
+ * </p>
+ * @param key - the key
+ * @return the hash
+ */
+uint64_t cm_hash(uint64_t key);
+
+struct client_map *init_client_map(void)
+{
+    struct client_map *map;
+    
+    if ((map = (struct client_map *) s_calloc(1, sizeof(struct client_map), __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return NULL;
+    }
+    if ((map->slots = (struct client_map_slot *) s_calloc(CM_BASE_CAPACITY, sizeof(struct client_map_slot),
+                                                          __FILE__, __func__, __LINE__)) == NULL)
+    {
+        free(map);
+        return NULL;
+    }
+    map->capacity = CM_BASE_CAPACITY;
+    
+    map->cm_get       = cm_get;
+    map->cm_put       = cm_put;
+    map->cm_remove    = cm_remove;
+    map->cm_get_id    = cm_get_id;
+    map->cm_put_id    = cm_put_id;
+    map->cm_remove_id = cm_remove_id;
+    
+    return map;
+}
+
+int free_client_map(struct client_map *map)
+{
+    if (map == NULL)
+    {
+        errno = EFAULT;
+        return -1;
+    }
+    
+    free(map->slots);
+    free(map);
+    
+    return 0;
+}
+
+int sockaddr_in_equal(const struct sockaddr_in *a, const struct sockaddr_in *b)
+{
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+struct conn_client *cm_get(const struct client_map *map, const struct sockaddr_in *addr)
+{
+    return cm_get_id(map, cm_key(addr));
+}
+
+int cm_put(struct client_map *map, const struct sockaddr_in *addr, struct conn_client *client)
+{
+    return cm_put_id(map, cm_key(addr), client);
+}
+
+int cm_remove(struct client_map *map, const struct sockaddr_in *addr)
+{
+    return cm_remove_id(map, cm_key(addr));
+}
+
+struct conn_client *cm_get_id(const struct client_map *map, uint64_t key)
+{
+    size_t mask;
+    size_t i;
+    
+    mask = map->capacity - 1;
+    
+    /* Probe until the key or an empty slot is found; the load limit guarantees an empty slot exists. */
+    for (i = cm_hash(key) & mask; map->slots[i].client != NULL; i = (i + 1) & mask)
+    {
+        if (map->slots[i].key == key)
+        {
+            return map->slots[i].client;
+        }
+    }
+    
+    return NULL;
+}
+
+int cm_put_id(struct client_map *map, uint64_t key, struct conn_client *client)
+{
+    size_t mask;
+    size_t i;
+    
+    if ((map->count + 1) * CM_MAX_LOAD_DEN > map->capacity * CM_MAX_LOAD_NUM)
+    {
+        if (cm_grow(map) == -1)
+        {
+            return -1;
+        }
+    }
+    
+    mask = map->capacity - 1;
+    
+    for (i = cm_hash(key) & mask; map->slots[i].client != NULL; i = (i + 1) & mask)
+    {
+        if (map->slots[i].key == key) /* Already mapped: replace the client. */
+        {
+            map->slots[i].client = client;
+            return 0;
+        }
+    }
+    
+    map->slots[i].key    = key;
+    map->slots[i].client = client;
+    ++map->count;
+    
+    return 0;
+}
+
+int cm_remove_id(struct client_map *map, uint64_t key)
+{
+    size_t mask;
+    size_t hole;
+    size_t i;
+    
+    mask = map->capacity - 1;
+    
+    for (hole = cm_hash(key) & mask; map->slots[hole].client == NULL || map->slots[hole].key != key;
+         hole = (hole + 1) & mask)
+    {
+        if (map->slots[hole].client == NULL)
+        {
+            errno = ENOENT;
+            return -1;
+        }
+    }
+    
+    /* Backward-shift deletion: move each later entry of the run into the hole unless its home slot lies cyclically
+     * after the hole, in which case moving it would make it unreachable. */
+    for (i = (hole + 1) & mask; map->slots[i].client != NULL; i = (i + 1) & mask)
+    {
+        size_t home;
+        
+        home = cm_hash(map->slots[i].key) & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            map->slots[hole] = map->slots[i];
+            hole = i;
+        }
+    }
+    map->slots[hole].key    = 0;
+    map->slots[hole].client = NULL;
+    --map->count;
+    
+    return 0;
+}
+
+int cm_grow(struct client_map *map)
+{
+    struct client_map_slot *old_slots;
+    size_t                 old_capacity;
+    
+    old_slots    = map->slots;
+    old_capacity = map->capacity;
+    
+    if ((map->slots = (struct client_map_slot *) s_calloc(old_capacity * 2, sizeof(struct client_map_slot),
+                                                          __FILE__, __func__, __LINE__)) == NULL)
+    {
+        map->slots = old_slots;
+        return -1;
+    }
+    map->capacity = old_capacity * 2;
+    
+    for (size_t i = 0; i < old_capacity; ++i)
+    {
+        if (old_slots[i].client != NULL)
+        {
+            size_t mask;
+            size_t j;
+            
+            mask = map->capacity - 1;
+            for (j = cm_hash(old_slots[i].key) & mask; map->slots[j].client != NULL; j = (j + 1) & mask)
+            {}
+            map->slots[j] = old_slots[i];
+        }
+    }
+    free(old_slots);
+    
+    return 0;
+}
+
+uint64_t cm_key(const struct sockaddr_in *addr)
+{
+    return ((uint64_t) addr->sin_addr.s_addr << 16) | addr->sin_port; // NOLINT(readability-magic-numbers) : port bits
+}
+
+uint64_t cm_hash(uint64_t key)
+{
+    /* The splitmix64 finalizer. */
+    key ^= key >> 30;                        // NOLINT(readability-magic-numbers)
+    key *= UINT64_C(0xbf58476d1ce4e5b9);     // NOLINT(readability-magic-numbers)
+    key ^= key >> 27;                        // NOLINT(readability-magic-numbers)
+    key *= UINT64_C(0x94d049bb133111eb);     // NOLINT(readability-magic-numbers)
+    key ^= key >> 31;                        // NOLINT(readability-magic-numbers)
+    
+    return key;
+}
@@ -0,0 +1,254 @@
+#include "../include/conn-table.h"
+#include "../include/manager.h"
+#include "../include/server-util.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Marks the end of the free list.
+ */
+#define CT_NO_SLOT UINT32_MAX
+
+/**
+ * ct_slot
+ * <p>
+ * A slot of a connection table: a client, and the storage its address and packets point to.
+ * <ul>
+ * <li>generation: the generation of the slot; changed when its client is removed</li>
+ * <li>in_use: whether the slot holds a client</li>
+ * <li>link: the index of the next free slot while free; the position of the slot in live while in use</li>
+ * </ul>
+ * </p>
+ */
+struct ct_slot
+{
+    struct conn_client client;
+    struct sockaddr_in addr;
+    struct packet      s_packet;
+    struct packet      r_packet;
+    
+    uint32_t generation;
+    bool     in_use;
+    uint32_t link;
+};
+
+/**
+ * ct_insert
+ * <p>
+ * Give a new client a free slot, adding a chunk of slots if there is none. The client is zeroed, except for its
+ * handle and the pointers to its address and packets.
+ * </p>
+ * @param table - the connection table
+ * @return the new client, NULL on failure
+ */
+struct conn_client *ct_insert(struct conn_table *table);
+
+/**
+ * ct_remove
+ * <p>
+ * Free the slot of a client, invalidating its handle. The last slot in live takes its place there, so removing a
+ * client while iterating moves another client to the current position.
+ * </p>
+ * @param table - the connection table
+ * @param client - the client to remove
+ */
+void ct_remove(struct conn_table *table, struct conn_client *client);
+
+/**
+ * ct_get
+ * <p>
+ * Resolve a handle.
+ * </p>
+ * @param table - the connection table
+ * @param handle - the handle
+ * @return the client, NULL if the client has been removed or the handle is zeroed
+ */
+struct conn_client *ct_get(const struct conn_table *table, struct conn_handle handle);
+
+/**
+ * ct_at
+ * <p>
+ * Get a client by its position in live, to iterate the clients.
+ * </p>
+ * @param table - the connection table
+ * @param pos - the position; less than the number of clients
+ * @return the client
+ */
+struct conn_client *ct_at(const struct conn_table *table, size_t pos);
+
+/**
+ * ct_slot_at
+ * <p>
+ * Get a slot by its index.
+ * </p>
+ * @param table - the connection table
+ * @param index - the index; less than the number of slots
+ * @return the slot
+ */
+static inline struct ct_slot *ct_slot_at(const struct conn_table *table, uint32_t index);
+
+/**
+ * ct_grow
+ * <p>
+ * Add a chunk of slots, and put them on the free list, lowest index first.
+ * </p>
+ * @param table - the connection table
+ * @return 0 on success, -1 on failure
+ */
+int ct_grow(struct conn_table *table);
+
+struct conn_table *init_conn_table(void)
+{
+    struct conn_table *table;
+    
+    if ((table = (struct conn_table *) s_calloc(1, sizeof(struct conn_table), __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return NULL;
+    }
+    table->first_free = CT_NO_SLOT;
+    
+    table->ct_insert = ct_insert;
+    table->ct_remove = ct_remove;
+    table->ct_get    = ct_get;
+    table->ct_at     = ct_at;
+    
+    return table;
+}
+
+int free_conn_table(struct conn_table *table)
+{
+    if (table == NULL)
+    {
+        errno = EFAULT;
+        return -1;
+    }
+    
+    for (size_t i = 0; i < table->num_chunks; ++i)
+    {
+        free(table->chunks[i]);
+    }
+    free(table->chunks);
+    free(table->live);
+    free(table);
+    
+    return 0;
+}
+
+struct conn_client *ct_insert(struct conn_table *table)
+{
+    struct ct_slot *slot;
+    uint32_t       index;
+    
+    if (table->first_free == CT_NO_SLOT && ct_grow(table) == -1)
+    {
+        return NULL;
+    }
+    
+    index = table->first_free;
+    slot  = ct_slot_at(table, index);
+    table->first_free = slot->link;
+    
+    memset(&slot->client, 0, sizeof(struct conn_client));
+    memset(&slot->addr, 0, sizeof(struct sockaddr_in));
+    memset(&slot->s_packet, 0, sizeof(struct packet));
+    memset(&slot->r_packet, 0, sizeof(struct packet));
+    slot->client.addr     = &slot->addr;
+    slot->client.s_packet = &slot->s_packet;
+    slot->client.r_packet = &slot->r_packet;
+    slot->client.handle   = (struct conn_handle) {.index = index, .generation = slot->generation};
+    
+    slot->in_use = true;
+    slot->link   = (uint32_t) table->count;
+    table->live[table->count++] = index;
+    
+    return &slot->client;
+}
+
+void ct_remove(struct conn_table *table, struct conn_client *client)
+{
+    struct ct_slot *slot;
+    uint32_t       last;
+    
+    slot = ct_slot_at(table, client->handle.index);
+    
+    /* Move the last slot in use into the removed one's position. */
+    last = table->live[--table->count];
+    table->live[slot->link]       = last;
+    ct_slot_at(table, last)->link = slot->link;
+    
+    if (++slot->generation == 0) /* Generation 0 is never given out. */
+    {
+        slot->generation = 1;
+    }
+    slot->in_use      = false;
+    slot->link        = table->first_free;
+    table->first_free = client->handle.index;
+}
+
+struct conn_client *ct_get(const struct conn_table *table, struct conn_handle handle)
+{
+    struct ct_slot *slot;
+    
+    if (handle.generation == 0 || handle.index >= table->num_chunks * CT_CHUNK_SLOTS)
+    {
+        return NULL;
+    }
+    slot = ct_slot_at(table, handle.index);
+    
+    return (slot->in_use && slot->generation == handle.generation) ? &slot->client : NULL;
+}
+
+struct conn_client *ct_at(const struct conn_table *table, size_t pos)
+{
+    return &ct_slot_at(table, table->live[pos])->client;
+}
+
+static inline struct ct_slot *ct_slot_at(const struct conn_table *table, uint32_t index)
+{
+    return &table->chunks[index / CT_CHUNK_SLOTS][index % CT_CHUNK_SLOTS];
+}
+
+int ct_grow(struct conn_table *table)
+{
+    struct ct_slot **chunks;
+    struct ct_slot *chunk;
+    uint32_t       *live;
+    size_t         base;
+    
+    base = table->num_chunks * CT_CHUNK_SLOTS;
+    if (base + CT_CHUNK_SLOTS >= CT_NO_SLOT)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    
+    if ((chunks = (struct ct_slot **) s_realloc(table->chunks, (table->num_chunks + 1) * sizeof(struct ct_slot *),
+                                                __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return -1;
+    }
+    table->chunks = chunks;
+    if ((live = (uint32_t *) s_realloc(table->live, (base + CT_CHUNK_SLOTS) * sizeof(uint32_t),
+                                       __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return -1;
+    }
+    table->live = live;
+    if ((chunk = (struct ct_slot *) s_calloc(CT_CHUNK_SLOTS, sizeof(struct ct_slot),
+                                             __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return -1;
+    }
+    table->chunks[table->num_chunks++] = chunk;
+    
+    /* Push the new slots in reverse, so the lowest is handed out first. */
+    for (size_t i = CT_CHUNK_SLOTS; i > 0; --i)
+    {
+        chunk[i - 1].generation = 1;
+        chunk[i - 1].link       = table->first_free;
+        table->first_free       = (uint32_t) (base + i - 1);
+    }
+    
+    return 0;
+}
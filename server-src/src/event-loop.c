@@ -0,0 +1,1144 @@
+#include "../include/event-loop.h"
+#include "../include/manager.h"
+#include "../include/server-util.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#if defined(__linux__) && defined(HAVE_IO_URING)
+#include "../include/uring.h"
+#include <stdio.h>
+#include <sys/socket.h>
+#endif
+
+/**
+ * The number of registrations a backend table can hold before it must grow.
+ */
+#define EL_BASE_CAPACITY 8
+
+#if defined(__linux__) && defined(HAVE_IO_URING)
+
+/**
+ * The number of submission queue entries of the io_uring backend.
+ */
+#define EL_URING_ENTRIES 256
+
+/**
+ * The number of provided buffers the kernel receives messages into. A buffer is held from the completion of its
+ * message until the next el_wait.
+ */
+#define EL_URING_BUFS 512
+
+/**
+ * The largest message received into a provided buffer; longer messages are truncated.
+ */
+#define EL_URING_MSG_BYTES 256
+
+/**
+ * The number of sends which may be in flight at once. Once every slot is in flight, messages are sent directly.
+ */
+#define EL_URING_SENDS 256
+
+/**
+ * The user data of an io_uring request: its kind in the top byte, the generation of its descriptor's registration
+ * in the next three bytes, and the descriptor or send slot in the low four bytes.
+ */
+#define EL_URING_KIND_SHIFT 56
+#define EL_URING_GEN_SHIFT 32
+#define EL_URING_GEN_MASK 0xFFFFFFU
+
+/**
+ * el_uring_kind
+ * <p>
+ * The kinds of request the io_uring backend submits.
+ * </p>
+ */
+enum el_uring_kind
+{
+    EL_URING_POLL = 1,
+    EL_URING_RECV,
+    EL_URING_SEND,
+    EL_URING_CANCEL
+};
+
+#endif
+
+/**
+ * select_impl
+ * <p>
+ * Backend state for select: the registered descriptors and their data, in registration order.
+ * </p>
+ */
+struct select_impl
+{
+    struct el_event *reg;
+    size_t          num_reg;
+    size_t          cap_reg;
+};
+
+#ifdef __linux__
+
+/**
+ * epoll_impl
+ * <p>
+ * Backend state for epoll: the epoll instance and a table, indexed by descriptor, of the data each registered
+ * descriptor reports.
+ * </p>
+ */
+struct epoll_impl
+{
+    int    epfd;
+    void   **fd_data;
+    size_t cap_data;
+};
+
+#endif
+
+#if defined(__linux__) && defined(HAVE_IO_URING)
+
+/**
+ * uring_reg
+ * <p>
+ * The registration of a descriptor with the io_uring backend. The generation changes with every registration, so
+ * completions of the requests of an earlier registration of the same descriptor are recognized and ignored.
+ * </p>
+ */
+struct uring_reg
+{
+    void     *data;
+    uint32_t gen;
+    bool     active;
+    bool     recv;
+    size_t   msg_bytes;
+};
+
+/**
+ * uring_send
+ * <p>
+ * A send in flight: the message and its copy of the data, kept until the send completes.
+ * </p>
+ */
+struct uring_send
+{
+    struct msghdr      msg;
+    struct iovec       iov;
+    struct sockaddr_in addr;
+    uint8_t            *buffer;
+    size_t             cap;
+    int                next_free;
+};
+
+/**
+ * uring_impl
+ * <p>
+ * Backend state for io_uring: the ring, a table of registrations indexed by descriptor, the message header the
+ * multishot receives are posted with, the buffers held by the events of the last el_wait, and the send slots.
+ * </p>
+ */
+struct uring_impl
+{
+    struct uring     *ring;
+    struct uring_reg *regs;
+    size_t           cap_regs;
+    struct msghdr    recv_msg;
+    
+    uint16_t held[EL_MAX_EVENTS];
+    size_t   num_held;
+    
+    struct uring_send sends[EL_URING_SENDS];
+    int               free_send;
+};
+
+#endif
+
+/**
+ * el_next
+ * <p>
+ * Return the next ready event which has not been dispatched and whose descriptor is still registered.
+ * </p>
+ * @param loop - the event loop
+ * @return the next ready event, NULL if there are none left
+ */
+struct el_event *el_next(struct event_loop *loop);
+
+/**
+ * el_forget
+ * <p>
+ * Null the data of any undispatched ready event on a descriptor, so that a descriptor removed during dispatch is not
+ * dispatched afterwards.
+ * </p>
+ * @param loop - the event loop
+ * @param fd - the descriptor being removed
+ */
+void el_forget(struct event_loop *loop, int fd);
+
+/**
+ * el_add_readiness
+ * <p>
+ * Register a datagram socket for read readiness, for backends which do not receive messages themselves.
+ * </p>
+ * @param loop - the event loop
+ * @param fd - the socket to register
+ * @param data - the data to report with the socket
+ * @param msg_bytes - unused
+ * @return 0 on success, -1 on failure
+ */
+int el_add_readiness(struct event_loop *loop, int fd, void *data, size_t msg_bytes);
+
+/**
+ * init_select
+ * <p>
+ * Set up the select backend.
+ * </p>
+ * @param loop - the event loop
+ * @return 0 on success, -1 on failure
+ */
+int init_select(struct event_loop *loop);
+
+/**
+ * select_add
+ * <p>
+ * Register a descriptor with the select backend. Sets errno to EINVAL if the descriptor is not below FD_SETSIZE.
+ * </p>
+ * @param loop - the event loop
+ * @param fd - the descriptor to register
+ * @param data - the data to report with the descriptor
+ * @return 0 on success, -1 on failure
+ */
+int select_add(struct event_loop *loop, int fd, void *data);
+
+/**
+ * select_remove
+ * <p>
+ * Remove a descriptor from the select backend.
+ * </p>
+ * @param loop - the event loop
+ * @param fd - the descriptor to remove
+ * @return 0 on success, -1 if the descriptor is not registered
+ */
+int select_remove(struct event_loop *loop, int fd);
+
+/**
+ * select_wait
+ * <p>
+ * Build a read set from the registered descriptors and select on it.
+ * </p>
+ * @param loop - the event loop
+ * @param timeout_ms - the maximum time to wait in milliseconds, -1 to wait indefinitely
+ * @return the number of ready events, -1 on failure
+ */
+int select_wait(struct event_loop *loop, int timeout_ms);
+
+#ifdef __linux__
+
+/**
+ * init_epoll
+ * <p>
+ * Set up the epoll backend.
+ * </p>
+ * @param loop - the event loop
+ * @return 0 on success, -1 on failure
+ */
+int init_epoll(struct event_loop *loop);
+
+/**
+ * epoll_add
+ * <p>
+ * Register a descriptor for edge-triggered read readiness.
+ * </p>
+ * @param loop - the event loop
+ * @param fd - the descriptor to register
+ * @param data - the data to report with the descriptor
+ * @return 0 on success, -1 on failure
+ */
+int epoll_add(struct event_loop *loop, int fd, void *data);
+
+/**
+ * epoll_remove
+ * <p>
+ * Remove a descriptor from the epoll instance.
+ * </p>
+ * @param loop - the event loop
+ * @param fd - the descriptor to remove
+ * @return 0 on success, -1 on failure
+ */
+int epoll_remove(struct event_loop *loop, int fd);
+
+/**
+ * epoll_wait_ready
+ * <p>
+ * Wait on the epoll instance and collect the ready descriptors.
+ * </p>
+ * @param loop - the event loop
+ * @param timeout_ms - the maximum time to wait in milliseconds, -1 to wait indefinitely
+ * @return the number of ready events, -1 on failure
+ */
+int epoll_wait_ready(struct event_loop *loop, int timeout_ms);
+
+#endif
+
+#if defined(__linux__) && defined(HAVE_IO_URING)
+
+/**
+ * init_uring_loop
+ * <p>
+ * Set up the io_uring backend: the ring, and the provided buffers messages are received into.
+ * </p>
+ * @param loop - the event loop
+ * @return 0 on success, -1 if io_uring is not available
+ */
+int init_uring_loop(struct event_loop *loop);
+
+/**
+ * free_uring_loop
+ * <p>
+ * Release the ring and the tables of the io_uring backend.
+ * </p>
+ * @param impl - the backend state
+ */
+void free_uring_loop(struct uring_impl *impl);
+
+/**
+ * uring_add
+ * <p>
+ * Register a descriptor for read readiness with a multishot poll.
+ * </p>
+ * @param loop - the event loop
+ * @param fd - the descriptor to register
+ * @param data - the data to report with the descriptor
+ * @return 0 on success, -1 on failure
+ */
+int uring_add(struct event_loop *loop, int fd, void *data);
+
+/**
+ * uring_add_recv
+ * <p>
+ * Register a datagram socket with a multishot recvmsg, so that the kernel receives its messages into the provided
+ * buffers as they arrive.
+ * </p>
+ * @param loop - the event loop
+ * @param fd - the socket to register
+ * @param data - the data to report with the socket
+ * @param msg_bytes - the number of bytes each message is zero-padded to; at most EL_URING_MSG_BYTES
+ * @return 0 on success, -1 on failure
+ */
+int uring_add_recv(struct event_loop *loop, int fd, void *data, size_t msg_bytes);
+
+/**
+ * uring_remove
+ * <p>
+ * Cancel the request posted for a descriptor and forget its registration.
+ * </p>
+ * @param loop - the event loop
+ * @param fd - the descriptor to remove
+ * @return 0 on success, -1 if the descriptor is not registered
+ */
+int uring_remove(struct event_loop *loop, int fd);
+
+/**
+ * uring_send
+ * <p>
+ * Copy a datagram into a free send slot and queue a sendmsg for it, submitted with the next el_wait. If no slot is
+ * free, send the datagram directly.
+ * </p>
+ * @param loop - the event loop
+ * @param fd - the socket to send from
+ * @param addr - the destination
+ * @param data - the datagram
+ * @param len - the length of the datagram
+ * @return 0 on success, -1 on failure
+ */
+int uring_send(struct event_loop *loop, int fd, const struct sockaddr_in *addr, const uint8_t *data, size_t len);
+
+/**
+ * uring_wait
+ * <p>
+ * Hand the buffers of the last events back to the kernel, then submit the queued requests and wait for completions
+ * with a single system call, unless completions are already waiting. Collect the completions as events.
+ * </p>
+ * @param loop - the event loop
+ * @param timeout_ms - the maximum time to wait in milliseconds, -1 to wait indefinitely
+ * @return the number of ready events, -1 on failure
+ */
+int uring_wait(struct event_loop *loop, int timeout_ms);
+
+/**
+ * uring_complete
+ * <p>
+ * Handle a completion: free a send slot, or add the readiness or the message it reports to the ready events. A
+ * multishot request which has ended is posted again.
+ * </p>
+ * @param loop - the event loop
+ * @param cqe - the completion
+ */
+void uring_complete(struct event_loop *loop, const struct io_uring_cqe *cqe);
+
+/**
+ * uring_post
+ * <p>
+ * Post the request of a registration: a multishot recvmsg or a multishot poll.
+ * </p>
+ * @param impl - the backend state
+ * @param fd - the registered descriptor
+ * @return 0 on success, -1 if the submission queue is full
+ */
+int uring_post(struct uring_impl *impl, int fd);
+
+#endif
+
+struct event_loop *init_event_loop(enum el_backend backend)
+{
+    struct event_loop *loop;
+    int               ret_val;
+    
+    if ((loop = (struct event_loop *) s_calloc(1, sizeof(struct event_loop), __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return NULL;
+    }
+    
+    loop->el_next     = el_next;
+    loop->el_add_recv = el_add_readiness;
+    
+    switch (backend)
+    {
+        case EL_BACKEND_URING:
+        {
+#if defined(__linux__) && defined(HAVE_IO_URING)
+            if ((ret_val = init_uring_loop(loop)) == 0)
+            {
+                break;
+            }
+            (void) fprintf(stderr, "io_uring is not available (%s); falling back to epoll\n",
+                           strerror(errno)); // NOLINT(concurrency-mt-unsafe) : called during setup
+            errno = 0;
+#endif
+        }
+        // fall through
+        case EL_BACKEND_EPOLL:
+        {
+#ifdef __linux__
+            ret_val = init_epoll(loop);
+            break;
+#else
+            ret_val = init_select(loop); /* No epoll on this platform. */
+            break;
+#endif
+        }
+        case EL_BACKEND_SELECT:
+        default:
+        {
+            ret_val = init_select(loop);
+            break;
+        }
+    }
+    
+    if (ret_val == -1)
+    {
+        free(loop);
+        return NULL;
+    }
+    
+    return loop;
+}
+
+int free_event_loop(struct event_loop *loop)
+{
+    if (loop == NULL)
+    {
+        errno = EFAULT;
+        return -1;
+    }
+    
+    switch (loop->backend)
+    {
+        case EL_BACKEND_URING:
+        {
+#if defined(__linux__) && defined(HAVE_IO_URING)
+            free_uring_loop((struct uring_impl *) loop->impl);
+#endif
+            free(loop->impl);
+            break;
+        }
+        case EL_BACKEND_EPOLL:
+        {
+#ifdef __linux__
+            close(((struct epoll_impl *) loop->impl)->epfd);
+            free(((struct epoll_impl *) loop->impl)->fd_data);
+#endif
+            free(loop->impl);
+            break;
+        }
+        case EL_BACKEND_SELECT:
+        default:
+        {
+            free(((struct select_impl *) loop->impl)->reg);
+            free(loop->impl);
+            break;
+        }
+    }
+    free(loop);
+    
+    return 0;
+}
+
+enum el_backend parse_el_backend(const char *name)
+{
+    if (strcmp(name, "epoll") == 0)
+    {
+        return EL_BACKEND_EPOLL;
+    }
+    if (strcmp(name, "uring") == 0)
+    {
+        return EL_BACKEND_URING;
+    }
+    if (strcmp(name, "select") != 0)
+    {
+        advise_usage("event loop backend must be one of: epoll, select, uring");
+    }
+    
+    return EL_BACKEND_SELECT;
+}
+
+struct el_event *el_next(struct event_loop *loop)
+{
+    while (loop->next_ready < loop->num_ready)
+    {
+        struct el_event *event;
+        
+        event = &loop->ready[loop->next_ready++];
+        if (event->fd != -1)
+        {
+            return event;
+        }
+    }
+    
+    return NULL;
+}
+
+int el_add_readiness(struct event_loop *loop, int fd, void *data, size_t msg_bytes)
+{
+    (void) msg_bytes;
+    
+    return loop->el_add(loop, fd, data);
+}
+
+void el_forget(struct event_loop *loop, int fd)
+{
+    for (size_t i = loop->next_ready; i < loop->num_ready; ++i)
+    {
+        if (loop->ready[i].fd == fd)
+        {
+            loop->ready[i].fd   = -1;
+            loop->ready[i].data = NULL;
+        }
+    }
+}
+
+int init_select(struct event_loop *loop)
+{
+    struct select_impl *impl;
+    
+    if ((impl = (struct select_impl *) s_calloc(1, sizeof(struct select_impl),
+                                                __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return -1;
+    }
+    if ((impl->reg = (struct el_event *) s_calloc(EL_BASE_CAPACITY, sizeof(struct el_event),
+                                                  __FILE__, __func__, __LINE__)) == NULL)
+    {
+        free(impl);
+        return -1;
+    }
+    impl->cap_reg = EL_BASE_CAPACITY;
+    
+    loop->backend   = EL_BACKEND_SELECT;
+    loop->impl      = impl;
+    loop->el_add    = select_add;
+    loop->el_remove = select_remove;
+    loop->el_wait   = select_wait;
+    
+    return 0;
+}
+
+int select_add(struct event_loop *loop, int fd, void *data)
+{
+    struct select_impl *impl;
+    
+    impl = (struct select_impl *) loop->impl;
+    
+    if (fd < 0 || fd >= FD_SETSIZE)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    if (impl->num_reg == impl->cap_reg) /* Double the capacity of the registration array. */
+    {
+        struct el_event *reg;
+        
+        if ((reg = (struct el_event *) s_realloc(impl->reg, impl->cap_reg * 2 * sizeof(struct el_event),
+                                                 __FILE__, __func__, __LINE__)) == NULL)
+        {
+            return -1;
+        }
+        impl->reg = reg;
+        impl->cap_reg *= 2;
+    }
+    
+    memset(&impl->reg[impl->num_reg], 0, sizeof(struct el_event));
+    impl->reg[impl->num_reg].fd   = fd;
+    impl->reg[impl->num_reg].data = data;
+    ++impl->num_reg;
+    
+    return 0;
+}
+
+int select_remove(struct event_loop *loop, int fd)
+{
+    struct select_impl *impl;
+    
+    impl = (struct select_impl *) loop->impl;
+    
+    el_forget(loop, fd);
+    
+    for (size_t i = 0; i < impl->num_reg; ++i)
+    {
+        if (impl->reg[i].fd == fd)
+        {
+            /* Shift the later registrations down to keep registration order. */
+            memmove(&impl->reg[i], &impl->reg[i + 1], (impl->num_reg - i - 1) * sizeof(struct el_event));
+            --impl->num_reg;
+            return 0;
+        }
+    }
+    
+    errno = ENOENT;
+    return -1;
+}
+
+int select_wait(struct event_loop *loop, int timeout_ms)
+{
+    struct select_impl *impl;
+    struct timeval     timeout;
+    fd_set             readfds;
+    int                max_fd;
+    
+    impl = (struct select_impl *) loop->impl;
+    
+    loop->num_ready  = 0;
+    loop->next_ready = 0;
+    
+    FD_ZERO(&readfds); /* Clean the readfds. */
+    max_fd = -1;
+    for (size_t i = 0; i < impl->num_reg; ++i)
+    {
+        FD_SET(impl->reg[i].fd, &readfds);
+        max_fd = (impl->reg[i].fd > max_fd) ? impl->reg[i].fd : max_fd; /* Set new max_fd if necessary. */
+    }
+    
+    timeout.tv_sec  = timeout_ms / 1000;         // NOLINT(readability-magic-numbers) : ms per s
+    timeout.tv_usec = (timeout_ms % 1000) * 1000; // NOLINT(readability-magic-numbers) : us per ms
+    
+    if (select(max_fd + 1, &readfds, NULL, NULL, (timeout_ms < 0) ? NULL : &timeout) == -1)
+    {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < impl->num_reg && loop->num_ready < EL_MAX_EVENTS; ++i)
+    {
+        if (FD_ISSET(impl->reg[i].fd, &readfds))
+        {
+            loop->ready[loop->num_ready++] = impl->reg[i];
+        }
+    }
+    
+    return (int) loop->num_ready;
+}
+
+#ifdef __linux__
+
+int init_epoll(struct event_loop *loop)
+{
+    struct epoll_impl *impl;
+    
+    if ((impl = (struct epoll_impl *) s_calloc(1, sizeof(struct epoll_impl),
+                                               __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return -1;
+    }
+    if ((impl->epfd = epoll_create1(0)) == -1) // NOLINT(android-cloexec-epoll-create1) : no exec here
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        free(impl);
+        return -1;
+    }
+    
+    loop->backend   = EL_BACKEND_EPOLL;
+    loop->impl      = impl;
+    loop->el_add    = epoll_add;
+    loop->el_remove = epoll_remove;
+    loop->el_wait   = epoll_wait_ready;
+    
+    return 0;
+}
+
+int epoll_add(struct event_loop *loop, int fd, void *data)
+{
+    struct epoll_impl  *impl;
+    struct epoll_event ev;
+    
+    impl = (struct epoll_impl *) loop->impl;
+    
+    if (fd < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    if ((size_t) fd >= impl->cap_data) /* Grow the descriptor-indexed data table to hold fd. */
+    {
+        void   **fd_data;
+        size_t new_cap;
+        
+        for (new_cap = (impl->cap_data) ? impl->cap_data : EL_BASE_CAPACITY;
+             new_cap <= (size_t) fd;
+             new_cap *= 2)
+        {}
+        
+        if ((fd_data = (void **) s_realloc(impl->fd_data, new_cap * sizeof(void *),
+                                           __FILE__, __func__, __LINE__)) == NULL)
+        {
+            return -1;
+        }
+        memset(fd_data + impl->cap_data, 0, (new_cap - impl->cap_data) * sizeof(void *));
+        impl->fd_data  = fd_data;
+        impl->cap_data = new_cap;
+    }
+    
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLIN | EPOLLET;
+    ev.data.fd = fd;
+    
+    if (epoll_ctl(impl->epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+    {
+        return -1;
+    }
+    impl->fd_data[fd] = data;
+    
+    return 0;
+}
+
+int epoll_remove(struct event_loop *loop, int fd)
+{
+    struct epoll_impl *impl;
+    
+    impl = (struct epoll_impl *) loop->impl;
+    
+    el_forget(loop, fd);
+    if (fd >= 0 && (size_t) fd < impl->cap_data)
+    {
+        impl->fd_data[fd] = NULL;
+    }
+    
+    return epoll_ctl(impl->epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int epoll_wait_ready(struct event_loop *loop, int timeout_ms)
+{
+    struct epoll_impl  *impl;
+    struct epoll_event events[EL_MAX_EVENTS];
+    int                num_events;
+    
+    impl = (struct epoll_impl *) loop->impl;
+    
+    loop->num_ready  = 0;
+    loop->next_ready = 0;
+    
+    if ((num_events = epoll_wait(impl->epfd, events, EL_MAX_EVENTS, timeout_ms)) == -1)
+    {
+        return -1;
+    }
+    
+    for (int i = 0; i < num_events; ++i)
+    {
+        loop->ready[loop->num_ready].fd     = events[i].data.fd;
+        loop->ready[loop->num_ready].data   = impl->fd_data[events[i].data.fd];
+        loop->ready[loop->num_ready].buffer = NULL;
+        ++loop->num_ready;
+    }
+    
+    return (int) loop->num_ready;
+}
+
+#endif
+
+#if defined(__linux__) && defined(HAVE_IO_URING)
+
+int init_uring_loop(struct event_loop *loop)
+{
+    struct uring_impl *impl;
+    size_t            buf_bytes;
+    
+    if ((impl = (struct uring_impl *) s_calloc(1, sizeof(struct uring_impl),
+                                               __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return -1;
+    }
+    if ((impl->ring = init_uring(EL_URING_ENTRIES)) == NULL)
+    {
+        free(impl);
+        return -1;
+    }
+    
+    /* Each buffer holds the recvmsg header and the source address ahead of the message. */
+    impl->recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+    buf_bytes                  = sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + EL_URING_MSG_BYTES;
+    if (impl->ring->ur_provide_buffers(impl->ring, EL_URING_BUFS, buf_bytes) == -1)
+    {
+        free_uring_loop(impl); /* Provided buffer rings need Linux 5.19. */
+        free(impl);
+        return -1;
+    }
+    
+    impl->free_send = -1;
+    for (int i = EL_URING_SENDS - 1; i >= 0; --i) /* Push the slots in reverse, so the first is handed out first. */
+    {
+        impl->sends[i].next_free = impl->free_send;
+        impl->free_send          = i;
+    }
+    
+    loop->backend     = EL_BACKEND_URING;
+    loop->impl        = impl;
+    loop->el_add      = uring_add;
+    loop->el_add_recv = uring_add_recv;
+    loop->el_remove   = uring_remove;
+    loop->el_send     = uring_send;
+    loop->el_wait     = uring_wait;
+    
+    return 0;
+}
+
+void free_uring_loop(struct uring_impl *impl)
+{
+    free_uring(impl->ring);
+    free(impl->regs);
+    for (int i = 0; i < EL_URING_SENDS; ++i)
+    {
+        free(impl->sends[i].buffer);
+    }
+}
+
+int uring_add(struct event_loop *loop, int fd, void *data)
+{
+    return uring_add_recv(loop, fd, data, 0);
+}
+
+int uring_add_recv(struct event_loop *loop, int fd, void *data, size_t msg_bytes)
+{
+    struct uring_impl *impl;
+    struct uring_reg  *reg;
+    
+    impl = (struct uring_impl *) loop->impl;
+    
+    if (fd < 0 || msg_bytes > EL_URING_MSG_BYTES)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    if ((size_t) fd >= impl->cap_regs) /* Grow the descriptor-indexed registration table to hold fd. */
+    {
+        struct uring_reg *regs;
+        size_t           new_cap;
+        
+        for (new_cap = (impl->cap_regs) ? impl->cap_regs : EL_BASE_CAPACITY;
+             new_cap <= (size_t) fd;
+             new_cap *= 2)
+        {}
+        
+        if ((regs = (struct uring_reg *) s_realloc(impl->regs, new_cap * sizeof(struct uring_reg),
+                                                   __FILE__, __func__, __LINE__)) == NULL)
+        {
+            return -1;
+        }
+        memset(regs + impl->cap_regs, 0, (new_cap - impl->cap_regs) * sizeof(struct uring_reg));
+        impl->regs     = regs;
+        impl->cap_regs = new_cap;
+    }
+    
+    reg = &impl->regs[fd];
+    reg->data      = data;
+    reg->gen       = (reg->gen + 1) & EL_URING_GEN_MASK;
+    reg->active    = true;
+    reg->recv      = (msg_bytes > 0);
+    reg->msg_bytes = msg_bytes;
+    
+    if (uring_post(impl, fd) == -1)
+    {
+        reg->active = false;
+        errno       = EBUSY;
+        return -1;
+    }
+    
+    return 0;
+}
+
+int uring_remove(struct event_loop *loop, int fd)
+{
+    struct uring_impl   *impl;
+    struct uring_reg    *reg;
+    struct io_uring_sqe *sqe;
+    uint64_t            target;
+    
+    impl = (struct uring_impl *) loop->impl;
+    
+    el_forget(loop, fd);
+    if (fd < 0 || (size_t) fd >= impl->cap_regs || !impl->regs[fd].active)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+    
+    reg         = &impl->regs[fd];
+    reg->active = false;
+    reg->data   = NULL;
+    
+    target = ((uint64_t) (reg->recv ? EL_URING_RECV : EL_URING_POLL) << EL_URING_KIND_SHIFT) |
+             ((uint64_t) reg->gen << EL_URING_GEN_SHIFT) | (uint32_t) fd;
+    if ((sqe = impl->ring->ur_get_sqe(impl->ring)) != NULL)
+    {
+        /* If the cancellation cannot be queued, the request's completions are ignored until the ring is freed. */
+        ur_prep_cancel(sqe, target, (uint64_t) EL_URING_CANCEL << EL_URING_KIND_SHIFT);
+    }
+    
+    return 0;
+}
+
+int uring_send(struct event_loop *loop, int fd, const struct sockaddr_in *addr, const uint8_t *data, size_t len)
+{
+    struct uring_impl   *impl;
+    struct uring_send   *send;
+    struct io_uring_sqe *sqe;
+    int                 slot;
+    
+    impl = (struct uring_impl *) loop->impl;
+    
+    if ((slot = impl->free_send) == -1)
+    {
+        /* Every slot is in flight: do not wait for one to free up. */
+        return (sendto(fd, data, len, 0, (const struct sockaddr *) addr, sizeof(struct sockaddr_in)) == -1) ? -1 : 0;
+    }
+    send = &impl->sends[slot];
+    
+    if (send->cap < len) /* The slots keep their buffers; they only grow for longer datagrams. */
+    {
+        uint8_t *buffer;
+        
+        if ((buffer = (uint8_t *) s_realloc(send->buffer, len, __FILE__, __func__, __LINE__)) == NULL)
+        {
+            return -1;
+        }
+        send->buffer = buffer;
+        send->cap    = len;
+    }
+    
+    if ((sqe = impl->ring->ur_get_sqe(impl->ring)) == NULL)
+    {
+        return (sendto(fd, data, len, 0, (const struct sockaddr *) addr, sizeof(struct sockaddr_in)) == -1) ? -1 : 0;
+    }
+    impl->free_send = send->next_free;
+    
+    memcpy(send->buffer, data, len);
+    memset(&send->msg, 0, sizeof(struct msghdr));
+    send->addr            = *addr;
+    send->iov.iov_base    = send->buffer;
+    send->iov.iov_len     = len;
+    send->msg.msg_name    = &send->addr;
+    send->msg.msg_namelen = sizeof(struct sockaddr_in);
+    send->msg.msg_iov     = &send->iov;
+    send->msg.msg_iovlen  = 1;
+    
+    ur_prep_sendmsg(sqe, fd, &send->msg, ((uint64_t) EL_URING_SEND << EL_URING_KIND_SHIFT) | (uint32_t) slot);
+    
+    return 0;
+}
+
+int uring_wait(struct event_loop *loop, int timeout_ms)
+{
+    struct uring_impl   *impl;
+    struct uring        *ring;
+    struct io_uring_cqe *cqe;
+    
+    impl = (struct uring_impl *) loop->impl;
+    ring = impl->ring;
+    
+    loop->num_ready  = 0;
+    loop->next_ready = 0;
+    
+    /* The messages of the last events have been handled. */
+    for (size_t i = 0; i < impl->num_held; ++i)
+    {
+        ring->ur_return_buffer(ring, impl->held[i]);
+    }
+    impl->num_held = 0;
+    
+    /* The sends and the posts queued since the last wait go out with the wait. */
+    if (ring->ur_submit(ring, (ring->ur_peek_cqe(ring) == NULL) ? 1 : 0, timeout_ms) == -1)
+    {
+        return -1;
+    }
+    
+    while (loop->num_ready < EL_MAX_EVENTS && (cqe = ring->ur_peek_cqe(ring)) != NULL)
+    {
+        uring_complete(loop, cqe);
+        ring->ur_cqe_seen(ring);
+    }
+    
+    return (int) loop->num_ready;
+}
+
+void uring_complete(struct event_loop *loop, const struct io_uring_cqe *cqe)
+{
+    struct uring_impl *impl;
+    struct uring_reg  *reg;
+    struct el_event   *event;
+    uint32_t          idx;
+    uint32_t          gen;
+    
+    impl = (struct uring_impl *) loop->impl;
+    idx  = (uint32_t) cqe->user_data;
+    gen  = (uint32_t) (cqe->user_data >> EL_URING_GEN_SHIFT) & EL_URING_GEN_MASK;
+    
+    switch ((enum el_uring_kind) (cqe->user_data >> EL_URING_KIND_SHIFT))
+    {
+        case EL_URING_SEND:
+        {
+            if (cqe->res < 0)
+            {
+                (void) fprintf(stderr, "\nMessage transmission to client failed: %s\n",
+                               strerror(-cqe->res)); // NOLINT(concurrency-mt-unsafe) : errno values only
+            }
+            impl->sends[idx].next_free = impl->free_send;
+            impl->free_send            = (int) idx;
+            return;
+        }
+        case EL_URING_POLL:
+        case EL_URING_RECV:
+        {
+            break;
+        }
+        case EL_URING_CANCEL:
+        default:
+        {
+            return;
+        }
+    }
+    
+    reg = (idx < impl->cap_regs) ? &impl->regs[idx] : NULL;
+    if (reg == NULL || !reg->active || reg->gen != gen) /* A completion of an earlier registration. */
+    {
+        if (cqe->flags & IORING_CQE_F_BUFFER)
+        {
+            impl->ring->ur_return_buffer(impl->ring, (uint16_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        return;
+    }
+    
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        /* The multishot request has ended, e.g. because every buffer was held: post it again. The buffers held now
+         * are handed back before the new request is submitted. */
+        if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED)
+        {
+            (void) fprintf(stderr, "\nio_uring request on descriptor %u failed: %s\n", idx,
+                           strerror(-cqe->res)); // NOLINT(concurrency-mt-unsafe) : errno values only
+        }
+        if (uring_post(impl, (int) idx) == -1)
+        {
+            reg->active = false;
+        }
+    }
+    
+    if (cqe->res < 0)
+    {
+        return;
+    }
+    
+    if (!reg->recv) /* Readiness: report the descriptor once per wait. */
+    {
+        for (size_t i = 0; i < loop->num_ready; ++i)
+        {
+            if (loop->ready[i].fd == (int) idx && loop->ready[i].buffer == NULL)
+            {
+                return;
+            }
+        }
+        event = &loop->ready[loop->num_ready++];
+        memset(event, 0, sizeof(struct el_event));
+        event->fd   = (int) idx;
+        event->data = reg->data;
+        return;
+    }
+    
+    if (cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        struct sockaddr *addr;
+        uint16_t        bid;
+        uint8_t         *payload;
+        size_t          len;
+        
+        bid = (uint16_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        payload = ur_recvmsg_payload(&impl->recv_msg, impl->ring->ur_buffer(impl->ring, bid), (size_t) cqe->res,
+                                     &addr, &len);
+        if (payload == NULL)
+        {
+            impl->ring->ur_return_buffer(impl->ring, bid);
+            return;
+        }
+        if (len < reg->msg_bytes) /* Callers read a whole message; pad a short one with zeros. */
+        {
+            memset(payload + len, 0, reg->msg_bytes - len);
+        }
+        
+        impl->held[impl->num_held++] = bid;
+        event = &loop->ready[loop->num_ready++];
+        event->fd     = (int) idx;
+        event->data   = reg->data;
+        event->buffer = payload;
+        event->len    = len;
+        memcpy(&event->addr, addr, sizeof(struct sockaddr_in));
+    }
+}
+
+int uring_post(struct uring_impl *impl, int fd)
+{
+    struct io_uring_sqe *sqe;
+    struct uring_reg    *reg;
+    uint64_t            user_data;
+    
+    reg = &impl->regs[fd];
+    if ((sqe = impl->ring->ur_get_sqe(impl->ring)) == NULL)
+    {
+        return -1;
+    }
+    
+    user_data = ((uint64_t) reg->gen << EL_URING_GEN_SHIFT) | (uint32_t) fd;
+    if (reg->recv)
+    {
+        ur_prep_recvmsg_multishot(sqe, fd, &impl->recv_msg, ((uint64_t) EL_URING_RECV << EL_URING_KIND_SHIFT) |
+                                                            user_data);
+    } else
+    {
+        ur_prep_poll_multishot(sqe, fd, ((uint64_t) EL_URING_POLL << EL_URING_KIND_SHIFT) | user_data);
+    }
+    
+    return 0;
+}
+
+#endif
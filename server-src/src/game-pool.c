@@ -0,0 +1,589 @@
+#include "../include/game-pool.h"
+#include "../include/manager.h"
+#include "../include/server-util.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/**
+ * The number of tasks a worker's deque holds. Must be a power of two.
+ */
+#define GP_DEQUE_CAPACITY 256
+
+/**
+ * The most tasks a worker takes from its inbox at once; those it does not play at once may be stolen.
+ */
+#define GP_TAKE_BATCH 8
+
+/**
+ * gp_deque
+ * <p>
+ * A work-stealing deque (Chase and Lev, with the memory orderings of Le et al.). The owner pushes and takes at the
+ * bottom without contention; thieves steal from the top, and race with the owner only for the last task.
+ * <ul>
+ * <li>top: the index of the oldest task; advanced by a successful steal, or by the owner taking the last task</li>
+ * <li>bottom: one past the index of the newest task; only written by the owner</li>
+ * <li>tasks: the tasks, indexed modulo GP_DEQUE_CAPACITY</li>
+ * </ul>
+ * </p>
+ */
+struct gp_deque
+{
+    _Atomic int64_t           top;
+    _Atomic int64_t           bottom;
+    _Atomic(struct gp_task *) tasks[GP_DEQUE_CAPACITY];
+};
+
+/**
+ * gp_worker
+ * <p>
+ * A game worker thread, its inbox and its deque. A worker with no task to play sleeps on wake; a producer which finds
+ * sleeping set after pushing to the inbox wakes it.
+ * </p>
+ */
+struct gp_worker
+{
+    pthread_t        thread;
+    bool             started;
+    size_t           index;
+    struct game_pool *pool;
+    
+    struct mpsc_ring *inbox;
+    pthread_mutex_t  lock;
+    pthread_cond_t   wake;
+    atomic_bool      sleeping;
+    
+    struct gp_deque deque;
+};
+
+/**
+ * gp_submit
+ * <p>
+ * Push a task to the inbox of a game worker, and wake the worker if it sleeps. The task goes to the worker picked by
+ * its room, or to the next worker whose inbox is not full. A task is refused if every inbox is full, or if its I/O
+ * thread already has GP_RESULTS_CAPACITY tasks out; the I/O thread is to hold the moves back and submit them later.
+ * </p>
+ * @param pool - the game pool
+ * @param task - the task
+ * @return 0 on success, -1 with errno set to EAGAIN if the task is refused
+ */
+int gp_submit(struct game_pool *pool, struct gp_task *task);
+
+/**
+ * gp_collect
+ * <p>
+ * Reset the eventfd of a queue, and take a batch of the tasks returned to it.
+ * </p>
+ * @param results - the queue
+ * @param tasks - set to the tasks taken, in the order they were returned
+ * @return the number of tasks taken, 0 if there are none
+ */
+size_t gp_collect(struct gp_results *results, struct gp_task *tasks[GP_COLLECT_BATCH]);
+
+/**
+ * gp_deque_push
+ * <p>
+ * Push a task onto the bottom of a deque. Only the owner of the deque may push.
+ * </p>
+ * @param deque - the deque
+ * @param task - the task
+ * @return 0 on success, -1 if the deque is full
+ */
+int gp_deque_push(struct gp_deque *deque, struct gp_task *task);
+
+/**
+ * gp_deque_take
+ * <p>
+ * Take the newest task from the bottom of a deque. Only the owner of the deque may take.
+ * </p>
+ * @param deque - the deque
+ * @return the task, NULL if the deque is empty or a thief stole the last task
+ */
+struct gp_task *gp_deque_take(struct gp_deque *deque);
+
+/**
+ * gp_deque_steal
+ * <p>
+ * Steal the oldest task from the top of a deque.
+ * </p>
+ * @param deque - the deque
+ * @return the task, NULL if the deque is empty or another thread took the task first
+ */
+struct gp_task *gp_deque_steal(struct gp_deque *deque);
+
+/**
+ * gp_take_inbox
+ * <p>
+ * Take a batch of tasks from a worker's inbox: return the first, and push the rest onto the worker's empty deque,
+ * from which idle workers may steal them.
+ * </p>
+ * @param pool - the game pool
+ * @param worker - the worker
+ * @return a task, NULL if the inbox is empty
+ */
+struct gp_task *gp_take_inbox(struct game_pool *pool, struct gp_worker *worker);
+
+/**
+ * gp_sleep
+ * <p>
+ * Sleep until a task is pushed to a worker's inbox, a peer has tasks to steal, or the pool stops.
+ * </p>
+ * @param pool - the game pool
+ * @param worker - the worker
+ */
+void gp_sleep(const struct game_pool *pool, struct gp_worker *worker);
+
+/**
+ * gp_wake
+ * <p>
+ * Wake a worker, if it sleeps.
+ * </p>
+ * @param worker - the worker
+ */
+void gp_wake(struct gp_worker *worker);
+
+/**
+ * gp_steal
+ * <p>
+ * Try to steal a task from each of the other workers in turn.
+ * </p>
+ * @param pool - the game pool
+ * @param worker - the worker stealing
+ * @return a task, NULL if none could be stolen
+ */
+struct gp_task *gp_steal(struct game_pool *pool, const struct gp_worker *worker);
+
+/**
+ * gp_play
+ * <p>
+ * Play the moves of a task on its game, in order, and check whether the game is over.
+ * </p>
+ * @param task - the task
+ */
+void gp_play(struct gp_task *task);
+
+/**
+ * gp_return
+ * <p>
+ * Hand a played task back to the queue of its I/O thread, and wake the I/O thread.
+ * </p>
+ * @param task - the task
+ */
+void gp_return(struct gp_task *task);
+
+/**
+ * gp_worker_main
+ * <p>
+ * The body of a game worker thread: play tasks from its own deque, then from its inbox, then stolen from other
+ * workers; sleep when there are none, until the pool stops.
+ * </p>
+ * @param arg - the worker
+ * @return NULL
+ */
+static void *gp_worker_main(void *arg);
+
+struct game_pool *init_game_pool(size_t num_workers)
+{
+    struct game_pool *pool;
+    
+    if ((pool = (struct game_pool *) s_calloc(1, sizeof(struct game_pool), __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return NULL;
+    }
+    if ((pool->workers = (struct gp_worker *) s_calloc(num_workers, sizeof(struct gp_worker),
+                                                       __FILE__, __func__, __LINE__)) == NULL)
+    {
+        free(pool);
+        return NULL;
+    }
+    atomic_store(&pool->running, true);
+    pool->num_workers = num_workers;
+    pool->gp_submit   = gp_submit;
+    
+    /* Every worker is set up before any starts, as each may steal from the others. */
+    for (size_t i = 0; i < num_workers; ++i)
+    {
+        pool->workers[i].index = i;
+        pool->workers[i].pool  = pool;
+        pthread_mutex_init(&pool->workers[i].lock, NULL);
+        pthread_cond_init(&pool->workers[i].wake, NULL);
+    }
+    for (size_t i = 0; i < num_workers; ++i)
+    {
+        if ((pool->workers[i].inbox = init_mpsc_ring(GP_INBOX_CAPACITY)) == NULL)
+        {
+            free_game_pool(pool);
+            return NULL;
+        }
+    }
+    
+    for (size_t i = 0; i < num_workers; ++i)
+    {
+        int err;
+        
+        if ((err = pthread_create(&pool->workers[i].thread, NULL, gp_worker_main, &pool->workers[i])) != 0)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, err);
+            free_game_pool(pool);
+            return NULL;
+        }
+        pool->workers[i].started = true;
+    }
+    
+    return pool;
+}
+
+int free_game_pool(struct game_pool *pool)
+{
+    struct gp_task *task;
+    
+    if (pool == NULL)
+    {
+        errno = EFAULT;
+        return -1;
+    }
+    
+    atomic_store(&pool->running, false);
+    for (size_t i = 0; i < pool->num_workers; ++i)
+    {
+        gp_wake(&pool->workers[i]);
+    }
+    
+    for (size_t i = 0; i < pool->num_workers; ++i)
+    {
+        struct gp_worker *worker;
+        void             *item;
+        
+        worker = &pool->workers[i];
+        if (worker->started)
+        {
+            pthread_join(worker->thread, NULL);
+        }
+        while ((task = gp_deque_take(&worker->deque)) != NULL)
+        {
+            free(task);
+        }
+        if (worker->inbox != NULL)
+        {
+            while (worker->inbox->mr_pop_batch(worker->inbox, &item, 1) == 1)
+            {
+                free(item);
+            }
+            free_mpsc_ring(worker->inbox);
+        }
+        pthread_cond_destroy(&worker->wake);
+        pthread_mutex_destroy(&worker->lock);
+    }
+    
+    free(pool->workers);
+    free(pool);
+    
+    return 0;
+}
+
+struct gp_results *init_gp_results(void)
+{
+    struct gp_results *results;
+    
+    if ((results = (struct gp_results *) s_calloc(1, sizeof(struct gp_results), __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return NULL;
+    }
+    if ((results->ring = init_mpsc_ring(GP_RESULTS_CAPACITY)) == NULL)
+    {
+        free(results);
+        return NULL;
+    }
+    if ((results->event_fd = eventfd(0, EFD_NONBLOCK)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        free_mpsc_ring(results->ring);
+        free(results);
+        return NULL;
+    }
+    atomic_init(&results->signalled, false);
+    results->gp_collect = gp_collect;
+    
+    return results;
+}
+
+int free_gp_results(struct gp_results *results)
+{
+    void *item;
+    
+    if (results == NULL)
+    {
+        errno = EFAULT;
+        return -1;
+    }
+    
+    while (results->ring->mr_pop_batch(results->ring, &item, 1) == 1)
+    {
+        free(item);
+    }
+    free_mpsc_ring(results->ring);
+    close(results->event_fd);
+    free(results);
+    
+    return 0;
+}
+
+int gp_submit(struct game_pool *pool, struct gp_task *task)
+{
+    struct gp_results *results;
+    int               saved_errno;
+    
+    results     = task->results;
+    saved_errno = errno;
+    if (results->num_out < GP_RESULTS_CAPACITY)
+    {
+        for (size_t i = 0; i < pool->num_workers; ++i)
+        {
+            struct gp_worker *worker;
+            
+            worker = &pool->workers[(task->room_id + i) % pool->num_workers];
+            if (worker->inbox->mr_push(worker->inbox, task) == 0)
+            {
+                ++results->num_out;
+                gp_wake(worker);
+                errno = saved_errno;
+                return 0;
+            }
+        }
+    }
+    
+    errno = EAGAIN;
+    return -1;
+}
+
+size_t gp_collect(struct gp_results *results, struct gp_task *tasks[GP_COLLECT_BATCH])
+{
+    void     *items[GP_COLLECT_BATCH];
+    uint64_t count;
+    size_t   num_tasks;
+    
+    /* Clear signalled before popping: a task returned once the ring looked empty signals the I/O thread again. */
+    if (read(results->event_fd, &count, sizeof(count)) == -1)
+    {
+        errno = 0; /* Already reset by an earlier batch. */
+    }
+    atomic_store(&results->signalled, false);
+    
+    num_tasks = results->ring->mr_pop_batch(results->ring, items, GP_COLLECT_BATCH);
+    for (size_t i = 0; i < num_tasks; ++i)
+    {
+        tasks[i] = (struct gp_task *) items[i];
+    }
+    results->num_out -= num_tasks;
+    
+    return num_tasks;
+}
+
+int gp_deque_push(struct gp_deque *deque, struct gp_task *task)
+{
+    int64_t bottom;
+    int64_t top;
+    
+    bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    top    = atomic_load_explicit(&deque->top, memory_order_acquire);
+    if (bottom - top >= GP_DEQUE_CAPACITY)
+    {
+        return -1;
+    }
+    
+    atomic_store_explicit(&deque->tasks[bottom & (GP_DEQUE_CAPACITY - 1)], task, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release); /* Publish the task to thieves. */
+    
+    return 0;
+}
+
+struct gp_task *gp_deque_take(struct gp_deque *deque)
+{
+    struct gp_task *task;
+    int64_t        bottom;
+    int64_t        top;
+    
+    /* Claim the bottom task before looking at the top, so a thief cannot take it unseen. */
+    bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    
+    if (top > bottom) /* Empty. */
+    {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+    
+    task = atomic_load_explicit(&deque->tasks[bottom & (GP_DEQUE_CAPACITY - 1)], memory_order_relaxed);
+    if (top == bottom) /* The last task: race the thieves for it. */
+    {
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed))
+        {
+            task = NULL;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    
+    return task;
+}
+
+struct gp_task *gp_deque_steal(struct gp_deque *deque)
+{
+    struct gp_task *task;
+    int64_t        top;
+    int64_t        bottom;
+    
+    top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom)
+    {
+        return NULL;
+    }
+    
+    task = atomic_load_explicit(&deque->tasks[top & (GP_DEQUE_CAPACITY - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed))
+    {
+        return NULL; /* The owner or another thief took it. */
+    }
+    
+    return task;
+}
+
+struct gp_task *gp_take_inbox(struct game_pool *pool, struct gp_worker *worker)
+{
+    void   *items[GP_TAKE_BATCH];
+    size_t num_items;
+    
+    if ((num_items = worker->inbox->mr_pop_batch(worker->inbox, items, GP_TAKE_BATCH)) == 0)
+    {
+        return NULL;
+    }
+    
+    for (size_t i = 1; i < num_items; ++i)
+    {
+        gp_deque_push(&worker->deque, (struct gp_task *) items[i]); /* The deque was empty; it cannot be full. */
+    }
+    if (num_items > 1) /* Let a sleeping worker steal what this one cannot play at once. */
+    {
+        for (size_t i = 1; i < pool->num_workers; ++i)
+        {
+            struct gp_worker *peer;
+            
+            peer = &pool->workers[(worker->index + i) % pool->num_workers];
+            if (atomic_load(&peer->sleeping))
+            {
+                gp_wake(peer);
+                break;
+            }
+        }
+    }
+    
+    return (struct gp_task *) items[0];
+}
+
+void gp_sleep(const struct game_pool *pool, struct gp_worker *worker)
+{
+    pthread_mutex_lock(&worker->lock);
+    atomic_store(&worker->sleeping, true); /* Seen by any producer whose task is not seen in the inbox. */
+    if (worker->inbox->mr_is_empty(worker->inbox) && atomic_load(&pool->running))
+    {
+        pthread_cond_wait(&worker->wake, &worker->lock);
+    }
+    atomic_store(&worker->sleeping, false);
+    pthread_mutex_unlock(&worker->lock);
+}
+
+void gp_wake(struct gp_worker *worker)
+{
+    if (atomic_load(&worker->sleeping))
+    {
+        pthread_mutex_lock(&worker->lock);
+        pthread_cond_signal(&worker->wake);
+        pthread_mutex_unlock(&worker->lock);
+    }
+}
+
+struct gp_task *gp_steal(struct game_pool *pool, const struct gp_worker *worker)
+{
+    struct gp_task *task;
+    
+    for (size_t i = 1; i < pool->num_workers; ++i)
+    {
+        if ((task = gp_deque_steal(&pool->workers[(worker->index + i) % pool->num_workers].deque)) != NULL)
+        {
+            return task;
+        }
+    }
+    
+    return NULL;
+}
+
+void gp_play(struct gp_task *task)
+{
+    struct Game over;
+    
+    for (size_t i = 0; i < task->num_moves; ++i)
+    {
+        task->game.cursor = task->moves[i].cursor;
+        if (task->moves[i].place)
+        {
+            task->game.updateBoard(&task->game);
+        }
+    }
+    
+    over            = task->game; /* isGameOver records the winner in the game; the played game is left as it is. */
+    task->game_over = over.isGameOver(&over);
+}
+
+void gp_return(struct gp_task *task)
+{
+    struct gp_results *results;
+    const uint64_t    count = 1;
+    
+    results = task->results;
+    
+    /* An I/O thread has no more tasks out than its ring holds, so the push does not fail; never drop a task. */
+    while (results->ring->mr_push(results->ring, task) == -1)
+    {
+        sched_yield();
+    }
+    
+    if (!atomic_exchange(&results->signalled, true) && write(results->event_fd, &count, sizeof(count)) == -1)
+    {
+        perror("\nWaking the I/O thread failed: \n");
+    }
+}
+
+static void *gp_worker_main(void *arg)
+{
+    struct gp_worker *worker;
+    struct game_pool *pool;
+    struct gp_task   *task;
+    
+    worker = (struct gp_worker *) arg;
+    pool   = worker->pool;
+    
+    while (atomic_load(&pool->running))
+    {
+        if ((task = gp_deque_take(&worker->deque)) == NULL &&
+            (task = gp_take_inbox(pool, worker)) == NULL &&
+            (task = gp_steal(pool, worker)) == NULL)
+        {
+            gp_sleep(pool, worker);
+            continue;
+        }
+        
+        gp_play(task);
+        gp_return(task);
+    }
+    
+    return NULL;
+}
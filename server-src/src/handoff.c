@@ -0,0 +1,827 @@
+#define _DEFAULT_SOURCE /* SOCK_NONBLOCK */
+
+#include "../include/client-map.h"
+#include "../include/event-loop.h"
+#include "../include/handoff.h"
+#include "../include/manager.h"
+#include "../include/room.h"
+#include <arpa/inet.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Identifies a handoff request: "RUDP".
+ */
+#define HO_MAGIC 0x52554450
+
+/**
+ * The version of the handoff records. The records are laid out by the compiler, so the successor must be built with
+ * the same layout: change the version whenever a record, or a state saved in one, changes.
+ */
+#define HO_VERSION 11
+
+/**
+ * The time a server waits for an accepted successor's request, in milliseconds; the successor sends it at once.
+ */
+#define HO_REQUEST_TIMEOUT_MS 1000
+
+/**
+ * The room id saved for a client who is not seated in a room.
+ */
+#define HO_NO_ROOM UINT32_MAX
+
+/**
+ * ho_type
+ * <p>
+ * The type of a handoff record.
+ * <ul>
+ * <li>HO_HELLO: a successor's request to hand off, and the predecessor's acceptance</li>
+ * <li>HO_REFUSE: the predecessor's refusal</li>
+ * <li>HO_CONFIG: the configuration of the predecessor</li>
+ * <li>HO_SHARD: a shard, with its server socket</li>
+ * <li>HO_ROOM: a room of the last shard</li>
+ * <li>HO_CLIENT: a client of the last shard, with its socket unless clients share the server socket</li>
+ * <li>HO_DONE: every shard has been sent</li>
+ * </ul>
+ * </p>
+ */
+enum ho_type
+{
+    HO_HELLO,
+    HO_REFUSE,
+    HO_CONFIG,
+    HO_SHARD,
+    HO_ROOM,
+    HO_CLIENT,
+    HO_DONE
+};
+
+/**
+ * ho_record
+ * <p>
+ * A handoff record; every record is sent as one message of a SOCK_SEQPACKET socket, with at most one socket attached.
+ * </p>
+ */
+struct ho_record
+{
+    uint8_t type;
+    
+    union
+    {
+        struct
+        {
+            uint32_t magic;
+            uint32_t version;
+        }            hello;
+        struct
+        {
+            uint32_t num_shards;
+            bool     single_socket;
+            uint8_t  cookie_key[SIPHASH_KEY_BYTES];
+        }            config;
+        struct
+        {
+            uint32_t room_capacity;
+            uint32_t num_rooms;
+            uint32_t num_clients;
+        }            shard;
+        struct
+        {
+            uint32_t id;
+            char     track_game[GAME_STATE_BYTES];
+            char     turn;
+            int32_t  cursor;
+            int32_t  win_condition;
+            uint64_t epoch;
+        }            room;
+        struct
+        {
+            in_addr_t addr;
+            in_port_t port;
+            uint8_t   state;
+            bool      mapped;
+            uint64_t  cid;
+            uint32_t  room_id;
+            uint8_t   seat;
+            uint8_t   s_flags;
+            uint32_t  s_seq_num;
+            uint16_t  s_length;
+            uint8_t   s_payload[S_PAYLOAD_BYTES];
+            uint8_t   r_flags;
+            uint32_t  r_seq_num;
+            uint16_t  r_length;
+            bool      awaiting_ack;
+            bool      state_pending;
+            uint8_t   num_retrans;
+            uint8_t   version;
+            uint32_t  snd_una;
+            uint32_t  snd_nxt;
+            uint32_t  rcv_nxt;
+            uint8_t   snd_wnd;
+            bool      bundle;
+            bool      delta;
+            uint16_t  state_ver;
+            uint16_t  acked_ver;
+            bool      state_acked;
+            uint8_t   states[STATE_HISTORY][STD_PAYLOAD_BYTES];
+            bool      tickets;
+            uint64_t  ticket_id;
+            bool      ticket_pending;
+            
+            struct rtt_estimator rtt;
+            struct rtx_entry     rtx[SV_RTX_SLOTS];
+        }            client;
+    };
+};
+
+/**
+ * ho_cmsg
+ * <p>
+ * Space for the control message carrying a socket, aligned for a cmsghdr.
+ * </p>
+ */
+union ho_cmsg
+{
+    char   buf[CMSG_SPACE(sizeof(int))];
+    size_t align; /* A cmsghdr is aligned as its length. */
+};
+
+/**
+ * ho_address
+ * <p>
+ * Fill in the address of the handoff path.
+ * </p>
+ * @param path - the handoff path
+ * @param addr - the address
+ * @return 0 on success, -1 if the path is too long
+ */
+int ho_address(const char *path, struct sockaddr_un *addr);
+
+/**
+ * ho_send
+ * <p>
+ * Send a record, with a socket attached.
+ * </p>
+ * @param fd - the handoff connection
+ * @param record - the record
+ * @param pass_fd - the socket to attach; -1 for none
+ * @return 0 on success, -1 on failure
+ */
+int ho_send(int fd, struct ho_record *record, int pass_fd);
+
+/**
+ * ho_recv
+ * <p>
+ * Receive a record of a type, with a socket attached if one is expected. Any other record, or a socket which is not
+ * expected, is a failure with errno set to EPROTO.
+ * </p>
+ * @param fd - the handoff connection
+ * @param record - set to the record
+ * @param type - the type of record expected
+ * @param passed_fd - set to the socket attached; NULL if none is expected
+ * @return 0 on success, -1 on failure
+ */
+int ho_recv(int fd, struct ho_record *record, enum ho_type type, int *passed_fd);
+
+/**
+ * ho_recv_room
+ * <p>
+ * Receive a room of a shard, and open a room for it with the same game.
+ * </p>
+ * @param set - the server settings
+ * @param shard - the settings of the shard
+ * @param rooms - the rooms opened for the shard, by the id of the predecessor's room
+ * @param room_capacity - the length of rooms
+ * @return 0 on success, -1 on failure
+ */
+int ho_recv_room(const struct server_settings *set, struct server_settings *shard, struct room **rooms,
+                 uint32_t room_capacity);
+
+/**
+ * ho_recv_client
+ * <p>
+ * Receive a client of a shard, with its socket, and connect it as the predecessor left it: seated in its room, and
+ * mapped by address if it was, and by connection ID if it had one.
+ * </p>
+ * @param set - the server settings
+ * @param shard - the settings of the shard
+ * @param rooms - the rooms opened for the shard, by the id of the predecessor's room
+ * @param room_capacity - the length of rooms
+ * @return 0 on success, -1 on failure
+ */
+int ho_recv_client(const struct server_settings *set, struct server_settings *shard, struct room **rooms,
+                   uint32_t room_capacity);
+
+/**
+ * ho_check_v2
+ * <p>
+ * Check the state of a client's version 2 connection, if it has one: the send window fits the ring, and so do the
+ * packets in it.
+ * </p>
+ * @param record - the client record
+ * @return true if the state is sound, or the connection is version 1
+ */
+bool ho_check_v2(const struct ho_record *record);
+
+int ho_connect(struct server_settings *set)
+{
+    struct sockaddr_un addr;
+    struct ho_record   record;
+    int                fd;
+    
+    if (ho_address(set->handoff_path, &addr) == -1)
+    {
+        return -1;
+    }
+    
+    if ((fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) == -1) // NOLINT(android-cloexec-socket) : SOCK_CLOEXEC dne
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_un)) == -1)
+    {
+        close(fd);
+        if (errno == ENOENT || errno == ECONNREFUSED) /* No server listens: start without clients. */
+        {
+            errno = 0;
+            return 0;
+        }
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    
+    memset(&record, 0, sizeof(struct ho_record));
+    record.type          = HO_HELLO;
+    record.hello.magic   = HO_MAGIC;
+    record.hello.version = HO_VERSION;
+    if (ho_send(fd, &record, -1) == -1 || ho_recv(fd, &record, HO_HELLO, NULL) == -1)
+    {
+        (void) fprintf(stderr, "\nThe server at %s did not hand off\n", set->handoff_path);
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        close(fd);
+        return -1;
+    }
+    printf("\nTaking over from the server at %s\n", set->handoff_path);
+    
+    /* The predecessor stops serving before it sends its configuration. */
+    if (ho_recv(fd, &record, HO_CONFIG, NULL) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        close(fd);
+        return -1;
+    }
+    if (record.config.num_shards < 1 || record.config.num_shards > SV_MAX_WORKERS)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, EPROTO);
+        close(fd);
+        return -1;
+    }
+    
+    /* The shards and their sockets are taken over as they are, and the cookies the predecessor made stay valid. */
+    set->handoff_fd    = fd;
+    set->num_workers   = record.config.num_shards;
+    set->single_socket = record.config.single_socket;
+    memcpy(set->cookie_key, record.config.cookie_key, SIPHASH_KEY_BYTES);
+    
+    return 0;
+}
+
+int ho_recv_shard(const struct server_settings *set, struct server_settings *shard)
+{
+    struct ho_record record;
+    struct room      **rooms;
+    uint32_t         room_capacity;
+    uint32_t         num_clients;
+    uint32_t         num_rooms;
+    
+    if (ho_recv(set->handoff_fd, &record, HO_SHARD, &shard->server_fd) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    room_capacity = record.shard.room_capacity;
+    num_rooms     = record.shard.num_rooms;
+    num_clients   = record.shard.num_clients;
+    
+    /* The rooms are opened in the order they arrive; the clients find theirs by the predecessor's room id. */
+    if ((rooms = (struct room **) s_calloc((room_capacity) ? room_capacity : 1, sizeof(struct room *),
+                                           __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return -1;
+    }
+    for (uint32_t i = 0; !errno && i < num_rooms; ++i)
+    {
+        ho_recv_room(set, shard, rooms, room_capacity);
+    }
+    for (uint32_t i = 0; !errno && i < num_clients; ++i)
+    {
+        ho_recv_client(set, shard, rooms, room_capacity);
+    }
+    free(rooms);
+    
+    return (errno) ? -1 : 0;
+}
+
+int ho_recv_room(const struct server_settings *set, struct server_settings *shard, struct room **rooms,
+                 uint32_t room_capacity)
+{
+    struct ho_record record;
+    struct room      *room;
+    
+    if (ho_recv(set->handoff_fd, &record, HO_ROOM, NULL) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    if (record.room.id >= room_capacity || rooms[record.room.id] != NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, EPROTO);
+        return -1;
+    }
+    
+    if ((room = shard->rooms->rt_open(shard->rooms)) == NULL)
+    {
+        return -1;
+    }
+    memcpy(room->game->trackGame, record.room.track_game, GAME_STATE_BYTES);
+    room->game->turn         = record.room.turn;
+    room->game->cursor       = record.room.cursor;
+    room->game->winCondition = record.room.win_condition;
+    
+    /* The packets of the room's clients name the game they belong to by its epoch. */
+    room->epoch = record.room.epoch;
+    if (shard->rooms->epochs < room->epoch)
+    {
+        shard->rooms->epochs = room->epoch;
+    }
+    rooms[record.room.id] = room;
+    
+    return 0;
+}
+
+int ho_recv_client(const struct server_settings *set, struct server_settings *shard, struct room **rooms,
+                   uint32_t room_capacity)
+{
+    struct ho_record   record;
+    struct conn_client *client;
+    struct room        *room;
+    int                c_fd;
+    
+    if (ho_recv(set->handoff_fd, &record, HO_CLIENT, (set->single_socket) ? NULL : &c_fd) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    if (set->single_socket)
+    {
+        c_fd = shard->server_fd;
+    }
+    
+    /* The client must be seated in an open seat of a room of the shard, if in any. */
+    room = (record.client.room_id < room_capacity) ? rooms[record.client.room_id] : NULL;
+    if ((record.client.room_id != HO_NO_ROOM &&
+         (room == NULL || record.client.seat >= ROOM_CAPACITY || room->players[record.client.seat].generation != 0)) ||
+        record.client.s_length > S_PAYLOAD_BYTES || record.client.state > CONN_HELD ||
+        !ho_check_v2(&record))
+    {
+        if (!set->single_socket)
+        {
+            close(c_fd);
+        }
+        fatal_errno(__FILE__, __func__, __LINE__, EPROTO);
+        return -1;
+    }
+    
+    if ((client = create_conn_client(shard)) == NULL)
+    {
+        if (!set->single_socket)
+        {
+            close(c_fd);
+        }
+        return -1;
+    }
+    client->c_fd        = c_fd; /* Closed with the client from now on. */
+    client->rto.data    = client;
+    client->delack.data = client;
+    
+    client->addr->sin_family      = AF_INET;
+    client->addr->sin_port        = record.client.port;
+    client->addr->sin_addr.s_addr = record.client.addr;
+    client->state                 = (enum conn_state) record.client.state;
+    client->awaiting_ack          = record.client.awaiting_ack;
+    client->state_pending         = record.client.state_pending;
+    client->num_retrans           = record.client.num_retrans;
+    client->version               = record.client.version;
+    client->snd_una               = record.client.snd_una;
+    client->snd_nxt               = record.client.snd_nxt;
+    client->rcv_nxt               = record.client.rcv_nxt;
+    client->snd_wnd               = record.client.snd_wnd;
+    client->bundle                = record.client.bundle;
+    client->delta                 = record.client.delta;
+    client->state_ver             = record.client.state_ver;
+    client->acked_ver             = record.client.acked_ver;
+    client->state_acked           = record.client.state_acked;
+    client->tickets               = record.client.tickets;
+    client->ticket_id             = record.client.ticket_id;
+    client->ticket_pending        = record.client.ticket_pending;
+    client->rtt                   = record.client.rtt;
+    memcpy(client->s_payload, record.client.s_payload, S_PAYLOAD_BYTES);
+    memcpy(client->rtx, record.client.rtx, sizeof(client->rtx));
+    memcpy(client->states, record.client.states, sizeof(client->states));
+    create_packet(client->s_packet, record.client.s_flags, record.client.s_seq_num, record.client.s_length,
+                  (record.client.s_length) ? client->s_payload : NULL);
+    create_packet(client->r_packet, record.client.r_flags, record.client.r_seq_num, record.client.r_length, NULL);
+    
+    if (room != NULL)
+    {
+        shard->rooms->rt_seat(shard->rooms, room, client, record.client.seat);
+    }
+    
+    /* The clients the predecessor found by address are found by address. */
+    if (record.client.mapped && shard->clients->cm_put(shard->clients, client->addr, client) == -1)
+    {
+        return -1; // errno set
+    }
+    client->mapped = record.client.mapped;
+    
+    /* The connection IDs stay with their shards, whose sockets keep their places among those bound to the address. */
+    if (record.client.cid != 0 && shard->cids->cm_put_id(shard->cids, record.client.cid, client) == -1)
+    {
+        return -1; // errno set
+    }
+    client->cid = record.client.cid;
+    if (client->state == CONN_SYN_RCVD)
+    {
+        ++shard->num_half_open;
+    }
+    if (!set->single_socket)
+    {
+        if (shard->bio->bio_offload(shard->bio, client->c_fd) == -1)
+        {
+            return -1; // errno set
+        }
+        if (shard->loop->el_add(shard->loop, client->c_fd, client) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno);
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+bool ho_check_v2(const struct ho_record *record)
+{
+    if (record->client.version == PROTO_V1)
+    {
+        return true;
+    }
+    if (record->client.version != PROTO_V2 || record->client.snd_wnd > SV_MAX_WINDOW ||
+        (uint32_t) (record->client.snd_nxt - record->client.snd_una) > SV_RTX_SLOTS)
+    {
+        return false;
+    }
+    
+    for (uint32_t seq_num = record->client.snd_una; seq_num != record->client.snd_nxt; ++seq_num)
+    {
+        if (record->client.rtx[seq_num & (SV_RTX_SLOTS - 1)].length > MAX_PUSH_BYTES)
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+int ho_finish(struct server_settings *set)
+{
+    struct ho_record record;
+    
+    if (ho_recv(set->handoff_fd, &record, HO_DONE, NULL) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    close(set->handoff_fd);
+    set->handoff_fd = -1;
+    
+    printf("\nTook over from the server at %s\n", set->handoff_path);
+    
+    return 0;
+}
+
+int ho_listen(struct server_settings *set)
+{
+    struct sockaddr_un addr;
+    
+    if (ho_address(set->handoff_path, &addr) == -1)
+    {
+        return -1;
+    }
+    
+    if ((set->handoff_listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    
+    /* Whatever is left at the path belongs to a predecessor which has handed off, or which did not close. */
+    if (unlink(set->handoff_path) == -1 && errno != ENOENT)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    errno = 0;
+    if (bind(set->handoff_listen_fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_un)) == -1 ||
+        listen(set->handoff_listen_fd, 1) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    
+    if (set->loop->el_add(set->loop, set->handoff_listen_fd, NULL) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    
+    return 0;
+}
+
+bool ho_accept(struct server_settings *set)
+{
+    int fd;
+    
+    /* Accept until the socket would block, as readiness may be edge-triggered. */
+    while ((fd = accept(set->handoff_listen_fd, NULL, NULL)) != -1)
+    {
+        const struct timeval timeout = {.tv_sec  = HO_REQUEST_TIMEOUT_MS / 1000,
+                                        .tv_usec = (HO_REQUEST_TIMEOUT_MS % 1000) * 1000};
+        struct ho_record     record;
+        
+        /* The request is awaited on the I/O thread; a successor which does not send it holds the clients up. */
+        if (set->handoff_fd == -1 &&
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0 &&
+            ho_recv(fd, &record, HO_HELLO, NULL) == 0 &&
+            record.hello.magic == HO_MAGIC && record.hello.version == HO_VERSION &&
+            ho_send(fd, &record, -1) == 0)
+        {
+            printf("\nHanding off to a new server\n");
+            set->handoff_fd = fd;
+            continue;
+        }
+        
+        memset(&record, 0, sizeof(struct ho_record));
+        record.type = HO_REFUSE;
+        (void) ho_send(fd, &record, -1);
+        close(fd);
+        (void) fprintf(stderr, "\nRefused to hand off to a new server\n");
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+        perror("\nAccepting a new server failed: \n");
+    }
+    errno = 0;
+    
+    return set->handoff_fd != -1;
+}
+
+int ho_send_config(const struct server_settings *set)
+{
+    struct ho_record record;
+    
+    memset(&record, 0, sizeof(struct ho_record));
+    record.type                 = HO_CONFIG;
+    record.config.num_shards    = (uint32_t) set->num_workers;
+    record.config.single_socket = set->single_socket;
+    memcpy(record.config.cookie_key, set->cookie_key, SIPHASH_KEY_BYTES);
+    if (ho_send(set->handoff_fd, &record, -1) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int ho_send_shard(const struct server_settings *set, const struct server_settings *shard)
+{
+    struct ho_record record;
+    
+    memset(&record, 0, sizeof(struct ho_record));
+    record.type                = HO_SHARD;
+    record.shard.room_capacity = (uint32_t) shard->rooms->capacity;
+    record.shard.num_rooms     = (uint32_t) shard->rooms->count;
+    record.shard.num_clients   = (uint32_t) shard->conns->count;
+    if (ho_send(set->handoff_fd, &record, shard->server_fd) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    
+    for (size_t i = 0; i < shard->rooms->capacity; ++i)
+    {
+        const struct room *room;
+        
+        if ((room = shard->rooms->rooms[i]) == NULL)
+        {
+            continue;
+        }
+        
+        memset(&record, 0, sizeof(struct ho_record));
+        record.type               = HO_ROOM;
+        record.room.id            = room->id;
+        record.room.turn          = room->game->turn;
+        record.room.cursor        = room->game->cursor;
+        record.room.win_condition = room->game->winCondition;
+        record.room.epoch         = room->epoch;
+        memcpy(record.room.track_game, room->game->trackGame, GAME_STATE_BYTES);
+        if (ho_send(set->handoff_fd, &record, -1) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno);
+            return -1;
+        }
+    }
+    
+    for (size_t i = 0; i < shard->conns->count; ++i)
+    {
+        const struct conn_client *client;
+        
+        client = shard->conns->ct_at(shard->conns, i);
+        memset(&record, 0, sizeof(struct ho_record));
+        record.type                 = HO_CLIENT;
+        record.client.addr           = client->addr->sin_addr.s_addr;
+        record.client.port           = client->addr->sin_port;
+        record.client.state          = (uint8_t) client->state;
+        record.client.mapped         = client->mapped;
+        record.client.cid            = client->cid;
+        record.client.room_id        = (client->room != NULL) ? client->room->id : HO_NO_ROOM;
+        record.client.seat           = client->seat;
+        record.client.s_flags        = client->s_packet->flags;
+        record.client.s_seq_num      = client->s_packet->seq_num;
+        record.client.s_length       = client->s_packet->length;
+        record.client.r_flags        = client->r_packet->flags;
+        record.client.r_seq_num      = client->r_packet->seq_num;
+        record.client.r_length       = client->r_packet->length;
+        record.client.awaiting_ack   = client->awaiting_ack;
+        record.client.state_pending  = client->state_pending;
+        record.client.num_retrans    = client->num_retrans;
+        record.client.version        = client->version;
+        record.client.snd_una        = client->snd_una;
+        record.client.snd_nxt        = client->snd_nxt;
+        record.client.rcv_nxt        = client->rcv_nxt;
+        record.client.snd_wnd        = client->snd_wnd;
+        record.client.bundle         = client->bundle;
+        record.client.delta          = client->delta;
+        record.client.state_ver      = client->state_ver;
+        record.client.acked_ver      = client->acked_ver;
+        record.client.state_acked    = client->state_acked;
+        record.client.tickets        = client->tickets;
+        record.client.ticket_id      = client->ticket_id;
+        record.client.ticket_pending = client->ticket_pending;
+        record.client.rtt            = client->rtt;
+        memcpy(record.client.s_payload, client->s_payload, S_PAYLOAD_BYTES);
+        memcpy(record.client.rtx, client->rtx, sizeof(record.client.rtx));
+        memcpy(record.client.states, client->states, sizeof(record.client.states));
+        if (ho_send(set->handoff_fd, &record, (set->single_socket) ? -1 : client->c_fd) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno);
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+int ho_send_done(const struct server_settings *set)
+{
+    struct ho_record record;
+    
+    memset(&record, 0, sizeof(struct ho_record));
+    record.type = HO_DONE;
+    if (ho_send(set->handoff_fd, &record, -1) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return -1;
+    }
+    
+    return 0;
+}
+
+void close_handoff(struct server_settings *set)
+{
+    if (set->handoff_listen_fd != -1)
+    {
+        close(set->handoff_listen_fd);
+        if (set->handoff_fd == -1) /* Otherwise, the successor listens on the path now. */
+        {
+            unlink(set->handoff_path);
+        }
+    }
+    if (set->handoff_fd != -1)
+    {
+        close(set->handoff_fd);
+    }
+}
+
+int ho_address(const char *path, struct sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path))
+    {
+        advise_usage("Handoff path must be shorter than 108 characters");
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    
+    return 0;
+}
+
+int ho_send(int fd, struct ho_record *record, int pass_fd)
+{
+    union ho_cmsg control;
+    struct iovec  iov;
+    struct msghdr msg;
+    
+    memset(&msg, 0, sizeof(struct msghdr));
+    iov.iov_base    = record;
+    iov.iov_len     = sizeof(struct ho_record);
+    msg.msg_iov     = &iov;
+    msg.msg_iovlen  = 1;
+    
+    if (pass_fd != -1)
+    {
+        struct cmsghdr *cmsg;
+        
+        memset(&control, 0, sizeof(control));
+        msg.msg_control    = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &pass_fd, sizeof(int));
+    }
+    
+    /* The socket is duplicated into the successor; the server's own copy stays open until it closes. */
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) == -1)
+    {
+        return -1;
+    }
+    
+    return 0;
+}
+
+int ho_recv(int fd, struct ho_record *record, enum ho_type type, int *passed_fd)
+{
+    union ho_cmsg control;
+    struct iovec  iov;
+    struct msghdr msg;
+    ssize_t       num_bytes;
+    int           received_fd;
+    
+    memset(&msg, 0, sizeof(struct msghdr));
+    iov.iov_base       = record;
+    iov.iov_len        = sizeof(struct ho_record);
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    
+    if ((num_bytes = recvmsg(fd, &msg, 0)) == -1)
+    {
+        return -1;
+    }
+    
+    received_fd = -1;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            memcpy(&received_fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    
+    /* A closed connection, a short record, or a socket where none belongs: the peer is not a server of this build. */
+    if (num_bytes != sizeof(struct ho_record) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ||
+        record->type != type || (passed_fd == NULL && received_fd != -1) || (passed_fd != NULL && received_fd == -1))
+    {
+        if (received_fd != -1)
+        {
+            close(received_fd);
+        }
+        errno = EPROTO;
+        return -1;
+    }
+    if (passed_fd != NULL)
+    {
+        *passed_fd = received_fd;
+    }
+    
+    return 0;
+}
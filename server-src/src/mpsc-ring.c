@@ -0,0 +1,151 @@
+#include "../include/manager.h"
+#include "../include/mpsc-ring.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * mr_push
+ * <p>
+ * Add an item at the tail of a ring. Safe to call from any number of threads at once.
+ * </p>
+ * @param ring - the ring
+ * @param item - the item
+ * @return 0 on success, -1 with errno set to EAGAIN if the ring is full
+ */
+int mr_push(struct mpsc_ring *ring, void *item);
+
+/**
+ * mr_pop_batch
+ * <p>
+ * Take up to max items from the head of a ring, in the order they were pushed. Only the consumer may pop.
+ * </p>
+ * @param ring - the ring
+ * @param items - set to the items taken
+ * @param max - the most items to take
+ * @return the number of items taken, 0 if the ring is empty
+ */
+size_t mr_pop_batch(struct mpsc_ring *ring, void **items, size_t max);
+
+/**
+ * mr_is_empty
+ * <p>
+ * Check whether the next item for the consumer has been published. Only the consumer may check.
+ * </p>
+ * @param ring - the ring
+ * @return true if the ring is empty
+ */
+bool mr_is_empty(struct mpsc_ring *ring);
+
+struct mpsc_ring *init_mpsc_ring(size_t capacity)
+{
+    struct mpsc_ring *ring;
+    size_t           slots;
+    
+    for (slots = 1; slots < capacity; slots <<= 1)
+    {}
+    
+    if ((ring = (struct mpsc_ring *) s_calloc(1, sizeof(struct mpsc_ring), __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return NULL;
+    }
+    if ((ring->slots = (struct mr_slot *) s_calloc(slots, sizeof(struct mr_slot),
+                                                   __FILE__, __func__, __LINE__)) == NULL)
+    {
+        free(ring);
+        return NULL;
+    }
+    
+    ring->capacity = slots;
+    for (size_t i = 0; i < slots; ++i) /* Every slot is free for the producer of the first lap. */
+    {
+        atomic_init(&ring->slots[i].seq, i);
+    }
+    atomic_init(&ring->tail, 0);
+    
+    ring->mr_push      = mr_push;
+    ring->mr_pop_batch = mr_pop_batch;
+    ring->mr_is_empty  = mr_is_empty;
+    
+    return ring;
+}
+
+int free_mpsc_ring(struct mpsc_ring *ring)
+{
+    if (ring == NULL)
+    {
+        errno = EFAULT;
+        return -1;
+    }
+    
+    free(ring->slots);
+    free(ring);
+    
+    return 0;
+}
+
+int mr_push(struct mpsc_ring *ring, void *item)
+{
+    struct mr_slot *slot;
+    size_t         pos;
+    
+    pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    for (;;)
+    {
+        intptr_t diff;
+        
+        slot = &ring->slots[pos & (ring->capacity - 1)];
+        diff = (intptr_t) atomic_load_explicit(&slot->seq, memory_order_acquire) - (intptr_t) pos;
+        if (diff == 0) /* The slot is free: claim its position. */
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        } else if (diff < 0) /* The slot still holds the item of the last lap: the ring is full. */
+        {
+            errno = EAGAIN;
+            return -1;
+        } else /* Another producer claimed the position first. */
+        {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+    
+    /* Sequentially consistent, so a producer which then looks for a sleeping consumer cannot miss it. */
+    slot->item = item;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_seq_cst);
+    
+    return 0;
+}
+
+size_t mr_pop_batch(struct mpsc_ring *ring, void **items, size_t max)
+{
+    size_t num_items;
+    
+    for (num_items = 0; num_items < max; ++num_items)
+    {
+        struct mr_slot *slot;
+        
+        slot = &ring->slots[ring->head & (ring->capacity - 1)];
+        if (atomic_load_explicit(&slot->seq, memory_order_seq_cst) != ring->head + 1)
+        {
+            break;
+        }
+        items[num_items] = slot->item;
+        atomic_store_explicit(&slot->seq, ring->head + ring->capacity, memory_order_release); /* Free for next lap. */
+        ++ring->head;
+    }
+    
+    return num_items;
+}
+
+bool mr_is_empty(struct mpsc_ring *ring)
+{
+    const struct mr_slot *slot;
+    
+    slot = &ring->slots[ring->head & (ring->capacity - 1)];
+    
+    return atomic_load_explicit(&slot->seq, memory_order_seq_cst) != ring->head + 1;
+}
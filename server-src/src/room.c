@@ -0,0 +1,432 @@
+#include "../include/Game.h"
+#include "../include/manager.h"
+#include "../include/room.h"
+#include "../include/server-util.h"
+#include <errno.h>
+#include <stdlib.h>
+
+/**
+ * The number of room ids a new room table can hold before it must grow.
+ */
+#define RT_BASE_CAPACITY 16
+
+/**
+ * rt_join
+ * <p>
+ * Seat a client in the first room with an open seat. If no room has an open seat, create a new room.
+ * </p>
+ * @param table - the room table
+ * @param client - the client to seat
+ * @return the room the client was seated in, NULL on failure
+ */
+struct room *rt_join(struct room_table *table, struct conn_client *client);
+
+/**
+ * rt_leave
+ * <p>
+ * Remove a client from its room. If the room is then empty, destroy it; otherwise, reset its game and open the seat.
+ * </p>
+ * @param table - the room table
+ * @param client - the client leaving
+ */
+void rt_leave(struct room_table *table, struct conn_client *client);
+
+/**
+ * rt_open
+ * <p>
+ * Create an empty room and put it on the list of rooms with an open seat.
+ * </p>
+ * @param table - the room table
+ * @return the new room, NULL on failure
+ */
+struct room *rt_open(struct room_table *table);
+
+/**
+ * rt_seat
+ * <p>
+ * Seat a client in an open seat of a room. If the room is then full, take it off the list of rooms with an open seat.
+ * </p>
+ * @param table - the room table
+ * @param room - the room
+ * @param client - the client to seat
+ * @param seat - the seat; must be open
+ */
+void rt_seat(struct room_table *table, struct room *room, struct conn_client *client, uint8_t seat);
+
+/**
+ * rt_replace
+ * <p>
+ * Seat a client in the seat of another, which is left without one. The room's game goes on.
+ * </p>
+ * @param table - the room table
+ * @param old - the client in the seat
+ * @param client - the client to seat
+ */
+void rt_replace(struct room_table *table, struct conn_client *old, struct conn_client *client);
+
+/**
+ * rt_mark_broadcast
+ * <p>
+ * Put a room on the broadcast list, if it is not already on it.
+ * </p>
+ * @param table - the room table
+ * @param room - the room whose game state must be broadcast
+ */
+void rt_mark_broadcast(struct room_table *table, struct room *room);
+
+/**
+ * rt_next_broadcast
+ * <p>
+ * Take the next room off the broadcast list.
+ * </p>
+ * @param table - the room table
+ * @return the room, NULL if the broadcast list is empty
+ */
+struct room *rt_next_broadcast(struct room_table *table);
+
+/**
+ * rt_mark_stalled
+ * <p>
+ * Put a room on the stalled list, if it is not already on it.
+ * </p>
+ * @param table - the room table
+ * @param room - the room whose moves were refused by the game workers
+ */
+void rt_mark_stalled(struct room_table *table, struct room *room);
+
+/**
+ * rt_next_stalled
+ * <p>
+ * Take the next room off the stalled list.
+ * </p>
+ * @param table - the room table
+ * @return the room, NULL if the stalled list is empty
+ */
+struct room *rt_next_stalled(struct room_table *table);
+
+/**
+ * create_room
+ * <p>
+ * Allocate a room and a new game for it. Give it a free id, growing the table if there is none.
+ * </p>
+ * @param table - the room table
+ * @return the new room, NULL on failure
+ */
+struct room *create_room(struct room_table *table);
+
+/**
+ * destroy_room
+ * <p>
+ * Take a room off the open, broadcast and stalled lists, free its game and the room, and free its id.
+ * </p>
+ * @param table - the room table
+ * @param room - the room to destroy
+ */
+void destroy_room(struct room_table *table, struct room *room);
+
+/**
+ * link_open
+ * <p>
+ * Put a room at the head of the list of rooms with an open seat.
+ * </p>
+ * @param table - the room table
+ * @param room - the room
+ */
+void link_open(struct room_table *table, struct room *room);
+
+/**
+ * unlink_open
+ * <p>
+ * Take a room off the list of rooms with an open seat.
+ * </p>
+ * @param table - the room table
+ * @param room - the room
+ */
+void unlink_open(struct room_table *table, struct room *room);
+
+struct room_table *init_room_table(void)
+{
+    struct room_table *table;
+    
+    if ((table = (struct room_table *) s_calloc(1, sizeof(struct room_table), __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return NULL;
+    }
+    
+    table->rt_join           = rt_join;
+    table->rt_leave          = rt_leave;
+    table->rt_open           = rt_open;
+    table->rt_seat           = rt_seat;
+    table->rt_replace        = rt_replace;
+    table->rt_mark_broadcast = rt_mark_broadcast;
+    table->rt_next_broadcast = rt_next_broadcast;
+    table->rt_mark_stalled   = rt_mark_stalled;
+    table->rt_next_stalled   = rt_next_stalled;
+    
+    return table;
+}
+
+int free_room_table(struct room_table *table)
+{
+    if (table == NULL)
+    {
+        errno = EFAULT;
+        return -1;
+    }
+    
+    for (size_t i = 0; i < table->capacity; ++i)
+    {
+        if (table->rooms[i] != NULL)
+        {
+            free(table->rooms[i]->game);
+            free(table->rooms[i]);
+        }
+    }
+    free(table->rooms);
+    free(table->free_ids);
+    free(table);
+    
+    return 0;
+}
+
+struct room *rt_join(struct room_table *table, struct conn_client *client)
+{
+    struct room *room;
+    uint8_t     seat;
+    
+    if ((room = table->first_open) == NULL && (room = rt_open(table)) == NULL)
+    {
+        return NULL;
+    }
+    
+    for (seat = 0; room->players[seat].generation != 0; ++seat)
+    {}
+    
+    rt_seat(table, room, client, seat);
+    
+    return room;
+}
+
+void rt_leave(struct room_table *table, struct conn_client *client)
+{
+    struct room *room;
+    
+    if ((room = client->room) == NULL)
+    {
+        return;
+    }
+    
+    room->players[client->seat] = (struct conn_handle) {0};
+    client->room = NULL;
+    
+    if (--room->num_players == 0)
+    {
+        destroy_room(table, room);
+        return;
+    }
+    
+    room->game->updateGameState(room->game, NULL, NULL, NULL); /* Fewer than ROOM_CAPACITY: reset game state. */
+    room->epoch     = ++table->epochs; /* Moves made against the old game are dropped, even those in play. */
+    room->num_moves = 0;
+    room->in_play   = false;
+    if (room->num_players == ROOM_CAPACITY - 1) /* The room was full; it now has an open seat. */
+    {
+        link_open(table, room);
+    }
+}
+
+struct room *rt_open(struct room_table *table)
+{
+    struct room *room;
+    
+    if ((room = create_room(table)) == NULL)
+    {
+        return NULL;
+    }
+    link_open(table, room);
+    
+    return room;
+}
+
+void rt_seat(struct room_table *table, struct room *room, struct conn_client *client, uint8_t seat)
+{
+    room->players[seat] = client->handle;
+    ++room->num_players;
+    client->room = room;
+    client->seat = seat;
+    
+    if (room->num_players == ROOM_CAPACITY)
+    {
+        unlink_open(table, room);
+    }
+}
+
+void rt_replace(struct room_table *table, struct conn_client *old, struct conn_client *client)
+{
+    (void) table;
+    
+    old->room->players[old->seat] = client->handle;
+    client->room = old->room;
+    client->seat = old->seat;
+    old->room    = NULL;
+}
+
+void rt_mark_broadcast(struct room_table *table, struct room *room)
+{
+    if (!room->do_broadcast)
+    {
+        room->do_broadcast     = true;
+        room->next_broadcast   = table->first_broadcast;
+        table->first_broadcast = room;
+    }
+}
+
+struct room *rt_next_broadcast(struct room_table *table)
+{
+    struct room *room;
+    
+    if ((room = table->first_broadcast) != NULL)
+    {
+        table->first_broadcast = room->next_broadcast;
+        room->next_broadcast   = NULL;
+        room->do_broadcast     = false;
+    }
+    
+    return room;
+}
+
+void rt_mark_stalled(struct room_table *table, struct room *room)
+{
+    if (!room->stalled)
+    {
+        room->stalled        = true;
+        room->next_stalled   = table->first_stalled;
+        table->first_stalled = room;
+    }
+}
+
+struct room *rt_next_stalled(struct room_table *table)
+{
+    struct room *room;
+    
+    if ((room = table->first_stalled) != NULL)
+    {
+        table->first_stalled = room->next_stalled;
+        room->next_stalled   = NULL;
+        room->stalled        = false;
+    }
+    
+    return room;
+}
+
+struct room *create_room(struct room_table *table)
+{
+    struct room *room;
+    uint32_t    id;
+    
+    if (table->num_free == 0) /* Double the number of room ids; all of the new ids are free. */
+    {
+        struct room **rooms;
+        uint32_t    *free_ids;
+        size_t      new_capacity;
+        
+        new_capacity = (table->capacity) ? table->capacity * 2 : RT_BASE_CAPACITY;
+        
+        if ((rooms = (struct room **) s_realloc(table->rooms, new_capacity * sizeof(struct room *),
+                                                __FILE__, __func__, __LINE__)) == NULL)
+        {
+            return NULL;
+        }
+        table->rooms = rooms;
+        if ((free_ids = (uint32_t *) s_realloc(table->free_ids, new_capacity * sizeof(uint32_t),
+                                               __FILE__, __func__, __LINE__)) == NULL)
+        {
+            return NULL;
+        }
+        table->free_ids = free_ids;
+        
+        /* Push the new ids in reverse, so the lowest is handed out first. */
+        for (size_t i = new_capacity; i > table->capacity; --i)
+        {
+            table->rooms[i - 1]                = NULL;
+            table->free_ids[table->num_free++] = (uint32_t) (i - 1);
+        }
+        table->capacity = new_capacity;
+    }
+    
+    if ((room = (struct room *) s_calloc(1, sizeof(struct room), __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return NULL;
+    }
+    if ((room->game = initializeGame()) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, ENOMEM);
+        free(room);
+        return NULL;
+    }
+    
+    id = table->free_ids[--table->num_free];
+    room->id         = id;
+    room->epoch      = ++table->epochs;
+    table->rooms[id] = room;
+    ++table->count;
+    
+    return room;
+}
+
+void destroy_room(struct room_table *table, struct room *room)
+{
+    unlink_open(table, room);
+    
+    if (room->do_broadcast) /* The broadcast list only holds rooms changed in this loop iteration; it is short. */
+    {
+        struct room **link;
+        
+        for (link = &table->first_broadcast; *link != room; link = &(*link)->next_broadcast)
+        {}
+        *link = room->next_broadcast;
+    }
+    if (room->stalled) /* The stalled list only holds rooms while the game workers are saturated; it is short. */
+    {
+        struct room **link;
+        
+        for (link = &table->first_stalled; *link != room; link = &(*link)->next_stalled)
+        {}
+        *link = room->next_stalled;
+    }
+    
+    table->rooms[room->id]             = NULL;
+    table->free_ids[table->num_free++] = room->id;
+    --table->count;
+    
+    free(room->game);
+    free(room);
+}
+
+void link_open(struct room_table *table, struct room *room)
+{
+    room->prev_open = NULL;
+    room->next_open = table->first_open;
+    if (table->first_open != NULL)
+    {
+        table->first_open->prev_open = room;
+    }
+    table->first_open = room;
+}
+
+void unlink_open(struct room_table *table, struct room *room)
+{
+    if (room->prev_open != NULL)
+    {
+        room->prev_open->next_open = room->next_open;
+    } else if (table->first_open == room)
+    {
+        table->first_open = room->next_open;
+    }
+    if (room->next_open != NULL)
+    {
+        room->next_open->prev_open = room->prev_open;
+    }
+    room->prev_open = NULL;
+    room->next_open = NULL;
+}
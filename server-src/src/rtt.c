@@ -0,0 +1,101 @@
+#include "../include/rtt.h"
+
+/**
+ * The scale of the smoothed round-trip time and of the round-trip time variation, as shifts: the smoothed time
+ * moves an eighth of the way to each sample, and the variation a quarter of the way to each deviation.
+ */
+#define RTT_SRTT_SHIFT 3
+#define RTT_RTTVAR_SHIFT 2
+
+/**
+ * rtt_sample
+ * <p>
+ * Fold a round-trip time into the estimates, and derive the timeout: the smoothed time plus four times the
+ * variation, within RTT_MIN_RTO_MS and RTT_MAX_RTO_MS.
+ * </p>
+ * @param rtt - the estimator
+ * @param sample_ms - the round-trip time, in milliseconds
+ */
+static void rtt_sample(struct rtt_estimator *rtt, uint32_t sample_ms);
+
+void rtt_init(struct rtt_estimator *rtt)
+{
+    rtt->srtt     = 0;
+    rtt->rttvar   = 0;
+    rtt->rto_ms   = RTT_INITIAL_RTO_MS;
+    rtt->measured = false;
+    rtt->timing   = false;
+}
+
+void rtt_start(struct rtt_estimator *rtt, uint32_t seq_num, uint64_t now_ms)
+{
+    if (rtt->timing)
+    {
+        return;
+    }
+    
+    rtt->timing    = true;
+    rtt->timed_seq = seq_num;
+    rtt->timed_ms  = now_ms;
+}
+
+void rtt_ack(struct rtt_estimator *rtt, uint32_t seq_num, uint64_t now_ms)
+{
+    /* Sequence numbers wrap: the packets up to seq_num include the timed one if it is not after seq_num. */
+    if (!rtt->timing || (int32_t) (seq_num - rtt->timed_seq) < 0)
+    {
+        return;
+    }
+    
+    rtt->timing = false;
+    rtt_sample(rtt, (now_ms - rtt->timed_ms > UINT32_MAX) ? UINT32_MAX : (uint32_t) (now_ms - rtt->timed_ms));
+}
+
+void rtt_stop(struct rtt_estimator *rtt)
+{
+    rtt->timing = false;
+}
+
+void rtt_backoff(struct rtt_estimator *rtt)
+{
+    rtt->timing = false;
+    rtt->rto_ms = (rtt->rto_ms > RTT_MAX_RTO_MS / 2) ? RTT_MAX_RTO_MS : rtt->rto_ms * 2;
+}
+
+static void rtt_sample(struct rtt_estimator *rtt, uint32_t sample_ms)
+{
+    uint32_t deviation;
+    uint32_t rto_ms;
+    
+    if (sample_ms > RTT_MAX_RTO_MS)
+    {
+        sample_ms = RTT_MAX_RTO_MS; /* Keeps the scaled estimates from overflowing. */
+    }
+    
+    if (!rtt->measured)
+    {
+        /* The first sample: the variation is half the round-trip time. */
+        rtt->srtt     = sample_ms << RTT_SRTT_SHIFT;
+        rtt->rttvar   = (sample_ms << RTT_RTTVAR_SHIFT) / 2;
+        rtt->measured = true;
+    } else
+    {
+        deviation = (sample_ms > rtt->srtt >> RTT_SRTT_SHIFT) ? sample_ms - (rtt->srtt >> RTT_SRTT_SHIFT)
+                                                              : (rtt->srtt >> RTT_SRTT_SHIFT) - sample_ms;
+        
+        /* RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, then SRTT = 7/8 SRTT + 1/8 R, on the scaled values. */
+        rtt->rttvar = rtt->rttvar - (rtt->rttvar >> RTT_RTTVAR_SHIFT) + deviation;
+        rtt->srtt   = rtt->srtt - (rtt->srtt >> RTT_SRTT_SHIFT) + sample_ms;
+    }
+    
+    /* The variation is kept at four times its value, which is the multiple the timeout takes of it. */
+    rto_ms = (rtt->srtt >> RTT_SRTT_SHIFT) + ((rtt->rttvar > RTT_GRANULARITY_MS) ? rtt->rttvar : RTT_GRANULARITY_MS);
+    if (rto_ms < RTT_MIN_RTO_MS)
+    {
+        rto_ms = RTT_MIN_RTO_MS;
+    } else if (rto_ms > RTT_MAX_RTO_MS)
+    {
+        rto_ms = RTT_MAX_RTO_MS;
+    }
+    rtt->rto_ms = rto_ms;
+}
@@ -2,7 +2,9 @@
 // Created by Maxwell Babey on 11/9/22.
 //
 
+#include "../include/client-map.h"
 #include "../include/manager.h"
+#include "../include/room.h"
 #include "../include/server-util.h"
 #include "../include/setup.h"
 #include <arpa/inet.h>
@@ -13,6 +15,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 char *check_ip(char *ip, uint8_t base)
@@ -107,6 +110,146 @@ in_port_t parse_port(const char *buffer, uint8_t base)
     return port;
 }
 
+size_t parse_num_workers(const char *buffer, uint8_t base)
+{
+    const char *msg = NULL;
+    char       *end;
+    long       sl;
+    
+    sl = strtol(buffer, &end, base);
+    
+    if (end == buffer)
+    {
+        msg = "Number of worker threads must be a decimal number";
+    } else if (*end != '\0')
+    {
+        msg = "Number of worker threads input must not have extra characters appended";
+    } else if (sl < 1 || sl > SV_MAX_WORKERS)
+    {
+        msg = "Number of worker threads must be between 1 and 64";
+    }
+    
+    if (msg)
+    {
+        advise_usage(msg);
+        return 1;
+    }
+    
+    return (size_t) sl;
+}
+
+size_t parse_num_game_workers(const char *buffer, uint8_t base)
+{
+    const char *msg = NULL;
+    char       *end;
+    long       sl;
+    
+    sl = strtol(buffer, &end, base);
+    
+    if (end == buffer)
+    {
+        msg = "Number of game worker threads must be a decimal number";
+    } else if (*end != '\0')
+    {
+        msg = "Number of game worker threads input must not have extra characters appended";
+    } else if (sl < 0 || sl > GP_MAX_WORKERS)
+    {
+        msg = "Number of game worker threads must be between 0 and 64";
+    }
+    
+    if (msg)
+    {
+        advise_usage(msg);
+        return 0;
+    }
+    
+    return (size_t) sl;
+}
+
+uint8_t parse_window(const char *buffer, uint8_t base)
+{
+    const char *msg = NULL;
+    char       *end;
+    long       sl;
+    
+    sl = strtol(buffer, &end, base);
+    
+    if (end == buffer)
+    {
+        msg = "Send window must be a decimal number";
+    } else if (*end != '\0')
+    {
+        msg = "Send window input must not have extra characters appended";
+    } else if (sl < 1 || sl > SV_MAX_WINDOW)
+    {
+        msg = "Send window must be between 1 and 31";
+    }
+    
+    if (msg)
+    {
+        advise_usage(msg);
+        return SV_DEFAULT_WINDOW;
+    }
+    
+    return (uint8_t) sl;
+}
+
+uint8_t parse_dup_thresh(const char *buffer, uint8_t base)
+{
+    const char *msg = NULL;
+    char       *end;
+    long       sl;
+    
+    sl = strtol(buffer, &end, base);
+    
+    if (end == buffer)
+    {
+        msg = "Fast retransmit threshold must be a decimal number";
+    } else if (*end != '\0')
+    {
+        msg = "Fast retransmit threshold input must not have extra characters appended";
+    } else if (sl < 0 || sl > SV_MAX_WINDOW)
+    {
+        msg = "Fast retransmit threshold must be between 0 and 31";
+    }
+    
+    if (msg)
+    {
+        advise_usage(msg);
+        return SV_DEFAULT_DUP_THRESH;
+    }
+    
+    return (uint8_t) sl;
+}
+
+uint16_t parse_mtu(const char *buffer, uint8_t base)
+{
+    const char *msg = NULL;
+    char       *end;
+    long       sl;
+    
+    sl = strtol(buffer, &end, base);
+    
+    if (end == buffer)
+    {
+        msg = "Path MTU must be a decimal number";
+    } else if (*end != '\0')
+    {
+        msg = "Path MTU input must not have extra characters appended";
+    } else if (sl < SV_MIN_MTU || sl > SV_MAX_MTU)
+    {
+        msg = "Path MTU must be between 576 and 1500";
+    }
+    
+    if (msg)
+    {
+        advise_usage(msg);
+        return SV_MAX_MTU;
+    }
+    
+    return (uint16_t) sl;
+}
+
 void set_string(char **str, const char *new_str)
 {
     size_t buf = strlen(new_str) + 1;
@@ -183,29 +326,6 @@ int open_server_socket(void)
     return fd;
 }
 
-int set_readfds(struct server_settings *set, fd_set *readfds)
-{
-    struct conn_client *curr_cli;
-    int                max_fd;
-    
-    FD_ZERO(readfds); /* Clean the readfds. */
-    FD_SET(set->server_fd, readfds);
-    max_fd = set->server_fd;
-    
-    /* Select the first MAX_CLIENTS connected clients. */
-    curr_cli = set->first_conn_client;
-    for (int num_selected_cli = 0; curr_cli != NULL && num_selected_cli < MAX_CLIENTS; ++num_selected_cli)
-    {
-        FD_SET(curr_cli->c_fd, readfds); /* Add that client's fd to the set. */
-        
-        max_fd = (curr_cli->c_fd > max_fd) ? curr_cli->c_fd : max_fd; /* Set new max_fd if necessary. */
-        
-        curr_cli = curr_cli->next; /* Go to next client in list. */
-    }
-    
-    return max_fd;
-}
-
 struct conn_client *connect_client(struct server_settings *set, struct sockaddr_in *from_addr)
 {
     struct conn_client *new_client;
@@ -216,120 +336,128 @@ struct conn_client *connect_client(struct server_settings *set, struct sockaddr_
         return NULL; // errno set
     }
     *new_client->addr = *from_addr; /* Copy the sender's information into the client struct. */
+    new_client->rto.data    = new_client;
+    new_client->delack.data = new_client;
+    rtt_init(&new_client->rtt);
     
-    /* Create a new socket with an ephemeral port. */
-    if ((new_client->c_fd = open_server_socket()) == -1)
+    /* Find the client by its address: retransmitted SYNs or cookies, and every message if clients share the server
+     * socket. */
+    if (set->clients->cm_put(set->clients, new_client->addr, new_client) == -1)
     {
         return NULL; // errno set
     }
+    new_client->mapped = true;
     
-    ++set->num_conn_client; /* Increment the number of connected clients. */
-    
-    return new_client;
-}
-
-struct conn_client *create_conn_client(struct server_settings *set)
-{
-    struct conn_client *new_client;
-    if ((new_client = s_calloc(1, sizeof(struct conn_client), __FILE__, __func__, __LINE__)) == NULL)
+    if (set->single_socket) /* Exchange messages on the server socket. */
     {
-        return NULL;
-    }
-    if ((new_client->addr     = s_calloc(1, sizeof(struct sockaddr_in), __FILE__, __func__, __LINE__)) == NULL)
-    {
-        free(new_client);
-        return NULL;
-    }
-    if ((new_client->s_packet = s_calloc(1, sizeof(struct packet), __FILE__, __func__, __LINE__)) == NULL)
-    {
-        free(new_client->addr);
-        free(new_client);
-        return NULL;
-    }
-    if ((new_client->r_packet = s_calloc(1, sizeof(struct packet), __FILE__, __func__, __LINE__)) == NULL)
-    {
-        free(new_client->addr);
-        free(new_client->s_packet);
-        free(new_client);
-        return NULL;
-    }
-    
-    set->mm->mm_add(set->mm, new_client->r_packet); /* Add the members of new client first that they are freed first. */
-    set->mm->mm_add(set->mm, new_client->s_packet);
-    set->mm->mm_add(set->mm, new_client->addr);
-    set->mm->mm_add(set->mm, new_client);
-    
-    if (set->first_conn_client == NULL) /* Add the new client to the back of the connected client list. */
-    {
-        set->first_conn_client = new_client;
+        new_client->c_fd = set->server_fd;
     } else
     {
-        struct conn_client *curr_node;
-        
-        /* Iterate to the end of the list. */
-        for (curr_node = set->first_conn_client;
-             curr_node->next != NULL;
-             curr_node = curr_node->next)
-        {}
+        /* Create a new socket with an ephemeral port. */
+        if ((new_client->c_fd = open_server_socket()) == -1)
+        {
+            return NULL; // errno set
+        }
+        if (set->bio->bio_offload(set->bio, new_client->c_fd) == -1)
+        {
+            return NULL; // errno set
+        }
         
-        curr_node->next = new_client;
+        if (set->loop->el_add(set->loop, new_client->c_fd, new_client) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno);
+            return NULL;
+        }
     }
     
     return new_client;
 }
 
+struct conn_client *create_conn_client(struct server_settings *set)
+{
+    return set->conns->ct_insert(set->conns); // errno set on failure
+}
+
 void remove_client(struct server_settings *set, struct conn_client *client)
 {
-    /* If the client being disconnected is the first connected client,
-     * set the first connected client to the second connected client. */
-    if (set->first_conn_client == client)
-    {
-        set->first_conn_client = set->first_conn_client->next;
-        delete_conn_client(set, client);
-    } else
-    {
-        struct conn_client *curr_cli;
-        
-        /* Iterate through the list until the disconnecting client is next in the list or until the end of the list. */
-        for (curr_cli = set->first_conn_client;
-             curr_cli->next != client && curr_cli->next != NULL;
-             curr_cli = curr_cli->next)
-        {}
-        
-        if (curr_cli->next == client) /* If the disconnecting client is in the list. */
-        {
-            curr_cli->next = curr_cli->next->next; /* A -> B -> C ==> A -> C */
-            delete_conn_client(set, client);
-        }
-    }
+    set->rooms->rt_leave(set->rooms, client);
+    delete_conn_client(set, client);
 }
 
 void delete_conn_client(struct server_settings *set, struct conn_client *client)
 {
-    --set->num_conn_client;
-    close(client->c_fd);
-    set->mm->mm_free(set->mm, client->r_packet);
-    set->mm->mm_free(set->mm, client->s_packet);
-    set->mm->mm_free(set->mm, client->addr);
-    set->mm->mm_free(set->mm, client);
-    client = NULL;
+    set->timers->tw_cancel(set->timers, &client->rto);
+    set->timers->tw_cancel(set->timers, &client->delack);
+    client->ack_pending = false; /* The timer may have expired along with the one which removes the client. */
+    if (client->mapped)
+    {
+        set->clients->cm_remove(set->clients, client->addr);
+    }
+    if (client->cid != 0)
+    {
+        set->cids->cm_remove_id(set->cids, client->cid);
+    }
+    if (client->state == CONN_SYN_RCVD)
+    {
+        --set->num_half_open;
+    }
+    if (!set->single_socket)
+    {
+        set->loop->el_remove(set->loop, client->c_fd);
+        close(client->c_fd);
+    }
+    set->conns->ct_remove(set->conns, client);
 }
 
-void deserialize_packet(struct packet *packet, const uint8_t *buffer)
+void deserialize_packet(struct packet *packet, const uint8_t *buffer, uint8_t version)
 {
-    size_t bytes_copied;
+    size_t   bytes_copied;
+    uint8_t  seq_num;
+    uint32_t n_num;
     
     bytes_copied = 0;
     memcpy(&packet->flags, buffer + bytes_copied, sizeof(packet->flags));
     bytes_copied += sizeof(packet->flags);
     
-    memcpy(&packet->seq_num, buffer + bytes_copied, sizeof(packet->seq_num));
-    bytes_copied += sizeof(packet->seq_num);
+    if (version == PROTO_V1)
+    {
+        memcpy(&seq_num, buffer + bytes_copied, sizeof(seq_num));
+        packet->seq_num = seq_num;
+        bytes_copied += sizeof(seq_num);
+    } else
+    {
+        memcpy(&packet->window, buffer + bytes_copied, sizeof(packet->window));
+        bytes_copied += sizeof(packet->window);
+    }
     
     memcpy(&packet->length, buffer + bytes_copied, sizeof(packet->length));
     packet->length = ntohs(packet->length);
     bytes_copied += sizeof(packet->length);
     
+    if (version != PROTO_V1)
+    {
+        memcpy(&n_num, buffer + bytes_copied, sizeof(n_num));
+        packet->seq_num = ntohl(n_num);
+        bytes_copied += sizeof(n_num);
+        
+        memcpy(&n_num, buffer + bytes_copied, sizeof(n_num));
+        packet->ack_num = ntohl(n_num);
+        bytes_copied += sizeof(n_num);
+        
+        if (packet->flags & FLAG_SAK)
+        {
+            memcpy(&n_num, buffer + bytes_copied, sizeof(n_num));
+            packet->sack = ntohl(n_num);
+            bytes_copied += sizeof(n_num);
+        }
+        
+        if (packet->flags & FLAG_CID) /* Opaque: kept as sent. */
+        {
+            memcpy(&packet->cid, buffer + bytes_copied, sizeof(packet->cid));
+            bytes_copied += sizeof(packet->cid);
+        }
+    }
+    
     if (packet->length > 0)
     {
         if ((packet->payload = (uint8_t *) s_malloc(packet->length + 1,
@@ -342,15 +470,15 @@ void deserialize_packet(struct packet *packet, const uint8_t *buffer)
     }
 }
 
-uint8_t *serialize_packet(struct packet *packet)
+uint8_t *serialize_packet(const struct packet *packet, uint8_t version)
 {
     uint8_t  *buffer;
-    size_t   packet_size;
     size_t   bytes_copied;
+    uint8_t  seq_num;
     uint16_t n_packet_length;
+    uint32_t n_num;
     
-    packet_size = HLEN_BYTES + packet->length;
-    if ((buffer = (uint8_t *) s_malloc(packet_size, __FILE__, __func__, __LINE__)) == NULL)
+    if ((buffer = (uint8_t *) s_malloc(packet_size(packet, version), __FILE__, __func__, __LINE__)) == NULL)
     {
         return NULL;
     }
@@ -359,13 +487,45 @@ uint8_t *serialize_packet(struct packet *packet)
     memcpy(buffer + bytes_copied, &packet->flags, sizeof(packet->flags));
     bytes_copied += sizeof(packet->flags);
     
-    memcpy(buffer + bytes_copied, &packet->seq_num, sizeof(packet->seq_num));
-    bytes_copied += sizeof(packet->seq_num);
+    if (version == PROTO_V1)
+    {
+        seq_num = (uint8_t) packet->seq_num;
+        memcpy(buffer + bytes_copied, &seq_num, sizeof(seq_num));
+        bytes_copied += sizeof(seq_num);
+    } else
+    {
+        memcpy(buffer + bytes_copied, &packet->window, sizeof(packet->window));
+        bytes_copied += sizeof(packet->window);
+    }
     
     n_packet_length = htons(packet->length);
     memcpy(buffer + bytes_copied, &n_packet_length, sizeof(n_packet_length));
     bytes_copied += sizeof(n_packet_length);
     
+    if (version != PROTO_V1)
+    {
+        n_num = htonl(packet->seq_num);
+        memcpy(buffer + bytes_copied, &n_num, sizeof(n_num));
+        bytes_copied += sizeof(n_num);
+        
+        n_num = htonl(packet->ack_num);
+        memcpy(buffer + bytes_copied, &n_num, sizeof(n_num));
+        bytes_copied += sizeof(n_num);
+        
+        if (packet->flags & FLAG_SAK)
+        {
+            n_num = htonl(packet->sack);
+            memcpy(buffer + bytes_copied, &n_num, sizeof(n_num));
+            bytes_copied += sizeof(n_num);
+        }
+        
+        if (packet->flags & FLAG_CID)
+        {
+            memcpy(buffer + bytes_copied, &packet->cid, sizeof(packet->cid));
+            bytes_copied += sizeof(packet->cid);
+        }
+    }
+    
     if (packet->length > 0)
     {
         memcpy(buffer + bytes_copied, packet->payload, packet->length);
@@ -374,7 +534,22 @@ uint8_t *serialize_packet(struct packet *packet)
     return buffer;
 }
 
-void create_packet(struct packet *packet, uint8_t flags, uint8_t seq_num, uint16_t len, uint8_t *payload)
+size_t packet_size(const struct packet *packet, uint8_t version)
+{
+    return header_size(packet->flags, version) + packet->length;
+}
+
+size_t header_size(uint8_t flags, uint8_t version)
+{
+    if (version == PROTO_V1)
+    {
+        return HLEN_BYTES;
+    }
+    
+    return HLEN_V2_BYTES + ((flags & FLAG_SAK) ? SACK_BYTES : 0) + ((flags & FLAG_CID) ? CID_BYTES : 0);
+}
+
+void create_packet(struct packet *packet, uint8_t flags, uint32_t seq_num, uint16_t len, uint8_t *payload)
 {
     memset(packet, 0, sizeof(struct packet));
     
@@ -416,6 +591,22 @@ const char *check_flags(uint8_t flags)
         {
             return "FIN/ACK";
         }
+        case (FLAG_PSH | FLAG_ACK):
+        {
+            return "PSH/ACK";
+        }
+        case (FLAG_PSH | FLAG_TRN | FLAG_ACK):
+        {
+            return "PSH/TRN/ACK";
+        }
+        case (FLAG_ACK | FLAG_SAK):
+        {
+            return "ACK/SAK";
+        }
+        case (FLAG_TKT | FLAG_ACK):
+        {
+            return "TKT/ACK";
+        }
         default:
         {
             return "INVALID";
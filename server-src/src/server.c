@@ -2,26 +2,63 @@
 // Created by Maxwell Babey on 10/24/22.
 //
 
+#define _DEFAULT_SOURCE /* SO_REUSEPORT */
+
 #include "../include/Game.h"
+#include "../include/batch-io.h"
+#include "../include/client-map.h"
+#include "../include/event-loop.h"
+#include "../include/game-pool.h"
+#include "../include/handoff.h"
 #include "../include/manager.h"
+#include "../include/room.h"
 #include "../include/server-util.h"
 #include "../include/server.h"
 #include "../include/setup.h"
+#include "../include/timer-wheel.h"
 #include <arpa/inet.h>
-#include <sys/select.h>
+#include <linux/filter.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/random.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 /**
- * The standard number of bytes in a payload; the size of the game data.
- * The game data is a uint8_t cursor, a char turn indicator, and a 9 B game state array.
+ * The number of times an outstanding packet is retransmitted before the client is assumed gone and removed.
+ */
+#define SV_MAX_RETRANS 8
+
+/**
+ * While set to > 0, the program will continue running. Will be set to 0 by SIGINT or a catastrophic failure in any
+ * thread.
+ */
+static volatile atomic_int running; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables) : var must change
+
+/**
+ * sv_worker
+ * <p>
+ * A worker thread and the shard of the server it runs: its own socket bound to the server address, event loop,
+ * memory manager, rooms and clients. Nothing in a shard is touched by any other thread.
+ * </p>
  */
-#define STD_PAYLOAD_BYTES (sizeof(uint8_t) + sizeof(char) + GAME_STATE_BYTES)
+struct sv_worker
+{
+    pthread_t              thread;
+    bool                   started;
+    struct server_settings set;
+};
 
 /**
- * While set to > 0, the program will continue running. Will be set to 0 by SIGINT or a catastrophic failure.
+ * open_shard
+ * <p>
+ * Open a shard: take it over from the predecessor if there is one, otherwise open its server socket.
+ * </p>
+ * @param set - the server settings
+ * @param shard - the settings of the shard
  */
-static volatile sig_atomic_t running; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables) : var must change
+void open_shard(const struct server_settings *set, struct server_settings *shard);
 
 /**
  * open_server
@@ -32,32 +69,155 @@ static volatile sig_atomic_t running; // NOLINT(cppcoreguidelines-avoid-non-cons
  */
 void open_server(struct server_settings *set);
 
+/**
+ * watch_server
+ * <p>
+ * Register the server socket, the wake pipe and the queue of returned tasks with the event loop.
+ * </p>
+ * @param set - the server settings
+ */
+void watch_server(struct server_settings *set);
+
+/**
+ * hand_off
+ * <p>
+ * Hand the server off to its successor once every thread has stopped: settle each shard, then send the configuration
+ * and every shard.
+ * </p>
+ * @param set - the server settings
+ */
+void hand_off(struct server_settings *set);
+
+/**
+ * settle_shard
+ * <p>
+ * Bring a shard to rest before it is handed off. Wait for the game workers to return every task of the shard, and
+ * play the moves they refused at once. Broadcast the game states which changed, send the ACKs held back, and send
+ * everything queued.
+ * </p>
+ * @param set - the settings of the shard
+ */
+void settle_shard(struct server_settings *set);
+
+/**
+ * start_workers
+ * <p>
+ * Create the shards of the worker threads and bind their sockets, then start the threads. Every socket is bound
+ * before any thread receives, so the kernel's hash of a client address to a socket does not change once the client
+ * has sent its SYN. SIGINT is blocked in the worker threads; it is handled by the main thread.
+ * </p>
+ * @param set - the server settings
+ */
+void start_workers(struct server_settings *set);
+
+/**
+ * stop_workers
+ * <p>
+ * Wait for the worker threads to finish. Their shards are closed with the server, once the game workers have stopped
+ * returning tasks to them.
+ * </p>
+ * @param set - the server settings
+ */
+void stop_workers(struct server_settings *set);
+
+/**
+ * sv_wake_all
+ * <p>
+ * Stop the server, and wake every thread blocked on its event loop so that it sees the server has stopped.
+ * </p>
+ * @param set - the server settings
+ */
+void sv_wake_all(const struct server_settings *set);
+
 /**
  * sv_comm_core
  * <p>
- * Create and zero the received packet and sent packet structs. Set the timeout option on the socket.
+ * Wait on the event loop for sockets with messages ready, or until the next retransmission timer is due. Handle the
+ * messages and the expired timers, then broadcast the game state of each full room whose game state changed. The
+ * packets queued while doing so are sent together at the end of each iteration.
  * </p>
  * @param set - the server settings
  */
 void sv_comm_core(struct server_settings *set);
 
+/**
+ * broadcast_changed
+ * <p>
+ * Broadcast the game state of each full room on the broadcast list.
+ * </p>
+ * @param set - the server settings
+ */
+void broadcast_changed(struct server_settings *set);
+
 /**
  * handle_receipt
  * <p>
- * Handle the receipt of a message on any sockets in readfds. If action is on the main socket, then it is a likely
- * a new connection and will be handled accordingly. If action is on any other socket, communicate with the client
- * attached to that socket.
+ * Handle the receipt of messages on the sockets reported ready by the event loop. If action is on the main socket,
+ * then it is a likely a new connection and will be handled accordingly. If action is on any other socket, communicate
+ * with the client attached to that socket. Sockets are read until empty, as readiness may be edge-triggered.
+ * </p>
+ * @param set - the server settings
+ */
+void handle_receipt(struct server_settings *set);
+
+/**
+ * handle_timeouts
+ * <p>
+ * Handle the expired timers. Back off the client's timeout, retransmit each outstanding packet and arm its timer again,
+ * or remove the client once the packet has been retransmitted SV_MAX_RETRANS times; a seated client taking OPT_TICKET
+ * has its seat held instead, and is removed once the hold expires. Send each ACK held back too long.
+ * </p>
+ * @param set - the server settings
+ */
+void handle_timeouts(struct server_settings *set);
+
+/**
+ * handle_game_results
+ * <p>
+ * Take back the tasks the game workers have played, in batches. The played game of a room replaces its game unless
+ * the game was reset while the task was out; the room's game state is then broadcast, and the moves which arrived
+ * meanwhile are handed out in a new task.
+ * </p>
+ * @param set - the server settings
+ */
+void handle_game_results(struct server_settings *set);
+
+/**
+ * sv_take_back
+ * <p>
+ * Take back a task the game workers have played, and free it.
+ * </p>
+ * @param set - the server settings
+ * @param task - the task
+ */
+void sv_take_back(struct server_settings *set, struct gp_task *task);
+
+/**
+ * handle_stalled
+ * <p>
+ * Submit the moves of the rooms on the stalled list again, until the game workers refuse a task.
+ * </p>
+ * @param set - the server settings
+ */
+void handle_stalled(struct server_settings *set);
+
+/**
+ * handle_client_receipt
+ * <p>
+ * Receive the messages waiting on a client's socket and respond to them, until the socket would block or the client
+ * is removed.
  * </p>
  * @param set - the server settings
- * @param readfds - the set of file descriptors to read form
+ * @param client - the client whose socket is ready
  */
-void handle_receipt(struct server_settings *set, fd_set *readfds);
+void handle_client_receipt(struct server_settings *set, struct conn_client *client);
 
 /**
  * handle_unicast
  * <p>
- * Convert the game state information into a byte array. In reply to a client who has just sent the same packet twice,
- * send the last sent packet with received packet seq num + 1 to the client.
+ * Convert the game state information of the client's room into a byte array. In reply to a client who has just sent
+ * the same packet twice, send the last sent packet with received packet seq num + 1 to the client. The packet is kept
+ * as the client's outstanding packet; its ACK is collected by the event loop.
  * </p>
  * @param set - the server settings
  * @param client - the client to which the message will be sent
@@ -67,513 +227,2589 @@ void handle_unicast(struct server_settings *set, struct conn_client *client);
 /**
  * handle_broadcast
  * <p>
- * Convert the game state information into a byte array. For each connected client, send a packet.
+ * Convert the game state information of a room into a byte array. For each client in the room, send a packet.
  * The packet will have flags PSH or PSH/TRN, depending on the game state. The difference is interpreted
- * by the client to indicate turn status.
+ * by the client to indicate turn status. The server does not wait for ACKs: each packet is kept as its client's
+ * outstanding packet, and the ACKs are collected by the event loop as they arrive. A client with a packet still
+ * outstanding is sent the game state once that packet is ACKed.
+ * </p>
+ * @param set - the server settings
+ * @param room - the room to broadcast to
+ */
+void handle_broadcast(struct server_settings *set, struct room *room);
+
+/**
+ * send_game_state
+ * <p>
+ * Send a game state payload to a client as a PSH, or a PSH/TRN if it is the client's turn. The packet is kept as the
+ * client's outstanding packet.
  * </p>
  * @param set - the server settings
+ * @param client - the client to which the game state will be sent
+ * @param payload - the game state, of STD_PAYLOAD_BYTES
+ */
+void send_game_state(struct server_settings *set, struct conn_client *client, const uint8_t *payload);
+
+/**
+ * sv_encode_state
+ * <p>
+ * Give a game state the next version of a connection with OPT_DELTA, keep it, and encode it: as the changes since the
+ * newest state the client has ACKed, or as a keyframe if the client may not hold that state, or if the changes would
+ * be no smaller.
+ * </p>
+ * @param client - the client
+ * @param state - the game state, of STD_PAYLOAD_BYTES
+ * @param buffer - the buffer to encode the state in, of MAX_STATE_BYTES
+ * @return the size of the encoded state
  */
-void handle_broadcast(struct server_settings *set);
+uint16_t sv_encode_state(struct conn_client *client, const uint8_t *state, uint8_t *buffer);
 
 /**
  * assemble_game_payload
  * <p>
- * Allocate memory to store the game state information.
+ * Store the game state information in a payload buffer of STD_PAYLOAD_BYTES.
  * </p>
  * @param game - the game to store the state of
- * @return pointer to the memory storing the game state
+ * @param payload - the buffer to store the game state in
  */
-uint8_t *assemble_game_payload(struct Game *game);
+void assemble_game_payload(const struct Game *game, uint8_t *payload);
 
 /**
  * sv_accept
  * <p>
- * Receive a message. If it is a SYN, connect the new client. Send a SYN/ACK back to the sender on that socket.
+ * Receive a batch of messages on the server socket, without blocking, and dispatch them.
+ * </p>
+ * @param set - the server settings
+ * @return the number of messages dispatched; fewer than BIO_BATCH if the socket was drained, -1 on failure
+ */
+int sv_accept(struct server_settings *set);
+
+/**
+ * sv_dispatch
+ * <p>
+ * Handle a message received on the server socket. A message with a connection ID is processed as the message of the
+ * client given that ID, whichever address it came from, and dropped if no client was. If the sender of any other
+ * message is a known client, process the message as that client's: every message if clients share the server socket,
+ * otherwise only retransmitted SYNs of a half-open connection, and returned cookies. If the sender is unknown, a SYN
+ * which appends a valid ticket to its options resumes the client the ticket was given to; a SYN from a client taking
+ * OPT_COOKIE is answered with a cookie, and nothing is kept; the ACK which returns a valid cookie connects the client.
+ * Any other SYN connects the new client in state SYN_RCVD, while fewer than SV_MAX_HALF_OPEN are, and is answered with
+ * a SYN/ACK from the client's socket. The server does not wait for the ACK.
+ * </p>
+ * @param set - the server settings
+ * @param from_addr - the sender of the message
+ * @param buffer - the message
+ * @param len - the size of the message
+ */
+void sv_dispatch(struct server_settings *set, struct sockaddr_in *from_addr, const uint8_t *buffer, size_t len);
+
+/**
+ * sv_send_cookie
+ * <p>
+ * Answer a SYN offering OPT_COOKIE without keeping any state: send a SYN/ACK from the server socket whose payload is
+ * the answer to the offer, with the connection ID chosen for the client if it offered OPT_CID, then the time and the
+ * MAC of the cookie.
+ * </p>
+ * @param set - the server settings
+ * @param from_addr - the sender of the SYN
+ * @param offer - the payload of the SYN: the offer, then the options
+ */
+void sv_send_cookie(struct server_settings *set, const struct sockaddr_in *from_addr, const uint8_t *offer);
+
+/**
+ * sv_accept_cookie
+ * <p>
+ * Connect the client which returned a cookie, if the server made it, for the address it came from, within
+ * SV_COOKIE_LIFETIME_MS. The connection is established at once, with the version, options and sequence numbers the
+ * echoed handshake agreed; an ACK from the client's socket tells the client so. The client stays mapped by its address,
+ * since it may return the cookie again until the ACK arrives. A client given a connection ID is dropped if another
+ * client holds the ID by now.
+ * </p>
+ * @param set - the server settings
+ * @param from_addr - the sender of the cookie
+ * @param echo - the payload of the ACK: the payload of the SYN, then the payload of the SYN/ACK
+ * @param len - the size of the payload
+ */
+void sv_accept_cookie(struct server_settings *set, struct sockaddr_in *from_addr, const uint8_t *echo, size_t len);
+
+/**
+ * sv_resume
+ * <p>
+ * Resume the client a ticket was given to, if the ticket is valid: connect the sender at once, seat it in the client's
+ * seat, and remove the client, whose room's game goes on. The SYN/ACK, the game state and a new ticket are sent in the
+ * same flush, so the client plays on after a single round trip. The resumed client stays mapped by its address until it
+ * hears from its socket, like one which returned a cookie; it is given no cookie.
+ * </p>
+ * @param set - the server settings
+ * @param from_addr - the sender of the SYN
+ * @param offer - the payload of the SYN: the offer, the options, then the ticket
+ * @return true if the ticket was valid, and the SYN is answered; false if the SYN must be handled as any other
+ */
+bool sv_resume(struct server_settings *set, struct sockaddr_in *from_addr, const uint8_t *offer);
+
+/**
+ * sv_redeem
+ * <p>
+ * Find the client a ticket was given to: the ticket must be one the shard made, and name a seat held, or kept, by the
+ * connection it was given to.
+ * </p>
+ * @param set - the server settings
+ * @param ticket - the ticket
+ * @return the client, NULL if the ticket is not valid
+ */
+struct conn_client *sv_redeem(const struct server_settings *set, const uint8_t *ticket);
+
+/**
+ * sv_issue_ticket
+ * <p>
+ * Give a seated client taking OPT_TICKET a new ticket, in a sequenced packet with FLAG_TKT. The connection is given a
+ * new ticket ID, so the tickets given to any earlier connection of the client are spent. A ticket counts against the
+ * send window like any other packet: while the window is full, it is held back until the client's ACKs open it.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ */
+void sv_issue_ticket(struct server_settings *set, struct conn_client *client);
+
+/**
+ * sv_hold
+ * <p>
+ * Keep the seat of a client whose connection timed out for SV_SEAT_HOLD_MS, for it to resume with its ticket. The
+ * client is no longer found by address or connection ID, and is sent nothing; its game goes on without it.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ */
+void sv_hold(struct server_settings *set, struct conn_client *client);
+
+/**
+ * sv_cookie_mac
+ * <p>
+ * Compute the MAC of a cookie, under the server's key, over the client's address, the payload of its SYN, the server's
+ * first sequence number, the connection ID and the time the cookie was made. The rest of the SYN/ACK follows from
+ * these.
+ * </p>
+ * @param set - the server settings
+ * @param addr - the client's address
+ * @param offer - the payload of the SYN
+ * @param isn - the server's first sequence number
+ * @param cid - the connection ID given to the client, 0 if none
+ * @param made_ms - the time the cookie was made, in milliseconds
+ * @return the MAC
+ */
+uint64_t sv_cookie_mac(const struct server_settings *set, const struct sockaddr_in *addr, const uint8_t *offer,
+                       uint32_t isn, uint64_t cid, uint32_t made_ms);
+
+/**
+ * sv_negotiate
+ * <p>
+ * Choose the protocol version of a new client from the offer in the payload of its SYN, and prepare the SYN/ACK. A
+ * client offering version 2 or later is answered with an offer of version 2, the server's window and the server's
+ * first sequence number; any other client is answered with a bare SYN/ACK, and speaks version 1. A client taking
+ * OPT_CID is found by its connection ID from now on; one taking OPT_TICKET is given tickets once seated.
+ * </p>
+ * @param set - the server settings
+ * @param client - the new client
+ * @param offer - the payload of the SYN
+ * @param len - the size of the payload
+ * @param isn - the server's first sequence number
+ * @param cid - the connection ID to give the client if it takes OPT_CID; 0 to choose one
+ * @return 0 on success, -1 on failure
+ */
+int sv_negotiate(struct server_settings *set, struct conn_client *client, const uint8_t *offer, size_t len,
+                 uint32_t isn, uint64_t cid);
+
+/**
+ * sv_answer
+ * <p>
+ * Write the answer to an offer of version 2: the version, the server's window and the server's first sequence
+ * number, then the options the server took, if the client offered any, and the connection ID if it took OPT_CID.
+ * </p>
+ * @param set - the server settings
+ * @param offer - the payload of the SYN
+ * @param len - the size of the payload
+ * @param isn - the server's first sequence number
+ * @param cid - the connection ID given to the client; 0 if none, and OPT_CID is not taken
+ * @param answer - the buffer to write the answer to, at least OFFER_BYTES + OPT_BYTES + CID_BYTES long
+ * @return the size of the answer
+ */
+uint16_t sv_answer(const struct server_settings *set, const uint8_t *offer, size_t len, uint32_t isn, uint64_t cid,
+                   uint8_t *answer);
+
+/**
+ * sv_choose_isn
+ * <p>
+ * Choose the sequence number of the first packet sent on a version 2 connection. It is random, so that a packet left
+ * over from an earlier connection of the same address is unlikely to fall in the window.
+ * </p>
+ * @return the initial sequence number
+ */
+uint32_t sv_choose_isn(void);
+
+/**
+ * sv_choose_cid
+ * <p>
+ * Choose a connection ID no client of the shard holds. Its first byte is the index of the shard, which the kernel
+ * steers the client's messages by; the rest are random, so that a client's ID cannot be guessed from another's.
+ * </p>
+ * @param set - the server settings
+ * @return the connection ID, never 0
+ */
+uint64_t sv_choose_cid(const struct server_settings *set);
+
+/**
+ * sv_clamp_window
+ * <p>
+ * Get the send window of a version 2 connection: the lesser of the configured window and the window the client
+ * advertised. A client advertising no window may still be sent one packet, so that its next ACK opens the window.
  * </p>
  * @param set - the server settings
+ * @param advertised - the window advertised by the client
+ * @return the send window
  */
-void sv_accept(struct server_settings *set);
+uint8_t sv_clamp_window(const struct server_settings *set, uint8_t advertised);
 
 /**
- * sv_recvfrom.
+ * sv_receive
  * <p>
- * Await a message from the connected client. If no go ahead is received from processing the message, resend the last
- * sent message and receive again.
+ * Receive a batch of messages from the connected client, without blocking, and process them. If the client is
+ * removed, the rest of the batch is dropped.
  * </p>
  * @param set - the server settings
- * @param client - the client from which to receive the message
+ * @param client - the client from which to receive the messages
+ * @return the number of messages received; fewer than BIO_BATCH if the socket was drained, -1 if the client was
+ * removed or on failure
  */
-void sv_recvfrom(struct server_settings *set, struct conn_client *client);
+int sv_receive(struct server_settings *set, struct conn_client *client);
 
 /**
  * sv_process
  * <p>
- * Check the flags and sequence number of a message. Respond depending on the result.
+ * Check the flags and sequence number of a message against the state of the client's connection. Respond depending
+ * on the result.
  * </p>
  * @param set - the server settings
  * @param client - the client from which the message was received
+ * @param from_addr - the sender of the message
  * @param packet_buffer - the buffer containing the message
+ * @param len - the size of the message
+ * @return -1 if the client was removed, 0 otherwise
  */
-bool sv_process(struct server_settings *set, struct conn_client *client, const uint8_t *packet_buffer);
+int sv_process(struct server_settings *set, struct conn_client *client, const struct sockaddr_in *from_addr,
+               const uint8_t *packet_buffer, size_t len);
 
 /**
- * sv_sendto
+ * process_syn_rcvd
  * <p>
- * Send a send packet to a client.
+ * Handle a message from a client whose SYN was answered. Retransmit the SYN/ACK on a retransmitted SYN; establish
+ * the connection on its ACK. Ignore anything else.
  * </p>
  * @param set - the server settings
- * @param client - the client to which a packet will be sent
+ * @param client - the client from which the message was received
+ * @param packet_buffer - the buffer containing the message
  */
-void sv_sendto(struct server_settings *set, struct conn_client *client);
+void process_syn_rcvd(struct server_settings *set, struct conn_client *client, const uint8_t *packet_buffer);
 
 /**
- * sv_disconnect
+ * process_established
  * <p>
- * Disconnect a client from the server by responding to a client FIN message and removing them from the server
- * connected client list.
+ * Handle a message from a client seated in a room. Retransmit the game state on a duplicate message, retransmit the
+ * outstanding packet on a bad ACK, ACK and apply a move, or start disconnecting on a FIN.
  * </p>
  * @param set - the server settings
- * @param client - the client to be disconnected
+ * @param client - the client from which the message was received
+ * @param packet_buffer - the buffer containing the message
  */
-void sv_disconnect(struct server_settings *set, struct conn_client *client);
+void process_established(struct server_settings *set, struct conn_client *client, const uint8_t *packet_buffer);
 
 /**
- * set_signal_handling
+ * process_last_ack
  * <p>
- * Setup a handler for the SIGINT signal.
+ * Handle a message from a client whose FIN was answered. Remove the client on its FIN/ACK; answer again on a
+ * retransmitted FIN. Ignore anything else.
  * </p>
- * @author D'Arcy Smith
- * @param sa - the sigaction for setup
+ * @param set - the server settings
+ * @param client - the client from which the message was received
+ * @param packet_buffer - the buffer containing the message
+ * @return -1 if the client was removed, 0 otherwise
  */
-static void set_signal_handling(struct sigaction *sa);
+int process_last_ack(struct server_settings *set, struct conn_client *client, const uint8_t *packet_buffer);
 
 /**
- * signal_handler
+ * process_v2
  * <p>
- * Callback function for the signal handler. Will set running to 0 upon signal.
+ * Handle a message on a version 2 connection past its handshake. An ACK releases the packets it covers from the
+ * retransmission ring. A PSH or FIN in sequence is applied, and ACKed by the packet it leads to or, failing one, by a
+ * delayed ACK; one out of sequence, a duplicate or a packet after a lost one, is answered at once with an ACK of what
+ * has arrived. The client is removed once its FIN/ACK is ACKed. A message to a client with a connection ID is dropped
+ * unless it carries the ID; one from another address moves the client there, if sv_migrate allows, or is dropped. A SYN
+ * is retransmitted by a client which did not hear the SYN/ACK, and is answered with it again.
  * </p>
- * @param sig - the signal
- * @author D'Arcy Smith
+ * @param set - the server settings
+ * @param client - the client from which the message was received
+ * @param from_addr - the sender of the message
+ * @param packet_buffer - the buffer containing the message
+ * @param len - the size of the message
+ * @return -1 if the client was removed, 0 otherwise
  */
-static void signal_handler(int sig);
+int process_v2(struct server_settings *set, struct conn_client *client, const struct sockaddr_in *from_addr,
+               const uint8_t *packet_buffer, size_t len);
 
-void run(int argc, char *argv[], struct server_settings *set)
-{
-    struct sigaction sa;
-    
-    init_def_state(argc, argv, set);
-    
-    set_signal_handling(&sa);
-    
-    if (!errno)
-    { open_server(set); }
+/**
+ * sv_migrate
+ * <p>
+ * Move a client with a connection ID to the address a packet came from. Only a packet which ACKs no less than the
+ * client has ACKed, and nothing not yet sent, moves it: an attacker who sees none of the connection's packets knows
+ * neither. A client found by address is found by the new one, unless another client is.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ * @param packet - the packet, deserialized
+ * @param addr - the address it came from
+ * @return 0 if the client moved, -1 otherwise
+ */
+int sv_migrate(struct server_settings *set, struct conn_client *client, const struct packet *packet,
+               const struct sockaddr_in *addr);
+
+/**
+ * sv_acked
+ * <p>
+ * Apply the cumulative ACK, the selective ACK and the advertised window of a packet from a version 2 client. The
+ * packets before the ACK number are released; the retransmission timer is cancelled if none is left, and armed
+ * again otherwise.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ * @param packet - the packet
+ */
+void sv_acked(struct server_settings *set, struct conn_client *client, const struct packet *packet);
+
+/**
+ * sv_sacked
+ * <p>
+ * Apply the selective ACK of a packet from a version 2 client: mark the packets it reports holding, so a timeout
+ * does not send them again.
+ * </p>
+ * @param client - the client
+ * @param packet - the packet; FLAG_SAK is set
+ */
+void sv_sacked(struct conn_client *client, const struct packet *packet);
+
+/**
+ * sv_state_acked
+ * <p>
+ * Note the newest game state among the packets a cumulative ACK releases, on a connection with OPT_DELTA: it is the
+ * base of the next state sent. Only a packet sent with the state it was first sent with proves the client holds that
+ * state; the ACK of a superseded packet may answer any of the states it carried, so it proves none of them.
+ * </p>
+ * @param client - the client
+ * @param ack_num - the ACK number; after snd_una
+ */
+void sv_state_acked(struct conn_client *client, uint32_t ack_num);
+
+/**
+ * sv_dup_ack
+ * <p>
+ * Count a duplicate ACK from a version 2 client: a bare ACK of snd_una while packets are outstanding, sent by the
+ * client when a packet arrives out of sequence or not at all. Retransmit fast when the count reaches the threshold;
+ * once per loss, as the count is only reset when snd_una advances.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ */
+void sv_dup_ack(struct server_settings *set, struct conn_client *client);
+
+/**
+ * sv_fast_retransmit
+ * <p>
+ * Retransmit to a version 2 client without waiting for the timeout: the oldest packet not ACKed, and every packet
+ * before the newest one the client reports holding which it does not hold. The packets after it may still be on
+ * their way. The retransmission timer is armed again, without backing off.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ */
+void sv_fast_retransmit(struct server_settings *set, struct conn_client *client);
+
+/**
+ * sv_supersede
+ * <p>
+ * Replace a game state about to be sent again on a version 2 connection with OPT_DELTA with the newest state of the
+ * same game in the retransmission ring, so that a lost state is never sent stale. The packet keeps its sequence
+ * number, which the client needs to move on; the newer state sent after it arrives again, and the client shows a state
+ * only if it is newer than the one shown. A state is not superseded by one of the next game, so the client sees how
+ * its game ended; nor without OPT_DELTA, as the client could not tell an older state from a newer one. A state sent
+ * again is a keyframe, as long as the server still keeps it: the client does not take a state based on one it does not
+ * hold, and waits for it to be sent again.
+ * </p>
+ * @param client - the client
+ * @param entry - the packet about to be sent again
+ */
+void sv_supersede(const struct conn_client *client, struct rtx_entry *entry);
+
+/**
+ * sv_establish
+ * <p>
+ * Complete the handshake of a client: seat them in a room and mark the room for broadcast. A half-open client with its
+ * own socket is no longer looked up by address. A client taking OPT_TICKET is given a ticket.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ */
+void sv_establish(struct server_settings *set, struct conn_client *client);
+
+/**
+ * sv_sendto
+ * <p>
+ * Queue a send packet to a client. Queued packets are sent at the end of the event loop iteration.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client to which a packet will be sent
+ */
+void sv_sendto(struct server_settings *set, struct conn_client *client);
+
+/**
+ * sv_transmit
+ * <p>
+ * Queue a packet to a client, framed in the protocol version of the connection; a SYN/ACK is part of a handshake, and
+ * is framed as in version 1. Queued packets are sent at the end of the event loop iteration. A version 2 packet to a
+ * client which offered OPT_BUNDLE joins the datagram already queued for the client, if it fits.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client to which the packet will be sent
+ * @param packet - the packet
+ */
+void sv_transmit(struct server_settings *set, struct conn_client *client, const struct packet *packet);
+
+/**
+ * sv_framing
+ * <p>
+ * Get the protocol version the packets of a connection are framed in: version 1 during the handshake, the
+ * negotiated version after it.
+ * </p>
+ * @param client - the client
+ * @return the protocol version
+ */
+uint8_t sv_framing(const struct conn_client *client);
+
+/**
+ * sv_can_send
+ * <p>
+ * Check whether a client may be sent a game state now: on version 1, if no packet is outstanding; on version 2, if
+ * the send window is not full.
+ * </p>
+ * @param client - the client
+ * @return true if a game state may be sent
+ */
+bool sv_can_send(const struct conn_client *client);
+
+/**
+ * sv_push
+ * <p>
+ * Send a packet on a version 2 connection with the next sequence number, and keep it in the retransmission ring
+ * until it is ACKed. The retransmission timer is armed if no other packet is outstanding.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ * @param flags - the flags of the packet
+ * @param payload - the payload; NULL if len is 0
+ * @param len - the length of the payload; at most MAX_PUSH_BYTES
+ */
+void sv_push(struct server_settings *set, struct conn_client *client, uint8_t flags, const uint8_t *payload,
+             uint16_t len);
+
+/**
+ * sv_send_entry
+ * <p>
+ * Send a packet of the retransmission ring of a version 2 connection. It carries the ACK of what has arrived, which
+ * is not sent on its own.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ * @param entry - the packet
+ */
+void sv_send_entry(struct server_settings *set, struct conn_client *client, struct rtx_entry *entry);
+
+/**
+ * sv_send_ack
+ * <p>
+ * Send a bare ACK on a version 2 connection. It takes no sequence number, and is not retransmitted.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ */
+void sv_send_ack(struct server_settings *set, struct conn_client *client);
+
+/**
+ * sv_delay_ack
+ * <p>
+ * Hold back the ACK of a packet which arrived in sequence on a version 2 connection, for the game state it leads to
+ * to carry, for up to SV_DELACK_MS. If an ACK is already held back, send it now: every second packet is ACKed at once.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ */
+void sv_delay_ack(struct server_settings *set, struct conn_client *client);
+
+/**
+ * sv_retransmit
+ * <p>
+ * Retransmit what a client has not ACKed: on version 1, and during the handshake, the outstanding packet; on version
+ * 2, every packet in the retransmission ring the client has not reported holding, oldest first, each game state
+ * superseded by the newest.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ */
+void sv_retransmit(struct server_settings *set, struct conn_client *client);
+
+/**
+ * sv_await_ack
+ * <p>
+ * Mark the packet just sent to a client as outstanding, and arm its retransmission timer. On version 1, and during
+ * the handshake, the packet is timed for the round-trip time unless another is being timed.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ */
+void sv_await_ack(struct server_settings *set, struct conn_client *client);
+
+/**
+ * sv_ack_received
+ * <p>
+ * Mark a client's outstanding packet as received, and cancel its retransmission timer. On version 1, and during the
+ * handshake, the ACK ends the timing of the packet.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client
+ */
+void sv_ack_received(struct server_settings *set, struct conn_client *client);
+
+/**
+ * sv_play
+ * <p>
+ * Play a move in a room. Without game workers, the move is played at once and the room's game state is broadcast.
+ * Otherwise, the move waits in the room until no task for the room is out, and is then handed to the game workers.
+ * </p>
+ * @param set - the server settings
+ * @param room - the room
+ * @param move - the move
+ */
+void sv_play(struct server_settings *set, struct room *room, struct gp_move move);
+
+/**
+ * sv_apply
+ * <p>
+ * Play a move on a room's game, and mark the room for broadcast.
+ * </p>
+ * @param set - the server settings
+ * @param room - the room
+ * @param move - the move
+ */
+void sv_apply(struct server_settings *set, struct room *room, struct gp_move move);
+
+/**
+ * sv_submit_moves
+ * <p>
+ * Hand the moves waiting in a room to the game workers, in a task with a copy of the room's game. If the game workers
+ * refuse the task, the moves stay in the room, and the room is put on the stalled list to be submitted again.
+ * </p>
+ * @param set - the server settings
+ * @param room - the room
+ */
+void sv_submit_moves(struct server_settings *set, struct room *room);
+
+/**
+ * sv_disconnect
+ * <p>
+ * Respond to a client FIN message with a FIN/ACK and a FIN. The client is removed from the server connected client
+ * list once its FIN/ACK arrives. On version 2, the FIN is answered with a single FIN/ACK, which takes a sequence number
+ * and is sent after the packets already in the retransmission ring; the client is removed once it is ACKed.
+ * </p>
+ * @param set - the server settings
+ * @param client - the client to be disconnected
+ */
+void sv_disconnect(struct server_settings *set, struct conn_client *client);
+
+/**
+ * set_signal_handling
+ * <p>
+ * Setup a handler for the SIGINT signal.
+ * </p>
+ * @author D'Arcy Smith
+ * @param sa - the sigaction for setup
+ */
+static void set_signal_handling(struct sigaction *sa);
+
+/**
+ * signal_handler
+ * <p>
+ * Callback function for the signal handler. Will set running to 0 upon signal.
+ * </p>
+ * @param sig - the signal
+ * @author D'Arcy Smith
+ */
+static void signal_handler(int sig);
+
+/**
+ * sv_worker_main
+ * <p>
+ * The body of a worker thread: serve the clients of the worker's shard until the server stops.
+ * </p>
+ * @param arg - the worker
+ * @return NULL
+ */
+static void *sv_worker_main(void *arg);
+
+void run(int argc, char *argv[], struct server_settings *set)
+{
+    struct sigaction sa;
+    
+    init_def_state(argc, argv, set);
+    
+    set_signal_handling(&sa);
+    
+    running = 1;
+    if (!errno)
+    { open_shard(set, set); }
+    
+    if (!errno && set->num_workers > 1)
+    { start_workers(set); }
+    
+    if (!errno && set->handoff_fd != -1)
+    { ho_finish(set); }
+    
+    if (!errno && set->handoff_path != NULL) /* Wait for a successor to take over. */
+    { ho_listen(set); }
+    
+    if (!errno)
+    {
+        printf("\nServer running on %s:%d with %zu thread(s)\n", set->server_ip, set->server_port, set->num_workers);
+        sv_comm_core(set);
+    }
+    
+    sv_wake_all(set);
+    if (set->workers != NULL)
+    { stop_workers(set); }
+    if (!errno && set->handoff_fd != -1) /* The game workers must still return the tasks of the shards. */
+    { hand_off(set); }
+    if (set->pool != NULL) /* No I/O thread submits tasks anymore; stop the game workers before the shards close. */
+    {
+        free_game_pool(set->pool);
+        set->pool = NULL;
+    }
+}
+
+void start_workers(struct server_settings *set)
+{
+    sigset_t block;
+    sigset_t prev;
+    size_t   num_workers;
+    
+    num_workers = set->num_workers - 1; /* The main thread runs a shard of its own. */
+    if ((set->workers = (struct sv_worker *) s_calloc(num_workers, sizeof(struct sv_worker),
+                                                      __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return;
+    }
+    
+    for (size_t i = 0; !errno && i < num_workers; ++i)
+    {
+        init_worker_state(set, &set->workers[i].set);
+        set->workers[i].set.shard_id = (uint8_t) (i + 1); /* Binds after the main thread's socket and those before. */
+        if (!errno)
+        { open_shard(set, &set->workers[i].set); }
+    }
+    if (errno)
+    {
+        return;
+    }
+    
+    /* Threads inherit the signal mask of their creator. */
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &block, &prev);
+    for (size_t i = 0; i < num_workers; ++i)
+    {
+        int err;
+        
+        if ((err = pthread_create(&set->workers[i].thread, NULL, sv_worker_main, &set->workers[i])) != 0)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, err);
+            break;
+        }
+        set->workers[i].started = true;
+    }
+    pthread_sigmask(SIG_SETMASK, &prev, NULL);
+}
+
+void stop_workers(struct server_settings *set)
+{
+    for (size_t i = 0; i < set->num_workers - 1; ++i)
+    {
+        if (set->workers[i].started)
+        {
+            pthread_join(set->workers[i].thread, NULL);
+        }
+    }
+}
+
+void sv_wake_all(const struct server_settings *set)
+{
+    const uint8_t byte = 1;
+    
+    running = 0;
+    if (set->wake_fds[1] != -1 && write(set->wake_fds[1], &byte, sizeof(byte)) == -1)
+    {
+        perror("\nWaking the worker threads failed: \n");
+    }
+}
+
+void open_shard(const struct server_settings *set, struct server_settings *shard)
+{
+    if (set->handoff_fd == -1)
+    {
+        open_server(shard);
+        return;
+    }
+    
+    if (ho_recv_shard(set, shard) == -1)
+    {
+        return;
+    }
+    watch_server(shard);
+    
+    /* The outstanding packets are retransmitted from now on; their retransmission counts carry over. The seats held
+     * are held for as long again. */
+    for (size_t i = 0; !errno && i < shard->conns->count; ++i)
+    {
+        struct conn_client *client;
+        
+        client = shard->conns->ct_at(shard->conns, i);
+        if (client->state == CONN_HELD)
+        {
+            shard->timers->tw_arm(shard->timers, &client->rto, tw_clock_ms(), SV_SEAT_HOLD_MS);
+        } else if (client->awaiting_ack)
+        {
+            shard->timers->tw_arm(shard->timers, &client->rto, tw_clock_ms(), client->rtt.rto_ms);
+        }
+    }
+}
+
+void open_server(struct server_settings *set)
+{
+    struct sockaddr_in addr;
+    
+    if ((set->server_fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) // NOLINT(android-cloexec-socket) : SOCK_CLOEXEC dne
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return;
+    }
+    
+    addr.sin_family           = AF_INET;
+    addr.sin_port             = htons(set->server_port);
+    if ((addr.sin_addr.s_addr = inet_addr(set->server_ip)) == (in_addr_t) -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return;
+    }
+    
+#ifdef SO_REUSEPORT
+    /* Every thread binds a socket to the server address; the kernel spreads clients over them by address hash. */
+    if (set->num_workers > 1)
+    {
+        const int enable = 1;
+        
+        if (setsockopt(set->server_fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno);
+            return;
+        }
+    }
+#endif
+    
+    if (bind(set->server_fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_in)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return;
+    }
+    
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+    /* A message with a connection ID goes to the socket of the shard which gave out the ID, in its first byte, so the
+     * client is found when its address changes; so does a SYN with a ticket, to the shard which seated the client. Any
+     * other, or an ID naming no socket, goes by address hash. The program is kept by the group, so the first socket
+     * bound attaches it. */
+    if (set->num_workers > 1 && set->shard_id == 0)
+    {
+        struct sock_filter code[] = {
+                BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+                BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, FLAG_CID, 0, 5),
+                BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, FLAG_SAK, 0, 2),
+                BPF_STMT(BPF_LD | BPF_B | BPF_ABS, HLEN_V2_BYTES + SACK_BYTES),
+                BPF_STMT(BPF_RET | BPF_A, 0),
+                BPF_STMT(BPF_LD | BPF_B | BPF_ABS, HLEN_V2_BYTES),
+                BPF_STMT(BPF_RET | BPF_A, 0),
+                BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, FLAG_SYN, 0, 6),
+                BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+                BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, HLEN_BYTES + OFFER_BYTES + OPT_BYTES + TICKET_BYTES, 0, 4),
+                BPF_STMT(BPF_LD | BPF_B | BPF_ABS, HLEN_BYTES + OFFER_BYTES),
+                BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, OPT_TICKET, 0, 2),
+                BPF_STMT(BPF_LD | BPF_B | BPF_ABS, HLEN_BYTES + OFFER_BYTES + OPT_BYTES),
+                BPF_STMT(BPF_RET | BPF_A, 0),
+                BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+        };
+        struct sock_fprog prog = {.len = sizeof(code) / sizeof(code[0]), .filter = code};
+        
+        if (setsockopt(set->server_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno);
+            return;
+        }
+    }
+#endif
+    
+    watch_server(set);
+}
+
+void watch_server(struct server_settings *set)
+{
+    /* A backend which receives the messages itself does not split coalesced ones: GRO is only for batch I/O. */
+    if (set->loop->el_send == NULL && set->bio->bio_offload(set->bio, set->server_fd) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return;
+    }
+    
+    /* The main socket reports no data: action on it is a new connection. The backend may receive its messages. */
+    if (set->loop->el_add_recv(set->loop, set->server_fd, NULL, MAX_RECV_BYTES) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return;
+    }
+    
+    if (set->wake_fds[0] != -1 && set->loop->el_add(set->loop, set->wake_fds[0], NULL) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return;
+    }
+    
+    if (set->results != NULL && set->loop->el_add(set->loop, set->results->event_fd, NULL) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return;
+    }
+}
+
+void sv_comm_core(struct server_settings *set)
+{
+    while (running)
+    {
+        int timeout_ms;
+        
+        timeout_ms = set->timers->tw_timeout(set->timers, tw_clock_ms());
+        if (set->loop->el_wait(set->loop, timeout_ms) == -1)
+        {
+            switch (errno)
+            {
+                case EINTR:
+                {
+                    // running set to 0 with signal handler.
+                    return;
+                }
+                default:
+                {
+                    fatal_errno(__FILE__, __func__, __LINE__, errno);
+                    running = 0;
+                    return;
+                }
+            }
+        }
+        
+        handle_receipt(set); /* Handle a received message on any of the active sockets. */
+        
+        handle_timeouts(set); /* Retransmit the outstanding packets which have not been ACKed in time. */
+        
+        if (set->pool != NULL) /* Returned tasks make room for the moves the game workers refused. */
+        {
+            handle_stalled(set);
+        }
+        
+        broadcast_changed(set);
+        
+        set->bio->bio_flush(set->bio); /* Send everything queued in this iteration; a broadcast goes out at once. */
+    }
+}
+
+void broadcast_changed(struct server_settings *set)
+{
+    /* Rooms are put on the broadcast list if a received message is a PSH or completes a handshake. */
+    for (struct room *room; (room = set->rooms->rt_next_broadcast(set->rooms)) != NULL;)
+    {
+        if (!errno && room->num_players == ROOM_CAPACITY) /* Broadcast game state to the players of full rooms. */
+        {
+            handle_broadcast(set, room);
+        }
+    }
+}
+
+void hand_off(struct server_settings *set)
+{
+    size_t num_clients;
+    
+    settle_shard(set);
+    for (size_t i = 0; !errno && set->workers != NULL && i < set->num_workers - 1; ++i)
+    {
+        settle_shard(&set->workers[i].set);
+    }
+    
+    /* Every shard is sent in order: the successor runs each on the thread this server ran it on. */
+    num_clients = set->conns->count;
+    if (!errno)
+    { ho_send_config(set); }
+    if (!errno)
+    { ho_send_shard(set, set); }
+    for (size_t i = 0; !errno && set->workers != NULL && i < set->num_workers - 1; ++i)
+    {
+        ho_send_shard(set, &set->workers[i].set);
+        num_clients += set->workers[i].set.conns->count;
+    }
+    if (!errno)
+    { ho_send_done(set); }
+    
+    if (!errno)
+    {
+        printf("\nHanded off %zu client(s)\n", num_clients);
+    }
+}
+
+void settle_shard(struct server_settings *set)
+{
+    while (!errno && set->results != NULL && set->results->num_out > 0)
+    {
+        struct pollfd pfd;
+        
+        pfd.fd     = set->results->event_fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                errno = 0;
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno);
+            return;
+        }
+        handle_game_results(set); /* May hand out the moves which arrived meanwhile. */
+    }
+    
+    /* The game workers are idle now: the successor is not handed moves in a room. */
+    for (struct room *room; !errno && (room = set->rooms->rt_next_stalled(set->rooms)) != NULL;)
+    {
+        for (size_t i = 0; i < room->num_moves; ++i)
+        {
+            sv_apply(set, room, room->moves[i]);
+        }
+        room->num_moves = 0;
+    }
+    
+    broadcast_changed(set);
+    
+    /* The successor does not take over the delayed ACK timers. */
+    for (size_t i = 0; !errno && i < set->conns->count; ++i)
+    {
+        struct conn_client *client;
+        
+        client = set->conns->ct_at(set->conns, i);
+        if (client->ack_pending)
+        {
+            sv_send_ack(set, client);
+        }
+    }
+    set->bio->bio_flush(set->bio);
+}
+
+void handle_receipt(struct server_settings *set)
+{
+    struct el_event *event;
+    
+    /* Only the sockets which are ready are dispatched; idle clients cost nothing. */
+    while (!errno && (event = set->loop->el_next(set->loop)) != NULL)
+    {
+        if (event->fd == set->server_fd && event->buffer != NULL) /* The backend received the message itself. */
+        {
+            sv_dispatch(set, &event->addr, event->buffer, event->len);
+        } else if (event->fd == set->server_fd) /* If there is action on the main socket, it is a new connection. */
+        {
+            while (!errno && sv_accept(set) >= BIO_BATCH)
+            {}
+        } else if (event->fd == set->wake_fds[0])
+        {
+            /* Another thread has stopped the server; the pipe is left unread so every thread sees it. */
+        } else if (set->results != NULL && event->fd == set->results->event_fd)
+        {
+            handle_game_results(set);
+        } else if (event->fd == set->handoff_listen_fd)
+        {
+            if (ho_accept(set)) /* Stop serving; the shards are handed off once every thread has stopped. */
+            {
+                running = 0;
+            }
+        } else
+        {
+            handle_client_receipt(set, (struct conn_client *) event->data);
+        }
+    }
+}
+
+void handle_timeouts(struct server_settings *set)
+{
+    struct tw_timer *timer;
+    struct tw_timer *next;
+    uint64_t        now_ms;
+    
+    now_ms = tw_clock_ms();
+    for (timer = set->timers->tw_expire(set->timers, now_ms); !errno && timer != NULL; timer = next)
+    {
+        struct conn_client *client;
+        
+        next   = timer->next; /* Read before the timer is armed again. */
+        client = (struct conn_client *) timer->data;
+        
+        if (timer == &client->delack)
+        {
+            if (client->ack_pending) /* No packet came along to carry the ACK. */
+            {
+                sv_send_ack(set, client);
+            }
+        } else if (client->state == CONN_HELD)
+        {
+            printf("\nSeat released in room %u\n", client->room->id);
+            remove_client(set, client);
+        } else if (++client->num_retrans > SV_MAX_RETRANS)
+        {
+            char ip[INET_ADDRSTRLEN];
+            
+            printf("\nClient timed out: %s:%u\n",
+                   inet_ntop(AF_INET, &client->addr->sin_addr, ip, sizeof(ip)),
+                   ntohs(client->addr->sin_port));
+            if (client->tickets && client->state == CONN_ESTABLISHED)
+            {
+                sv_hold(set, client);
+            } else
+            {
+                remove_client(set, client);
+            }
+        } else
+        {
+            rtt_backoff(&client->rtt);
+            sv_retransmit(set, client);
+            set->timers->tw_arm(set->timers, timer, now_ms, client->rtt.rto_ms);
+        }
+    }
+}
+
+void handle_client_receipt(struct server_settings *set, struct conn_client *client)
+{
+    while (!errno && sv_receive(set, client) >= BIO_BATCH)
+    {}
+}
+
+void handle_unicast(struct server_settings *set, struct conn_client *client)
+{
+    assemble_game_payload(client->room->game, client->s_payload);
+    
+    create_packet(client->s_packet,
+                  client->s_packet->flags,
+                  (uint8_t) (client->r_packet->seq_num + 1),
+                  STD_PAYLOAD_BYTES, client->s_payload);
+    sv_sendto(set, client);
+    sv_await_ack(set, client);
+    rtt_stop(&client->rtt); /* A resend: its ACK could answer either copy. */
+}
+
+void handle_broadcast(struct server_settings *set, struct room *room)
+{
+    uint8_t payload[STD_PAYLOAD_BYTES];
+    
+    assemble_game_payload(room->game, payload);
+    
+    for (uint8_t seat = 0; !errno && seat < ROOM_CAPACITY; ++seat)
+    {
+        struct conn_client *curr_cli;
+        
+        curr_cli = set->conns->ct_get(set->conns, room->players[seat]);
+        
+        /* A client whose seat is held is sent the latest game state when it resumes. */
+        if (curr_cli->state == CONN_HELD)
+        {
+            continue;
+        }
+        
+        /* A client whose window is full is sent the latest game state once its ACKs open the window. */
+        if (!sv_can_send(curr_cli))
+        {
+            curr_cli->state_pending = true;
+        } else
+        {
+            send_game_state(set, curr_cli, payload);
+        }
+    }
+}
+
+void send_game_state(struct server_settings *set, struct conn_client *client, const uint8_t *payload)
+{
+    uint8_t flags;
+    
+    /* Decide which client's turn it is. That client will be sent a PSH/TRN */
+    flags = (client->seat == client->room->game->turn % ROOM_CAPACITY) ? (FLAG_PSH | FLAG_TRN) : FLAG_PSH;
+    
+    client->state_pending = false;
+    if (client->version == PROTO_V2 && client->delta)
+    {
+        uint8_t buffer[MAX_STATE_BYTES];
+        
+        sv_push(set, client, flags, buffer, sv_encode_state(client, payload, buffer));
+        return;
+    }
+    if (client->version == PROTO_V2)
+    {
+        sv_push(set, client, flags, payload, STD_PAYLOAD_BYTES);
+        return;
+    }
+    
+    /* Each client owns a copy of the payload, so the packet can be retransmitted until it is ACKed. */
+    memcpy(client->s_payload, payload, STD_PAYLOAD_BYTES);
+    create_packet(client->s_packet, flags, (uint8_t) (client->r_packet->seq_num + 1),
+                  STD_PAYLOAD_BYTES, client->s_payload);
+    sv_sendto(set, client);
+    sv_await_ack(set, client);
+}
+
+uint16_t sv_encode_state(struct conn_client *client, const uint8_t *state, uint8_t *buffer)
+{
+    const uint8_t *base;
+    uint16_t      n_ver;
+    uint16_t      len;
+    size_t        num_changed;
+    
+    /* The client holds the state it ACKed as long as fewer than STATE_HISTORY states have been sent since. */
+    ++client->state_ver;
+    base = (client->state_acked && (uint16_t) (client->state_ver - client->acked_ver) < STATE_HISTORY)
+           ? client->states[client->acked_ver & (STATE_HISTORY - 1)] : NULL;
+    memcpy(client->states[client->state_ver & (STATE_HISTORY - 1)], state, STD_PAYLOAD_BYTES);
+    
+    num_changed = 0;
+    for (size_t i = 0; base != NULL && i < STD_PAYLOAD_BYTES; ++i)
+    {
+        num_changed += *(state + i) != *(base + i);
+    }
+    
+    n_ver = htons(client->state_ver);
+    memcpy(buffer, &n_ver, sizeof(n_ver));
+    if (base == NULL || 2 * num_changed >= STD_PAYLOAD_BYTES)
+    {
+        memcpy(buffer + sizeof(n_ver), &n_ver, sizeof(n_ver)); /* A keyframe is based on itself. */
+        memcpy(buffer + STATE_HDR_BYTES, state, STD_PAYLOAD_BYTES);
+        return MAX_STATE_BYTES;
+    }
+    
+    n_ver = htons(client->acked_ver);
+    memcpy(buffer + sizeof(n_ver), &n_ver, sizeof(n_ver));
+    len = STATE_HDR_BYTES;
+    for (size_t i = 0; i < STD_PAYLOAD_BYTES; ++i)
+    {
+        if (*(state + i) != *(base + i))
+        {
+            *(buffer + len++) = (uint8_t) i;
+            *(buffer + len++) = *(state + i);
+        }
+    }
+    
+    return len;
+}
+
+void assemble_game_payload(const struct Game *game, uint8_t *payload)
+{
+    *payload       = game->cursor;
+    *(payload + 1) = game->turn;
+    memcpy(payload + 2, game->trackGame, sizeof(game->trackGame));
+}
+
+int sv_accept(struct server_settings *set)
+{
+    int num_recv;
+    
+    if ((num_recv = set->bio->bio_recv(set->bio, set->server_fd)) == -1)
+    {
+        switch (errno)
+        {
+            case EINTR: /* User presses ctrl+C */
+            {
+                // running set to 0 with signal handler.
+                return -1;
+            }
+            default:
+            {
+                fatal_errno(__FILE__, __func__, __LINE__, errno);
+                running = 0;
+                return -1;
+            }
+        }
+    }
+    
+    for (int i = 0; !errno && i < num_recv; ++i)
+    {
+        sv_dispatch(set, &set->bio->rx[i].addr, set->bio->rx[i].buffer, set->bio->rx[i].len);
+    }
+    
+    return num_recv;
+}
+
+void sv_dispatch(struct server_settings *set, struct sockaddr_in *from_addr, const uint8_t *buffer, size_t len)
+{
+    struct conn_client *client;
+    uint16_t           length;
+    size_t             payload_len;
+    bool               cookie_ack;
+    
+    /* A message with a connection ID is its client's, whichever address it came from. */
+    if (*buffer & FLAG_CID)
+    {
+        uint64_t cid;
+        
+        if (len >= header_size(*buffer, PROTO_V2))
+        {
+            memcpy(&cid, buffer + header_size(*buffer, PROTO_V2) - CID_BYTES, sizeof(cid));
+            if ((client = set->cids->cm_get_id(set->cids, cid)) != NULL)
+            {
+                sv_process(set, client, from_addr, buffer, len);
+            }
+        }
+        return;
+    }
+    
+    /* The payload follows the version 1 header, and is read no further than the message goes. */
+    memcpy(&length, buffer + 2, sizeof(length));
+    payload_len = (len > HLEN_BYTES) ? len - HLEN_BYTES : 0;
+    payload_len = (ntohs(length) < payload_len) ? ntohs(length) : payload_len;
+    cookie_ack  = *buffer == FLAG_ACK && payload_len >= 2 * (OFFER_BYTES + OPT_BYTES) + COOKIE_BYTES;
+    
+    if ((client = set->clients->cm_get(set->clients, from_addr)) != NULL)
+    {
+        if (!cookie_ack)
+        {
+            sv_process(set, client, from_addr, buffer, len);
+        } else if (client->state == CONN_ESTABLISHED && client->version == PROTO_V2)
+        {
+            sv_send_ack(set, client); /* The client has not heard from its socket yet. */
+        }
+        return;
+    }
+    
+    if (cookie_ack)
+    {
+        sv_accept_cookie(set, from_addr, buffer + HLEN_BYTES, payload_len);
+        return;
+    }
+    if (*buffer != FLAG_SYN)
+    {
+        return;
+    }
+    
+    if (payload_len == OFFER_BYTES + OPT_BYTES + TICKET_BYTES && *(buffer + HLEN_BYTES) >= PROTO_V2 &&
+        (*(buffer + HLEN_BYTES + OFFER_BYTES) & OPT_TICKET) && sv_resume(set, from_addr, buffer + HLEN_BYTES))
+    {
+        return;
+    }
+    if (payload_len >= OFFER_BYTES + OPT_BYTES && *(buffer + HLEN_BYTES) >= PROTO_V2 &&
+        (*(buffer + HLEN_BYTES + OFFER_BYTES) & OPT_COOKIE))
+    {
+        sv_send_cookie(set, from_addr, buffer + HLEN_BYTES);
+        return;
+    }
+    if (set->num_half_open >= SV_MAX_HALF_OPEN)
+    {
+        return; /* Until some complete their handshake, only clients which return cookies are connected. */
+    }
+    
+    if ((client = connect_client(set, from_addr)) == NULL)
+    {
+        running = 0;
+        return; // errno set
+    }
+    
+    /* Answer with a SYN/ACK from the client's socket; the ACK is collected by the event loop. */
+    client->state = CONN_SYN_RCVD;
+    ++set->num_half_open;
+    if (sv_negotiate(set, client, buffer + HLEN_BYTES, payload_len, sv_choose_isn(), 0) == -1)
+    {
+        running = 0;
+        return; // errno set
+    }
+    sv_sendto(set, client);
+    sv_await_ack(set, client);
+}
+
+void sv_send_cookie(struct server_settings *set, const struct sockaddr_in *from_addr, const uint8_t *offer)
+{
+    struct packet packet;
+    uint8_t       payload[MAX_SYN_ACK_BYTES];
+    uint8_t       *packet_buffer;
+    uint16_t      length;
+    uint32_t      isn;
+    uint32_t      made_ms;
+    uint32_t      n_made_ms;
+    uint64_t      cid;
+    uint64_t      mac;
+    
+    /* The connection ID is chosen now, and kept nowhere but in the cookie, like the rest of the handshake. */
+    isn       = sv_choose_isn();
+    cid       = (*(offer + OFFER_BYTES) & OPT_CID) ? sv_choose_cid(set) : 0;
+    made_ms   = (uint32_t) tw_clock_ms();
+    n_made_ms = htonl(made_ms);
+    mac       = sv_cookie_mac(set, from_addr, offer, isn, cid, made_ms);
+    length    = sv_answer(set, offer, OFFER_BYTES + OPT_BYTES, isn, cid, payload);
+    memcpy(payload + length, &n_made_ms, sizeof(n_made_ms));
+    memcpy(payload + length + sizeof(n_made_ms), &mac, sizeof(mac));
+    
+    create_packet(&packet, FLAG_SYN | FLAG_ACK, MAX_SEQ, length + COOKIE_BYTES, payload);
+    if ((packet_buffer = serialize_packet(&packet, PROTO_V1)) == NULL)
+    {
+        running = 0;
+        return;
+    }
+    set->mm->mm_add(set->mm, packet_buffer);
+    
+    if (set->bio->bio_send(set->bio, set->server_fd, from_addr, packet_buffer, packet_size(&packet, PROTO_V1)) == -1)
+    {
+        perror("\nMessage transmission to client failed: \n");
+        errno = 0;
+    }
+    
+    set->mm->mm_free(set->mm, packet_buffer);
+}
+
+void sv_accept_cookie(struct server_settings *set, struct sockaddr_in *from_addr, const uint8_t *echo, size_t len)
+{
+    struct conn_client *client;
+    const uint8_t      *answer;
+    const uint8_t      *cookie;
+    uint32_t           n_num;
+    uint32_t           isn;
+    uint32_t           made_ms;
+    uint64_t           cid;
+    uint64_t           mac;
+    
+    /* The SYN was one the server answered with a cookie, so the MAC covers an offer of version 2 with OPT_COOKIE. The
+     * answer holds a connection ID if the offer has OPT_CID, which the server always takes. */
+    answer = echo + OFFER_BYTES + OPT_BYTES;
+    cookie = answer + OFFER_BYTES + OPT_BYTES;
+    cid    = 0;
+    if (*(echo + OFFER_BYTES) & OPT_CID)
+    {
+        cookie += CID_BYTES;
+    }
+    if (len != (size_t) (cookie - echo) + COOKIE_BYTES)
+    {
+        return;
+    }
+    if (*(echo + OFFER_BYTES) & OPT_CID)
+    {
+        memcpy(&cid, cookie - CID_BYTES, sizeof(cid));
+    }
+    memcpy(&n_num, answer + 2, sizeof(n_num));
+    isn = ntohl(n_num);
+    memcpy(&n_num, cookie, sizeof(n_num));
+    made_ms = ntohl(n_num);
+    memcpy(&mac, cookie + sizeof(n_num), sizeof(mac));
+    if ((uint32_t) ((uint32_t) tw_clock_ms() - made_ms) > SV_COOKIE_LIFETIME_MS ||
+        mac != sv_cookie_mac(set, from_addr, echo, isn, cid, made_ms) ||
+        (cid != 0 && set->cids->cm_get_id(set->cids, cid) != NULL))
+    {
+        return;
+    }
+    
+    if ((client = connect_client(set, from_addr)) == NULL)
+    {
+        running = 0;
+        return; // errno set
+    }
+    
+    client->state = CONN_ESTABLISHED; /* Never half-open. */
+    if (sv_negotiate(set, client, echo, OFFER_BYTES + OPT_BYTES, isn, cid) == -1)
+    {
+        running = 0;
+        return; // errno set
+    }
+    sv_establish(set, client);
+    if (!errno)
+    {
+        sv_send_ack(set, client);
+    }
+}
+
+bool sv_resume(struct server_settings *set, struct sockaddr_in *from_addr, const uint8_t *offer)
+{
+    struct conn_client *held;
+    struct conn_client *client;
+    uint8_t            taken[OFFER_BYTES + OPT_BYTES];
+    char               ip[INET_ADDRSTRLEN];
+    
+    if ((held = sv_redeem(set, offer + OFFER_BYTES + OPT_BYTES)) == NULL)
+    {
+        return false;
+    }
+    
+    if ((client = connect_client(set, from_addr)) == NULL)
+    {
+        running = 0;
+        return true; // errno set
+    }
+    
+    /* The ticket proves the client was seated; it is connected at once, so it returns no cookie. */
+    memcpy(taken, offer, sizeof(taken));
+    taken[OFFER_BYTES] &= (uint8_t) ~OPT_COOKIE;
+    client->state = CONN_ESTABLISHED;
+    if (sv_negotiate(set, client, taken, sizeof(taken), sv_choose_isn(), 0) == -1)
+    {
+        running = 0;
+        return true; // errno set
+    }
+    set->rooms->rt_replace(set->rooms, held, client);
+    remove_client(set, held);
+    
+    printf("\nClient resumed from: %s:%u in room %u\n",
+           inet_ntop(AF_INET, &client->addr->sin_addr, ip, sizeof(ip)),
+           ntohs(client->addr->sin_port),
+           client->room->id);
+    
+    sv_sendto(set, client);
+    
+    /* Nothing is outstanding on the new connection: the state fits the window, and the ticket if the window allows. */
+    if (client->room->num_players == ROOM_CAPACITY) /* Every state of the new connection is a keyframe until ACKed. */
+    {
+        uint8_t payload[STD_PAYLOAD_BYTES];
+        
+        assemble_game_payload(client->room->game, payload);
+        send_game_state(set, client, payload);
+    }
+    if (client->tickets)
+    {
+        sv_issue_ticket(set, client);
+    }
+    
+    return true;
+}
+
+struct conn_client *sv_redeem(const struct server_settings *set, const uint8_t *ticket)
+{
+    struct conn_client *client;
+    struct room        *room;
+    uint32_t           n_room_id;
+    uint64_t           ticket_id;
+    uint64_t           mac;
+    
+    memcpy(&n_room_id, ticket + 2, sizeof(n_room_id));
+    memcpy(&ticket_id, ticket + 2 + sizeof(n_room_id), sizeof(ticket_id));
+    memcpy(&mac, ticket + TICKET_BYTES - sizeof(mac), sizeof(mac));
+    if (*ticket != set->shard_id || *(ticket + 1) >= ROOM_CAPACITY || ntohl(n_room_id) >= set->rooms->capacity ||
+        mac != siphash24(set->cookie_key, ticket, TICKET_BYTES - sizeof(mac)))
+    {
+        return NULL;
+    }
+    
+    /* Once the client leaves, or resumes, the seat is held by another connection, or by none. */
+    room   = set->rooms->rooms[ntohl(n_room_id)];
+    client = (room != NULL) ? set->conns->ct_get(set->conns, room->players[*(ticket + 1)]) : NULL;
+    if (client == NULL || !client->tickets || client->ticket_id != ticket_id ||
+        (client->state != CONN_ESTABLISHED && client->state != CONN_HELD))
+    {
+        return NULL;
+    }
+    
+    return client;
+}
+
+void sv_issue_ticket(struct server_settings *set, struct conn_client *client)
+{
+    uint8_t  ticket[TICKET_BYTES];
+    uint32_t n_room_id;
+    uint64_t mac;
+    
+    if (!sv_can_send(client))
+    {
+        client->ticket_pending = true;
+        return;
+    }
+    client->ticket_pending = false;
+    
+    /* The ID only tells the connections of a seat apart; the MAC keeps the ticket from being forged. */
+    client->ticket_id = ((uint64_t) sv_choose_isn() << 32) | sv_choose_isn();
+    n_room_id         = htonl(client->room->id);
+    *ticket           = set->shard_id;
+    *(ticket + 1)     = client->seat;
+    memcpy(ticket + 2, &n_room_id, sizeof(n_room_id));
+    memcpy(ticket + 2 + sizeof(n_room_id), &client->ticket_id, sizeof(client->ticket_id));
+    mac = siphash24(set->cookie_key, ticket, TICKET_BYTES - sizeof(mac));
+    memcpy(ticket + TICKET_BYTES - sizeof(mac), &mac, sizeof(mac));
+    
+    sv_push(set, client, FLAG_TKT, ticket, TICKET_BYTES);
+}
+
+void sv_hold(struct server_settings *set, struct conn_client *client)
+{
+    set->timers->tw_cancel(set->timers, &client->delack);
+    client->ack_pending  = false;
+    client->awaiting_ack = false;
+    if (client->mapped)
+    {
+        set->clients->cm_remove(set->clients, client->addr);
+        client->mapped = false;
+    }
+    if (client->cid != 0)
+    {
+        set->cids->cm_remove_id(set->cids, client->cid);
+        client->cid = 0;
+    }
+    client->state = CONN_HELD;
+    
+    printf("\nSeat held in room %u\n", client->room->id);
+    set->timers->tw_arm(set->timers, &client->rto, tw_clock_ms(), SV_SEAT_HOLD_MS);
+}
+
+uint64_t sv_cookie_mac(const struct server_settings *set, const struct sockaddr_in *addr, const uint8_t *offer,
+                       uint32_t isn, uint64_t cid, uint32_t made_ms)
+{
+    uint8_t in[sizeof(addr->sin_addr.s_addr) + sizeof(addr->sin_port) + OFFER_BYTES + OPT_BYTES + sizeof(isn) +
+               sizeof(cid) + sizeof(made_ms)];
+    size_t  offset;
+    
+    offset = 0;
+    memcpy(in + offset, &addr->sin_addr.s_addr, sizeof(addr->sin_addr.s_addr));
+    offset += sizeof(addr->sin_addr.s_addr);
+    memcpy(in + offset, &addr->sin_port, sizeof(addr->sin_port));
+    offset += sizeof(addr->sin_port);
+    memcpy(in + offset, offer, OFFER_BYTES + OPT_BYTES);
+    offset += OFFER_BYTES + OPT_BYTES;
+    memcpy(in + offset, &isn, sizeof(isn));
+    offset += sizeof(isn);
+    memcpy(in + offset, &cid, sizeof(cid));
+    offset += sizeof(cid);
+    memcpy(in + offset, &made_ms, sizeof(made_ms));
+    
+    return siphash24(set->cookie_key, in, sizeof(in));
+}
+
+int sv_negotiate(struct server_settings *set, struct conn_client *client, const uint8_t *offer, size_t len,
+                 uint32_t isn, uint64_t cid)
+{
+    uint32_t n_isn;
+    uint8_t  options;
+    
+    /* The offer: the version, the window, and the first sequence number. */
+    if (len < OFFER_BYTES || *offer < PROTO_V2)
+    {
+        client->version = PROTO_V1;
+        create_packet(client->s_packet, FLAG_SYN | FLAG_ACK, MAX_SEQ, 0, NULL);
+        return 0;
+    }
+    
+    client->version = PROTO_V2;
+    client->snd_wnd = sv_clamp_window(set, *(offer + 1));
+    options         = (len >= OFFER_BYTES + OPT_BYTES) ? *(offer + OFFER_BYTES) : 0;
+    client->bundle  = options & OPT_BUNDLE;
+    client->delta   = options & OPT_DELTA;
+    client->tickets = options & OPT_TICKET;
+    memcpy(&n_isn, offer + 2, sizeof(n_isn));
+    client->rcv_nxt = ntohl(n_isn);
+    client->snd_una = isn;
+    client->snd_nxt = client->snd_una;
+    
+    if (options & OPT_CID)
+    {
+        client->cid = (cid != 0) ? cid : sv_choose_cid(set);
+        if (set->cids->cm_put_id(set->cids, client->cid, client) == -1)
+        {
+            client->cid = 0;
+            return -1; // errno set
+        }
+    }
+    
+    /* The SYN/ACK keeps the answer in the client's payload, so it can be retransmitted until it is ACKed. */
+    create_packet(client->s_packet, FLAG_SYN | FLAG_ACK, MAX_SEQ,
+                  sv_answer(set, offer, len, isn, client->cid, client->s_payload), client->s_payload);
+    return 0;
+}
+
+uint16_t sv_answer(const struct server_settings *set, const uint8_t *offer, size_t len, uint32_t isn, uint64_t cid,
+                   uint8_t *answer)
+{
+    uint32_t n_isn;
+    uint8_t  taken;
+    
+    n_isn         = htonl(isn);
+    *answer       = PROTO_V2;
+    *(answer + 1) = set->window;
+    memcpy(answer + 2, &n_isn, sizeof(n_isn));
+    if (len < OFFER_BYTES + OPT_BYTES)
+    {
+        return OFFER_BYTES;
+    }
+    
+    /* A client which offers options is told which of them the server took, then given its connection ID. */
+    taken = *(offer + OFFER_BYTES) & (OPT_BUNDLE | OPT_DELTA | OPT_COOKIE | OPT_CID | OPT_TICKET);
+    if (cid == 0)
+    {
+        taken &= (uint8_t) ~OPT_CID;
+    }
+    *(answer + OFFER_BYTES) = taken;
+    if (!(taken & OPT_CID))
+    {
+        return OFFER_BYTES + OPT_BYTES;
+    }
+    memcpy(answer + OFFER_BYTES + OPT_BYTES, &cid, sizeof(cid));
+    return OFFER_BYTES + OPT_BYTES + CID_BYTES;
+}
+
+uint32_t sv_choose_isn(void)
+{
+    uint32_t isn;
+    
+    if (getrandom(&isn, sizeof(isn), GRND_NONBLOCK) != (ssize_t) sizeof(isn))
+    {
+        isn   = (uint32_t) tw_clock_ms(); /* The entropy pool is not ready: any number will do. */
+        errno = 0;
+    }
+    
+    return isn;
+}
+
+uint64_t sv_choose_cid(const struct server_settings *set)
+{
+    uint8_t  id[CID_BYTES];
+    uint64_t cid;
+    
+    id[0] = set->shard_id;
+    for (uint64_t attempt = 0;; ++attempt)
+    {
+        if (getrandom(id + 1, sizeof(id) - 1, GRND_NONBLOCK) != (ssize_t) (sizeof(id) - 1))
+        {
+            uint64_t in[2];
+            uint64_t mac;
+            
+            /* The entropy pool is not ready: an ID made under the cookie key is as hard to guess. */
+            in[0] = tw_clock_ms();
+            in[1] = attempt;
+            mac   = siphash24(set->cookie_key, (const uint8_t *) in, sizeof(in));
+            memcpy(id + 1, &mac, sizeof(id) - 1);
+            errno = 0;
+        }
+        memcpy(&cid, id, sizeof(cid));
+        
+        /* 0 means no ID; an ID in use would hand its client over. */
+        if (cid != 0 && set->cids->cm_get_id(set->cids, cid) == NULL)
+        {
+            return cid;
+        }
+    }
+}
+
+uint8_t sv_clamp_window(const struct server_settings *set, uint8_t advertised)
+{
+    if (advertised == 0)
+    {
+        advertised = 1;
+    }
+    
+    return (advertised < set->window) ? advertised : set->window;
+}
+
+void sv_sendto(struct server_settings *set, struct conn_client *client)
+{
+    sv_transmit(set, client, client->s_packet);
+}
+
+void sv_transmit(struct server_settings *set, struct conn_client *client, const struct packet *packet)
+{
+    char    ip[INET_ADDRSTRLEN];
+    uint8_t *packet_buffer = NULL;
+    uint8_t version;
+    int     (*queue)(struct batch_io *, int, const struct sockaddr_in *, const uint8_t *, size_t);
+    
+    version = (packet->flags & FLAG_SYN) ? PROTO_V1 : sv_framing(client);
+    if ((packet_buffer = serialize_packet(packet, version)) == NULL)
+    {
+        running = 0;
+        return;
+    }
+    set->mm->mm_add(set->mm, packet_buffer);
+    
+    printf("\nSending packet:\n\tIP: %s\n\tPort: %u\n\tFlags: %s\n\tSequence Number: %u\n",
+           inet_ntop(AF_INET, &client->addr->sin_addr, ip, sizeof(ip)),
+           ntohs(client->addr->sin_port),
+           check_flags(packet->flags),
+           (version == PROTO_V1) ? (uint8_t) packet->seq_num : packet->seq_num);
+    if (version != PROTO_V1 && (packet->flags & FLAG_ACK))
+    {
+        printf("\tACK Number: %u\n", packet->ack_num);
+        if (client->ack_pending) /* The ACK held back goes with this packet. */
+        {
+            client->ack_pending = false;
+            set->timers->tw_cancel(set->timers, &client->delack);
+        }
+    }
+    
+    /* A client which unpacks bundles is sent the packets queued for it in this iteration in as few datagrams as fit. */
+    queue = (client->bundle && version == PROTO_V2) ? set->bio->bio_bundle : set->bio->bio_send;
+    if (queue(set->bio, client->c_fd, client->addr, packet_buffer, packet_size(packet, version)) == -1)
+    {
+        perror("\nMessage transmission to client failed: \n");
+        errno = 0;
+    }
+    
+    set->mm->mm_free(set->mm, packet_buffer);
+}
+
+int sv_receive(struct server_settings *set, struct conn_client *client)
+{
+    int num_recv;
+    
+    if ((num_recv = set->bio->bio_recv(set->bio, client->c_fd)) == -1)
+    {
+        switch (errno)
+        {
+            case EINTR: /* User presses ctrl+C */
+            {
+                // running set to 0 with signal handler.
+                return -1;
+            }
+            default:
+            {
+                fatal_errno(__FILE__, __func__, __LINE__, errno);
+                running = 0;
+                return -1;
+            }
+        }
+    }
+    
+    for (int i = 0; !errno && i < num_recv; ++i)
+    {
+        struct bio_dgram *dgram;
+        
+        dgram = &set->bio->rx[i];
+        /* A client in the client map keeps the address it is mapped by; one with a connection ID moves by
+         * sv_migrate. */
+        if (!client->mapped && client->cid == 0)
+        {
+            *client->addr = dgram->addr;
+        }
+        
+        if (sv_process(set, client, &dgram->addr, dgram->buffer, dgram->len) == -1)
+        {
+            return -1; /* The client has been removed. */
+        }
+    }
+    
+    return num_recv;
+}
+
+int sv_process(struct server_settings *set, struct conn_client *client, const struct sockaddr_in *from_addr,
+               const uint8_t *packet_buffer, size_t len)
+{
+    char ip[INET_ADDRSTRLEN];
+    
+    if (client->state == CONN_HELD)
+    {
+        return 0; /* The connection is given up; only the client's ticket takes the seat back. */
+    }
+    if (sv_framing(client) == PROTO_V2)
+    {
+        return process_v2(set, client, from_addr, packet_buffer, len);
+    }
+    
+    printf("\nReceived packet:\n\tIP: %s\n\tPort: %u\n\tFlags: %s\n\tSequence Number: %d\n",
+           inet_ntop(AF_INET, &client->addr->sin_addr, ip, sizeof(ip)),
+           ntohs(client->addr->sin_port),
+           check_flags(*packet_buffer),
+           *(packet_buffer + 1));
+    
+    switch (client->state)
+    {
+        case CONN_SYN_RCVD:
+        {
+            process_syn_rcvd(set, client, packet_buffer);
+            return 0;
+        }
+        case CONN_ESTABLISHED:
+        {
+            process_established(set, client, packet_buffer);
+            return 0;
+        }
+        case CONN_LAST_ACK:
+        {
+            return process_last_ack(set, client, packet_buffer);
+        }
+        case CONN_HELD:
+        default:
+        {
+            return 0;
+        }
+    }
+}
+
+void process_syn_rcvd(struct server_settings *set, struct conn_client *client, const uint8_t *packet_buffer)
+{
+    if (*packet_buffer == FLAG_SYN)
+    {
+        sv_retransmit(set, client); /* The SYN/ACK was lost: retransmit it. */
+        return;
+    }
+    if ((*packet_buffer != FLAG_ACK) || (*(packet_buffer + 1) != client->s_packet->seq_num))
+    {
+        return;
+    }
+    
+    /* Store the ACK; the first PSH is sequenced after it. */
+    deserialize_packet(client->r_packet, packet_buffer, PROTO_V1);
+    if (errno == ENOMEM)
+    {
+        running = 0;
+        return;
+    }
+    set->mm->mm_add(set->mm, client->r_packet->payload);
+    set->mm->mm_free(set->mm, client->r_packet->payload);
+    client->r_packet->payload = NULL;
+    
+    sv_ack_received(set, client);
+    sv_establish(set, client);
+}
+
+void process_established(struct server_settings *set, struct conn_client *client, const uint8_t *packet_buffer)
+{
+    if ((*packet_buffer == client->r_packet->flags) &&
+        (*(packet_buffer + 1) == client->r_packet->seq_num))
+    {
+        /* Retransmission received: resend the game state, unless a broadcast will. */
+        if (!client->room->do_broadcast)
+        {
+            handle_unicast(set, client);
+        }
+        return;
+    }
+    if (*packet_buffer == FLAG_ACK)
+    {
+        if (*(packet_buffer + 1) != client->s_packet->seq_num)
+        {
+            sv_retransmit(set, client); /* Bad seq num: retransmit the outstanding packet. */
+            return;
+        }
+        sv_ack_received(set, client); /* The outstanding packet was received. */
+    }
+    
+    deserialize_packet(client->r_packet, packet_buffer, PROTO_V1); /* Deserialize the packet to store its contents. */
+    if (errno == ENOMEM)
+    {
+        running = 0;
+        return;
+    }
+    set->mm->mm_add(set->mm, client->r_packet->payload);
+    
+    if ((*packet_buffer & FLAG_PSH) &&
+        (*(packet_buffer + 1) == (uint8_t) (client->s_packet->seq_num + 1)))
+    {
+        /* A PSH in sequence implies the outstanding packet was received; the ACK replaces it. */
+        sv_ack_received(set, client);
+        create_packet(client->s_packet, FLAG_ACK, client->r_packet->seq_num, 0, NULL);
+        sv_sendto(set, client);
+        
+        /* Update the game state. */
+        sv_play(set, client->room, (struct gp_move) {.cursor = *client->r_packet->payload,
+                                                      .place  = *(client->r_packet->payload + 1) != 0});
+    }
+    
+    set->mm->mm_free(set->mm, client->r_packet->payload);
+    client->r_packet->payload = NULL;
+    
+    if (client->r_packet->flags == FLAG_FIN)
+    {
+        sv_disconnect(set, client);
+    } else if (client->state_pending && !client->awaiting_ack && client->room->num_players == ROOM_CAPACITY)
+    {
+        uint8_t payload[STD_PAYLOAD_BYTES];
+        
+        /* The outstanding packet was ACKed: send the game state held back from a broadcast. */
+        assemble_game_payload(client->room->game, payload);
+        send_game_state(set, client, payload);
+    }
+}
+
+int process_last_ack(struct server_settings *set, struct conn_client *client, const uint8_t *packet_buffer)
+{
+    if (*packet_buffer == (FLAG_FIN | FLAG_ACK))
+    {
+        remove_client(set, client);
+        return -1; /* Client disconnected. */
+    }
+    if (*packet_buffer == FLAG_FIN)
+    {
+        sv_disconnect(set, client); /* The FIN/ACK or the FIN was lost: answer again. */
+    }
+    
+    return 0;
+}
+
+int process_v2(struct server_settings *set, struct conn_client *client, const struct sockaddr_in *from_addr,
+               const uint8_t *packet_buffer, size_t len)
+{
+    char     ip[INET_ADDRSTRLEN];
+    uint16_t length;
+    
+    if (*packet_buffer == FLAG_SYN) /* Framed as in version 1. */
+    {
+        if (client->s_packet->flags == (FLAG_SYN | FLAG_ACK))
+        {
+            sv_sendto(set, client);
+        }
+        return 0;
+    }
+    
+    /* The length follows the flags and the window. A truncated message, or a stray version 1 one, is dropped. */
+    memcpy(&length, packet_buffer + 2, sizeof(length));
+    if (len < HLEN_V2_BYTES || len < header_size(*packet_buffer, PROTO_V2) + ntohs(length))
+    {
+        return 0;
+    }
+    
+    deserialize_packet(client->r_packet, packet_buffer, PROTO_V2);
+    if (errno == ENOMEM)
+    {
+        running = 0;
+        return 0;
+    }
+    set->mm->mm_add(set->mm, client->r_packet->payload);
+    
+    if (client->cid != 0)
+    {
+        if (!(client->r_packet->flags & FLAG_CID) || client->r_packet->cid != client->cid ||
+            ((from_addr->sin_addr.s_addr != client->addr->sin_addr.s_addr ||
+              from_addr->sin_port != client->addr->sin_port) &&
+             sv_migrate(set, client, client->r_packet, from_addr) == -1))
+        {
+            set->mm->mm_free(set->mm, client->r_packet->payload);
+            client->r_packet->payload = NULL;
+            return 0;
+        }
+        client->r_packet->flags &= (uint8_t) ~FLAG_CID; /* Checked. */
+    }
+    
+    printf("\nReceived packet:\n\tIP: %s\n\tPort: %u\n\tFlags: %s\n\tSequence Number: %u\n",
+           inet_ntop(AF_INET, &client->addr->sin_addr, ip, sizeof(ip)),
+           ntohs(client->addr->sin_port),
+           check_flags(client->r_packet->flags),
+           client->r_packet->seq_num);
+    
+    if (client->r_packet->flags & FLAG_ACK)
+    {
+        sv_acked(set, client, client->r_packet);
+    }
+    
+    if (client->r_packet->flags & (FLAG_PSH | FLAG_FIN))
+    {
+        if (client->r_packet->seq_num != client->rcv_nxt)
+        {
+            if (client->state == CONN_LAST_ACK && (client->r_packet->flags & FLAG_FIN))
+            {
+                sv_retransmit(set, client); /* The FIN/ACK was lost: answer again. */
+            } else
+            {
+                sv_send_ack(set, client); /* A duplicate, or a packet after a lost one: ACK what has arrived. */
+            }
+        } else if (client->state == CONN_ESTABLISHED && (client->r_packet->flags & FLAG_FIN))
+        {
+            ++client->rcv_nxt;
+            sv_disconnect(set, client); /* The FIN/ACK ACKs the FIN. */
+        } else
+        {
+            ++client->rcv_nxt;
+            sv_delay_ack(set, client); /* A move is ACKed by the game state it leads to. */
+            if (client->state == CONN_ESTABLISHED && client->r_packet->length >= GAME_RECV_BYTES)
+            {
+                sv_play(set, client->room, (struct gp_move) {.cursor = *client->r_packet->payload,
+                                                              .place  = *(client->r_packet->payload + 1) != 0});
+            }
+        }
+    }
+    
+    set->mm->mm_free(set->mm, client->r_packet->payload);
+    client->r_packet->payload = NULL;
+    
+    if (client->state == CONN_LAST_ACK && client->snd_una == client->snd_nxt)
+    {
+        remove_client(set, client);
+        return -1; /* Client disconnected. */
+    }
+    
+    if (client->state == CONN_ESTABLISHED && client->state_pending && sv_can_send(client) &&
+        client->room->num_players == ROOM_CAPACITY)
+    {
+        uint8_t payload[STD_PAYLOAD_BYTES];
+        
+        /* The window opened: send the game state held back from a broadcast. */
+        assemble_game_payload(client->room->game, payload);
+        send_game_state(set, client, payload);
+    }
+    if (client->state == CONN_ESTABLISHED && client->ticket_pending)
+    {
+        sv_issue_ticket(set, client); /* Held back again if the state filled the window. */
+    }
+    
+    return 0;
+}
+
+int sv_migrate(struct server_settings *set, struct conn_client *client, const struct packet *packet,
+               const struct sockaddr_in *addr)
+{
+    char ip[INET_ADDRSTRLEN];
+    
+    if (!(packet->flags & FLAG_ACK) || seq_before(packet->ack_num, client->snd_una) ||
+        seq_after(packet->ack_num, client->snd_nxt))
+    {
+        return -1;
+    }
+    
+    if (client->mapped)
+    {
+        if (set->clients->cm_get(set->clients, addr) != NULL)
+        {
+            return -1; /* Another client is connected from the address. */
+        }
+        if (set->clients->cm_put(set->clients, addr, client) == -1)
+        {
+            running = 0;
+            return -1; // errno set
+        }
+        set->clients->cm_remove(set->clients, client->addr);
+    }
+    *client->addr = *addr;
     
-    if (!errno)
-    { sv_comm_core(set); }
+    printf("\nClient moved to: %s:%u\n",
+           inet_ntop(AF_INET, &client->addr->sin_addr, ip, sizeof(ip)),
+           ntohs(client->addr->sin_port));
+    return 0;
 }
 
-void open_server(struct server_settings *set)
+void sv_acked(struct server_settings *set, struct conn_client *client, const struct packet *packet)
 {
-    struct sockaddr_in addr;
-    
-    if ((set->server_fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) // NOLINT(android-cloexec-socket) : SOCK_CLOEXEC dne
+    client->snd_wnd = sv_clamp_window(set, packet->window);
+    if (packet->flags & FLAG_SAK)
     {
-        fatal_errno(__FILE__, __func__, __LINE__, errno);
-        return;
+        sv_sacked(client, packet);
     }
     
-    addr.sin_family           = AF_INET;
-    addr.sin_port             = htons(set->server_port);
-    if ((addr.sin_addr.s_addr = inet_addr(set->server_ip)) == (in_addr_t) -1)
+    /* An old ACK, or one for packets never sent, releases nothing. */
+    if (!seq_after(packet->ack_num, client->snd_una) || seq_after(packet->ack_num, client->snd_nxt))
     {
-        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        if (packet->ack_num == client->snd_una && client->snd_una != client->snd_nxt &&
+            !(packet->flags & (FLAG_PSH | FLAG_FIN)))
+        {
+            sv_dup_ack(set, client);
+        }
         return;
     }
     
-    if (bind(set->server_fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_in)) == -1)
+    if (client->delta)
     {
-        fatal_errno(__FILE__, __func__, __LINE__, errno);
-        return;
+        sv_state_acked(client, packet->ack_num);
+    }
+    client->snd_una     = packet->ack_num;
+    client->num_retrans = 0;
+    client->dup_acks    = 0;
+    rtt_ack(&client->rtt, client->snd_una - 1, tw_clock_ms());
+    if (client->snd_una == client->snd_nxt)
+    {
+        sv_ack_received(set, client);
+    } else
+    {
+        set->timers->tw_arm(set->timers, &client->rto, tw_clock_ms(), client->rtt.rto_ms);
     }
-    
-    printf("\nServer running on %s:%d\n", set->server_ip, set->server_port);
 }
 
-void sv_comm_core(struct server_settings *set)
+void sv_sacked(struct conn_client *client, const struct packet *packet)
 {
-    fd_set readfds;
-    int    max_fd;
+    uint32_t seq_num;
     
-    running = 1;
-    while (running)
+    seq_num = packet->ack_num + 1;
+    for (uint32_t bits = packet->sack; bits != 0; bits >>= 1, ++seq_num)
     {
-        max_fd = set_readfds(set, &readfds);
-        
-        if (select(max_fd + 1, &readfds, NULL, NULL, NULL) == -1)
-        {
-            switch (errno)
-            {
-                case EINTR:
-                {
-                    // running set to 0 with signal handler.
-                    return;
-                }
-                default:
-                {
-                    fatal_errno(__FILE__, __func__, __LINE__, errno);
-                    running = 0;
-                    return;
-                }
-            }
-        }
-        
-        set->do_broadcast = false; /* May be set true if received message is a PSH or ACK255. */
-        set->do_unicast = false; /* May be set true if received message is a duplicate. */
-        
-        handle_receipt(set, &readfds); /* Handle a received message on any of the active sockets. */
-        
-        if (!errno &&
-            set->num_conn_client == MAX_CLIENTS &&         /* If MAX_CLIENTS connected, */
-            set->do_broadcast)                             /* If not retransmission, */
-        {                                                  /* Broadcast game state to all connected clients. */
-            handle_broadcast(set);
-        }
-        
-        if (set->num_conn_client < MAX_CLIENTS) /* If fewer than MAX_CLIENTS, reset game state. */
+        /* Bits for packets already ACKed, or never sent, are ignored. */
+        if ((bits & 1) && !seq_before(seq_num, client->snd_una) && seq_before(seq_num, client->snd_nxt))
         {
-            set->game->updateGameState(set->game, NULL, NULL, NULL);
+            client->rtx[seq_num & (SV_RTX_SLOTS - 1)].sacked = true;
         }
     }
 }
 
-void handle_receipt(struct server_settings *set, fd_set *readfds)
+void sv_state_acked(struct conn_client *client, uint32_t ack_num)
 {
-    struct conn_client *curr_cli;
-    
-    /* If there is action on the main socket, it is a new connection. */
-    if (FD_ISSET(set->server_fd, readfds))
+    for (uint32_t seq_num = client->snd_una; seq_num != ack_num; ++seq_num)
     {
-        if (!errno)
-        { sv_accept(set); }
-    } else
-    {
-        curr_cli = set->first_conn_client;
-        for (int cli_num = 0;
-             curr_cli != NULL && cli_num < MAX_CLIENTS; ++cli_num)  /* Receive messages from each client. */
+        const struct rtx_entry *entry;
+        uint16_t               n_ver;
+        
+        entry = &client->rtx[seq_num & (SV_RTX_SLOTS - 1)];
+        if ((entry->flags & FLAG_PSH) && !entry->superseded && entry->length >= STATE_HDR_BYTES)
         {
-            if (FD_ISSET(curr_cli->c_fd, readfds))
-            {
-                if (!errno)
-                { sv_recvfrom(set, curr_cli); }
-            }
-            if (!errno && !set->do_broadcast && set->do_unicast)
-            {
-                handle_unicast(set, curr_cli);
-                set->do_unicast = false;
-            }
-            if (curr_cli->r_packet->flags == FLAG_FIN)
+            memcpy(&n_ver, entry->payload, sizeof(n_ver));
+            if (!client->state_acked || (int16_t) (ntohs(n_ver) - client->acked_ver) > 0)
             {
-                struct conn_client *disconn_client;
-                
-                disconn_client = curr_cli;
-                curr_cli       = curr_cli->next; /* Go to next client in list. */
-                
-                sv_disconnect(set, disconn_client);
-            } else
-            {
-                curr_cli = curr_cli->next; /* Go to next client in list. */
+                client->acked_ver   = ntohs(n_ver);
+                client->state_acked = true;
             }
         }
     }
 }
 
-void handle_unicast(struct server_settings *set, struct conn_client *client)
+void sv_dup_ack(struct server_settings *set, struct conn_client *client)
 {
-    uint8_t *payload;
-    
-    if ((payload = assemble_game_payload(set->game)) == NULL)
+    if (set->dup_thresh == 0 || client->dup_acks >= set->dup_thresh)
     {
-        running = 0;
         return;
     }
-    set->mm->mm_add(set->mm, payload);
     
-    if (!errno)
+    if (++client->dup_acks == set->dup_thresh)
     {
-        create_packet(client->s_packet,
-                      client->s_packet->flags,
-                      (uint8_t) (client->r_packet->seq_num + 1),
-                      STD_PAYLOAD_BYTES, payload);
+        sv_fast_retransmit(set, client);
     }
-    if (!errno)
-    { sv_sendto(set, client); }
-    if (!errno)
-    { sv_recvfrom(set, client); }
-    
-    set->mm->mm_free(set->mm, payload);
 }
 
-void handle_broadcast(struct server_settings *set)
+void sv_fast_retransmit(struct server_settings *set, struct conn_client *client)
 {
-    struct conn_client *curr_cli;
-    uint8_t            *payload;
+    uint32_t end;
     
-    if ((payload = assemble_game_payload(set->game)) == NULL)
+    /* The newest packet the client holds; without a selective ACK, the oldest packet is the only hole known. */
+    end = client->snd_una + 1;
+    for (uint32_t seq_num = client->snd_una; seq_num != client->snd_nxt; ++seq_num)
     {
-        running = 0;
-        return;
+        if (client->rtx[seq_num & (SV_RTX_SLOTS - 1)].sacked)
+        {
+            end = seq_num;
+        }
     }
-    set->mm->mm_add(set->mm, payload);
     
-    curr_cli = set->first_conn_client;
-    for (int cli_num = 0; curr_cli != NULL && cli_num < MAX_CLIENTS; ++cli_num)
+    rtt_stop(&client->rtt);
+    for (uint32_t seq_num = client->snd_una; !errno && seq_before(seq_num, end); ++seq_num)
     {
-        /* Decide which client's turn it is. That client will be sent a PSH/TRN */
-        if (!errno)
+        struct rtx_entry *entry;
+        
+        entry = &client->rtx[seq_num & (SV_RTX_SLOTS - 1)];
+        if (!entry->sacked)
         {
-            uint8_t flags = (cli_num == set->game->turn % MAX_CLIENTS) ? (FLAG_PSH | FLAG_TRN) : FLAG_PSH;
-            create_packet(curr_cli->s_packet, flags, (uint8_t) (curr_cli->r_packet->seq_num + 1),
-                          STD_PAYLOAD_BYTES, payload);
+            sv_supersede(client, entry);
+            sv_send_entry(set, client, entry);
         }
-        if (!errno)
-        { sv_sendto(set, curr_cli); }
-        if (!errno)
-        { sv_recvfrom(set, curr_cli); }
-        
-        curr_cli = curr_cli->next;
     }
-    
-    set->mm->mm_free(set->mm, payload);
+    set->timers->tw_arm(set->timers, &client->rto, tw_clock_ms(), client->rtt.rto_ms);
 }
 
-uint8_t *assemble_game_payload(struct Game *game)
+void sv_supersede(const struct conn_client *client, struct rtx_entry *entry)
 {
-    uint8_t *payload;
+    const struct rtx_entry *latest;
+    uint16_t               n_ver;
+    uint16_t               version;
     
-    if ((payload = (uint8_t *) s_calloc(STD_PAYLOAD_BYTES, sizeof(uint8_t),
-                                        __FILE__, __func__, __LINE__)) == NULL)
+    if (!client->delta || !(entry->flags & FLAG_PSH) || entry->length < STATE_HDR_BYTES)
     {
-        return NULL;
+        return;
     }
     
-    *payload       = game->cursor;
-    *(payload + 1) = game->turn;
-    memcpy(payload + 2, game->trackGame, sizeof(game->trackGame));
+    latest = entry;
+    for (uint32_t seq_num = client->snd_nxt - 1; seq_num != entry->seq_num; --seq_num)
+    {
+        const struct rtx_entry *newer;
+        
+        newer = &client->rtx[seq_num & (SV_RTX_SLOTS - 1)];
+        if ((newer->flags & FLAG_PSH) && newer->epoch == entry->epoch && newer->length >= STATE_HDR_BYTES)
+        {
+            latest = newer;
+            break;
+        }
+    }
     
-    return payload;
+    /* The turn goes with the state. */
+    entry->flags      = latest->flags;
+    entry->superseded = entry->superseded || latest != entry;
+    memcpy(&n_ver, latest->payload, sizeof(n_ver));
+    version = ntohs(n_ver);
+    if ((uint16_t) (client->state_ver - version) < STATE_HISTORY)
+    {
+        memcpy(entry->payload, &n_ver, sizeof(n_ver));
+        memcpy(entry->payload + sizeof(n_ver), &n_ver, sizeof(n_ver)); /* A keyframe is based on itself. */
+        memcpy(entry->payload + STATE_HDR_BYTES, client->states[version & (STATE_HISTORY - 1)], STD_PAYLOAD_BYTES);
+        entry->length = MAX_STATE_BYTES;
+    } else if (latest != entry)
+    {
+        entry->length = latest->length;
+        memcpy(entry->payload, latest->payload, latest->length);
+    }
 }
 
-void sv_accept(struct server_settings *set)
+void sv_establish(struct server_settings *set, struct conn_client *client)
 {
-    struct sockaddr_in from_addr;
-    socklen_t          size_addr_in;
-    uint8_t            buffer[HLEN_BYTES];
+    char ip[INET_ADDRSTRLEN];
     
-    size_addr_in = sizeof(struct sockaddr_in);
-    
-    /* Get client sockaddr_in here. */
-    if ((recvfrom(set->server_fd, buffer, sizeof(buffer), 0, (struct sockaddr *) &from_addr, &size_addr_in)) == -1)
+    if (set->rooms->rt_join(set->rooms, client) == NULL)
     {
-        switch (errno)
-        {
-            case EINTR:
-            {
-                /* running set to 0 with signal handler. */
-                return;
-            }
-            default:
-            {
-                fatal_errno(__FILE__, __func__, __LINE__, errno);
-                running = 0;
-                return;
-            }
-        }
+        running = 0;
+        return; // errno set
     }
     
-    if (set->num_conn_client < MAX_CLIENTS && *buffer == FLAG_SYN) /* If the message received was a SYN packet. */
+    /* With its own socket, a half-open client is no longer looked up by address; retransmitted SYNs have stopped. */
+    if (client->state == CONN_SYN_RCVD)
     {
-        struct conn_client *new_client;
-        if ((new_client = connect_client(set, &from_addr)) == NULL)
+        --set->num_half_open;
+        if (!set->single_socket)
         {
-            running = 0;
-            return; // errno set
+            set->clients->cm_remove(set->clients, client->addr);
+            client->mapped = false;
         }
-        
-        printf("\nClient connected from: %s:%u\n",
-               inet_ntoa(new_client->addr->sin_addr), // NOLINT(concurrency-mt-unsafe) : no threads here
-               ntohs(new_client->addr->sin_port));
-        
-        create_packet(new_client->s_packet, FLAG_SYN | FLAG_ACK, MAX_SEQ, 0, NULL);
-        if (!errno)
-        { sv_sendto(set, new_client); }
-        if (!errno)
-        { sv_recvfrom(set, new_client); }
-    } else if (set->num_conn_client == MAX_CLIENTS && *buffer == FLAG_SYN)
+    }
+    client->state = CONN_ESTABLISHED;
+    
+    printf("\nClient connected from: %s:%u to room %u\n",
+           inet_ntop(AF_INET, &client->addr->sin_addr, ip, sizeof(ip)),
+           ntohs(client->addr->sin_port),
+           client->room->id);
+    
+    if (client->tickets)
     {
-        printf("\n--- Client connection denied: lobby full ---\n");
+        sv_issue_ticket(set, client);
     }
+    
+    /* Do a broadcast because the game may have just started. */
+    set->rooms->rt_mark_broadcast(set->rooms, client->room);
 }
 
-void sv_sendto(struct server_settings *set, struct conn_client *client)
+void sv_play(struct server_settings *set, struct room *room, struct gp_move move)
 {
-    uint8_t   *packet_buffer = NULL;
-    socklen_t size_addr_in;
-    size_t    packet_size;
+    if (set->pool == NULL)
+    {
+        sv_apply(set, room, move);
+        return;
+    }
     
-    if ((packet_buffer = serialize_packet(client->s_packet)) == NULL)
+    if (room->num_moves == GP_MAX_MOVES)
     {
-        running = 0;
+        (void) fprintf(stderr, "\nRoom %u has too many moves waiting; move dropped\n", room->id);
         return;
     }
-    set->mm->mm_add(set->mm, packet_buffer);
+    room->moves[room->num_moves++] = move;
     
-    size_addr_in = sizeof(struct sockaddr_in);
-    packet_size  = HLEN_BYTES + client->s_packet->length;
+    if (!room->in_play) /* Otherwise, the moves are handed out when the room's task returns. */
+    {
+        sv_submit_moves(set, room);
+    }
+}
+
+void sv_apply(struct server_settings *set, struct room *room, struct gp_move move)
+{
+    room->game->cursor = move.cursor;
+    if (move.place)
+    {
+        room->game->updateBoard(room->game);
+    }
     
-    printf("\nSending packet:\n\tIP: %s\n\tPort: %u\n\tFlags: %s\n\tSequence Number: %d\n",
-           inet_ntoa(client->addr->sin_addr), // NOLINT(concurrency-mt-unsafe) : no threads here
-           ntohs(client->addr->sin_port),
-           check_flags(client->s_packet->flags),
-           client->s_packet->seq_num);
+    /* Do a broadcast because the game state was just updated. */
+    set->rooms->rt_mark_broadcast(set->rooms, room);
+}
+
+void sv_submit_moves(struct server_settings *set, struct room *room)
+{
+    struct gp_task *task;
     
-    if (sendto(client->c_fd, packet_buffer, packet_size, 0, (struct sockaddr *) client->addr, size_addr_in) == -1)
+    if ((task = (struct gp_task *) s_calloc(1, sizeof(struct gp_task), __FILE__, __func__, __LINE__)) == NULL)
     {
-        perror("\nMessage transmission to client failed: \n");
+        running = 0;
         return;
     }
     
-    set->mm->mm_free(set->mm, packet_buffer);
+    task->results   = set->results;
+    task->room_id   = room->id;
+    task->epoch     = room->epoch;
+    task->game      = *room->game;
+    task->num_moves = room->num_moves;
+    memcpy(task->moves, room->moves, room->num_moves * sizeof(struct gp_move));
+    
+    if (set->pool->gp_submit(set->pool, task) == -1) /* Backpressure: the game workers are saturated. */
+    {
+        free(task);
+        errno = 0;
+        set->rooms->rt_mark_stalled(set->rooms, room);
+        return;
+    }
+    room->num_moves = 0;
+    room->in_play   = true;
 }
 
-void sv_recvfrom(struct server_settings *set, struct conn_client *client)
+void handle_stalled(struct server_settings *set)
 {
-    uint8_t   packet_buffer[HLEN_BYTES + GAME_RECV_BYTES];
-    socklen_t size_addr_in;
-    bool      go_ahead;
-    
-    size_addr_in = sizeof(struct sockaddr_in);
-    go_ahead     = false;
-    do
+    for (struct room *room; !errno && (room = set->rooms->rt_next_stalled(set->rooms)) != NULL;)
     {
-        memset(packet_buffer, 0, sizeof(packet_buffer));
-        if (recvfrom(client->c_fd, packet_buffer, sizeof(packet_buffer), 0,
-                     (struct sockaddr *) client->addr, &size_addr_in) == -1)
+        if (!room->in_play && room->num_moves > 0)
         {
-            switch (errno)
+            sv_submit_moves(set, room);
+            if (room->stalled) /* Refused again; the rest wait for more tasks to return. */
             {
-                case EINTR: /* User presses ctrl+C */
-                {
-                    // running set to 0 with signal handler.
-                    return;
-                }
-                default:
-                {
-                    fatal_errno(__FILE__, __func__, __LINE__, errno);
-                    running = 0;
-                    return;
-                }
+                return;
             }
-        } else
+        }
+    }
+}
+
+void handle_game_results(struct server_settings *set)
+{
+    struct gp_task *tasks[GP_COLLECT_BATCH];
+    size_t         num_tasks;
+    
+    while ((num_tasks = set->results->gp_collect(set->results, tasks)) > 0)
+    {
+        for (size_t i = 0; i < num_tasks; ++i)
         {
-            
-            /* If bad message received, do not go ahead. If good message received, do go ahead. */
-            if (!(go_ahead = sv_process(set, client, packet_buffer)))
-            {
-                sv_sendto(set, client); /* Case: bad ACK seq num, retransmit. */
-            }
+            sv_take_back(set, tasks[i]);
         }
-    } while (!go_ahead);
+    }
 }
 
-bool sv_process(struct server_settings *set, struct conn_client *client, const uint8_t *packet_buffer)
+void sv_take_back(struct server_settings *set, struct gp_task *task)
 {
-    printf("\nReceived packet:\n\tIP: %s\n\tPort: %u\n\tFlags: %s\n\tSequence Number: %d\n",
-           inet_ntoa(client->addr->sin_addr), // NOLINT(concurrency-mt-unsafe) : no threads here
-           ntohs(client->addr->sin_port),
-           check_flags(*packet_buffer),
-           *(packet_buffer + 1));
+    struct room *room;
     
-    if ((*packet_buffer == client->r_packet->flags) &&
-        (*(packet_buffer + 1) == client->r_packet->seq_num))
+    room = (task->room_id < set->rooms->capacity) ? set->rooms->rooms[task->room_id] : NULL;
+    
+    /* The room may have been destroyed, or its game reset, while the task was out. */
+    if (room != NULL && room->epoch == task->epoch)
     {
-        set->do_unicast = true;
-        return true; /* Retransmission received: go ahead. */
+        *room->game   = task->game;
+        room->in_play = false;
+        if (task->game_over)
+        {
+            printf("\nGame over in room %u\n", room->id);
+        }
+        
+        /* Do a broadcast because the game state was just updated. */
+        set->rooms->rt_mark_broadcast(set->rooms, room);
+        if (room->num_moves > 0)
+        {
+            sv_submit_moves(set, room);
+        }
     }
-    if ((*packet_buffer == FLAG_ACK) &&
-        (*(packet_buffer + 1) != client->s_packet->seq_num))
+    free(task);
+}
+
+uint8_t sv_framing(const struct conn_client *client)
+{
+    return (client->state == CONN_SYN_RCVD) ? PROTO_V1 : client->version;
+}
+
+bool sv_can_send(const struct conn_client *client)
+{
+    if (client->version == PROTO_V2)
     {
-        return false; /* Bad seq num: do not go ahead. */
+        return (uint32_t) (client->snd_nxt - client->snd_una) < client->snd_wnd;
     }
-    if (*packet_buffer == (FLAG_FIN | FLAG_ACK))
+    
+    return !client->awaiting_ack;
+}
+
+void sv_push(struct server_settings *set, struct conn_client *client, uint8_t flags, const uint8_t *payload,
+             uint16_t len)
+{
+    struct rtx_entry *entry;
+    
+    entry = &client->rtx[client->snd_nxt & (SV_RTX_SLOTS - 1)];
+    entry->seq_num    = client->snd_nxt++;
+    entry->flags      = flags;
+    entry->sacked     = false;
+    entry->superseded = false;
+    entry->epoch      = (client->room != NULL) ? client->room->epoch : 0;
+    entry->length     = len;
+    if (len > 0)
     {
-        remove_client(set, client);
-        return true; /* Client disconnected: go ahead. */
+        memcpy(entry->payload, payload, len);
     }
     
-    deserialize_packet(client->r_packet, packet_buffer); /* Deserialize the packet to store its contents. */
-    if (errno == ENOMEM)
+    sv_send_entry(set, client, entry);
+    rtt_start(&client->rtt, entry->seq_num, tw_clock_ms());
+    if (!client->awaiting_ack)
     {
-        running = 0;
-        return true; /* Deserializing failure: go ahead. */
+        sv_await_ack(set, client);
     }
-    set->mm->mm_add(set->mm, client->r_packet->payload);
+}
+
+void sv_send_entry(struct server_settings *set, struct conn_client *client, struct rtx_entry *entry)
+{
+    struct packet packet;
     
-    if ((*packet_buffer & FLAG_PSH) &&
-        (*(packet_buffer + 1) == (uint8_t) (client->s_packet->seq_num + 1)))
+    create_packet(&packet, entry->flags | FLAG_ACK, entry->seq_num, entry->length, entry->payload);
+    packet.ack_num = client->rcv_nxt;
+    packet.window  = set->window;
+    sv_transmit(set, client, &packet);
+}
+
+void sv_send_ack(struct server_settings *set, struct conn_client *client)
+{
+    struct packet packet;
+    
+    create_packet(&packet, FLAG_ACK, client->snd_nxt, 0, NULL);
+    packet.ack_num = client->rcv_nxt;
+    packet.window  = set->window;
+    sv_transmit(set, client, &packet);
+}
+
+void sv_delay_ack(struct server_settings *set, struct conn_client *client)
+{
+    if (client->ack_pending)
+    {
+        sv_send_ack(set, client);
+        return;
+    }
+    
+    client->ack_pending = true;
+    set->timers->tw_arm(set->timers, &client->delack, tw_clock_ms(), SV_DELACK_MS);
+}
+
+void sv_retransmit(struct server_settings *set, struct conn_client *client)
+{
+    rtt_stop(&client->rtt);
+    if (sv_framing(client) == PROTO_V1)
     {
-        create_packet(client->s_packet, FLAG_ACK, client->r_packet->seq_num, 0, NULL);
         sv_sendto(set, client);
+        return;
+    }
+    
+    /* Only the holes: packets the client reported holding are not sent again. Without a selective ACK, this is go
+     * back N. */
+    for (uint32_t seq_num = client->snd_una; !errno && seq_num != client->snd_nxt; ++seq_num)
+    {
+        struct rtx_entry *entry;
         
-        /* Update the game state. */
-        set->game->cursor = *client->r_packet->payload;
-        if (*(client->r_packet->payload + 1))
+        entry = &client->rtx[seq_num & (SV_RTX_SLOTS - 1)];
+        if (!entry->sacked)
         {
-            set->game->updateBoard(set->game);
+            sv_supersede(client, entry);
+            sv_send_entry(set, client, entry);
         }
-        
-        set->do_broadcast = true; /* Do a broadcast because the game state was just updated. */
     }
-    if ((*packet_buffer == FLAG_ACK) && (*(packet_buffer + 1) == MAX_SEQ))
+}
+
+void sv_await_ack(struct server_settings *set, struct conn_client *client)
+{
+    uint64_t now_ms;
+    
+    now_ms = tw_clock_ms();
+    if (sv_framing(client) == PROTO_V1)
     {
-        set->do_broadcast = true; /* Do a broadcast because the game has just started. */
+        rtt_start(&client->rtt, client->s_packet->seq_num, now_ms);
     }
     
-    set->mm->mm_free(set->mm, client->r_packet->payload);
-    client->r_packet->payload = NULL;
+    client->awaiting_ack = true;
+    client->num_retrans  = 0;
+    set->timers->tw_arm(set->timers, &client->rto, now_ms, client->rtt.rto_ms);
+}
+
+void sv_ack_received(struct server_settings *set, struct conn_client *client)
+{
+    if (sv_framing(client) == PROTO_V1)
+    {
+        rtt_ack(&client->rtt, client->s_packet->seq_num, tw_clock_ms());
+    }
     
-    return true; /* Good message received: go ahead. */
+    client->awaiting_ack = false;
+    set->timers->tw_cancel(set->timers, &client->rto);
 }
 
 void sv_disconnect(struct server_settings *set, struct conn_client *client)
 {
+    set->rooms->rt_leave(set->rooms, client); /* The client's seat opens at once; the room is not sent to them. */
+    client->state = CONN_LAST_ACK;
+    
+    if (client->version == PROTO_V2) /* The ring always has a slot for it: the window is less than the ring. */
+    {
+        client->state_pending = false;
+        sv_push(set, client, FLAG_FIN | FLAG_ACK, NULL, 0);
+        return;
+    }
+    
     create_packet(client->s_packet, FLAG_FIN | FLAG_ACK, MAX_SEQ, 0, NULL);
     sv_sendto(set, client);
     if (!errno)
     {
         create_packet(client->s_packet, FLAG_FIN, MAX_SEQ, 0, NULL);
         sv_sendto(set, client);
+        sv_await_ack(set, client);
     }
-    if (!errno)
-    { sv_recvfrom(set, client); } /* Wait for FIN/ACK */
 }
 
 void close_server(struct server_settings *set)
 {
     printf("\nClosing server.\n");
     
+    close_handoff(set);
     if (set->server_fd != 0)
     {
         close(set->server_fd);
     }
-    if (set->first_conn_client != NULL)
+    if (set->loop != NULL)
+    {
+        free_event_loop(set->loop);
+    }
+    if (set->clients != NULL)
+    {
+        free_client_map(set->clients);
+    }
+    if (set->cids != NULL)
+    {
+        free_client_map(set->cids);
+    }
+    if (set->rooms != NULL)
+    {
+        free_room_table(set->rooms);
+    }
+    if (set->timers != NULL)
     {
-        for (struct conn_client *curr_cli = set->first_conn_client; curr_cli != NULL; curr_cli = curr_cli->next)
+        free_timer_wheel(set->timers);
+    }
+    if (set->bio != NULL)
+    {
+        free_batch_io(set->bio);
+    }
+    if (set->results != NULL)
+    {
+        free_gp_results(set->results);
+    }
+    if (set->workers != NULL) /* Only the main thread owns the workers and the wake pipe. */
+    {
+        for (size_t i = 0; i < set->num_workers - 1; ++i)
+        {
+            close_server(&set->workers[i].set);
+        }
+        free(set->workers);
+        close(set->wake_fds[0]);
+        close(set->wake_fds[1]);
+    }
+    if (set->conns != NULL)
+    {
+        for (size_t i = 0; !set->single_socket && i < set->conns->count; ++i)
         {
+            const struct conn_client *curr_cli;
+            
+            curr_cli = set->conns->ct_at(set->conns, i);
             if (curr_cli->c_fd != 0)
             {
                 close(curr_cli->c_fd);
             }
         }
+        free_conn_table(set->conns);
     }
     free_memory_manager(set->mm);
 }
@@ -598,3 +2834,14 @@ static void signal_handler(int sig)
 }
 
 #pragma GCC diagnostic pop
+
+static void *sv_worker_main(void *arg)
+{
+    struct sv_worker *worker;
+    
+    worker = (struct sv_worker *) arg;
+    sv_comm_core(&worker->set);
+    sv_wake_all(&worker->set); /* A worker stops only if the server stopped or it failed; stop every thread. */
+    
+    return NULL;
+}
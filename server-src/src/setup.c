@@ -2,22 +2,32 @@
 // Created by Maxwell Babey on 10/24/22.
 //
 
+#include "../include/batch-io.h"
+#include "../include/client-map.h"
+#include "../include/game-pool.h"
+#include "../include/handoff.h"
 #include "../include/manager.h"
-#include "../include/Game.h"
+#include "../include/room.h"
 #include "../include/setup.h"
+#include "../include/timer-wheel.h"
 #include <string.h>
+#include <sys/random.h>
 #include <sys/time.h>
 #include <unistd.h>
 
 /**
  * Usage message; printed when there is a user error upon running.
  */
-#define USAGE "server -i <host ip address> -p <port number>"
+#define USAGE "server -i <host ip address> -p <port number> -e <event loop backend: epoll | select | uring> " \
+              "-s (clients share the server socket) -t <number of worker threads> " \
+              "-g <number of game worker threads> -H <handoff path> -w <send window> " \
+              "-d <duplicate ACKs before a fast retransmit> -m <path MTU>"
 
 /**
  * set_server_defaults
  * <p>
- * Zero the memory in server_settings. Set the default port and initialize the memory manager.
+ * Zero the memory in server_settings. Set the default port and a single thread, draw the key SYN cookies are made
+ * with, and initialize the memory manager.
  * </p>
  * @param set - server_settings *: pointer to the settings for this server
  */
@@ -34,28 +44,130 @@ void set_server_defaults(struct server_settings *set);
  */
 void read_args(int argc, char *argv[], struct server_settings *set);
 
+/**
+ * init_shard
+ * <p>
+ * Initialize the state a thread serves its clients with: the connection table, the room table, the client maps by
+ * address and by connection ID, the timer wheel, the batch I/O layer, the event loop, and the queue the game workers
+ * return its tasks to.
+ * </p>
+ * @param set - server_settings *: pointer to the settings for the shard
+ */
+void init_shard(struct server_settings *set);
+
 void init_def_state(int argc, char *argv[], struct server_settings *set)
 {
     set_server_defaults(set);
     if (!errno)
     { read_args(argc, argv, set); }
+    if (!errno && set->handoff_path != NULL) /* A predecessor's shards replace those configured. */
+    { ho_connect(set); }
+    if (!errno && set->num_game_workers > 0)
+    { set->pool = init_game_pool(set->num_game_workers); }
+    if (!errno)
+    { init_shard(set); }
+    if (!errno && set->num_workers > 1 && pipe(set->wake_fds) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+    }
+}
+
+void init_worker_state(const struct server_settings *set, struct server_settings *worker)
+{
+    memset(worker, 0, sizeof(struct server_settings));
+    worker->server_ip     = set->server_ip;
+    worker->server_port   = set->server_port;
+    worker->el_backend    = set->el_backend;
+    worker->single_socket = set->single_socket;
+    worker->num_workers   = set->num_workers;
+    worker->wake_fds[0]   = set->wake_fds[0];
+    worker->wake_fds[1]   = set->wake_fds[1];
+    worker->pool          = set->pool;
+    worker->window        = set->window;
+    worker->dup_thresh    = set->dup_thresh;
+    worker->mtu           = set->mtu;
+    memcpy(worker->cookie_key, set->cookie_key, SIPHASH_KEY_BYTES);
+    
+    worker->handoff_listen_fd = -1; /* Only the main thread hands off. */
+    worker->handoff_fd        = -1;
+    
+    if ((worker->mm = init_memory_manager()) == NULL)
+    {
+        return;
+    }
+    
+    init_shard(worker);
 }
 
 void set_server_defaults(struct server_settings *set)
 {
     memset(set, 0, sizeof(struct server_settings));
     set->server_port = DEFAULT_PORT;
+    set->el_backend  = EL_BACKEND_EPOLL;
+    set->num_workers = 1;
+    set->window      = SV_DEFAULT_WINDOW;
+    set->dup_thresh  = SV_DEFAULT_DUP_THRESH;
+    set->mtu         = SV_MAX_MTU;
+    set->wake_fds[0] = -1;
+    set->wake_fds[1] = -1;
+    
+    set->handoff_listen_fd = -1;
+    set->handoff_fd        = -1;
+    
+    /* Blocks until the entropy pool is ready: a guessable key would let any address return a cookie. */
+    if (getrandom(set->cookie_key, SIPHASH_KEY_BYTES, 0) != (ssize_t) SIPHASH_KEY_BYTES)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno);
+        return;
+    }
     
     if ((set->mm = init_memory_manager()) == NULL)
     {
         return;
     }
+}
+
+void init_shard(struct server_settings *set)
+{
+    if ((set->conns = init_conn_table()) == NULL)
+    {
+        return;
+    }
+    
+    if ((set->rooms = init_room_table()) == NULL)
+    {
+        return;
+    }
+    
+    if ((set->clients = init_client_map()) == NULL)
+    {
+        return;
+    }
+    
+    if ((set->cids = init_client_map()) == NULL)
+    {
+        return;
+    }
     
-    if ((set->game = initializeGame()) == NULL)
+    if ((set->timers = init_timer_wheel()) == NULL)
+    {
+        return;
+    }
+    
+    if ((set->bio = init_batch_io(MAX_RECV_BYTES, set->mtu - UDP_IP_HLEN_BYTES)) == NULL)
+    {
+        return;
+    }
+    
+    if ((set->loop = init_event_loop(set->el_backend)) == NULL)
+    {
+        return;
+    }
+    set->bio->loop = set->loop; /* Used only if the backend sends datagrams itself. */
+    if (set->pool != NULL && (set->results = init_gp_results()) == NULL)
     {
         return;
     }
-    set->mm->mm_add(set->mm, set->game);
 }
 
 void read_args(int argc, char *argv[], struct server_settings *set)
@@ -63,7 +175,7 @@ void read_args(int argc, char *argv[], struct server_settings *set)
     const int base = 10;
     int       c;
     
-    while ((c = getopt(argc, argv, ":i:p:")) != -1) // NOLINT(concurrency-mt-unsafe) : No threads here
+    while ((c = getopt(argc, argv, ":i:p:e:st:g:H:w:d:m:")) != -1) // NOLINT(concurrency-mt-unsafe) : No threads here
     {
         switch (c)
         {
@@ -85,6 +197,76 @@ void read_args(int argc, char *argv[], struct server_settings *set)
                 
                 break;
             }
+            case 'e':
+            {
+                set->el_backend = parse_el_backend(optarg);
+                if (errno == ENOTRECOVERABLE)
+                {
+                    return;
+                }
+                
+                break;
+            }
+            case 's':
+            {
+                set->single_socket = true;
+                break;
+            }
+            case 't':
+            {
+                set->num_workers = parse_num_workers(optarg, base);
+                if (errno == ENOTRECOVERABLE)
+                {
+                    return;
+                }
+                
+                break;
+            }
+            case 'g':
+            {
+                set->num_game_workers = parse_num_game_workers(optarg, base);
+                if (errno == ENOTRECOVERABLE)
+                {
+                    return;
+                }
+                
+                break;
+            }
+            case 'H':
+            {
+                set->handoff_path = optarg;
+                break;
+            }
+            case 'w':
+            {
+                set->window = parse_window(optarg, base);
+                if (errno == ENOTRECOVERABLE)
+                {
+                    return;
+                }
+                
+                break;
+            }
+            case 'd':
+            {
+                set->dup_thresh = parse_dup_thresh(optarg, base);
+                if (errno == ENOTRECOVERABLE)
+                {
+                    return;
+                }
+                
+                break;
+            }
+            case 'm':
+            {
+                set->mtu = parse_mtu(optarg, base);
+                if (errno == ENOTRECOVERABLE)
+                {
+                    return;
+                }
+                
+                break;
+            }
             default:
             {
                 advise_usage(USAGE);
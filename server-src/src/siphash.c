@@ -0,0 +1,145 @@
+#include "../include/siphash.h"
+
+/**
+ * The number of rounds of SipHash-2-4 per 8-byte block of the message, and after the last block.
+ */
+#define SIP_C_ROUNDS 2
+#define SIP_D_ROUNDS 4
+
+/**
+ * sip_state
+ * <p>
+ * The internal state of SipHash: four 64-bit words.
+ * </p>
+ */
+struct sip_state
+{
+    uint64_t v0;
+    uint64_t v1;
+    uint64_t v2;
+    uint64_t v3;
+};
+
+/**
+ * sip_rotl
+ * <p>
+ * Rotate a word left.
+ * </p>
+ * @param x - the word
+ * @param b - the number of bits, between 1 and 63
+ * @return the rotated word
+ */
+static uint64_t sip_rotl(uint64_t x, unsigned b);
+
+/**
+ * sip_load
+ * <p>
+ * Load 8 bytes as a little-endian word.
+ * </p>
+ * @param p - the bytes
+ * @return the word
+ */
+static uint64_t sip_load(const uint8_t *p);
+
+/**
+ * sip_round
+ * <p>
+ * Apply a SipRound to the state.
+ * </p>
+ * @param s - the state
+ */
+static void sip_round(struct sip_state *s);
+
+/**
+ * sip_compress
+ * <p>
+ * Mix a word of the message into the state.
+ * </p>
+ * @param s - the state
+ * @param m - the word
+ */
+static void sip_compress(struct sip_state *s, uint64_t m);
+
+uint64_t siphash24(const uint8_t *key, const uint8_t *in, size_t len)
+{
+    struct sip_state s;
+    uint64_t         k0;
+    uint64_t         k1;
+    uint64_t         last;
+    size_t           end;
+    
+    k0   = sip_load(key);
+    k1   = sip_load(key + sizeof(k0));
+    s.v0 = k0 ^ 0x736f6d6570736575ULL; /* "somepseudorandomlygeneratedbytes" */
+    s.v1 = k1 ^ 0x646f72616e646f6dULL;
+    s.v2 = k0 ^ 0x6c7967656e657261ULL;
+    s.v3 = k1 ^ 0x7465646279746573ULL;
+    
+    end = len - (len % sizeof(uint64_t));
+    for (size_t i = 0; i < end; i += sizeof(uint64_t))
+    {
+        sip_compress(&s, sip_load(in + i));
+    }
+    
+    /* The last word holds the bytes left over, and the low byte of the length in its top byte. */
+    last = (uint64_t) len << 56;
+    for (size_t i = end; i < len; ++i)
+    {
+        last |= (uint64_t) in[i] << (8 * (i - end));
+    }
+    sip_compress(&s, last);
+    
+    s.v2 ^= 0xff;
+    for (int i = 0; i < SIP_D_ROUNDS; ++i)
+    {
+        sip_round(&s);
+    }
+    
+    return s.v0 ^ s.v1 ^ s.v2 ^ s.v3;
+}
+
+static uint64_t sip_rotl(uint64_t x, unsigned b)
+{
+    return (x << b) | (x >> (64 - b));
+}
+
+static uint64_t sip_load(const uint8_t *p)
+{
+    uint64_t word;
+    
+    word = 0;
+    for (unsigned i = 0; i < sizeof(word); ++i)
+    {
+        word |= (uint64_t) p[i] << (8 * i);
+    }
+    
+    return word;
+}
+
+static void sip_round(struct sip_state *s)
+{
+    s->v0 += s->v1;
+    s->v1 = sip_rotl(s->v1, 13);
+    s->v1 ^= s->v0;
+    s->v0 = sip_rotl(s->v0, 32);
+    s->v2 += s->v3;
+    s->v3 = sip_rotl(s->v3, 16);
+    s->v3 ^= s->v2;
+    s->v0 += s->v3;
+    s->v3 = sip_rotl(s->v3, 21);
+    s->v3 ^= s->v0;
+    s->v2 += s->v1;
+    s->v1 = sip_rotl(s->v1, 17);
+    s->v1 ^= s->v2;
+    s->v2 = sip_rotl(s->v2, 32);
+}
+
+static void sip_compress(struct sip_state *s, uint64_t m)
+{
+    s->v3 ^= m;
+    for (int i = 0; i < SIP_C_ROUNDS; ++i)
+    {
+        sip_round(s);
+    }
+    s->v0 ^= m;
+}
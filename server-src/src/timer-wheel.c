@@ -0,0 +1,294 @@
+#include "../include/manager.h"
+#include "../include/timer-wheel.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * Mask of the bits of a tick which index the slots of a level.
+ */
+#define TW_SLOT_MASK ((uint64_t) TW_SLOTS - 1)
+
+/**
+ * The furthest in the future, in ticks, a timer can be placed; later timers are placed at this limit, and are placed
+ * again when they reach level 0.
+ */
+#define TW_MAX_DELTA (((uint64_t) 1 << (TW_LEVELS * TW_SLOT_BITS)) - 1)
+
+/**
+ * tw_arm
+ * <p>
+ * Arm a timer to expire after a delay, rounded up to a whole tick. A timer which is already armed is re-armed.
+ * </p>
+ * @param wheel - the timer wheel
+ * @param timer - the timer
+ * @param now_ms - the current time, in milliseconds
+ * @param delay_ms - the delay, in milliseconds
+ */
+void tw_arm(struct timer_wheel *wheel, struct tw_timer *timer, uint64_t now_ms, uint32_t delay_ms);
+
+/**
+ * tw_cancel
+ * <p>
+ * Disarm a timer. Does nothing if the timer is not armed.
+ * </p>
+ * @param wheel - the timer wheel
+ * @param timer - the timer
+ */
+void tw_cancel(struct timer_wheel *wheel, struct tw_timer *timer);
+
+/**
+ * tw_expire
+ * <p>
+ * Advance the wheel to the current time and collect the timers which expired. The expired timers are disarmed and
+ * linked through their next pointers; next must be read before a timer is armed again.
+ * </p>
+ * @param wheel - the timer wheel
+ * @param now_ms - the current time, in milliseconds
+ * @return the first expired timer, NULL if none expired
+ */
+struct tw_timer *tw_expire(struct timer_wheel *wheel, uint64_t now_ms);
+
+/**
+ * tw_timeout
+ * <p>
+ * Find how long the caller may wait before the wheel must be advanced: until the next non-empty slot of level 0, or
+ * until level 0 completes a rotation, whichever is sooner.
+ * </p>
+ * @param wheel - the timer wheel
+ * @param now_ms - the current time, in milliseconds
+ * @return the time to wait, in milliseconds, or -1 if no timer is armed
+ */
+int tw_timeout(const struct timer_wheel *wheel, uint64_t now_ms);
+
+/**
+ * tw_place
+ * <p>
+ * Link an armed timer into the slot for its expiry tick: the finest level whose slots reach that far.
+ * </p>
+ * @param wheel - the timer wheel
+ * @param timer - the timer
+ */
+void tw_place(struct timer_wheel *wheel, struct tw_timer *timer);
+
+/**
+ * tw_tick
+ * <p>
+ * Advance the wheel by one tick. Move the timers of the higher level slots reached down a level, then append the
+ * timers of the level 0 slot reached to the list of expired timers.
+ * </p>
+ * @param wheel - the timer wheel
+ * @param tail - the link at the end of the list of expired timers; updated to the new end
+ */
+void tw_tick(struct timer_wheel *wheel, struct tw_timer ***tail);
+
+struct timer_wheel *init_timer_wheel(void)
+{
+    struct timer_wheel *wheel;
+    
+    if ((wheel = (struct timer_wheel *) s_calloc(1, sizeof(struct timer_wheel), __FILE__, __func__, __LINE__)) == NULL)
+    {
+        return NULL;
+    }
+    wheel->origin_ms = tw_clock_ms();
+    
+    wheel->tw_arm     = tw_arm;
+    wheel->tw_cancel  = tw_cancel;
+    wheel->tw_expire  = tw_expire;
+    wheel->tw_timeout = tw_timeout;
+    
+    return wheel;
+}
+
+int free_timer_wheel(struct timer_wheel *wheel)
+{
+    if (wheel == NULL)
+    {
+        errno = EFAULT;
+        return -1;
+    }
+    
+    free(wheel);
+    
+    return 0;
+}
+
+uint64_t tw_clock_ms(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000; // NOLINT(readability-magic-numbers) : ms
+}
+
+void tw_arm(struct timer_wheel *wheel, struct tw_timer *timer, uint64_t now_ms, uint32_t delay_ms)
+{
+    uint64_t expires;
+    
+    tw_cancel(wheel, timer);
+    
+    /* Round up, and never expire on the current tick: its slot has already been collected. */
+    expires = (now_ms + delay_ms - wheel->origin_ms + TW_TICK_MS - 1) / TW_TICK_MS;
+    if (expires <= wheel->now)
+    {
+        expires = wheel->now + 1;
+    }
+    
+    timer->expires = expires;
+    tw_place(wheel, timer);
+    ++wheel->count;
+}
+
+void tw_cancel(struct timer_wheel *wheel, struct tw_timer *timer)
+{
+    if (timer->pprev == NULL)
+    {
+        return;
+    }
+    
+    *timer->pprev = timer->next;
+    if (timer->next != NULL)
+    {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next  = NULL;
+    timer->pprev = NULL;
+    --wheel->count;
+}
+
+struct tw_timer *tw_expire(struct timer_wheel *wheel, uint64_t now_ms)
+{
+    struct tw_timer *expired;
+    struct tw_timer **tail;
+    uint64_t        target;
+    
+    expired = NULL;
+    tail    = &expired;
+    target  = (now_ms - wheel->origin_ms) / TW_TICK_MS;
+    
+    if (wheel->count == 0) /* Nothing to collect: skip ahead. */
+    {
+        wheel->now = (target > wheel->now) ? target : wheel->now;
+        return NULL;
+    }
+    
+    while (wheel->now < target && wheel->count > 0)
+    {
+        tw_tick(wheel, &tail);
+    }
+    if (wheel->now < target)
+    {
+        wheel->now = target;
+    }
+    
+    return expired;
+}
+
+int tw_timeout(const struct timer_wheel *wheel, uint64_t now_ms)
+{
+    uint64_t ticks;
+    uint64_t due_ms;
+    
+    if (wheel->count == 0)
+    {
+        return -1;
+    }
+    
+    for (ticks = 1; ticks < TW_SLOTS; ++ticks)
+    {
+        uint64_t slot;
+        
+        slot = (wheel->now + ticks) & TW_SLOT_MASK;
+        if (slot == 0 || wheel->slots[0][slot] != NULL) /* A slot to collect, or a rotation to cascade. */
+        {
+            break;
+        }
+    }
+    
+    due_ms = wheel->origin_ms + (wheel->now + ticks) * TW_TICK_MS;
+    
+    return (due_ms > now_ms) ? (int) (due_ms - now_ms) : 0;
+}
+
+void tw_place(struct timer_wheel *wheel, struct tw_timer *timer)
+{
+    struct tw_timer **head;
+    uint64_t        delta;
+    uint64_t        expires;
+    int             level;
+    
+    expires = timer->expires;
+    delta   = expires - wheel->now;
+    if (delta > TW_MAX_DELTA)
+    {
+        expires = wheel->now + TW_MAX_DELTA; /* Placed again, and closer, once it cascades down. */
+        delta   = TW_MAX_DELTA;
+    }
+    
+    for (level = 0; level < TW_LEVELS - 1 && delta >= ((uint64_t) 1 << ((level + 1) * TW_SLOT_BITS)); ++level)
+    {}
+    
+    head = &wheel->slots[level][(expires >> (level * TW_SLOT_BITS)) & TW_SLOT_MASK];
+    
+    timer->next  = *head;
+    timer->pprev = head;
+    if (*head != NULL)
+    {
+        (*head)->pprev = &timer->next;
+    }
+    *head = timer;
+}
+
+void tw_tick(struct timer_wheel *wheel, struct tw_timer ***tail)
+{
+    struct tw_timer *timer;
+    int             top;
+    
+    ++wheel->now;
+    
+    /* Find the highest level reached: every level below it has just completed a rotation. */
+    for (top = 0; top < TW_LEVELS - 1 && ((wheel->now >> (top * TW_SLOT_BITS)) & TW_SLOT_MASK) == 0; ++top)
+    {}
+    
+    /* Cascade from the top down, so timers moved down a level are moved again if that level is reached as well. */
+    for (int level = top; level > 0; --level)
+    {
+        struct tw_timer **head;
+        
+        head  = &wheel->slots[level][(wheel->now >> (level * TW_SLOT_BITS)) & TW_SLOT_MASK];
+        timer = *head;
+        *head = NULL;
+        while (timer != NULL)
+        {
+            struct tw_timer *next;
+            
+            next = timer->next;
+            tw_place(wheel, timer);
+            timer = next;
+        }
+    }
+    
+    /* Move the timers of the level 0 slot reached to the end of the expired list, disarming them. */
+    timer = wheel->slots[0][wheel->now & TW_SLOT_MASK];
+    wheel->slots[0][wheel->now & TW_SLOT_MASK] = NULL;
+    while (timer != NULL)
+    {
+        struct tw_timer *next;
+        
+        next = timer->next;
+        
+        if (timer->expires > wheel->now) /* Placed at the limit of the wheel: not yet due. */
+        {
+            tw_place(wheel, timer);
+        } else
+        {
+            timer->next  = NULL;
+            timer->pprev = NULL;
+            **tail       = timer;
+            *tail        = &timer->next;
+            --wheel->count;
+        }
+        timer = next;
+    }
+}